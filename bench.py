@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+
+"""Times picoquant on synthetic files of each format, in each output mode.
+
+Run through `make bench`, which builds the generator first. Extra arguments
+can be given as `make bench BENCH_FLAGS="--records 50000000"`. With --save,
+the results are written as JSON lines, and --compare reports any case which
+became slower than in a saved run.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+
+picoquant = "./src/picoquant"
+generate = "./src/picoquant_generate"
+
+formats = ["ht2", "ht3", "pt2", "pt3", "ptu-t2", "ptu-t3", "t3r"]
+
+modes = {
+    "csv": [],
+    "binary": ["--binary-out"],
+    "columnar": ["--columnar"],
+    "threads": ["--threads", str(os.cpu_count() or 1)],
+    "pipeline": ["--pipeline"],
+    "intensity": ["--intensity", "1000000000"],
+}
+
+t3_modes = {
+    "to-t2": ["--to-t2"],
+    "histogram": ["--histogram", "1000"],
+}
+
+
+def generate_file(path, fmt, args):
+    cmd = [
+        generate,
+        "--format", fmt,
+        "--file-out", path,
+        "--records", str(args.records),
+        "--count-rate", str(args.count_rate),
+        "--overflows", str(args.overflows),
+    ]
+    if args.channels is not None and fmt != "t3r":
+        cmd += ["--channels", str(args.channels)]
+    subprocess.run(cmd, check=True)
+
+
+def run(path, flags, repeat):
+    """The best of several runs, from the statistics of picoquant itself."""
+    best = None
+    with tempfile.NamedTemporaryFile(mode="r", suffix=".jsonl") as stats:
+        for _ in range(repeat):
+            cmd = [picoquant, "--file-in", path, "--file-out", os.devnull,
+                   "--stats=" + stats.name, *flags]
+            subprocess.run(cmd, check=True)
+            lines = [json.loads(line) for line in stats.read().splitlines()]
+            done = [line for line in lines if line["event"] == "done"][-1]
+            if best is None or done["elapsed_s"] < best["elapsed_s"]:
+                best = done
+    return best
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("--records", type=int, default=5000000)
+    parser.add_argument("--count-rate", type=float, default=1e6)
+    parser.add_argument("--channels", type=int, default=None)
+    parser.add_argument("--overflows", type=float, default=0)
+    parser.add_argument("--repeat", type=int, default=3)
+    parser.add_argument("--formats", default=",".join(formats))
+    parser.add_argument("--modes", default=None,
+                        help="comma-separated, from: " +
+                        ", ".join([*modes, *t3_modes]))
+    parser.add_argument("--save", help="write the results to this file")
+    parser.add_argument("--compare", help="compare with a saved run")
+    parser.add_argument("--tolerance", type=float, default=0.1,
+                        help="slowdown reported by --compare (default 0.1)")
+    args = parser.parse_args()
+
+    selected = args.modes.split(",") if args.modes else None
+    previous = {}
+    if args.compare:
+        with open(args.compare) as f:
+            for line in f:
+                result = json.loads(line)
+                previous[(result["format"], result["mode"])] = result
+
+    results = []
+    slower = []
+    print("{:8s} {:10s} {:>14s} {:>10s} {:>10s}".format(
+        "format", "mode", "records/s", "MB/s", "seconds"))
+
+    with tempfile.TemporaryDirectory() as directory:
+        for fmt in args.formats.split(","):
+            path = os.path.join(directory, "bench." + fmt)
+            generate_file(path, fmt, args)
+
+            cases = dict(modes)
+            if fmt in ["ht3", "pt3", "ptu-t3", "t3r"]:
+                cases.update(t3_modes)
+
+            for mode, flags in cases.items():
+                if selected is not None and mode not in selected:
+                    continue
+
+                stats = run(path, flags, args.repeat)
+                result = {
+                    "format": fmt,
+                    "mode": mode,
+                    "records": args.records,
+                    "records_per_s": stats["records_per_s"],
+                    "mb_per_s": stats["mb_per_s"],
+                    "elapsed_s": stats["elapsed_s"],
+                }
+                results.append(result)
+
+                note = ""
+                before = previous.get((fmt, mode))
+                if before is not None:
+                    change = result["records_per_s"]/before["records_per_s"] - 1
+                    note = "{:+.1%}".format(change)
+                    if change < -args.tolerance:
+                        slower.append(result)
+                        note += " SLOWER"
+
+                print("{:8s} {:10s} {:14.0f} {:10.1f} {:10.3f} {}".format(
+                    fmt, mode, result["records_per_s"], result["mb_per_s"],
+                    result["elapsed_s"], note), flush=True)
+
+    if args.save:
+        with open(args.save, "w") as f:
+            for result in results:
+                f.write(json.dumps(result) + "\n")
+
+    if slower:
+        print("{} cases were more than {:.0%} slower than {}.".format(
+            len(slower), args.tolerance, args.compare))
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* 
+ * The decoders of libpicoquant, for Python. Photons are decoded straight into
+ * any writable buffer of the right width (NumPy arrays, array.array, ...), 
+ * one column per field, without an intermediate copy; see reader.py for the
+ * usual way to call this.
+ *
+ * readinto decodes without the GIL, so each reader has a lock of its own,
+ * held by anything which uses the underlying reader.
+ */
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include "reader.h"
+
+typedef struct {
+	PyObject_HEAD
+	pq_reader_t *reader;
+	PyThread_type_lock lock;
+} pq_python_reader_t;
+
+typedef struct {
+	char const *name;
+	Py_ssize_t itemsize;
+	Py_buffer view;
+} pq_python_column_t;
+
+static int pq_python_columns_get(PyObject **objects, 
+		pq_python_column_t *columns, int n_columns, Py_ssize_t *length) {
+/*
+ * Find the buffer behind each column, checking that it can hold the field. 
+ * The number of records which fit in every column is stored in length.
+ */
+	int i;
+	int j;
+	Py_ssize_t column_length;
+
+	for ( i = 0; i < n_columns; i++ ) {
+		if ( PyObject_GetBuffer(objects[i], &columns[i].view, 
+				PyBUF_WRITABLE | PyBUF_FORMAT | PyBUF_C_CONTIGUOUS) ) {
+			for ( j = 0; j < i; j++ ) {
+				PyBuffer_Release(&columns[j].view);
+			}
+			return(-1);
+		}
+
+		if ( columns[i].view.itemsize != columns[i].itemsize ||
+				columns[i].view.format == NULL ||
+				strchr("bBhHiIlLqQ", 
+				columns[i].view.format[strlen(columns[i].view.format)-1])
+				== NULL ) {
+			PyErr_Format(PyExc_TypeError, 
+					"%s must be a buffer of %zd-byte integers.", 
+					columns[i].name, columns[i].itemsize);
+			for ( j = 0; j <= i; j++ ) {
+				PyBuffer_Release(&columns[j].view);
+			}
+			return(-1);
+		}
+
+		column_length = columns[i].view.len/columns[i].itemsize;
+		if ( i == 0 || column_length < *length ) {
+			*length = column_length;
+		}
+	}
+
+	return(0);
+}
+
+static void pq_python_columns_release(pq_python_column_t *columns, 
+		int n_columns) {
+	int i;
+
+	for ( i = 0; i < n_columns; i++ ) {
+		PyBuffer_Release(&columns[i].view);
+	}
+}
+
+static void pq_python_reader_lock(pq_python_reader_t *self) {
+/*
+ * Take the lock of the reader, waiting for it without the GIL so that a 
+ * thread in readinto can finish.
+ */
+	if ( ! PyThread_acquire_lock(self->lock, NOWAIT_LOCK) ) {
+		Py_BEGIN_ALLOW_THREADS
+		PyThread_acquire_lock(self->lock, WAIT_LOCK);
+		Py_END_ALLOW_THREADS
+	}
+}
+
+static void pq_python_reader_unlock(pq_python_reader_t *self) {
+	PyThread_release_lock(self->lock);
+}
+
+static int pq_python_reader_acquire(pq_python_reader_t *self) {
+/*
+ * Lock the reader for use, failing if it has been closed.
+ */
+	pq_python_reader_lock(self);
+
+	if ( self->reader == NULL ) {
+		pq_python_reader_unlock(self);
+		PyErr_SetString(PyExc_ValueError, "Reader is closed.");
+		return(-1);
+	} else {
+		return(0);
+	}
+}
+
+static PyObject *pq_python_reader_new(PyTypeObject *type, 
+		PyObject *args, PyObject *kwargs) {
+	pq_python_reader_t *self;
+
+	self = (pq_python_reader_t *)type->tp_alloc(type, 0);
+	if ( self == NULL ) {
+		return(NULL);
+	}
+
+	self->reader = NULL;
+	self->lock = PyThread_allocate_lock();
+	if ( self->lock == NULL ) {
+		Py_DECREF(self);
+		return(PyErr_NoMemory());
+	}
+
+	return((PyObject *)self);
+}
+
+static int pq_python_reader_init(pq_python_reader_t *self, 
+		PyObject *args, PyObject *kwargs) {
+	static char *keywords[] = {"filename", NULL};
+	PyObject *filename = NULL;
+	PyObject *filename_bytes = NULL;
+	char const *filename_c = NULL;
+
+	if ( ! PyArg_ParseTupleAndKeywords(args, kwargs, "|O", keywords,
+			&filename) ) {
+		return(-1);
+	}
+
+	if ( filename != NULL && filename != Py_None ) {
+		if ( ! PyUnicode_FSConverter(filename, &filename_bytes) ) {
+			return(-1);
+		}
+		filename_c = PyBytes_AS_STRING(filename_bytes);
+	}
+
+	pq_python_reader_lock(self);
+	pq_reader_close(self->reader);
+
+	Py_BEGIN_ALLOW_THREADS
+	self->reader = pq_reader_open(filename_c);
+	Py_END_ALLOW_THREADS
+	pq_python_reader_unlock(self);
+
+	if ( self->reader == NULL ) {
+		PyErr_Format(PyExc_IOError, "Could not read %s.", 
+				filename_c == NULL ? "stdin" : filename_c);
+	}
+
+	Py_XDECREF(filename_bytes);
+	return(self->reader == NULL ? -1 : 0);
+}
+
+static void pq_python_reader_dealloc(pq_python_reader_t *self) {
+	if ( self->lock != NULL ) {
+		pq_python_reader_lock(self);
+		pq_reader_close(self->reader);
+		self->reader = NULL;
+		pq_python_reader_unlock(self);
+		PyThread_free_lock(self->lock);
+	}
+
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyObject *pq_python_reader_decode(pq_python_reader_t *self, 
+		PyObject *args) {
+/*
+ * readinto(channel, time) for t2 data, readinto(channel, pulse, time) for t3.
+ * Returns the number of photons stored, 0 at the end of the file. The lock
+ * is held by the caller.
+ */
+	PyObject *objects[3];
+	pq_python_column_t columns[3] = {
+			{"channel", sizeof(uint32_t)}, 
+			{"", sizeof(uint64_t)}, 
+			{"time", sizeof(uint64_t)}};
+	int n_columns;
+	int t3;
+	Py_ssize_t length = 0;
+	int64_t result = 0;
+	uint32_t *channel;
+	uint64_t *pulse = NULL;
+	uint64_t *time;
+
+	t3 = pq_reader_mode(self->reader) == PQ_RECORD_T3;
+	if ( t3 ) {
+		columns[1].name = "pulse";
+		n_columns = 3;
+		if ( ! PyArg_ParseTuple(args, "OOO:readinto", 
+				&objects[0], &objects[1], &objects[2]) ) {
+			return(NULL);
+		}
+	} else if ( pq_reader_mode(self->reader) == PQ_RECORD_T2 ) {
+		columns[1] = columns[2];
+		n_columns = 2;
+		if ( ! PyArg_ParseTuple(args, "OO:readinto", 
+				&objects[0], &objects[1]) ) {
+			return(NULL);
+		}
+	} else {
+		PyErr_SetString(PyExc_ValueError, 
+				"Histograms are read with readinto_bins.");
+		return(NULL);
+	}
+
+	if ( pq_python_columns_get(objects, columns, n_columns, &length) ) {
+		return(NULL);
+	}
+
+	channel = (uint32_t *)columns[0].view.buf;
+	if ( t3 ) {
+		pulse = (uint64_t *)columns[1].view.buf;
+		time = (uint64_t *)columns[2].view.buf;
+	} else {
+		time = (uint64_t *)columns[1].view.buf;
+	}
+
+	Py_BEGIN_ALLOW_THREADS
+	result = pq_reader_next_columns(self->reader, channel, pulse, time, 
+			length);
+	Py_END_ALLOW_THREADS
+
+	pq_python_columns_release(columns, n_columns);
+
+	if ( result < 0 ) {
+		PyErr_Format(PyExc_IOError, "Could not decode records (error %d).",
+				(int)result);
+		return(NULL);
+	}
+
+	return(PyLong_FromLongLong(result));
+}
+
+static PyObject *pq_python_reader_readinto(pq_python_reader_t *self, 
+		PyObject *args) {
+	PyObject *count;
+
+	if ( pq_python_reader_acquire(self) ) {
+		return(NULL);
+	}
+
+	count = pq_python_reader_decode(self, args);
+	pq_python_reader_unlock(self);
+	return(count);
+}
+
+static PyObject *pq_python_reader_copy_bins(pq_python_reader_t *self, 
+		PyObject *args) {
+/*
+ * readinto_bins(curve, bin_left, bin_right, counts), for histograms. The lock
+ * is held by the caller.
+ */
+	PyObject *objects[4];
+	pq_python_column_t columns[4] = {
+			{"curve", sizeof(uint32_t)}, 
+			{"bin_left", sizeof(int64_t)}, 
+			{"bin_right", sizeof(int64_t)}, 
+			{"counts", sizeof(uint32_t)}};
+	Py_ssize_t length = 0;
+	int64_t result;
+
+	if ( ! PyArg_ParseTuple(args, "OOOO:readinto_bins", 
+			&objects[0], &objects[1], &objects[2], &objects[3]) ) {
+		return(NULL);
+	}
+
+	if ( pq_reader_mode(self->reader) != PQ_RECORD_INTERACTIVE ) {
+		PyErr_SetString(PyExc_ValueError, "Photons are read with readinto.");
+		return(NULL);
+	}
+
+	if ( pq_python_columns_get(objects, columns, 4, &length) ) {
+		return(NULL);
+	}
+
+	result = pq_reader_next_bin_columns(self->reader, 
+			(uint32_t *)columns[0].view.buf, 
+			(int64_t *)columns[1].view.buf, 
+			(int64_t *)columns[2].view.buf, 
+			(uint32_t *)columns[3].view.buf, length);
+
+	pq_python_columns_release(columns, 4);
+	return(PyLong_FromLongLong(result));
+}
+
+static PyObject *pq_python_reader_readinto_bins(pq_python_reader_t *self, 
+		PyObject *args) {
+	PyObject *count;
+
+	if ( pq_python_reader_acquire(self) ) {
+		return(NULL);
+	}
+
+	count = pq_python_reader_copy_bins(self, args);
+	pq_python_reader_unlock(self);
+	return(count);
+}
+
+static PyObject *pq_python_reader_close(pq_python_reader_t *self, 
+		PyObject *unused) {
+	pq_python_reader_lock(self);
+	pq_reader_close(self->reader);
+	self->reader = NULL;
+	pq_python_reader_unlock(self);
+	Py_RETURN_NONE;
+}
+
+static PyObject *pq_python_reader_mode(pq_python_reader_t *self, 
+		void *closure) {
+	int mode;
+
+	if ( pq_python_reader_acquire(self) ) {
+		return(NULL);
+	}
+
+	mode = pq_reader_mode(self->reader);
+	pq_python_reader_unlock(self);
+
+	switch ( mode ) {
+		case PQ_RECORD_T2:
+			return(PyUnicode_FromString("t2"));
+		case PQ_RECORD_T3:
+			return(PyUnicode_FromString("t3"));
+		default:
+			return(PyUnicode_FromString("interactive"));
+	}
+}
+
+static PyObject *pq_python_reader_resolution(pq_python_reader_t *self, 
+		void *closure) {
+	double resolution;
+
+	if ( pq_python_reader_acquire(self) ) {
+		return(NULL);
+	}
+
+	resolution = pq_reader_resolution(self->reader);
+	pq_python_reader_unlock(self);
+
+	return(PyFloat_FromDouble(resolution));
+}
+
+static PyObject *pq_python_reader_remaining(pq_python_reader_t *self, 
+		void *closure) {
+	int64_t remaining;
+
+	if ( pq_python_reader_acquire(self) ) {
+		return(NULL);
+	}
+
+	remaining = pq_reader_remaining(self->reader);
+	pq_python_reader_unlock(self);
+
+	if ( remaining >= 0 ) {
+		return(PyLong_FromLongLong(remaining));
+	} else {
+		Py_RETURN_NONE;
+	}
+}
+
+static PyMethodDef pq_python_reader_methods[] = {
+	{"readinto", (PyCFunction)pq_python_reader_readinto, METH_VARARGS,
+		"readinto(channel, time) or readinto(channel, pulse, time): decode\n"
+		"photons into the buffers, returning the number stored."},
+	{"readinto_bins", (PyCFunction)pq_python_reader_readinto_bins, 
+		METH_VARARGS,
+		"readinto_bins(curve, bin_left, bin_right, counts): copy histogram\n"
+		"bins into the buffers, returning the number stored."},
+	{"close", (PyCFunction)pq_python_reader_close, METH_NOARGS,
+		"Close the file."},
+	{NULL}
+};
+
+static PyGetSetDef pq_python_reader_getset[] = {
+	{"mode", (getter)pq_python_reader_mode, NULL, 
+		"t2, t3, or interactive.", NULL},
+	{"resolution", (getter)pq_python_reader_resolution, NULL, 
+		"Resolution of t2 or t3 data, in ps.", NULL},
+	{"remaining", (getter)pq_python_reader_remaining, NULL, 
+		"Number of histogram bins not yet read.", NULL},
+	{NULL}
+};
+
+static PyTypeObject pq_python_reader_type = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	.tp_name = "picoquant._picoquant.Reader",
+	.tp_doc = "Reader(filename=None): decode a PicoQuant file (or stdin).",
+	.tp_basicsize = sizeof(pq_python_reader_t),
+	.tp_flags = Py_TPFLAGS_DEFAULT,
+	.tp_new = pq_python_reader_new,
+	.tp_init = (initproc)pq_python_reader_init,
+	.tp_dealloc = (destructor)pq_python_reader_dealloc,
+	.tp_methods = pq_python_reader_methods,
+	.tp_getset = pq_python_reader_getset,
+};
+
+static struct PyModuleDef pq_python_module = {
+	PyModuleDef_HEAD_INIT,
+	.m_name = "_picoquant",
+	.m_doc = "Decoders from libpicoquant.",
+	.m_size = -1,
+};
+
+PyMODINIT_FUNC PyInit__picoquant(void) {
+	PyObject *module;
+
+	if ( PyType_Ready(&pq_python_reader_type) < 0 ) {
+		return(NULL);
+	}
+
+	module = PyModule_Create(&pq_python_module);
+	if ( module == NULL ) {
+		return(NULL);
+	}
+
+	Py_INCREF(&pq_python_reader_type);
+	if ( PyModule_AddObject(module, "Reader", 
+			(PyObject *)&pq_python_reader_type) < 0 ) {
+		Py_DECREF(&pq_python_reader_type);
+		Py_DECREF(module);
+		return(NULL);
+	}
+
+	return(module);
+}
@@ -0,0 +1,80 @@
+import numpy
+
+from picoquant._picoquant import Reader
+
+def photons(filename, batch=1 << 20):
+    """
+    Decode all photons in the t2 or t3 file, returning a dict of arrays:
+    channel and time for t2 data, and additionally pulse for t3 data.
+    """
+    reader = Reader(filename)
+
+    try:
+        if reader.mode == "t2":
+            names = ["channel", "time"]
+        elif reader.mode == "t3":
+            names = ["channel", "pulse", "time"]
+        else:
+            raise(ValueError("{} does not contain photons.".format(filename)))
+
+        # Decode straight into the tail of the result, which grows in place
+        # whenever it fills up.
+        arrays = [numpy.empty(batch, dtype=numpy.uint32)] + \
+                 [numpy.empty(batch, dtype=numpy.uint64)
+                  for name in names[1:]]
+        length = 0
+
+        while True:
+            if length == len(arrays[0]):
+                for array in arrays:
+                    array.resize(2*length, refcheck=False)
+
+            count = reader.readinto(*[array[length:] for array in arrays])
+            length += count
+
+            if count == 0:
+                break
+
+        for array in arrays:
+            array.resize(length, refcheck=False)
+
+        return(dict(zip(names, arrays)))
+    finally:
+        reader.close()
+
+def histograms(filename):
+    """
+    Read all curves from the histogram file, returning a dict of 2-D arrays
+    (curve, bin): bin_left, bin_right, and counts. Curves with fewer bins than
+    the longest are padded with zeros.
+    """
+    reader = Reader(filename)
+
+    try:
+        if reader.mode != "interactive":
+            raise(ValueError("{} does not contain histograms.".format(
+                filename)))
+
+        n = reader.remaining
+        curve = numpy.empty(n, dtype=numpy.uint32)
+        bin_left = numpy.empty(n, dtype=numpy.int64)
+        bin_right = numpy.empty(n, dtype=numpy.int64)
+        counts = numpy.empty(n, dtype=numpy.uint32)
+        reader.readinto_bins(curve, bin_left, bin_right, counts)
+    finally:
+        reader.close()
+
+    n_curves = int(curve.max()) + 1 if n else 0
+    lengths = numpy.bincount(curve, minlength=n_curves)
+    n_bins = int(lengths.max()) if n else 0
+    starts = numpy.concatenate(([0], numpy.cumsum(lengths)[:-1]))
+    index = numpy.arange(n) - starts[curve]
+
+    result = dict()
+    for name, values in [("bin_left", bin_left),
+                         ("bin_right", bin_right),
+                         ("counts", counts)]:
+        result[name] = numpy.zeros((n_curves, n_bins), dtype=values.dtype)
+        result[name][curve, index] = values
+
+    return(result)
@@ -1,4 +1,17 @@
-from setuptools import setup
+import os
+
+from setuptools import setup, Extension
+
+# Build against the library in ../src, or an installed one.
+src = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src")
+
+decoder = Extension(
+    "picoquant._picoquant",
+    sources=["picoquant/_picoquant.c"],
+    include_dirs=[src],
+    library_dirs=[os.path.join(src, ".libs")],
+    libraries=["picoquant"],
+    define_macros=[("_FILE_OFFSET_BITS", "64")])
 
 setup(
     name="picoquant",
@@ -10,6 +23,7 @@ setup(
     licence="MIT",
 
     packages=["picoquant"],
+    ext_modules=[decoder],
 
 ##    install_requires=["photon_correlation >= 0.1"]
     )
@@ -0,0 +1,405 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "error.h"
+#include "files.h"
+#include "format.h"
+#include "picoquant.h"
+#include "threads.h"
+#include "tttr.h"
+
+typedef struct {
+	char **names;
+	size_t length;
+	size_t capacity;
+} pq_batch_names_t;
+
+static int pq_batch_name_add(pq_batch_names_t *names, char const *name) {
+	char **grown;
+
+	if ( names->length == names->capacity ) {
+		names->capacity = names->capacity == 0 ? 64 : 2*names->capacity;
+		grown = (char **)realloc(names->names, 
+				names->capacity*sizeof(char *));
+		if ( grown == NULL ) {
+			error("Could not allocate the list of files.\n");
+			return(PQ_ERROR_MEM);
+		}
+		names->names = grown;
+	}
+
+	names->names[names->length] = strdup(name);
+	if ( names->names[names->length] == NULL ) {
+		error("Could not allocate the list of files.\n");
+		return(PQ_ERROR_MEM);
+	}
+	names->length++;
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_batch_pattern_add(pq_batch_names_t *names, char const *pattern) {
+/*
+ * Expand the pattern, for lists of files and shells which do not. A name 
+ * which matches nothing is kept, so that it is reported when it cannot be 
+ * opened.
+ */
+	int result = PQ_SUCCESS;
+#ifdef HAVE_GLOB_H
+	glob_t matches;
+	size_t i;
+
+	if ( strpbrk(pattern, "*?[") != NULL && 
+			glob(pattern, 0, NULL, &matches) == 0 ) {
+		for ( i = 0; result == PQ_SUCCESS && i < matches.gl_pathc; i++ ) {
+			result = pq_batch_name_add(names, matches.gl_pathv[i]);
+		}
+		globfree(&matches);
+		return(result);
+	}
+#endif
+
+	result = pq_batch_name_add(names, pattern);
+	return(result);
+}
+
+static int pq_batch_list_read(pq_batch_names_t *names, char const *filename) {
+	int result = PQ_SUCCESS;
+	FILE *stream_in;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+
+	if ( ! strcmp(filename, "-") ) {
+		stream_in = stdin;
+	} else {
+		stream_in = fopen(filename, "r");
+	}
+
+	if ( stream_in == NULL ) {
+		error("Could not open %s.\n", filename);
+		return(PQ_ERROR_IO);
+	}
+
+	while ( result == PQ_SUCCESS && 
+			(length = getline(&line, &capacity, stream_in)) >= 0 ) {
+		while ( length > 0 && 
+				(line[length-1] == '\n' || line[length-1] == '\r') ) {
+			line[--length] = '\0';
+		}
+
+		if ( length > 0 ) {
+			result = pq_batch_pattern_add(names, line);
+		}
+	}
+
+	free(line);
+	if ( stream_in != stdin ) {
+		fclose(stream_in);
+	}
+
+	return(result);
+}
+
+static char *pq_batch_output_name(char const *filename_in, 
+		char const *directory, char const *suffix) {
+/*
+ * The output goes next to the input or, with --file-out, into that 
+ * directory under the same name, with the suffix added.
+ */
+	char const *base = filename_in;
+	char *filename_out;
+	size_t length;
+
+	if ( directory != NULL ) {
+		if ( strrchr(filename_in, '/') != NULL ) {
+			base = strrchr(filename_in, '/') + 1;
+		}
+		length = strlen(directory) + 1 + strlen(base) + strlen(suffix) + 1;
+	} else {
+		length = strlen(base) + strlen(suffix) + 1;
+	}
+
+	filename_out = (char *)malloc(length);
+	if ( filename_out == NULL ) {
+		return(NULL);
+	}
+
+	if ( directory != NULL ) {
+		snprintf(filename_out, length, "%s/%s%s", directory, base, suffix);
+	} else {
+		snprintf(filename_out, length, "%s%s", base, suffix);
+	}
+
+	return(filename_out);
+}
+
+static int pq_batch_compare_size(void const *a, void const *b) {
+	int64_t size_a = ((pq_batch_job_t const *)a)->size;
+	int64_t size_b = ((pq_batch_job_t const *)b)->size;
+
+	return((size_a < size_b) - (size_a > size_b));
+}
+
+static int pq_batch_compare_output(void const *a, void const *b) {
+	return(strcmp((*(pq_batch_job_t * const *)a)->filename_out, 
+				(*(pq_batch_job_t * const *)b)->filename_out));
+}
+
+static int pq_batch_check_outputs(pq_batch_job_t *jobs, size_t n_jobs) {
+/*
+ * Two files written to the same output would be decoded into it at once.
+ */
+	pq_batch_job_t **sorted;
+	int result = PQ_SUCCESS;
+	size_t i;
+
+	sorted = (pq_batch_job_t **)malloc(n_jobs*sizeof(pq_batch_job_t *));
+	if ( sorted == NULL ) {
+		error("Could not allocate the list of files.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( i = 0; i < n_jobs; i++ ) {
+		sorted[i] = &jobs[i];
+	}
+	qsort(sorted, n_jobs, sizeof(pq_batch_job_t *), pq_batch_compare_output);
+
+	for ( i = 1; i < n_jobs; i++ ) {
+		if ( ! strcmp(sorted[i-1]->filename_out, sorted[i]->filename_out) ) {
+			error("Both %s and %s would be written to %s.\n", 
+					sorted[i-1]->filename_in, sorted[i]->filename_in,
+					sorted[i]->filename_out);
+			result = PQ_ERROR_OPTIONS;
+		}
+	}
+
+	free(sorted);
+	return(result);
+}
+
+static void *pq_batch_work(void *arg) {
+/*
+ * Decode one file of the batch, as picoquant would with --file-in and 
+ * --file-out. A file which fails leaves no output behind, so that it is not
+ * mistaken for a finished one.
+ */
+	pq_batch_job_t *job = (pq_batch_job_t *)arg;
+	options_t options = *job->options;
+	FILE *stream_in = NULL;
+	FILE *stream_out = NULL;
+	char *buffer;
+
+	options.filename_in = job->filename_in;
+	options.filename_out = job->filename_out;
+	options.threads = job->threads;
+
+	debug("Decoding %s into %s.\n", job->filename_in, job->filename_out);
+	if ( stream_open(&stream_in, stdin, job->filename_in, "r") ) {
+		job->result = PQ_ERROR_IO;
+		return(NULL);
+	}
+
+	if ( stream_open(&stream_out, stdout, job->filename_out, "w") ) {
+		fclose(stream_in);
+		job->result = PQ_ERROR_IO;
+		return(NULL);
+	}
+
+	/* As in streams_open, but each output needs its own buffer. */
+	buffer = (char *)malloc(PQ_FORMAT_STREAM_BUFFER);
+	if ( buffer != NULL ) {
+		setvbuf(stream_out, buffer, _IOFBF, PQ_FORMAT_STREAM_BUFFER);
+	}
+
+	job->result = pq_dispatch(stream_in, stream_out, &options);
+
+	fclose(stream_in);
+	if ( fclose(stream_out) && ! pq_check(job->result) ) {
+		error("Could not write %s.\n", job->filename_out);
+		job->result = PQ_ERROR_IO;
+	}
+	free(buffer);
+
+	if ( pq_check(job->result) ) {
+		error("Could not decode %s.\n", job->filename_in);
+		remove(job->filename_out);
+	}
+
+	return(NULL);
+}
+
+int pq_batch_active(options_t *options) {
+	return(options->n_filenames_batch > 0 || options->filename_list != NULL);
+}
+
+int pq_batch_run(options_t *options) {
+/*
+ * Decode every file of the batch on a pool with one thread per processor,
+ * or --threads. The largest files are started first, and those with more 
+ * than one chunk of records are decoded with as many threads as they have 
+ * chunks, up to the size of the pool, so that the chunks of a large file 
+ * spread over the threads which have run out of files.
+ */
+	int result = PQ_SUCCESS;
+	pq_batch_names_t names = {NULL, 0, 0};
+	pq_batch_job_t *jobs = NULL;
+	char const *suffix = options->suffix;
+	struct stat file_stat;
+	int64_t chunks;
+	int threads = options->threads;
+	size_t i, failed = 0;
+
+	if ( options->filename_in != NULL ) {
+		error("Give the files of a batch either with --file-in or as a "
+				"list, not both.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( options->follow || options->shm_name != NULL || 
+			options->print_stats ) {
+		error("--follow, --shm and --stats are for a single file, not a "
+				"batch.\n");
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	if ( suffix == NULL ) {
+		if ( options->print_header ) {
+			suffix = ".header";
+		} else if ( options->print_resolution ) {
+			suffix = ".resolution";
+		} else if ( options->print_mode ) {
+			suffix = ".mode";
+		} else {
+			suffix = ".data";
+		}
+	}
+
+	if ( threads < 1 ) {
+		threads = 1;
+#ifdef _SC_NPROCESSORS_ONLN
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		if ( threads < 1 ) {
+			threads = 1;
+		}
+#endif
+	}
+
+	for ( i = 0; result == PQ_SUCCESS && 
+			i < (size_t)options->n_filenames_batch; i++ ) {
+		result = pq_batch_pattern_add(&names, options->filenames_batch[i]);
+	}
+
+	if ( result == PQ_SUCCESS && options->filename_list != NULL ) {
+		result = pq_batch_list_read(&names, options->filename_list);
+	}
+
+	if ( result == PQ_SUCCESS && names.length > 0 ) {
+		jobs = (pq_batch_job_t *)calloc(names.length, sizeof(pq_batch_job_t));
+		if ( jobs == NULL ) {
+			error("Could not allocate the batch.\n");
+			result = PQ_ERROR_MEM;
+		}
+	}
+
+	for ( i = 0; result == PQ_SUCCESS && i < names.length; i++ ) {
+		jobs[i].filename_in = names.names[i];
+		jobs[i].filename_out = pq_batch_output_name(names.names[i], 
+				options->filename_out, suffix);
+		jobs[i].options = options;
+		jobs[i].threads = 1;
+
+		if ( jobs[i].filename_out == NULL ) {
+			error("Could not allocate the batch.\n");
+			result = PQ_ERROR_MEM;
+		} else if ( ! stat(jobs[i].filename_in, &file_stat) ) {
+			jobs[i].size = file_stat.st_size;
+
+			/* Records are 32 bits in all formats which can be split. */
+			chunks = jobs[i].size / (4*(int64_t)TTTR_CHUNK_RECORDS);
+			jobs[i].threads = chunks < threads ? (int)chunks : threads;
+			if ( jobs[i].threads < 1 || options->correlate_log ) {
+				/* The --log-bins cascade counts on one thread. */
+				jobs[i].threads = 1;
+			}
+		}
+	}
+
+	if ( result == PQ_SUCCESS && names.length > 0 ) {
+		result = pq_batch_check_outputs(jobs, names.length);
+	}
+
+	if ( result == PQ_SUCCESS && names.length > 0 ) {
+		qsort(jobs, names.length, sizeof(pq_batch_job_t), 
+				pq_batch_compare_size);
+		debug("Decoding %zu files on %d threads.\n", names.length, threads);
+		result = pq_pool_run(pq_batch_work, jobs, sizeof(pq_batch_job_t), 
+				names.length, threads);
+	}
+
+	for ( i = 0; result == PQ_SUCCESS && i < names.length; i++ ) {
+		if ( pq_check(jobs[i].result) ) {
+			failed++;
+		}
+	}
+
+	if ( failed > 0 ) {
+		error("%zu of %zu files could not be decoded.\n", 
+				failed, names.length);
+		result = PQ_ERROR_IO;
+		for ( i = 0; i < names.length; i++ ) {
+			if ( pq_check(jobs[i].result) ) {
+				result = jobs[i].result;
+				break;
+			}
+		}
+	}
+
+	for ( i = 0; i < names.length; i++ ) {
+		free(names.names[i]);
+		if ( jobs != NULL ) {
+			free(jobs[i].filename_out);
+		}
+	}
+	free(names.names);
+	free(jobs);
+
+	return(result);
+}
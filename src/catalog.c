@@ -0,0 +1,1226 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "catalog.h"
+#include "error.h"
+#include "options.h"
+#include "picoquant.h"
+#include "threads.h"
+#include "unified.h"
+#include "picoharp.h"
+#include "hydraharp.h"
+#include "timeharp.h"
+#include "picoharp/ph_v20.h"
+#include "hydraharp/hh_v10.h"
+#include "hydraharp/hh_v20.h"
+#include "timeharp/th_v20.h"
+#include "timeharp/th_v30.h"
+#include "timeharp/th_v50.h"
+#include "timeharp/th_v60.h"
+
+static char const * const pq_catalog_names[PQ_CATALOG_FIELDS] = {
+	"path", "size", "mtime", "hardware", "version", "mode", "resolution",
+	"sync_rate", "records", "curves", "acquisition_time", "file_time", 
+	"comment"};
+
+static char const * const pq_catalog_extensions[] = {
+	"phd", "pt2", "pt3", "hhd", "ht2", "ht3", "thd", "t3r", "ptu", NULL};
+
+static void pq_catalog_usage(void) {
+	version();
+	fprintf(stderr,
+"Usage: picoquant catalog [options] [path ...]\n"
+"\n"
+"Scan the paths (directories, recursively, or single files) for PicoQuant\n"
+"data files and record a few fields of each header in the catalog. Files\n"
+"already in the catalog are only read again if their size or modification\n"
+"time changed. Without paths, or with --where, print the catalogued files\n"
+"as tab-separated lines, with the names of the fields on the first line.\n"
+"\n"
+"              -h, --help: Prints this usage message.\n"
+"           -v, --verbose: Print debug-level information.\n"
+"           -f, --catalog: The catalog file. By default, this is\n"
+"                          " PQ_CATALOG_DEFAULT " in the current directory.\n"
+"            -T --threads: Read the headers using n threads. By default,\n"
+"                          one per processor.\n"
+"              -w --where: Only print the files matching this condition,\n"
+"                          as field=value, field!=value, field<value or\n"
+"                          field>value. Numbers are compared as numbers.\n"
+"                          May be given more than once.\n"
+"\n"
+"Fields: path, size, mtime, hardware, version, mode, resolution,\n"
+"        sync_rate, records, curves, acquisition_time, file_time, comment\n");
+}
+
+static char *pq_catalog_strdup(char const *value, size_t length) {
+/*
+ * A copy of the value which is safe to place in a line of the catalog.
+ */
+	char *copy = (char *)malloc(length + 1);
+	size_t i;
+
+	if ( copy != NULL ) {
+		for ( i = 0; i < length; i++ ) {
+			copy[i] = (value[i] == '\t' || value[i] == '\r' || 
+					value[i] == '\n') ? ' ' : value[i];
+		}
+		copy[length] = '\0';
+	}
+
+	return(copy);
+}
+
+static int pq_catalog_compare(void const *a, void const *b) {
+	return(strcmp(((pq_catalog_entry_t *)a)->fields[PQ_CATALOG_PATH],
+			((pq_catalog_entry_t *)b)->fields[PQ_CATALOG_PATH]));
+}
+
+static void pq_catalog_entry_free(pq_catalog_entry_t *entry) {
+	int i;
+
+	for ( i = 0; i < PQ_CATALOG_FIELDS; i++ ) {
+		free(entry->fields[i]);
+		entry->fields[i] = NULL;
+	}
+}
+
+static pq_catalog_entry_t *pq_catalog_add(pq_catalog_t *catalog) {
+/*
+ * A new, empty entry at the end of the catalog.
+ */
+	pq_catalog_entry_t *entries;
+
+	if ( catalog->length == catalog->capacity ) {
+		catalog->capacity = catalog->capacity ? 2*catalog->capacity : 1024;
+		entries = (pq_catalog_entry_t *)realloc(catalog->entries, 
+				catalog->capacity*sizeof(pq_catalog_entry_t));
+		if ( entries == NULL ) {
+			error("Could not allocate catalog.\n");
+			return(NULL);
+		}
+		catalog->entries = entries;
+	}
+
+	memset(&catalog->entries[catalog->length], 0, sizeof(pq_catalog_entry_t));
+	return(&catalog->entries[catalog->length++]);
+}
+
+void pq_catalog_init(pq_catalog_t *catalog) {
+	catalog->entries = NULL;
+	catalog->length = 0;
+	catalog->capacity = 0;
+}
+
+void pq_catalog_free(pq_catalog_t *catalog) {
+	size_t i;
+
+	for ( i = 0; i < catalog->length; i++ ) {
+		pq_catalog_entry_free(&catalog->entries[i]);
+	}
+
+	free(catalog->entries);
+	pq_catalog_init(catalog);
+}
+
+int pq_catalog_load(pq_catalog_t *catalog, char const *filename) {
+/*
+ * Read the catalog, if there is one yet.
+ */
+	int result = PQ_SUCCESS;
+	FILE *stream_in;
+	char *line = NULL;
+	size_t capacity = 0;
+	ssize_t length;
+	char *start, *end;
+	pq_catalog_entry_t *entry;
+	int i;
+
+	stream_in = fopen(filename, "r");
+	if ( stream_in == NULL ) {
+		debug("No catalog at %s yet.\n", filename);
+		return(PQ_SUCCESS);
+	}
+
+	length = getline(&line, &capacity, stream_in);
+	if ( length < 0 || 
+			strncmp(line, PQ_CATALOG_MAGIC, strlen(PQ_CATALOG_MAGIC)) ) {
+		error("%s is not a picoquant catalog.\n", filename);
+		result = PQ_ERROR_VERSION;
+	}
+
+	while ( result == PQ_SUCCESS && 
+			(length = getline(&line, &capacity, stream_in)) >= 0 ) {
+		if ( length > 0 && line[length-1] == '\n' ) {
+			line[--length] = '\0';
+		}
+
+		if ( line[0] == '#' || length == 0 ) {
+			continue;
+		}
+
+		entry = pq_catalog_add(catalog);
+		if ( entry == NULL ) {
+			result = PQ_ERROR_MEM;
+			break;
+		}
+
+		start = line;
+		for ( i = 0; i < PQ_CATALOG_FIELDS && start != NULL; i++ ) {
+			end = strchr(start, '\t');
+			entry->fields[i] = pq_catalog_strdup(start, 
+					end == NULL ? strlen(start) : (size_t)(end - start));
+			start = end == NULL ? NULL : end + 1;
+		}
+
+		if ( i != PQ_CATALOG_FIELDS || start != NULL ) {
+			warn("Skipping malformed catalog line: %s\n", line);
+			pq_catalog_entry_free(entry);
+			catalog->length--;
+		}
+	}
+
+	free(line);
+	fclose(stream_in);
+
+	qsort(catalog->entries, catalog->length, sizeof(pq_catalog_entry_t),
+			pq_catalog_compare);
+	return(result);
+}
+
+static void pq_catalog_names_print(FILE *stream_out) {
+	int i;
+
+	for ( i = 0; i < PQ_CATALOG_FIELDS; i++ ) {
+		fprintf(stream_out, "%s%c", pq_catalog_names[i], 
+				i + 1 == PQ_CATALOG_FIELDS ? '\n' : '\t');
+	}
+}
+
+static void pq_catalog_entry_print(FILE *stream_out, 
+		pq_catalog_entry_t *entry) {
+	int i;
+
+	for ( i = 0; i < PQ_CATALOG_FIELDS; i++ ) {
+		fprintf(stream_out, "%s%c", 
+				entry->fields[i] == NULL ? "" : entry->fields[i],
+				i + 1 == PQ_CATALOG_FIELDS ? '\n' : '\t');
+	}
+}
+
+int pq_catalog_save(pq_catalog_t *catalog, char const *filename) {
+/*
+ * Write the catalog beside the old one, then move it into place, so that
+ * an interrupted update leaves the old catalog intact.
+ */
+	FILE *stream_out;
+	char *filename_tmp;
+	size_t i;
+	int result = PQ_SUCCESS;
+
+	filename_tmp = (char *)malloc(strlen(filename) + 5);
+	if ( filename_tmp == NULL ) {
+		error("Could not allocate catalog filename.\n");
+		return(PQ_ERROR_MEM);
+	}
+	sprintf(filename_tmp, "%s.tmp", filename);
+
+	stream_out = fopen(filename_tmp, "w");
+	if ( stream_out == NULL ) {
+		error("Could not open %s for writing.\n", filename_tmp);
+		free(filename_tmp);
+		return(PQ_ERROR_IO);
+	}
+
+	fprintf(stream_out, "%s\n#", PQ_CATALOG_MAGIC);
+	pq_catalog_names_print(stream_out);
+	for ( i = 0; i < catalog->length; i++ ) {
+		pq_catalog_entry_print(stream_out, &catalog->entries[i]);
+	}
+
+	if ( ferror(stream_out) | fclose(stream_out) ) {
+		error("Could not write %s.\n", filename_tmp);
+		result = PQ_ERROR_IO;
+	} else if ( rename(filename_tmp, filename) ) {
+		error("Could not replace %s.\n", filename);
+		result = PQ_ERROR_IO;
+	}
+
+	if ( result != PQ_SUCCESS ) {
+		remove(filename_tmp);
+	}
+
+	free(filename_tmp);
+	return(result);
+}
+
+static void pq_catalog_set(pq_catalog_entry_t *entry, int field, 
+		char const *value, size_t length) {
+/*
+ * Store the value, up to length bytes or its terminating null.
+ */
+	char const *end = (char const *)memchr(value, '\0', length);
+
+	free(entry->fields[field]);
+	entry->fields[field] = pq_catalog_strdup(value, 
+			end == NULL ? length : (size_t)(end - value));
+}
+
+static void pq_catalog_integer(pq_catalog_entry_t *entry, int field, 
+		int64_t value) {
+	char number[32];
+
+	sprintf(number, "%"PRId64, value);
+	pq_catalog_set(entry, field, number, sizeof(number));
+}
+
+static void pq_catalog_mode(pq_catalog_entry_t *entry, int mode) {
+/*
+ * The mode, named as for --mode-only.
+ */
+	if ( mode == PQ_RECORD_T2 ) {
+		pq_catalog_set(entry, PQ_CATALOG_MODE, "t2", 2);
+	} else if ( mode == PQ_RECORD_T3 ) {
+		pq_catalog_set(entry, PQ_CATALOG_MODE, "t3", 2);
+	} else if ( mode == PQ_RECORD_INTERACTIVE ) {
+		pq_catalog_set(entry, PQ_CATALOG_MODE, "interactive", 11);
+	} else if ( mode == PQ_RECORD_CONTINUOUS ) {
+		pq_catalog_set(entry, PQ_CATALOG_MODE, "continuous", 10);
+	}
+}
+
+static void pq_catalog_resolution(pq_catalog_entry_t *entry, 
+		float64_t resolution) {
+/*
+ * Add the resolution (in ps) of one more curve, as printed by 
+ * --resolution-only, with the curves separated by commas.
+ */
+	char number[64];
+	char *values;
+	size_t length = 0;
+
+	snprintf(number, sizeof(number), "%.2"PRIf64, resolution);
+
+	if ( entry->fields[PQ_CATALOG_RESOLUTION] != NULL ) {
+		length = strlen(entry->fields[PQ_CATALOG_RESOLUTION]);
+	}
+
+	values = (char *)realloc(entry->fields[PQ_CATALOG_RESOLUTION], 
+			length + strlen(number) + 2);
+	if ( values == NULL ) {
+		return;
+	}
+
+	if ( length > 0 ) {
+		values[length++] = ',';
+	}
+	strcpy(values + length, number);
+	entry->fields[PQ_CATALOG_RESOLUTION] = values;
+}
+
+/* The fields common to the main header of every classic format. */
+#define PQ_CATALOG_CLASSIC(entry, header) \
+	do { \
+		pq_catalog_integer(entry, PQ_CATALOG_CURVES, \
+				(header)->NumberOfCurves); \
+		pq_catalog_integer(entry, PQ_CATALOG_ACQUISITION_TIME, \
+				(header)->AcquisitionTime); \
+		pq_catalog_set(entry, PQ_CATALOG_FILE_TIME, (header)->FileTime, \
+				sizeof((header)->FileTime)); \
+		pq_catalog_set(entry, PQ_CATALOG_COMMENT, (header)->Comment, \
+				sizeof((header)->Comment)); \
+	} while ( 0 )
+
+static int pq_catalog_ph_v20(FILE *stream_in, pq_catalog_entry_t *entry) {
+	ph_v20_header_t *header;
+	ph_v20_interactive_t *interactive;
+	ph_v20_tttr_header_t *tttr_header;
+	tttr_t tttr;
+	int result;
+	int i;
+
+	result = ph_v20_header_read(stream_in, &header);
+	if ( result != PQ_SUCCESS ) {
+		return(result);
+	}
+
+	PQ_CATALOG_CLASSIC(entry, header);
+
+	if ( header->MeasurementMode == PH_MODE_INTERACTIVE ) {
+		pq_catalog_mode(entry, PQ_RECORD_INTERACTIVE);
+		result = ph_v20_interactive_header_read(stream_in, header, 
+				&interactive);
+		if ( result == PQ_SUCCESS ) {
+			for ( i = 0; i < header->NumberOfCurves; i++ ) {
+				pq_catalog_resolution(entry, 
+						interactive->Curve[i].Resolution*1e3);
+			}
+			ph_v20_interactive_header_free(&interactive);
+		}
+	} else if ( header->MeasurementMode == PH_MODE_T2 || 
+			header->MeasurementMode == PH_MODE_T3 ) {
+		result = ph_v20_tttr_header_read(stream_in, &tttr_header);
+		if ( result == PQ_SUCCESS ) {
+			if ( header->MeasurementMode == PH_MODE_T2 ) {
+				pq_catalog_mode(entry, PQ_RECORD_T2);
+				ph_v20_t2_init(header, tttr_header, &tttr);
+			} else {
+				pq_catalog_mode(entry, PQ_RECORD_T3);
+				ph_v20_t3_init(header, tttr_header, &tttr);
+			}
+			pq_catalog_resolution(entry, tttr.resolution_float*1e12);
+			pq_catalog_integer(entry, PQ_CATALOG_SYNC_RATE, 
+					tttr_header->InpRate0);
+			pq_catalog_integer(entry, PQ_CATALOG_RECORDS, 
+					tttr_header->NumRecords);
+			ph_v20_tttr_header_free(&tttr_header);
+		}
+	}
+
+	ph_v20_header_free(&header);
+	return(result);
+}
+
+static int pq_catalog_hh_v10(FILE *stream_in, pq_catalog_entry_t *entry) {
+	hh_v10_header_t *header;
+	hh_v10_interactive_t *interactive;
+	hh_v10_tttr_header_t *tttr_header;
+	tttr_t tttr;
+	int result;
+	int i;
+
+	result = hh_v10_header_read(stream_in, &header);
+	if ( result != PQ_SUCCESS ) {
+		return(result);
+	}
+
+	PQ_CATALOG_CLASSIC(entry, header);
+
+	if ( header->MeasurementMode == HH_MODE_INTERACTIVE ) {
+		pq_catalog_mode(entry, PQ_RECORD_INTERACTIVE);
+		result = hh_v10_interactive_header_read(stream_in, header, 
+				&interactive);
+		if ( result == PQ_SUCCESS ) {
+			for ( i = 0; i < header->NumberOfCurves; i++ ) {
+				pq_catalog_resolution(entry, 
+						interactive->Curve[i].Resolution);
+			}
+			hh_v10_interactive_header_free(&interactive);
+		}
+	} else if ( header->MeasurementMode == HH_MODE_T2 || 
+			header->MeasurementMode == HH_MODE_T3 ) {
+		result = hh_v10_tttr_header_read(stream_in, &tttr_header);
+		if ( result == PQ_SUCCESS ) {
+			if ( header->MeasurementMode == HH_MODE_T2 ) {
+				pq_catalog_mode(entry, PQ_RECORD_T2);
+				hh_v10_t2_init(header, tttr_header, &tttr);
+			} else {
+				pq_catalog_mode(entry, PQ_RECORD_T3);
+				hh_v10_t3_init(header, tttr_header, &tttr);
+			}
+			pq_catalog_resolution(entry, tttr.resolution_float*1e12);
+			pq_catalog_integer(entry, PQ_CATALOG_SYNC_RATE, 
+					tttr_header->SyncRate);
+			pq_catalog_integer(entry, PQ_CATALOG_RECORDS, 
+					tttr_header->NumRecords);
+			hh_v10_tttr_header_free(&tttr_header);
+		}
+	}
+
+	hh_v10_header_free(&header);
+	return(result);
+}
+
+static int pq_catalog_hh_v20(FILE *stream_in, pq_catalog_entry_t *entry) {
+	hh_v20_header_t *header;
+	hh_v20_interactive_t *interactive;
+	hh_v20_tttr_header_t *tttr_header;
+	tttr_t tttr;
+	int result;
+	int i;
+
+	result = hh_v20_header_read(stream_in, &header);
+	if ( result != PQ_SUCCESS ) {
+		return(result);
+	}
+
+	PQ_CATALOG_CLASSIC(entry, header);
+
+	if ( header->MeasurementMode == HH_MODE_INTERACTIVE ) {
+		pq_catalog_mode(entry, PQ_RECORD_INTERACTIVE);
+		result = hh_v20_interactive_header_read(stream_in, header, 
+				&interactive);
+		if ( result == PQ_SUCCESS ) {
+			for ( i = 0; i < header->NumberOfCurves; i++ ) {
+				pq_catalog_resolution(entry, 
+						interactive->Curve[i].Resolution);
+			}
+			hh_v20_interactive_header_free(&interactive);
+		}
+	} else if ( header->MeasurementMode == HH_MODE_T2 || 
+			header->MeasurementMode == HH_MODE_T3 ) {
+		result = hh_v20_tttr_header_read(stream_in, &tttr_header);
+		if ( result == PQ_SUCCESS ) {
+			if ( header->MeasurementMode == HH_MODE_T2 ) {
+				pq_catalog_mode(entry, PQ_RECORD_T2);
+				hh_v20_t2_init(header, tttr_header, &tttr);
+			} else {
+				pq_catalog_mode(entry, PQ_RECORD_T3);
+				hh_v20_t3_init(header, tttr_header, &tttr);
+			}
+			pq_catalog_resolution(entry, tttr.resolution_float*1e12);
+			pq_catalog_integer(entry, PQ_CATALOG_SYNC_RATE, 
+					tttr_header->SyncRate);
+			pq_catalog_integer(entry, PQ_CATALOG_RECORDS, 
+					tttr_header->NumRecords);
+			hh_v20_tttr_header_free(&tttr_header);
+		}
+	}
+
+	hh_v20_header_free(&header);
+	return(result);
+}
+
+/* The TimeHarp formats differ only in the layout of their headers, so one
+ * definition covers every version. The curves are read whole, as their 
+ * resolution is stored with the counts.
+ */
+#define PQ_CATALOG_TH(th) \
+static int pq_catalog_##th(FILE *stream_in, pq_catalog_entry_t *entry) { \
+	th##_header_t *header; \
+	th##_interactive_t *interactive; \
+	th##_tttr_header_t *tttr_header; \
+	tttr_t tttr; \
+	int result; \
+	int i; \
+\
+	result = th##_header_read(stream_in, &header); \
+	if ( result != PQ_SUCCESS ) { \
+		return(result); \
+	} \
+\
+	PQ_CATALOG_CLASSIC(entry, header); \
+\
+	if ( header->MeasurementMode == TH_MODE_INTERACTIVE ) { \
+		pq_catalog_mode(entry, PQ_RECORD_INTERACTIVE); \
+		result = th##_interactive_read(stream_in, header, &interactive); \
+		if ( result == PQ_SUCCESS ) { \
+			for ( i = 0; i < header->NumberOfCurves; i++ ) { \
+				pq_catalog_resolution(entry, \
+						interactive[i].Resolution*1e3); \
+			} \
+			th##_interactive_free(header, &interactive); \
+		} \
+	} else if ( header->MeasurementMode == TH_MODE_CONTINUOUS ) { \
+		pq_catalog_mode(entry, PQ_RECORD_CONTINUOUS); \
+	} else if ( header->MeasurementMode == TH_MODE_TTTR ) { \
+		result = th##_tttr_header_read(stream_in, &tttr_header); \
+		if ( result == PQ_SUCCESS ) { \
+			pq_catalog_mode(entry, PQ_RECORD_T3); \
+			th##_t3_init(header, tttr_header, &tttr); \
+			pq_catalog_resolution(entry, tttr.resolution_float*1e12); \
+			pq_catalog_integer(entry, PQ_CATALOG_SYNC_RATE, \
+					tttr_header->SyncRate); \
+			pq_catalog_integer(entry, PQ_CATALOG_RECORDS, \
+					tttr_header->NumberOfRecords); \
+			th##_tttr_header_free(&tttr_header); \
+		} \
+	} \
+\
+	th##_header_free(&header); \
+	return(result); \
+}
+
+PQ_CATALOG_TH(th_v20)
+PQ_CATALOG_TH(th_v30)
+PQ_CATALOG_TH(th_v50)
+PQ_CATALOG_TH(th_v60)
+
+static void pq_catalog_tag(pq_catalog_entry_t *entry, int field, 
+		pu_tags_t *tags, char const *ident) {
+	char *value = pu_tags_string(tags, ident);
+
+	if ( value != NULL ) {
+		pq_catalog_set(entry, field, value, strlen(value));
+		free(value);
+	}
+}
+
+static int pq_catalog_unified(FILE *stream_in, pu_header_t *pu_header, 
+		pq_catalog_entry_t *entry) {
+/*
+ * A ptu header is a dictionary of tags, so the fields are looked up by name.
+ */
+	pu_tags_t tags;
+	pu_options_t pu_options;
+	pu_entry_t *tag;
+	float64_t days;
+	time_t seconds;
+	struct tm timeinfo;
+	char date[32];
+	int result;
+
+	pu_tags_init(&tags);
+	result = pu_tags_read(stream_in, &tags);
+
+	if ( result == PQ_SUCCESS ) {
+		pu_options_init(&pu_options, &tags);
+
+		pq_catalog_tag(entry, PQ_CATALOG_HARDWARE, &tags, "HW_Type");
+		pq_catalog_set(entry, PQ_CATALOG_VERSION, pu_header->Version, 
+				sizeof(pu_header->Version));
+		pq_catalog_mode(entry, 
+				PU_RECORD_MODE(pu_options.record_type) == PU_RECORD_MODE_T2 ?
+				PQ_RECORD_T2 : 
+				PU_RECORD_MODE(pu_options.record_type) == PU_RECORD_MODE_T3 ?
+				PQ_RECORD_T3 : 0);
+		/* t2 times count the global resolution, t3 times the bin width. */
+		pq_catalog_resolution(entry, 1e12*(
+				PU_RECORD_MODE(pu_options.record_type) == PU_RECORD_MODE_T2 ?
+				pu_options.global_resolution : pu_options.resolution_seconds));
+		pq_catalog_integer(entry, PQ_CATALOG_SYNC_RATE, pu_options.sync_rate);
+		pq_catalog_integer(entry, PQ_CATALOG_RECORDS, 
+				pu_options.number_of_records);
+		if ( pu_tags_find(&tags, "MeasDesc_AcquisitionTime", -1) != NULL ) {
+			pq_catalog_integer(entry, PQ_CATALOG_ACQUISITION_TIME, 
+					pu_tags_int(&tags, "MeasDesc_AcquisitionTime", 0));
+		}
+		pq_catalog_tag(entry, PQ_CATALOG_COMMENT, &tags, "File_Comment");
+
+		/* A TDateTime counts days from 1899-12-30. */
+		tag = pu_tags_find(&tags, "File_CreatingTime", -1);
+		if ( tag != NULL && tag->tag.type == PU_TAG_TDateTime ) {
+			memcpy(&days, &tag->tag.value, sizeof(days));
+			seconds = (time_t)((days - 25569)*86400);
+			if ( gmtime_r(&seconds, &timeinfo) != NULL && 
+					strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", 
+						&timeinfo) > 0 ) {
+				pq_catalog_set(entry, PQ_CATALOG_FILE_TIME, date, 
+						sizeof(date));
+			}
+		}
+	}
+
+	pu_tags_free(&tags);
+	return(result);
+}
+
+int pq_catalog_entry_read(pq_catalog_entry_t *entry) {
+/*
+ * Fill in the fields of the entry from the header of its file, which is 
+ * read once. Nothing past the header is read, except for the curves of 
+ * TimeHarp histograms.
+ */
+	FILE *stream_in;
+	pq_header_t pq_header;
+	pu_header_t pu_header;
+	int result;
+	int i;
+
+	for ( i = PQ_CATALOG_HARDWARE; i < PQ_CATALOG_FIELDS; i++ ) {
+		free(entry->fields[i]);
+		entry->fields[i] = NULL;
+	}
+
+	stream_in = fopen(entry->fields[PQ_CATALOG_PATH], "rb");
+	if ( stream_in == NULL ) {
+		error("Could not open %s.\n", entry->fields[PQ_CATALOG_PATH]);
+		return(PQ_ERROR_IO);
+	}
+
+	result = pq_unified_header_read(stream_in, &pq_header, &pu_header);
+
+	if ( result == PQ_FORMAT_CLASSIC ) {
+		pq_catalog_set(entry, PQ_CATALOG_HARDWARE, pq_header.Ident, 
+				sizeof(pq_header.Ident));
+		pq_catalog_set(entry, PQ_CATALOG_VERSION, pq_header.FormatVersion,
+				sizeof(pq_header.FormatVersion));
+
+		if ( ! strcmp(pq_header.Ident, "PicoHarp 300") && 
+				! strcmp(pq_header.FormatVersion, "2.0") ) {
+			result = pq_catalog_ph_v20(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "HydraHarp") && 
+				! strcmp(pq_header.FormatVersion, "1.0") ) {
+			result = pq_catalog_hh_v10(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "HydraHarp") && 
+				! strcmp(pq_header.FormatVersion, "2.0") ) {
+			result = pq_catalog_hh_v20(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "TimeHarp 200") &&
+				! strcmp(pq_header.FormatVersion, "2.0") ) {
+			result = pq_catalog_th_v20(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "TimeHarp 200") &&
+				! strcmp(pq_header.FormatVersion, "3.0") ) {
+			result = pq_catalog_th_v30(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "TimeHarp 200") &&
+				! strcmp(pq_header.FormatVersion, "5.0") ) {
+			result = pq_catalog_th_v50(stream_in, entry);
+		} else if ( ! strcmp(pq_header.Ident, "TimeHarp 200") &&
+				! strcmp(pq_header.FormatVersion, "6.0") ) {
+			result = pq_catalog_th_v60(stream_in, entry);
+		} else {
+			result = PQ_ERROR_UNKNOWN_DATA;
+		}
+	} else if ( result == PQ_FORMAT_UNIFIED ) {
+		result = pq_catalog_unified(stream_in, &pu_header, entry);
+	} else {
+		result = PQ_ERROR_UNKNOWN_DATA;
+	}
+
+	fclose(stream_in);
+
+	if ( pq_check(result) ) {
+		return(PQ_ERROR_UNKNOWN_DATA);
+	} else {
+		return(PQ_SUCCESS);
+	}
+}
+
+static int pq_catalog_is_data(char const *filename) {
+	char const *extension = strrchr(filename, '.');
+	int i;
+
+	if ( extension == NULL || strchr(extension, '/') != NULL ) {
+		return(0);
+	}
+
+	for ( i = 0; pq_catalog_extensions[i] != NULL; i++ ) {
+		if ( ! strcasecmp(extension + 1, pq_catalog_extensions[i]) ) {
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+static int pq_catalog_scan(pq_catalog_t *found, char const *path, 
+		int named) {
+/*
+ * Add the data files at or below path to found, with their size and mtime.
+ * Symbolic links to directories are not followed.
+ */
+	int result = PQ_SUCCESS;
+	struct stat path_stat;
+	DIR *directory;
+	struct dirent *child;
+	char *child_path;
+	pq_catalog_entry_t *entry;
+	char number[32];
+
+	if ( stat(path, &path_stat) ) {
+		if ( named ) {
+			error("Could not stat %s.\n", path);
+			return(PQ_ERROR_IO);
+		}
+		return(PQ_SUCCESS);
+	}
+
+	if ( S_ISREG(path_stat.st_mode) ) {
+		if ( ! named && ! pq_catalog_is_data(path) ) {
+			return(PQ_SUCCESS);
+		}
+
+		entry = pq_catalog_add(found);
+		if ( entry == NULL ) {
+			return(PQ_ERROR_MEM);
+		}
+
+		entry->fields[PQ_CATALOG_PATH] = pq_catalog_strdup(path, 
+				strlen(path));
+		sprintf(number, "%lld", (long long)path_stat.st_size);
+		entry->fields[PQ_CATALOG_SIZE] = pq_catalog_strdup(number, 
+				strlen(number));
+		sprintf(number, "%lld", (long long)path_stat.st_mtime);
+		entry->fields[PQ_CATALOG_MTIME] = pq_catalog_strdup(number, 
+				strlen(number));
+		return(PQ_SUCCESS);
+	} else if ( ! S_ISDIR(path_stat.st_mode) || 
+			(! named && (lstat(path, &path_stat) || 
+			 S_ISLNK(path_stat.st_mode))) ) {
+		return(PQ_SUCCESS);
+	}
+
+	directory = opendir(path);
+	if ( directory == NULL ) {
+		warn("Could not open directory %s.\n", path);
+		return(PQ_SUCCESS);
+	}
+
+	while ( result == PQ_SUCCESS && (child = readdir(directory)) != NULL ) {
+		if ( ! strcmp(child->d_name, ".") || 
+				! strcmp(child->d_name, "..") ) {
+			continue;
+		}
+
+		child_path = (char *)malloc(strlen(path) + strlen(child->d_name) + 2);
+		if ( child_path == NULL ) {
+			error("Could not allocate path.\n");
+			result = PQ_ERROR_MEM;
+		} else {
+			sprintf(child_path, "%s%s%s", path, 
+					path[strlen(path)-1] == '/' ? "" : "/", child->d_name);
+			result = pq_catalog_scan(found, child_path, 0);
+			free(child_path);
+		}
+	}
+
+	closedir(directory);
+	return(result);
+}
+
+typedef struct {
+	pq_catalog_entry_t **pending;
+	size_t length;
+	size_t next;
+	int *results;
+#ifdef HAVE_PTHREAD_H
+	pthread_mutex_t lock;
+#endif
+} pq_catalog_work_t;
+
+static void *pq_catalog_work(void *arg) {
+/*
+ * Take the next file to read until none are left, so that threads stuck on
+ * a slow file do not hold up the rest.
+ */
+	pq_catalog_work_t *work = *(pq_catalog_work_t **)arg;
+	size_t i;
+
+	while ( 1 ) {
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_lock(&work->lock);
+#endif
+		i = work->next++;
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_unlock(&work->lock);
+#endif
+
+		if ( i >= work->length ) {
+			break;
+		}
+
+		work->results[i] = pq_catalog_entry_read(work->pending[i]);
+	}
+
+	return(NULL);
+}
+
+static int pq_catalog_under(char const *path, char * const *roots, 
+		int n_roots) {
+	size_t length;
+	int i;
+
+	for ( i = 0; i < n_roots; i++ ) {
+		length = strlen(roots[i]);
+		if ( ! strncmp(path, roots[i], length) && 
+				(path[length] == '\0' || path[length] == '/' || 
+				 roots[i][length-1] == '/') ) {
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+int pq_catalog_update(pq_catalog_t *catalog, char * const *paths, 
+		int n_paths, int threads) {
+/*
+ * Bring the entries below the paths up to date with the files: new and 
+ * changed files are read, and missing ones are dropped. Entries elsewhere
+ * are kept as they are.
+ */
+	int result = PQ_SUCCESS;
+	pq_catalog_t found;
+	pq_catalog_entry_t *entry, *old;
+	pq_catalog_work_t work;
+	pq_catalog_work_t **args = NULL;
+	size_t i, j, n_read = 0;
+	int k;
+
+	pq_catalog_init(&found);
+	memset(&work, 0, sizeof(work));
+
+	for ( k = 0; result == PQ_SUCCESS && k < n_paths; k++ ) {
+		result = pq_catalog_scan(&found, paths[k], 1);
+	}
+
+	/* Drop any file found twice, through overlapping paths. */
+	qsort(found.entries, found.length, sizeof(pq_catalog_entry_t),
+			pq_catalog_compare);
+	for ( i = 0, j = 0; i < found.length; i++ ) {
+		if ( j > 0 && ! pq_catalog_compare(&found.entries[j-1], 
+					&found.entries[i]) ) {
+			pq_catalog_entry_free(&found.entries[i]);
+		} else {
+			found.entries[j++] = found.entries[i];
+		}
+	}
+	found.length = j;
+
+	if ( result == PQ_SUCCESS ) {
+		work.pending = (pq_catalog_entry_t **)malloc(
+				(found.length + 1)*sizeof(pq_catalog_entry_t *));
+		work.results = (int *)calloc(found.length + 1, sizeof(int));
+		args = (pq_catalog_work_t **)malloc(
+				threads*sizeof(pq_catalog_work_t *));
+		if ( work.pending == NULL || work.results == NULL || args == NULL ) {
+			error("Could not allocate catalog work.\n");
+			result = PQ_ERROR_MEM;
+		}
+	}
+
+	/* Unchanged files keep their fields, the rest are read again. */
+	for ( i = 0; result == PQ_SUCCESS && i < found.length; i++ ) {
+		entry = &found.entries[i];
+		old = NULL;
+		if ( catalog->length > 0 ) {
+			old = (pq_catalog_entry_t *)bsearch(entry, catalog->entries, 
+					catalog->length, sizeof(pq_catalog_entry_t), 
+					pq_catalog_compare);
+		}
+
+		if ( old != NULL && 
+				! strcmp(old->fields[PQ_CATALOG_SIZE], 
+					entry->fields[PQ_CATALOG_SIZE]) &&
+				! strcmp(old->fields[PQ_CATALOG_MTIME], 
+					entry->fields[PQ_CATALOG_MTIME]) ) {
+			for ( k = PQ_CATALOG_HARDWARE; k < PQ_CATALOG_FIELDS; k++ ) {
+				entry->fields[k] = old->fields[k];
+				old->fields[k] = NULL;
+			}
+		} else {
+			work.pending[work.length++] = entry;
+		}
+	}
+
+	if ( result == PQ_SUCCESS && work.length > 0 ) {
+		if ( (size_t)threads > work.length ) {
+			threads = (int)work.length;
+		}
+		for ( k = 0; k < threads; k++ ) {
+			args[k] = &work;
+		}
+
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_init(&work.lock, NULL);
+#endif
+		result = pq_threads_run(pq_catalog_work, args, 
+				sizeof(pq_catalog_work_t *), threads);
+#ifdef HAVE_PTHREAD_H
+		pthread_mutex_destroy(&work.lock);
+#endif
+	}
+
+	if ( result == PQ_SUCCESS ) {
+		/* Files which could not be read are not data files after all. */
+		for ( i = 0; i < work.length; i++ ) {
+			if ( work.results[i] == PQ_SUCCESS ) {
+				n_read++;
+			} else {
+				warn("Could not read the header of %s, skipping it.\n",
+						work.pending[i]->fields[PQ_CATALOG_PATH]);
+				pq_catalog_entry_free(work.pending[i]);
+			}
+		}
+
+		debug("Read %zu of %zu files, %zu were unchanged.\n", 
+				n_read, found.length, found.length - work.length);
+
+		/* Keep the old entries which were not scanned, then swap in the 
+		 * ones which were.
+		 */
+		for ( i = 0; result == PQ_SUCCESS && i < catalog->length; i++ ) {
+			old = &catalog->entries[i];
+			if ( ! pq_catalog_under(old->fields[PQ_CATALOG_PATH], 
+						paths, n_paths) ) {
+				entry = pq_catalog_add(&found);
+				if ( entry == NULL ) {
+					result = PQ_ERROR_MEM;
+				} else {
+					*entry = *old;
+					memset(old, 0, sizeof(pq_catalog_entry_t));
+				}
+			}
+		}
+
+		for ( i = 0, j = 0; i < found.length; i++ ) {
+			if ( found.entries[i].fields[PQ_CATALOG_PATH] != NULL ) {
+				found.entries[j++] = found.entries[i];
+			}
+		}
+		found.length = j;
+
+		qsort(found.entries, found.length, sizeof(pq_catalog_entry_t),
+				pq_catalog_compare);
+	}
+
+	if ( result == PQ_SUCCESS ) {
+		pq_catalog_free(catalog);
+		*catalog = found;
+	} else {
+		pq_catalog_free(&found);
+	}
+
+	free(work.pending);
+	free(work.results);
+	free(args);
+	return(result);
+}
+
+static int pq_catalog_match(char const *value, char const *operator, 
+		char const *target) {
+	char *end_value, *end_target;
+	double value_number, target_number;
+	int compare;
+
+	value_number = strtod(value, &end_value);
+	target_number = strtod(target, &end_target);
+
+	if ( *value != '\0' && *end_value == '\0' && 
+			*target != '\0' && *end_target == '\0' ) {
+		compare = (value_number > target_number) - 
+				(value_number < target_number);
+	} else if ( operator[0] == '=' || operator[0] == '!' ) {
+		compare = strcasecmp(value, target);
+	} else {
+		compare = strcmp(value, target);
+	}
+
+	switch ( operator[0] ) {
+		case '=':
+			return(compare == 0);
+		case '!':
+			return(compare != 0);
+		case '<':
+			return(compare < 0);
+		default:
+			return(compare > 0);
+	}
+}
+
+static int pq_catalog_entry_match(pq_catalog_entry_t *entry, int field, 
+		char const *operator, char const *target) {
+/*
+ * Resolutions have one value per curve, any of which may match.
+ */
+	char *value = entry->fields[field] == NULL ? "" : entry->fields[field];
+	char *copy, *part, *save;
+	int match = 0;
+
+	if ( field != PQ_CATALOG_RESOLUTION ) {
+		return(pq_catalog_match(value, operator, target));
+	}
+
+	copy = strdup(value);
+	if ( copy == NULL ) {
+		return(0);
+	}
+
+	for ( part = strtok_r(copy, ",", &save); part != NULL && ! match; 
+			part = strtok_r(NULL, ",", &save) ) {
+		match = pq_catalog_match(part, operator, target);
+	}
+
+	free(copy);
+	return(match);
+}
+
+int pq_catalog_query(FILE *stream_out, pq_catalog_t *catalog, 
+		char * const *conditions, int n_conditions) {
+/*
+ * Print the entries which meet all of the conditions.
+ */
+	int *fields;
+	char const **operators;
+	char const **targets;
+	size_t i, length;
+	int j, k, match;
+
+	fields = (int *)malloc((n_conditions + 1)*sizeof(int));
+	operators = (char const **)malloc((n_conditions + 1)*sizeof(char *));
+	targets = (char const **)malloc((n_conditions + 1)*sizeof(char *));
+	if ( fields == NULL || operators == NULL || targets == NULL ) {
+		error("Could not allocate conditions.\n");
+		free(fields);
+		free(operators);
+		free(targets);
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( j = 0; j < n_conditions; j++ ) {
+		length = strcspn(conditions[j], "=!<>");
+		operators[j] = conditions[j] + length;
+		targets[j] = operators[j] + 1 + (operators[j][0] == '!');
+
+		fields[j] = -1;
+		for ( k = 0; k < PQ_CATALOG_FIELDS; k++ ) {
+			if ( strlen(pq_catalog_names[k]) == length &&
+					! strncmp(conditions[j], pq_catalog_names[k], length) ) {
+				fields[j] = k;
+			}
+		}
+
+		if ( fields[j] < 0 || operators[j][0] == '\0' || 
+				(operators[j][0] == '!' && operators[j][1] != '=') ) {
+			error("Could not understand condition %s.\n", conditions[j]);
+			free(fields);
+			free(operators);
+			free(targets);
+			return(PQ_ERROR_OPTIONS);
+		}
+	}
+
+	pq_catalog_names_print(stream_out);
+	for ( i = 0; i < catalog->length; i++ ) {
+		match = 1;
+		for ( j = 0; j < n_conditions && match; j++ ) {
+			match = pq_catalog_entry_match(&catalog->entries[i], fields[j],
+					operators[j], targets[j]);
+		}
+
+		if ( match ) {
+			pq_catalog_entry_print(stream_out, &catalog->entries[i]);
+		}
+	}
+
+	free(fields);
+	free(operators);
+	free(targets);
+	return(PQ_SUCCESS);
+}
+
+int pq_catalog_main(int argc, char *argv[]) {
+	int result = PQ_SUCCESS;
+	int c, option_index;
+	char *filename = PQ_CATALOG_DEFAULT;
+	int threads = 1;
+	char **conditions;
+	int n_conditions = 0;
+	pq_catalog_t catalog;
+
+	char *options_string = "hvf:T:w:";
+
+	static struct option long_options[] = {
+		{"help", no_argument, 0, 'h'},
+		{"verbose", no_argument, 0, 'v'},
+		{"catalog", required_argument, 0, 'f'},
+		{"threads", required_argument, 0, 'T'},
+		{"where", required_argument, 0, 'w'},
+		{0, 0, 0, 0}};
+
+#ifdef _SC_NPROCESSORS_ONLN
+	threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if ( threads < 1 ) {
+		threads = 1;
+	}
+#endif
+
+	conditions = (char **)malloc(argc*sizeof(char *));
+	if ( conditions == NULL ) {
+		error("Could not allocate conditions.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	while ( result == PQ_SUCCESS && 
+			(c = getopt_long(argc, argv, options_string,
+						long_options, &option_index)) != -1 ) {
+		switch (c) {
+			case 'h':
+				pq_catalog_usage();
+				result = PQ_USAGE;
+				break;
+			case 'v':
+				verbose = 1;
+				break;
+			case 'f':
+				filename = optarg;
+				break;
+			case 'T':
+				threads = strtoi32(optarg, NULL, 10);
+				if ( threads < 1 ) {
+					error("Number of threads must be at least 1.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'w':
+				conditions[n_conditions++] = optarg;
+				break;
+			case '?':
+			default:
+				pq_catalog_usage();
+				result = PQ_ERROR_OPTIONS;
+		}
+	}
+
+	if ( result != PQ_SUCCESS ) {
+		free(conditions);
+		return(result);
+	}
+
+	pq_catalog_init(&catalog);
+	result = pq_catalog_load(&catalog, filename);
+
+	/* Paths are catalogued as given, without any trailing slash. */
+	for ( c = optind; c < argc; c++ ) {
+		while ( strlen(argv[c]) > 1 && argv[c][strlen(argv[c])-1] == '/' ) {
+			argv[c][strlen(argv[c])-1] = '\0';
+		}
+	}
+
+	if ( result == PQ_SUCCESS && optind < argc ) {
+		result = pq_catalog_update(&catalog, argv + optind, argc - optind,
+				threads);
+		if ( result == PQ_SUCCESS ) {
+			result = pq_catalog_save(&catalog, filename);
+		}
+	}
+
+	if ( result == PQ_SUCCESS && (optind == argc || n_conditions > 0) ) {
+		result = pq_catalog_query(stdout, &catalog, conditions, 
+				n_conditions);
+	}
+
+	pq_catalog_free(&catalog);
+	free(conditions);
+	return(result);
+}
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CATALOG_H_
+#define CATALOG_H_
+
+#include <stdio.h>
+
+#include "types.h"
+
+/* A catalog holds one line per data file: its path, size, and modification
+ * time, then a few fields picked from its header, separated by tabs. The
+ * first line names the fields. Files are only read again when their size or
+ * modification time changes.
+ */
+#define PQ_CATALOG_MAGIC "# picoquant catalog 1"
+#define PQ_CATALOG_DEFAULT "picoquant.catalog"
+
+#define PQ_CATALOG_PATH 0
+#define PQ_CATALOG_SIZE 1
+#define PQ_CATALOG_MTIME 2
+#define PQ_CATALOG_HARDWARE 3
+#define PQ_CATALOG_VERSION 4
+#define PQ_CATALOG_MODE 5
+#define PQ_CATALOG_RESOLUTION 6
+#define PQ_CATALOG_SYNC_RATE 7
+#define PQ_CATALOG_RECORDS 8
+#define PQ_CATALOG_CURVES 9
+#define PQ_CATALOG_ACQUISITION_TIME 10
+#define PQ_CATALOG_FILE_TIME 11
+#define PQ_CATALOG_COMMENT 12
+#define PQ_CATALOG_FIELDS 13
+
+typedef struct {
+	char *fields[PQ_CATALOG_FIELDS];
+} pq_catalog_entry_t;
+
+typedef struct {
+	pq_catalog_entry_t *entries;
+	size_t length;
+	size_t capacity;
+} pq_catalog_t;
+
+void pq_catalog_init(pq_catalog_t *catalog);
+int pq_catalog_load(pq_catalog_t *catalog, char const *filename);
+int pq_catalog_save(pq_catalog_t *catalog, char const *filename);
+int pq_catalog_update(pq_catalog_t *catalog, char * const *paths, 
+		int n_paths, int threads);
+int pq_catalog_entry_read(pq_catalog_entry_t *entry);
+int pq_catalog_query(FILE *stream_out, pq_catalog_t *catalog, 
+		char * const *conditions, int n_conditions);
+void pq_catalog_free(pq_catalog_t *catalog);
+
+int pq_catalog_main(int argc, char *argv[]);
+
+#endif
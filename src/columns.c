@@ -0,0 +1,561 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "columns.h"
+#include "histogram.h"
+#include "intensity.h"
+#include "error.h"
+#include "t2.h"
+#include "t3.h"
+
+/* Longest LEB128 encoding of a 64-bit value. */
+#define PQ_VARINT_MAX 10
+
+static int pq_columns_write(pq_columns_t *columns, void const *data, 
+		size_t length) {
+/*
+ * Write the data, padded with zeros to a multiple of 8 bytes.
+ */
+	static char const padding[8] = {0};
+
+	fwrite(data, 1, length, columns->stream_out);
+	if ( length % 8 ) {
+		fwrite(padding, 1, 8 - length % 8, columns->stream_out);
+	}
+
+	return( ! ferror(columns->stream_out) ? PQ_SUCCESS : PQ_ERROR_IO );
+}
+
+static int pq_columns_fread(pq_columns_t *columns, void *data, 
+		size_t length) {
+/*
+ * Read the data, and skip the padding after it.
+ */
+	char padding[8];
+
+	if ( fread(data, 1, length, columns->stream_in) != length ||
+			( length % 8 && 
+			  fread(padding, 1, 8 - length % 8, columns->stream_in) != 
+			  8 - length % 8 ) ) {
+		error("Could not read column data.\n");
+		return(PQ_ERROR_IO);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_columns_alloc(pq_columns_t *columns) {
+	int i;
+
+	columns->capacity = PQ_COLUMNS_CHUNK;
+	columns->encoded_capacity = 0;
+
+	for ( i = 0; i < columns->n_columns; i++ ) {
+		columns->data[i] = (char *)malloc(
+				columns->capacity*columns->sizes[i]);
+		if ( columns->data[i] == NULL ) {
+			error("Could not allocate column %s.\n", columns->names[i]);
+			return(PQ_ERROR_MEM);
+		}
+
+		if ( columns->encodings[i] != PQ_COLUMNS_RAW ) {
+			columns->encoded_capacity = columns->capacity*PQ_VARINT_MAX;
+		}
+	}
+
+	if ( columns->encoded_capacity > 0 ) {
+		columns->encoded = (uint8_t *)malloc(columns->encoded_capacity);
+		if ( columns->encoded == NULL ) {
+			error("Could not allocate column encoding buffer.\n");
+			return(PQ_ERROR_MEM);
+		}
+	}
+
+	return(PQ_SUCCESS);
+}
+
+static void pq_columns_release(pq_columns_t *columns) {
+	int i;
+
+	for ( i = 0; i < PQ_COLUMNS_MAX; i++ ) {
+		free(columns->data[i]);
+		columns->data[i] = NULL;
+	}
+	free(columns->encoded);
+	columns->encoded = NULL;
+	columns->n_columns = 0;
+}
+
+uint64_t pq_columns_get(pq_columns_t *columns, int column, size_t index) {
+	if ( columns->sizes[column] == sizeof(uint32_t) ) {
+		return(((uint32_t *)columns->data[column])[index]);
+	} else {
+		return(((uint64_t *)columns->data[column])[index]);
+	}
+}
+
+void pq_columns_set(pq_columns_t *columns, int column, size_t index, 
+		uint64_t value) {
+	if ( columns->sizes[column] == sizeof(uint32_t) ) {
+		((uint32_t *)columns->data[column])[index] = (uint32_t)value;
+	} else {
+		((uint64_t *)columns->data[column])[index] = value;
+	}
+}
+
+static size_t pq_columns_encode(pq_columns_t *columns, int column) {
+/*
+ * Encode the column as LEB128 varints, seven bits to a byte with the high 
+ * bit marking that more bytes follow. Returns the number of bytes used.
+ */
+	uint8_t *out = columns->encoded;
+	uint64_t previous = 0;
+	uint64_t value, current;
+	int64_t delta;
+	size_t i;
+
+	for ( i = 0; i < columns->length; i++ ) {
+		current = pq_columns_get(columns, column, i);
+
+		if ( columns->encodings[column] == PQ_COLUMNS_DELTA ) {
+			delta = (int64_t)(current - previous);
+			value = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+			previous = current;
+		} else {
+			value = current;
+		}
+
+		while ( value >= 0x80 ) {
+			*out++ = (uint8_t)value | 0x80;
+			value >>= 7;
+		}
+		*out++ = (uint8_t)value;
+	}
+
+	return(out - columns->encoded);
+}
+
+static int pq_columns_decode(pq_columns_t *columns, int column, 
+		size_t length) {
+/*
+ * Decode a column encoded by pq_columns_encode.
+ */
+	uint8_t const *in = columns->encoded;
+	uint8_t const *end = columns->encoded + length;
+	uint64_t previous = 0;
+	uint64_t value;
+	int shift;
+	size_t i;
+
+	for ( i = 0; i < columns->length; i++ ) {
+		value = 0;
+		shift = 0;
+		do {
+			if ( in == end || shift > 63 ) {
+				error("Malformed varint in column %s.\n", 
+						columns->names[column]);
+				return(PQ_ERROR_UNKNOWN_DATA);
+			}
+			value |= (uint64_t)(*in & 0x7f) << shift;
+			shift += 7;
+		} while ( *in++ & 0x80 );
+
+		if ( columns->encodings[column] == PQ_COLUMNS_DELTA ) {
+			value = previous + ((value >> 1) ^ (-(value & 1)));
+			previous = value;
+		}
+
+		pq_columns_set(columns, column, i, value);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+int pq_columns_init(pq_columns_t *columns, FILE *stream_out, int mode,
+		int n_columns, char const * const *names, size_t const *sizes,
+		int const *encodings) {
+/*
+ * Allocate the columns and write the header describing them. If no encodings
+ * are given, the columns are written raw.
+ */
+	uint32_t header[4];
+	uint32_t description[2];
+	int result;
+	int i;
+
+	memset(columns, 0, sizeof(pq_columns_t));
+	columns->stream_out = stream_out;
+	columns->mode = mode;
+
+	if ( n_columns > PQ_COLUMNS_MAX ) {
+		error("Too many columns for output: %d\n", n_columns);
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	columns->n_columns = n_columns;
+	for ( i = 0; i < n_columns; i++ ) {
+		strncpy(columns->names[i], names[i], PQ_COLUMNS_NAME - 1);
+		columns->sizes[i] = sizes[i];
+		columns->encodings[i] = (encodings == NULL) ? 
+				PQ_COLUMNS_RAW : encodings[i];
+	}
+
+	result = pq_columns_alloc(columns);
+	if ( pq_check(result) ) {
+		pq_columns_release(columns);
+		return(result);
+	}
+
+	header[0] = PQ_COLUMNS_VERSION;
+	header[1] = mode;
+	header[2] = n_columns;
+	header[3] = 0;
+	fwrite(PQ_COLUMNS_MAGIC, 1, 8, stream_out);
+	fwrite(header, sizeof(uint32_t), 4, stream_out);
+
+	for ( i = 0; i < n_columns; i++ ) {
+		description[0] = columns->sizes[i];
+		description[1] = columns->encodings[i];
+		fwrite(columns->names[i], 1, PQ_COLUMNS_NAME, stream_out);
+		fwrite(description, sizeof(uint32_t), 2, stream_out);
+	}
+
+	return( ! ferror(stream_out) ? PQ_SUCCESS : PQ_ERROR_IO );
+}
+
+int pq_columns_flush(pq_columns_t *columns) {
+/*
+ * Write the records gathered so far as a chunk.
+ */
+	int result = PQ_SUCCESS;
+	uint64_t length = columns->length;
+	uint64_t encoded_length;
+	int i;
+
+	if ( length == 0 ) {
+		return(PQ_SUCCESS);
+	}
+
+	result = pq_columns_write(columns, &length, sizeof(length));
+	for ( i = 0; ! pq_check(result) && i < columns->n_columns; i++ ) {
+		if ( columns->encodings[i] == PQ_COLUMNS_RAW ) {
+			result = pq_columns_write(columns, columns->data[i], 
+					columns->length*columns->sizes[i]);
+		} else {
+			encoded_length = pq_columns_encode(columns, i);
+			result = pq_columns_write(columns, &encoded_length, 
+					sizeof(encoded_length));
+			if ( ! pq_check(result) ) {
+				result = pq_columns_write(columns, columns->encoded,
+						encoded_length);
+			}
+		}
+	}
+
+	columns->length = 0;
+
+	return(result);
+}
+
+int pq_columns_free(pq_columns_t *columns) {
+/*
+ * Write any remaining records and the end of the stream.
+ */
+	int result = PQ_SUCCESS;
+	uint64_t end = 0;
+
+	if ( columns->n_columns == 0 ) {
+		return(PQ_SUCCESS);
+	}
+
+	result = pq_columns_flush(columns);
+	if ( ! pq_check(result) ) {
+		result = pq_columns_write(columns, &end, sizeof(end));
+	}
+
+	pq_columns_release(columns);
+
+	return(result);
+}
+
+int pq_columns_finish(pq_columns_t *columns, int result) {
+/*
+ * End the columnar output of a stream which finished with the given result,
+ * and return the result of the stream as a whole.
+ */
+	int status = pq_columns_free(columns);
+
+	return( pq_check(result) ? result : status );
+}
+
+int pq_columns_open(pq_columns_t *columns, FILE *stream_in, 
+		uint32_t version, uint32_t mode) {
+/*
+ * Read the column descriptions, following the magic bytes, version, and mode
+ * which were already read to identify the stream.
+ */
+	uint32_t header[2];
+	uint32_t description[2];
+	int result;
+	int i;
+
+	memset(columns, 0, sizeof(pq_columns_t));
+	columns->stream_in = stream_in;
+	columns->mode = mode;
+
+	if ( version != PQ_COLUMNS_VERSION ) {
+		error("Columnar format version not supported: %"PRIu32"\n", version);
+		return(PQ_ERROR_VERSION);
+	}
+
+	if ( fread(header, sizeof(uint32_t), 2, stream_in) != 2 ) {
+		error("Could not read columnar header.\n");
+		return(PQ_ERROR_IO);
+	}
+
+	if ( header[0] > PQ_COLUMNS_MAX ) {
+		error("Too many columns: %"PRIu32"\n", header[0]);
+		return(PQ_ERROR_UNKNOWN_DATA);
+	}
+
+	for ( i = 0; i < (int)header[0]; i++ ) {
+		if ( fread(columns->names[i], 1, PQ_COLUMNS_NAME, stream_in) != 
+					PQ_COLUMNS_NAME ||
+				fread(description, sizeof(uint32_t), 2, stream_in) != 2 ) {
+			error("Could not read column description.\n");
+			return(PQ_ERROR_IO);
+		}
+
+		columns->names[i][PQ_COLUMNS_NAME-1] = '\0';
+		columns->sizes[i] = description[0];
+		columns->encodings[i] = description[1];
+
+		if ( ( columns->sizes[i] != sizeof(uint32_t) && 
+				columns->sizes[i] != sizeof(uint64_t) ) ||
+				columns->encodings[i] > PQ_COLUMNS_DELTA ) {
+			error("Column %s not supported (size %zu, encoding %d).\n",
+					columns->names[i], columns->sizes[i], 
+					columns->encodings[i]);
+			return(PQ_ERROR_UNKNOWN_DATA);
+		}
+	}
+	columns->n_columns = header[0];
+
+	result = pq_columns_alloc(columns);
+	if ( pq_check(result) ) {
+		pq_columns_release(columns);
+	}
+
+	return(result);
+}
+
+int pq_columns_read(pq_columns_t *columns) {
+/*
+ * Read the next chunk into the columns. Returns PQ_ERROR_EOF at the end of
+ * the stream.
+ */
+	int result = PQ_SUCCESS;
+	uint64_t length;
+	uint64_t encoded_length;
+	int i;
+
+	columns->length = 0;
+
+	result = pq_columns_fread(columns, &length, sizeof(length));
+	if ( pq_check(result) ) {
+		return(result);
+	} else if ( length == 0 ) {
+		return(PQ_ERROR_EOF);
+	} else if ( length > columns->capacity ) {
+		error("Column chunk too large: %"PRIu64" records.\n", length);
+		return(PQ_ERROR_UNKNOWN_DATA);
+	}
+
+	columns->length = length;
+
+	for ( i = 0; ! pq_check(result) && i < columns->n_columns; i++ ) {
+		if ( columns->encodings[i] == PQ_COLUMNS_RAW ) {
+			result = pq_columns_fread(columns, columns->data[i],
+					length*columns->sizes[i]);
+		} else {
+			result = pq_columns_fread(columns, &encoded_length, 
+					sizeof(encoded_length));
+			if ( ! pq_check(result) && 
+					encoded_length > columns->encoded_capacity ) {
+				error("Encoded column %s too large.\n", columns->names[i]);
+				result = PQ_ERROR_UNKNOWN_DATA;
+			}
+
+			if ( ! pq_check(result) ) {
+				result = pq_columns_fread(columns, columns->encoded, 
+						encoded_length);
+			}
+
+			if ( ! pq_check(result) ) {
+				result = pq_columns_decode(columns, i, encoded_length);
+			}
+		}
+	}
+
+	return(result);
+}
+
+void pq_columns_close(pq_columns_t *columns) {
+	pq_columns_release(columns);
+}
+
+void pq_columns_header_printf(FILE *stream_out, pq_columns_t *columns) {
+	static char const * const encodings[] = {"raw", "varint", "delta"};
+	int i;
+
+	fprintf(stream_out, "Ident = %s\n", PQ_COLUMNS_MAGIC);
+	fprintf(stream_out, "Version = %d\n", PQ_COLUMNS_VERSION);
+	fprintf(stream_out, "MeasurementMode = %s\n", 
+			columns->mode == PQ_RECORD_T2 ? "t2" : "t3");
+	fprintf(stream_out, "NumberOfColumns = %d\n", columns->n_columns);
+	for ( i = 0; i < columns->n_columns; i++ ) {
+		fprintf(stream_out, "Column[%d] = %s,%zu,%s\n", i, 
+				columns->names[i], columns->sizes[i], 
+				encodings[columns->encodings[i]]);
+	}
+}
+
+int pq_columns_dispatch(FILE *stream_in, FILE *stream_out,
+		pu_header_t *pu_header, options_t *options) {
+/*
+ * Read back a columnar stream written by picoquant, and output its records
+ * as for any other t2 or t3 data.
+ */
+	int result = PQ_SUCCESS;
+	int64_t record_count = 0;
+	uint32_t version, mode;
+	size_t i;
+	pq_columns_t columns;
+	pq_columns_t columns_out = {0};
+	t2_t t2;
+	t3_t t3;
+
+	memcpy(&version, &pu_header->Version[0], sizeof(uint32_t));
+	memcpy(&mode, &pu_header->Version[4], sizeof(uint32_t));
+
+	if ( mode != PQ_RECORD_T2 && mode != PQ_RECORD_T3 ) {
+		error("Columnar mode not recognized: %"PRIu32"\n", mode);
+		return(PQ_ERROR_MODE);
+	}
+
+	result = pq_columns_open(&columns, stream_in, version, mode);
+	if ( pq_check(result) ) {
+		return(result);
+	}
+
+	if ( columns.n_columns != (mode == PQ_RECORD_T2 ? 2 : 3) ) {
+		error("Expected %d columns, found %d.\n", 
+				mode == PQ_RECORD_T2 ? 2 : 3, columns.n_columns);
+		result = PQ_ERROR_UNKNOWN_DATA;
+	} else if ( options->print_mode ) {
+		fprintf(stream_out, "%s\n", mode == PQ_RECORD_T2 ? "t2" : "t3");
+	} else if ( options->print_header ) {
+		pq_columns_header_printf(stream_out, &columns);
+	} else if ( options->print_resolution ) {
+		error("Columnar data does not record the resolution.\n");
+		result = PQ_ERROR_OPTIONS;
+	} else if ( options->to_t2 && mode == PQ_RECORD_T3 ) {
+		error("Columnar data does not record the sync rate for t3 -> t2.\n");
+		result = PQ_ERROR_OPTIONS;
+	} else if ( pq_histogram_active(options) || 
+			pq_correlate_active(options) || 
+			pq_intensity_active(options) ) {
+		error("Histograms, correlations, and intensity traces are made "
+				"while decoding, not from columnar data.\n");
+		result = PQ_ERROR_OPTIONS;
+	} else {
+		if ( options->columnar && mode == PQ_RECORD_T2 ) {
+			result = pq_t2_columns_init(&columns_out, stream_out, 
+					options->compact);
+		} else if ( options->columnar ) {
+			result = pq_t3_columns_init(&columns_out, stream_out, 0,
+					options->compact);
+		}
+
+		while ( ! pq_check(result) && record_count < options->number ) {
+			result = pq_columns_read(&columns);
+
+			for ( i = 0; 
+					! pq_check(result) && 
+					i < columns.length && 
+					record_count < options->number; 
+					i++ ) {
+				record_count++;
+				pq_record_status_print("picoquant", record_count, options);
+
+				if ( mode == PQ_RECORD_T2 ) {
+					t2.channel = pq_columns_get(&columns, 0, i);
+					t2.time = pq_columns_get(&columns, 1, i);
+
+					if ( options->columnar ) {
+						result = pq_t2_columns_append(&columns_out, &t2);
+					} else if ( options->binary_out ) {
+						result = pq_t2_fwrite(stream_out, &t2);
+					} else {
+						result = pq_t2_fprintf(stream_out, &t2);
+					}
+				} else {
+					t3.channel = pq_columns_get(&columns, 0, i);
+					t3.pulse = pq_columns_get(&columns, 1, i);
+					t3.time = pq_columns_get(&columns, 2, i);
+
+					if ( options->columnar ) {
+						result = pq_t3_columns_append(&columns_out, &t3);
+					} else if ( options->binary_out ) {
+						result = pq_t3_fwrite(stream_out, &t3);
+					} else {
+						result = pq_t3_fprintf(stream_out, &t3);
+					}
+				}
+			}
+		}
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+		}
+
+		if ( options->columnar ) {
+			result = pq_columns_finish(&columns_out, result);
+		}
+	}
+
+	pq_columns_close(&columns);
+
+	return(result);
+}
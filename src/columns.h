@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef COLUMNS_H_
+#define COLUMNS_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "header.h"
+#include "options.h"
+
+/* Columnar binary output. Rather than writing each record as a packed 
+ * structure, the fields of the records are gathered into one array per field
+ * and written a chunk at a time, so that a reader can use each column 
+ * directly as an array (for example, mapping the times as uint64_t[]).
+ *
+ * The stream starts with a header:
+ *     char     magic[8]        "PQCOLUMN"
+ *     uint32_t version         PQ_COLUMNS_VERSION
+ *     uint32_t mode            PQ_RECORD_T2 or PQ_RECORD_T3
+ *     uint32_t n_columns
+ *     uint32_t reserved
+ * followed by a description of each column:
+ *     char     name[24]
+ *     uint32_t size            bytes per element
+ *     uint32_t encoding        PQ_COLUMNS_RAW, _VARINT, or _DELTA
+ * Each chunk then consists of a uint64_t number of records, followed by the
+ * columns in order. A raw column is the array itself. An encoded column is a
+ * uint64_t number of bytes followed by one LEB128 varint per record, either
+ * of the value itself or, for delta encoding, of the zigzag-encoded 
+ * difference from the previous value in the chunk (starting from 0), so that
+ * every chunk can be decoded on its own. Every column is padded to a multiple
+ * of 8 bytes, so all of them stay aligned. A chunk of zero records ends the 
+ * stream. All values are in the byte order of the machine which wrote them.
+ */
+#define PQ_COLUMNS_MAGIC "PQCOLUMN"
+#define PQ_COLUMNS_VERSION 1
+#define PQ_COLUMNS_MAX 4
+#define PQ_COLUMNS_NAME 24
+#define PQ_COLUMNS_CHUNK (1 << 20)
+
+#define PQ_COLUMNS_RAW 0
+#define PQ_COLUMNS_VARINT 1
+#define PQ_COLUMNS_DELTA 2
+
+typedef struct {
+	FILE *stream_in;
+	FILE *stream_out;
+	int mode;
+	int n_columns;
+	char names[PQ_COLUMNS_MAX][PQ_COLUMNS_NAME];
+	size_t sizes[PQ_COLUMNS_MAX];
+	int encodings[PQ_COLUMNS_MAX];
+	char *data[PQ_COLUMNS_MAX];
+	size_t length;
+	size_t capacity;
+
+	uint8_t *encoded;
+	size_t encoded_capacity;
+} pq_columns_t;
+
+int pq_columns_init(pq_columns_t *columns, FILE *stream_out, int mode,
+		int n_columns, char const * const *names, size_t const *sizes,
+		int const *encodings);
+int pq_columns_flush(pq_columns_t *columns);
+int pq_columns_free(pq_columns_t *columns);
+int pq_columns_finish(pq_columns_t *columns, int result);
+
+int pq_columns_open(pq_columns_t *columns, FILE *stream_in, 
+		uint32_t version, uint32_t mode);
+int pq_columns_read(pq_columns_t *columns);
+void pq_columns_close(pq_columns_t *columns);
+void pq_columns_header_printf(FILE *stream_out, pq_columns_t *columns);
+int pq_columns_dispatch(FILE *stream_in, FILE *stream_out,
+		pu_header_t *pu_header, options_t *options);
+
+uint64_t pq_columns_get(pq_columns_t *columns, int column, size_t index);
+void pq_columns_set(pq_columns_t *columns, int column, size_t index, 
+		uint64_t value);
+
+#endif
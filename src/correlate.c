@@ -0,0 +1,529 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "correlate.h"
+#include "error.h"
+#include "threads.h"
+
+int pq_correlate_active(options_t *options) {
+	return(options->correlate_max > 0);
+}
+
+static size_t pq_correlator_levels(pq_correlator_t *correlator, 
+		uint64_t *edges) {
+/*
+ * Walk the bins of the cascade, storing their left edges (and the right edge
+ * of the last) in edges if it is given, and return the number of bins. The 
+ * levels continue while the bins end at or before max, so that a last bin
+ * which would run past max is left out rather than counted in part.
+ */
+	size_t n_bins = 0;
+	size_t level;
+	uint64_t lag;
+	uint64_t right = 0;
+	int done = 0;
+
+	correlator->n_levels = 0;
+
+	for ( level = 0; level < 64 && ! done; level++ ) {
+		for ( lag = (level == 0 ? 0 : correlator->n_registers/2);
+				lag < correlator->n_registers; lag++ ) {
+			if ( lag >= correlator->max >> level ) {
+				done = 1;
+				break;
+			}
+
+			if ( edges != NULL ) {
+				edges[n_bins] = lag << level;
+			}
+			n_bins++;
+			right = (lag + 1) << level;
+			correlator->n_levels = level + 1;
+		}
+	}
+
+	if ( edges != NULL ) {
+		edges[n_bins] = right;
+	}
+
+	return(n_bins);
+}
+
+int pq_correlator_init(pq_correlator_t *correlator, options_t *options) {
+/*
+ * Set up the bin edges from the options. Linear edges divide max evenly, and 
+ * logarithmic ones are the bins of the multi-tau cascade, with n_registers 
+ * given by the number of bins, rounded up to a power of 2 so that the 
+ * registers wrap with a mask.
+ */
+	size_t i;
+
+	memset(correlator, 0, sizeof(pq_correlator_t));
+
+	correlator->max = options->correlate_max;
+	correlator->log_bins = options->correlate_log;
+
+	if ( correlator->log_bins ) {
+		correlator->n_registers = 2;
+		while ( correlator->n_registers < (options->correlate_bins > 0 ?
+					options->correlate_bins : PQ_CORRELATOR_REGISTERS) &&
+				correlator->n_registers < PQ_CORRELATOR_REGISTERS_MAX ) {
+			correlator->n_registers *= 2;
+		}
+		correlator->n_bins = pq_correlator_levels(correlator, NULL);
+
+		correlator->heads = (uint64_t *)calloc(correlator->n_levels, 
+				sizeof(uint64_t));
+		if ( correlator->heads == NULL ) {
+			error("Could not allocate correlation registers.\n");
+			return(PQ_ERROR_MEM);
+		}
+	} else {
+		correlator->n_bins = options->correlate_bins > 0 ?
+				options->correlate_bins : PQ_CORRELATOR_BINS;
+
+		if ( correlator->n_bins > correlator->max ) {
+			error("Cannot have more than one bin per ps of delay.\n");
+			return(PQ_ERROR_OPTIONS);
+		}
+	}
+
+	correlator->edges = (uint64_t *)malloc(
+			(correlator->n_bins + 1)*sizeof(uint64_t));
+	if ( correlator->edges == NULL ) {
+		error("Could not allocate correlation bins.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	if ( correlator->log_bins ) {
+		pq_correlator_levels(correlator, correlator->edges);
+	} else {
+		correlator->edges[0] = 0;
+		for ( i = 1; i <= correlator->n_bins; i++ ) {
+			correlator->edges[i] = (uint64_t)((float64_t)correlator->max*i/
+					correlator->n_bins);
+			if ( correlator->edges[i] <= correlator->edges[i-1] ) {
+				correlator->edges[i] = correlator->edges[i-1] + 1;
+			}
+		}
+		correlator->edges[correlator->n_bins] = correlator->max;
+	}
+
+	correlator->correlation.n_bins = correlator->n_bins;
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_correlation_channels(pq_correlation_t *correlation, 
+		size_t n_channels) {
+/*
+ * Make room for the channel pairs up to n_channels, keeping the counts.
+ */
+	uint64_t *counts;
+	size_t i;
+	size_t j;
+
+	if ( n_channels <= correlation->n_channels ) {
+		return(PQ_SUCCESS);
+	}
+
+	counts = (uint64_t *)calloc(n_channels*n_channels*correlation->n_bins, 
+			sizeof(uint64_t));
+	if ( counts == NULL ) {
+		error("Could not allocate correlation counts.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( i = 0; i < correlation->n_channels; i++ ) {
+		for ( j = 0; j < correlation->n_channels; j++ ) {
+			memcpy(&counts[(i*n_channels + j)*correlation->n_bins],
+					&correlation->counts[(i*correlation->n_channels + j)*
+						correlation->n_bins],
+					correlation->n_bins*sizeof(uint64_t));
+		}
+	}
+
+	free(correlation->counts);
+	correlation->counts = counts;
+	correlation->n_channels = n_channels;
+
+	return(PQ_SUCCESS);
+}
+
+static void pq_correlator_cascade(pq_correlator_t *correlator, 
+		uint32_t channel, uint64_t time) {
+/*
+ * Count the pairs ending on this photon at each level of the cascade, then 
+ * add it to the registers of its channel. The registers of a level are a 
+ * ring of the last n_registers bins, cleared as the bins move on.
+ */
+	pq_correlation_t *correlation = &correlator->correlation;
+	size_t n_registers = correlator->n_registers;
+	size_t mask = n_registers - 1;
+	size_t n_levels = correlator->n_levels;
+	size_t n_channels = correlation->n_channels;
+	size_t level;
+	size_t base = 0;
+	size_t first;
+	size_t end;
+	size_t c;
+	uint64_t bin;
+	uint64_t lag;
+	uint64_t step;
+	uint64_t *registers;
+	uint64_t *counts;
+
+	for ( level = 0; level < n_levels; level++ ) {
+		bin = time >> level;
+		first = (level == 0 ? 0 : n_registers/2);
+
+		if ( bin - correlator->heads[level] >= n_registers ) {
+			/* Every register has passed, so there is nothing to count. */
+			for ( c = 0; c < n_channels; c++ ) {
+				memset(&correlator->registers[
+						(c*n_levels + level)*n_registers], 0, 
+						n_registers*sizeof(uint64_t));
+			}
+		} else {
+			for ( step = correlator->heads[level] + 1; step <= bin; step++ ) {
+				for ( c = 0; c < n_channels; c++ ) {
+					correlator->registers[(c*n_levels + level)*n_registers + 
+							(step & mask)] = 0;
+				}
+			}
+
+			/* Level 0 counts all of its lags, later ones the upper half. */
+			end = correlator->n_bins - base + first;
+			if ( end > n_registers ) {
+				end = n_registers;
+			}
+			if ( end > bin + 1 ) {
+				end = bin + 1;
+			}
+
+			for ( c = 0; c < n_channels; c++ ) {
+				registers = &correlator->registers[
+						(c*n_levels + level)*n_registers];
+				counts = &correlation->counts[(c*n_channels + channel)*
+						correlation->n_bins + base - first];
+
+				for ( lag = first; lag < end; lag++ ) {
+					counts[lag] += registers[(bin - lag) & mask];
+				}
+			}
+		}
+
+		correlator->heads[level] = bin;
+		correlator->registers[(channel*n_levels + level)*n_registers + 
+				(bin & mask)]++;
+		base += n_registers - first;
+	}
+}
+
+int pq_correlator_append(pq_correlator_t *correlator, uint32_t channel,
+		uint64_t time) {
+	int result;
+	size_t n_channels = correlator->correlation.n_channels;
+	size_t n_slots = correlator->n_levels*correlator->n_registers;
+	uint64_t *photon_counts;
+	uint64_t *registers;
+	pq_correlator_photon_t *photons;
+	size_t level;
+
+	if ( channel >= n_channels ) {
+		result = pq_correlation_channels(&correlator->correlation, 
+				(size_t)channel + 1);
+		if ( pq_check(result) ) {
+			return(result);
+		}
+
+		photon_counts = (uint64_t *)realloc(correlator->photon_counts,
+				((size_t)channel + 1)*sizeof(uint64_t));
+		if ( photon_counts == NULL ) {
+			error("Could not allocate correlation counts.\n");
+			return(PQ_ERROR_MEM);
+		}
+
+		memset(&photon_counts[n_channels], 0, 
+				(channel + 1 - n_channels)*sizeof(uint64_t));
+		correlator->photon_counts = photon_counts;
+
+		if ( correlator->log_bins ) {
+			registers = (uint64_t *)realloc(correlator->registers,
+					((size_t)channel + 1)*n_slots*sizeof(uint64_t));
+			if ( registers == NULL ) {
+				error("Could not allocate correlation registers.\n");
+				return(PQ_ERROR_MEM);
+			}
+
+			memset(&registers[n_channels*n_slots], 0,
+					(channel + 1 - n_channels)*n_slots*sizeof(uint64_t));
+			correlator->registers = registers;
+		}
+	}
+
+	if ( correlator->log_bins ) {
+		/* The cascade needs no history. Photons out of order are skipped. */
+		if ( ! correlator->started ) {
+			for ( level = 0; level < correlator->n_levels; level++ ) {
+				correlator->heads[level] = time >> level;
+			}
+			correlator->first_time = time;
+			correlator->last_time = time;
+			correlator->started = 1;
+		}
+
+		correlator->photon_counts[channel]++;
+		if ( time >= correlator->last_time ) {
+			pq_correlator_cascade(correlator, channel, time);
+			correlator->last_time = time;
+		}
+
+		return(PQ_SUCCESS);
+	}
+
+	if ( correlator->length == correlator->size ) {
+		photons = (pq_correlator_photon_t *)realloc(correlator->photons, 
+				(correlator->size*2 + PQ_CORRELATOR_PHOTONS)*
+				sizeof(pq_correlator_photon_t));
+		if ( photons == NULL ) {
+			error("Could not allocate correlation photons.\n");
+			return(PQ_ERROR_MEM);
+		}
+
+		correlator->photons = photons;
+		correlator->size = correlator->size*2 + PQ_CORRELATOR_PHOTONS;
+	}
+
+	if ( ! correlator->started ) {
+		correlator->first_time = time;
+		correlator->started = 1;
+	}
+	correlator->last_time = time;
+	correlator->photon_counts[channel]++;
+
+	correlator->photons[correlator->length].channel = channel;
+	correlator->photons[correlator->length].time = time;
+	correlator->length++;
+
+	return(PQ_SUCCESS);
+}
+
+static size_t pq_correlator_bin(pq_correlator_t *correlator, uint64_t tau) {
+/*
+ * The linear bin of tau. Rounding can put tau one bin off the edges 
+ * computed in init.
+ */
+	size_t middle;
+
+	middle = (size_t)((float64_t)tau*correlator->n_bins/correlator->max);
+	if ( middle >= correlator->n_bins ) {
+		middle = correlator->n_bins - 1;
+	}
+
+	if ( tau < correlator->edges[middle] ) {
+		middle--;
+	} else if ( tau >= correlator->edges[middle+1] ) {
+		middle++;
+	}
+
+	return(middle);
+}
+
+void *pq_correlator_job(void *job) {
+/*
+ * Correlate the photons in [from, to) with all photons before them, within
+ * max. Photons out of order are skipped.
+ */
+	pq_correlator_job_t *correlator_job = (pq_correlator_job_t *)job;
+	pq_correlator_t *correlator = correlator_job->correlator;
+	pq_correlation_t *correlation = &correlator_job->correlation;
+	pq_correlator_photon_t *photons = correlator->photons;
+	size_t n_channels = correlation->n_channels;
+	size_t n_bins = correlation->n_bins;
+	size_t i;
+	size_t j;
+	uint64_t tau;
+
+	for ( i = correlator_job->from; i < correlator_job->to; i++ ) {
+		for ( j = i; j-- > 0; ) {
+			if ( photons[j].time > photons[i].time ) {
+				continue;
+			}
+
+			tau = photons[i].time - photons[j].time;
+			if ( tau >= correlator->max ) {
+				break;
+			}
+
+			correlation->counts[(photons[j].channel*n_channels + 
+					photons[i].channel)*n_bins + 
+					pq_correlator_bin(correlator, tau)]++;
+		}
+	}
+
+	correlator_job->result = PQ_SUCCESS;
+	return(NULL);
+}
+
+int pq_correlator_update(pq_correlator_t *correlator, 
+		pq_correlator_job_t *jobs, int n_jobs) {
+/*
+ * Correlate the photons appended since the last update, split between the
+ * jobs, and add their counts to the total. Then keep only the history 
+ * needed by the next update.
+ */
+	int result = PQ_SUCCESS;
+	int k;
+	size_t i;
+	size_t n_new = correlator->length - correlator->n_history;
+	size_t n_counts;
+	size_t keep;
+
+	if ( n_new == 0 ) {
+		return(PQ_SUCCESS);
+	}
+
+	for ( k = 0; ! pq_check(result) && k < n_jobs; k++ ) {
+		jobs[k].correlator = correlator;
+		jobs[k].from = correlator->n_history + n_new*k/n_jobs;
+		jobs[k].to = correlator->n_history + n_new*(k+1)/n_jobs;
+		jobs[k].correlation.n_bins = correlator->n_bins;
+		result = pq_correlation_channels(&jobs[k].correlation, 
+				correlator->correlation.n_channels);
+	}
+
+	if ( pq_check(result) ) {
+		return(result);
+	}
+
+	pq_threads_run(pq_correlator_job, jobs, sizeof(pq_correlator_job_t), 
+			n_jobs);
+
+	for ( k = 0; k < n_jobs; k++ ) {
+		n_counts = jobs[k].correlation.n_channels*
+				jobs[k].correlation.n_channels*jobs[k].correlation.n_bins;
+		for ( i = 0; i < n_counts; i++ ) {
+			correlator->correlation.counts[i] += 
+					jobs[k].correlation.counts[i];
+			jobs[k].correlation.counts[i] = 0;
+		}
+	}
+
+	keep = correlator->length;
+	while ( keep > 0 && correlator->last_time - 
+			correlator->photons[keep-1].time < correlator->max ) {
+		keep--;
+	}
+
+	memmove(correlator->photons, &correlator->photons[keep],
+			(correlator->length - keep)*sizeof(pq_correlator_photon_t));
+	correlator->length -= keep;
+	correlator->n_history = correlator->length;
+
+	return(PQ_SUCCESS);
+}
+
+void pq_correlator_print(FILE *stream_out, pq_correlator_t *correlator,
+		options_t *options) {
+/*
+ * Print the counts for each pair of channels which saw photons, along with
+ * g2: the counts normalized by those expected for uncorrelated photons at
+ * the average rates over the whole measurement.
+ */
+	pq_correlation_t *correlation = &correlator->correlation;
+	pq_correlation_bin_t bin;
+	size_t i;
+	size_t j;
+	size_t k;
+	float64_t duration = correlator->last_time - correlator->first_time;
+	float64_t expected;
+
+	for ( i = 0; i < correlation->n_channels; i++ ) {
+		for ( j = 0; j < correlation->n_channels; j++ ) {
+			if ( correlator->photon_counts[i] == 0 || 
+					correlator->photon_counts[j] == 0 ) {
+				continue;
+			}
+
+			bin.channel_0 = i;
+			bin.channel_1 = j;
+
+			for ( k = 0; k < correlation->n_bins; k++ ) {
+				bin.bin_left = correlator->edges[k];
+				bin.bin_right = correlator->edges[k+1];
+				bin.counts = correlation->counts[
+						(i*correlation->n_channels + j)*correlation->n_bins + k];
+
+				if ( duration > 0 ) {
+					expected = (float64_t)correlator->photon_counts[i]*
+							correlator->photon_counts[j]*
+							(bin.bin_right - bin.bin_left)/duration;
+					bin.g2 = bin.counts/expected;
+				} else {
+					bin.g2 = 0;
+				}
+
+				if ( options->binary_out ) {
+					fwrite(&bin, sizeof(bin), 1, stream_out);
+				} else {
+					fprintf(stream_out, "%"PRIu32",%"PRIu32",%"PRIu64",%"PRIu64
+							",%"PRIu64",%.6"PRIf64"\n", 
+							bin.channel_0, bin.channel_1, 
+							bin.bin_left, bin.bin_right, bin.counts, bin.g2);
+				}
+			}
+		}
+	}
+}
+
+void pq_correlator_free(pq_correlator_t *correlator) {
+	free(correlator->edges);
+	free(correlator->photons);
+	free(correlator->photon_counts);
+	free(correlator->registers);
+	free(correlator->heads);
+	free(correlator->correlation.counts);
+	memset(correlator, 0, sizeof(pq_correlator_t));
+}
+
+void pq_correlator_jobs_free(pq_correlator_job_t *jobs, int n_jobs) {
+	int k;
+
+	for ( k = 0; k < n_jobs; k++ ) {
+		free(jobs[k].correlation.counts);
+		jobs[k].correlation.counts = NULL;
+		jobs[k].correlation.n_channels = 0;
+	}
+}
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CORRELATE_H_
+#define CORRELATE_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "options.h"
+
+/* The correlator counts pairs of t2 photons, the first on channel_0 and the
+ * second on channel_1 a delay tau later, for 0 <= tau < max. 
+ *
+ * With linear bins, the pairs are counted exactly. Photons are appended to a
+ * buffer, which also holds the recent history: every photon within max of 
+ * the newest. Each update correlates the new photons against everything 
+ * before them and then drops the photons which have fallen out of the 
+ * window, so the memory used is bounded by the number of photons in max 
+ * (plus one block). The new photons can be split between several jobs, each
+ * counting into its own table.
+ *
+ * With logarithmic bins, the delays run over many decades, where the exact
+ * count costs the number of photons in max for every photon. Instead, a 
+ * multi-tau cascade keeps, for each channel, registers of the counts in the
+ * last n_registers bins of 1 ps, 2 ps, 4 ps, ... up to max. Each photon is 
+ * correlated with the registers of its level as it is appended: the first 
+ * level gives the delays of 0 to n_registers - 1 bins, and each later level 
+ * the upper half of its registers, twice as wide as the level before. A pair
+ * is counted at the difference of the bins of its photons, which is its 
+ * delay to within one bin width, at a cost of n_registers/2 per level.
+ */
+#define PQ_CORRELATOR_PHOTONS 8192
+#define PQ_CORRELATOR_BINS 100
+#define PQ_CORRELATOR_REGISTERS 16
+#define PQ_CORRELATOR_REGISTERS_MAX 65536
+
+typedef struct {
+	uint32_t channel;
+	uint64_t time;
+} pq_correlator_photon_t;
+
+typedef struct {
+	size_t n_channels;
+	size_t n_bins;
+	uint64_t *counts;
+} pq_correlation_t;
+
+typedef struct {
+	uint32_t channel_0;
+	uint32_t channel_1;
+	uint64_t bin_left;
+	uint64_t bin_right;
+	uint64_t counts;
+	float64_t g2;
+} pq_correlation_bin_t;
+
+typedef struct {
+	uint64_t max;
+	size_t n_bins;
+	int log_bins;
+	uint64_t *edges;
+
+	size_t n_registers;
+	size_t n_levels;
+	uint64_t *registers;
+	uint64_t *heads;
+
+	pq_correlator_photon_t *photons;
+	size_t n_history;
+	size_t length;
+	size_t size;
+
+	uint64_t *photon_counts;
+	uint64_t first_time;
+	uint64_t last_time;
+	int started;
+
+	pq_correlation_t correlation;
+} pq_correlator_t;
+
+typedef struct {
+	pq_correlator_t *correlator;
+	size_t from;
+	size_t to;
+	pq_correlation_t correlation;
+	int result;
+} pq_correlator_job_t;
+
+int pq_correlate_active(options_t *options);
+int pq_correlator_init(pq_correlator_t *correlator, options_t *options);
+int pq_correlator_append(pq_correlator_t *correlator, uint32_t channel,
+		uint64_t time);
+int pq_correlator_update(pq_correlator_t *correlator, 
+		pq_correlator_job_t *jobs, int n_jobs);
+void *pq_correlator_job(void *job);
+void pq_correlator_print(FILE *stream_out, pq_correlator_t *correlator,
+		options_t *options);
+void pq_correlator_free(pq_correlator_t *correlator);
+void pq_correlator_jobs_free(pq_correlator_job_t *jobs, int n_jobs);
+
+#endif
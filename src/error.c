@@ -87,14 +87,15 @@ int pq_check(int status) {
 
 void pq_record_status_print(char *name, uint64_t count, options_t *options) {
 	time_t rawtime;
-	struct tm *timeinfo;
+	struct tm timeinfo;
 	char fmttime[80];
 
 	if ( (options->print_every > 0) && 
 			( (count % options->print_every) == 0 ) ) {
+		/* Files of a batch print their status from several threads. */
 		time(&rawtime);
-		timeinfo = localtime(&rawtime);
-		strftime(fmttime, 80, "%Y.%m.%d %H.%M.%S", timeinfo);
+		localtime_r(&rawtime, &timeinfo);
+		strftime(fmttime, 80, "%Y.%m.%d %H.%M.%S", &timeinfo);
 		fprintf(stderr, "%s: (%s) Record %20"PRIu64"\n", fmttime, name, count);
 	}
 }
@@ -30,9 +30,11 @@
  */
 
 #include <stdio.h>
+#include <unistd.h>
 
 #include "error.h"
 #include "files.h"
+#include "format.h"
 
 int stream_open(FILE **stream, FILE *default_stream, 
 		char *filename, char *mode) {
@@ -59,8 +61,21 @@ void stream_close(FILE *stream, FILE *default_stream) {
 
 int streams_open(FILE **in_stream, char *in_filename,
 		FILE **out_stream, char *out_filename) {
-	return( stream_open(in_stream, stdin, in_filename, "r") +
-			stream_open(out_stream, stdout, out_filename, "w") );
+	/* The output is written through a large buffer, so that it is flushed
+	 * with a single write per buffer instead of one per page. A terminal
+	 * keeps its line buffering.
+	 */
+	static char out_buffer[PQ_FORMAT_STREAM_BUFFER];
+	int result;
+
+	result = stream_open(in_stream, stdin, in_filename, "r") +
+			stream_open(out_stream, stdout, out_filename, "w");
+
+	if ( *out_stream != NULL && ! isatty(fileno(*out_stream)) ) {
+		setvbuf(*out_stream, out_buffer, _IOFBF, sizeof(out_buffer));
+	}
+
+	return(result);
 }
 
 void streams_close(FILE *in_stream, FILE *out_stream) {
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+
+#include "format.h"
+
+static char const pq_format_pairs[] = 
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+static char *pq_format_digits(char *out, uint64_t value, int digits) {
+/*
+ * Write the decimal digits of the value, two at a time, padded with zeros to 
+ * at least the given number of digits. Returns the end of the output.
+ */
+	char scratch[24];
+	char *start = scratch + sizeof(scratch);
+	size_t length;
+	unsigned int pair;
+
+	while ( value >= 100 ) {
+		pair = (unsigned int)(value % 100) * 2;
+		value /= 100;
+		start -= 2;
+		memcpy(start, &pq_format_pairs[pair], 2);
+	}
+
+	if ( value >= 10 ) {
+		start -= 2;
+		memcpy(start, &pq_format_pairs[value*2], 2);
+	} else {
+		*--start = '0' + (char)value;
+	}
+
+	length = scratch + sizeof(scratch) - start;
+	for ( ; (int)length < digits && start > scratch; length++ ) {
+		*--start = '0';
+	}
+
+	memcpy(out, start, length);
+	return(out + length);
+}
+
+char *pq_format_u64(char *out, uint64_t value) {
+/*
+ * Equivalent to "%"PRIu64.
+ */
+	return(pq_format_digits(out, value, 1));
+}
+
+char *pq_format_i64(char *out, int64_t value, int digits) {
+/*
+ * Equivalent to "%.<digits>"PRId64.
+ */
+	if ( value < 0 ) {
+		*out++ = '-';
+		return(pq_format_digits(out, -(uint64_t)value, digits));
+	} else {
+		return(pq_format_digits(out, (uint64_t)value, digits));
+	}
+}
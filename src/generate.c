@@ -0,0 +1,570 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Writes synthetic t2 and t3 files in the formats picoquant reads, for
+ * benchmarking. The photons arrive as a Poisson process spread evenly over 
+ * the channels, and the headers are written with the library's own 
+ * *_header_fwrite, so the files are read back exactly as real ones would be.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "error.h"
+#include "header.h"
+#include "unified.h"
+#include "picoharp.h"
+#include "picoharp/ph_v20.h"
+#include "hydraharp.h"
+#include "hydraharp/hh_v20.h"
+#include "timeharp.h"
+#include "timeharp/th_v50.h"
+
+#define GENERATE_HT2 0
+#define GENERATE_HT3 1
+#define GENERATE_PT2 2
+#define GENERATE_PT3 3
+#define GENERATE_PTU_T2 4
+#define GENERATE_PTU_T3 5
+#define GENERATE_T3R 6
+
+typedef struct {
+	char *name;
+	int format;
+	int t3;
+	int max_channels;
+} generate_format_t;
+
+static generate_format_t const generate_formats[] = {
+		{"ht2", GENERATE_HT2, 0, 62},
+		{"ht3", GENERATE_HT3, 1, 62},
+		{"pt2", GENERATE_PT2, 0, 4},
+		{"pt3", GENERATE_PT3, 1, 4},
+		{"ptu-t2", GENERATE_PTU_T2, 0, 62},
+		{"ptu-t3", GENERATE_PTU_T3, 1, 62},
+		{"t3r", GENERATE_T3R, 1, 1},
+		{NULL, 0, 0, 0}};
+
+typedef struct {
+	generate_format_t const *format;
+	char *filename_out;
+	uint64_t records;
+	double count_rate;
+	double sync_rate;
+	int channels;
+	double overflows;
+	uint64_t seed;
+} generate_options_t;
+
+/* The random number state, and the records and overflow periods written. */
+typedef struct {
+	uint64_t state;
+	uint64_t written;
+	uint64_t wraps;
+	FILE *stream_out;
+} generate_t;
+
+static void generate_usage(void) {
+	fprintf(stderr,
+"Usage: picoquant_generate --format FORMAT --file-out FILE [options]\n"
+"\n"
+"Writes a synthetic t2 or t3 file for benchmarking picoquant.\n"
+"\n"
+"            -f, --format: ht2, ht3 (HydraHarp v2), pt2, pt3 (PicoHarp v2),\n"
+"                          ptu-t2, ptu-t3 (unified, HydraHarp v2 records),\n"
+"                          or t3r (TimeHarp v5).\n"
+"          -o, --file-out: The file to write.\n"
+"           -n, --records: Number of records, including overflows. By\n"
+"                          default, this is 10000000.\n"
+"        -r, --count-rate: Photons per second, over all channels. By\n"
+"                          default, this is 1e6.\n"
+"         -s, --sync-rate: Sync pulses per second, for t3 data. By \n"
+"                          default, this is 80e6.\n"
+"          -c, --channels: Number of detection channels. By default,\n"
+"                          this is 2 (1 for t3r).\n"
+"         -O, --overflows: Probability that the detector idles for a\n"
+"                          whole overflow period after a photon, which adds\n"
+"                          overflow records on top of those from the count\n"
+"                          rate. By default, this is 0.\n"
+"              -S, --seed: Seed for the random numbers.\n");
+}
+
+static uint64_t generate_random(generate_t *generate) {
+/* xorshift64*, which is plenty for spreading photons around. */
+	generate->state ^= generate->state >> 12;
+	generate->state ^= generate->state << 25;
+	generate->state ^= generate->state >> 27;
+	return(generate->state * UINT64_C(2685821657736338717));
+}
+
+static double generate_uniform(generate_t *generate) {
+/* In (0, 1], so that its log is finite. */
+	return(((generate_random(generate) >> 11) + 1) * (1.0/9007199254740992.0));
+}
+
+static double generate_exponential(generate_t *generate, double mean) {
+	return(-log(generate_uniform(generate))*mean);
+}
+
+static void generate_record(generate_t *generate, uint32_t record) {
+	fwrite(&record, sizeof(record), 1, generate->stream_out);
+	generate->written++;
+}
+
+static int generate_options_parse(int argc, char *argv[], 
+		generate_options_t *options) {
+	int c, option_index;
+	int i;
+	char *options_string = "hf:o:n:r:s:c:O:S:";
+	static struct option long_options[] = {
+		{"help", no_argument, 0, 'h'},
+		{"format", required_argument, 0, 'f'},
+		{"file-out", required_argument, 0, 'o'},
+		{"records", required_argument, 0, 'n'},
+		{"count-rate", required_argument, 0, 'r'},
+		{"sync-rate", required_argument, 0, 's'},
+		{"channels", required_argument, 0, 'c'},
+		{"overflows", required_argument, 0, 'O'},
+		{"seed", required_argument, 0, 'S'},
+		{0, 0, 0, 0}};
+
+	options->format = NULL;
+	options->filename_out = NULL;
+	options->records = 10000000;
+	options->count_rate = 1e6;
+	options->sync_rate = 80e6;
+	options->channels = 0;
+	options->overflows = 0;
+	options->seed = 1;
+
+	while ( (c = getopt_long(argc, argv, options_string,
+						long_options, &option_index)) != -1 ) {
+		switch (c) {
+			case 'f':
+				for ( i = 0; generate_formats[i].name != NULL; i++ ) {
+					if ( ! strcmp(optarg, generate_formats[i].name) ) {
+						options->format = &generate_formats[i];
+					}
+				}
+
+				if ( options->format == NULL ) {
+					error("Unknown format: %s\n", optarg);
+					return(PQ_ERROR_OPTIONS);
+				}
+				break;
+			case 'o':
+				options->filename_out = optarg;
+				break;
+			case 'n':
+				options->records = strtoull(optarg, NULL, 10);
+				break;
+			case 'r':
+				options->count_rate = strtod(optarg, NULL);
+				break;
+			case 's':
+				options->sync_rate = strtod(optarg, NULL);
+				break;
+			case 'c':
+				options->channels = strtol(optarg, NULL, 10);
+				break;
+			case 'O':
+				options->overflows = strtod(optarg, NULL);
+				break;
+			case 'S':
+				options->seed = strtoull(optarg, NULL, 10);
+				break;
+			case 'h':
+			default:
+				generate_usage();
+				return(PQ_USAGE);
+		}
+	}
+
+	if ( options->format == NULL || options->filename_out == NULL ) {
+		generate_usage();
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	if ( options->channels == 0 ) {
+		options->channels = options->format->max_channels < 2 ? 
+				options->format->max_channels : 2;
+	}
+
+	if ( options->channels < 1 || 
+			options->channels > options->format->max_channels ) {
+		error("Format %s supports 1 to %d channels.\n", 
+				options->format->name, options->format->max_channels);
+		return(PQ_ERROR_OPTIONS);
+	} else if ( options->count_rate <= 0 || options->sync_rate <= 0 ||
+			options->overflows < 0 || options->overflows >= 1 ) {
+		error("The rates must be positive, and the overflow probability "
+				"less than 1.\n");
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+/*
+ * Headers.
+ */
+static void generate_pq_header(FILE *stream_out, char const *ident, 
+		char const *version) {
+	pq_header_t pq_header;
+
+	memset(&pq_header, 0, sizeof(pq_header));
+	strncpy(pq_header.Ident, ident, sizeof(pq_header.Ident) - 1);
+	strncpy(pq_header.FormatVersion, version, sizeof(pq_header.FormatVersion) - 1);
+	pq_header_fwrite(stream_out, &pq_header);
+}
+
+static void generate_hh_header(FILE *stream_out, 
+		generate_options_t *options, double resolution) {
+	hh_v20_header_t hh_header;
+	hh_v20_tttr_header_t tttr_header;
+	hh_v20_input_channel_t input_channels[64];
+	int32_t input_rates[64];
+
+	memset(&hh_header, 0, sizeof(hh_header));
+	memset(&tttr_header, 0, sizeof(tttr_header));
+	memset(input_channels, 0, sizeof(input_channels));
+	memset(input_rates, 0, sizeof(input_rates));
+
+	generate_pq_header(stream_out, "HydraHarp", "2.0");
+	strncpy(hh_header.CreatorName, "picoquant", sizeof(hh_header.CreatorName) - 1);
+	strncpy(hh_header.Comment, "synthetic data", sizeof(hh_header.Comment) - 1);
+	hh_header.BitsPerRecord = 32;
+	hh_header.MeasurementMode = options->format->t3 ? HH_MODE_T3 : HH_MODE_T2;
+	hh_header.Resolution = resolution;
+	hh_header.BaseResolution = HH_BASE_RESOLUTION*1e12;
+	hh_header.InputChannelsPresent = options->channels;
+	hh_header.InpChan = input_channels;
+	hh_header.InputRate = input_rates;
+	hh_v20_header_fwrite(stream_out, &hh_header);
+
+	tttr_header.SyncRate = options->sync_rate;
+	tttr_header.NumRecords = options->records;
+	hh_v20_tttr_header_fwrite(stream_out, &tttr_header);
+}
+
+static void generate_ph_header(FILE *stream_out, 
+		generate_options_t *options, double resolution) {
+	ph_v20_header_t ph_header;
+	ph_v20_board_t board;
+	ph_v20_router_channel_t router_channels[4];
+	ph_v20_tttr_header_t tttr_header;
+
+	memset(&ph_header, 0, sizeof(ph_header));
+	memset(&board, 0, sizeof(board));
+	memset(router_channels, 0, sizeof(router_channels));
+	memset(&tttr_header, 0, sizeof(tttr_header));
+
+	generate_pq_header(stream_out, "PicoHarp 300", "2.0");
+	strncpy(ph_header.CreatorName, "picoquant", sizeof(ph_header.CreatorName) - 1);
+	strncpy(ph_header.Comment, "synthetic data", sizeof(ph_header.Comment) - 1);
+	ph_header.BitsPerRecord = 32;
+	ph_header.RoutingChannels = 4;
+	ph_header.NumberOfBoards = 1;
+	ph_header.MeasurementMode = options->format->t3 ? PH_MODE_T3 : PH_MODE_T2;
+	strncpy(board.HardwareIdent, "PicoHarp 300", sizeof(board.HardwareIdent) - 1);
+	board.Resolution = resolution*1e-3;
+	board.RtCh = router_channels;
+	ph_header.Brd = &board;
+	ph_v20_header_fwrite(stream_out, &ph_header);
+
+	tttr_header.InpRate0 = options->sync_rate;
+	tttr_header.NumRecords = options->records;
+	ph_v20_tttr_header_fwrite(stream_out, &tttr_header);
+}
+
+static void generate_th_header(FILE *stream_out,
+		generate_options_t *options, double resolution) {
+	th_v50_header_t th_header;
+	th_v50_board_t board;
+	th_v50_tttr_header_t tttr_header;
+
+	memset(&th_header, 0, sizeof(th_header));
+	memset(&board, 0, sizeof(board));
+	memset(&tttr_header, 0, sizeof(tttr_header));
+
+	generate_pq_header(stream_out, "TimeHarp 200", "5.0");
+	strncpy(th_header.Comment, "synthetic data", sizeof(th_header.Comment) - 1);
+	th_header.NumberOfBoards = 1;
+	th_header.MeasurementMode = TH_MODE_TTTR;
+	board.Resolution = resolution*1e-3;
+	th_header.Brd = &board;
+	th_v50_header_fwrite(stream_out, &th_header);
+
+	tttr_header.SyncRate = options->sync_rate;
+	tttr_header.NumberOfRecords = options->records;
+	th_v50_tttr_header_fwrite(stream_out, &tttr_header);
+}
+
+static void generate_pu_tag(FILE *stream_out, char const *ident, 
+		uint32_t type, int64_t value) {
+	pu_tag_t tag;
+
+	memset(&tag, 0, sizeof(tag));
+	strncpy(tag.ident, ident, sizeof(tag.ident) - 1);
+	tag.index = -1;
+	tag.type = type;
+	tag.value = value;
+	fwrite(&tag, sizeof(tag), 1, stream_out);
+}
+
+static void generate_pu_header(FILE *stream_out,
+		generate_options_t *options, double resolution) {
+	float64_t resolution_seconds = resolution*1e-12;
+	int64_t value;
+
+	fwrite("PQTTTR\0\0" "1.0.00\0\0", sizeof(char), 16, stream_out);
+	generate_pu_tag(stream_out, "TTResultFormat_TTTRRecType", PU_TAG_Int8,
+			options->format->t3 ? PU_RECORD_HH_V2_T3 : PU_RECORD_HH_V2_T2);
+	generate_pu_tag(stream_out, "HW_InpChannels", PU_TAG_Int8, 
+			options->channels);
+	memcpy(&value, &resolution_seconds, sizeof(value));
+	generate_pu_tag(stream_out, "MeasDesc_Resolution", PU_TAG_Float8, value);
+	generate_pu_tag(stream_out, "TTResult_SyncRate", PU_TAG_Int8, 
+			options->sync_rate);
+	if ( options->format->t3 ) {
+		/* The sync period, which is not rounded to the nearest Hz. */
+		resolution_seconds = 1/options->sync_rate;
+		memcpy(&value, &resolution_seconds, sizeof(value));
+		generate_pu_tag(stream_out, "MeasDesc_GlobalResolution", 
+				PU_TAG_Float8, value);
+	}
+	generate_pu_tag(stream_out, "TTResult_NumberOfRecords", PU_TAG_Int8, 
+			options->records);
+	generate_pu_tag(stream_out, "Header_End", PU_TAG_Empty8, 0);
+}
+
+/*
+ * Records.
+ */
+static void generate_overflows(generate_t *generate, 
+		generate_options_t *options, uint64_t wraps) {
+/*
+ * Account for the overflow periods passed since the last record. HydraHarp 
+ * v2 records can carry several at once, the others take one record each.
+ */
+	uint64_t n;
+
+	while ( generate->wraps < wraps && generate->written < options->records ) {
+		n = wraps - generate->wraps;
+
+		switch ( options->format->format ) {
+			case GENERATE_HT2:
+			case GENERATE_PTU_T2:
+				n = n < 0x1ffffff ? n : 0x1ffffff;
+				generate_record(generate, 
+						(1u << 31) | (63u << 25) | (uint32_t)n);
+				break;
+			case GENERATE_HT3:
+			case GENERATE_PTU_T3:
+				n = n < 0x3ff ? n : 0x3ff;
+				generate_record(generate, 
+						(1u << 31) | (63u << 25) | (uint32_t)n);
+				break;
+			case GENERATE_PT2:
+				n = 1;
+				generate_record(generate, 15u << 28);
+				break;
+			case GENERATE_PT3:
+				n = 1;
+				generate_record(generate, 15u << 28);
+				break;
+			case GENERATE_T3R:
+				n = 1;
+				generate_record(generate, 0x800u << 16);
+				break;
+		}
+
+		generate->wraps += n;
+	}
+}
+
+static void generate_t2(generate_t *generate, generate_options_t *options) {
+/*
+ * Times are counted in units of the resolution of the records.
+ */
+	double unit;
+	double time = 0;
+	uint64_t wrap;
+	uint64_t ticks;
+	uint32_t channel;
+
+	if ( options->format->format == GENERATE_PT2 ) {
+		unit = PH_V20_BASE_RESOLUTION;
+		wrap = PH_T2_OVERFLOW;
+	} else {
+		unit = HH_BASE_RESOLUTION;
+		wrap = HH_T2_OVERFLOW;
+	}
+
+	while ( generate->written < options->records ) {
+		time += generate_exponential(generate, 1/(options->count_rate*unit));
+		if ( generate_uniform(generate) <= options->overflows ) {
+			time += wrap;
+		}
+
+		ticks = time;
+		generate_overflows(generate, options, ticks / wrap);
+		if ( generate->written == options->records ) {
+			break;
+		}
+
+		channel = generate_random(generate) % options->channels;
+		if ( options->format->format == GENERATE_PT2 ) {
+			generate_record(generate, (channel << 28) | (ticks % wrap));
+		} else {
+			generate_record(generate, (channel << 25) | (ticks % wrap));
+		}
+	}
+}
+
+static void generate_t3(generate_t *generate, generate_options_t *options, 
+		double resolution) {
+/*
+ * The photons arrive at random pulses, with arrival times after the pulse 
+ * decaying exponentially over a quarter of the sync period.
+ */
+	double pulse = 0;
+	double lifetime = 0.25e12/(options->sync_rate*resolution);
+	uint64_t wrap;
+	uint64_t sync;
+	uint32_t dtime_max;
+	uint32_t dtime;
+	uint32_t channel;
+
+	if ( options->format->format == GENERATE_HT3 || 
+			options->format->format == GENERATE_PTU_T3 ) {
+		wrap = HH_T3_OVERFLOW;
+		dtime_max = (1 << 15) - 1;
+	} else {
+		wrap = PH_T3_OVERFLOW;
+		dtime_max = (1 << 12) - 1;
+	}
+
+	while ( generate->written < options->records ) {
+		pulse += generate_exponential(generate, 
+				options->sync_rate/options->count_rate);
+		if ( generate_uniform(generate) <= options->overflows ) {
+			pulse += wrap;
+		}
+
+		sync = pulse;
+		generate_overflows(generate, options, sync / wrap);
+		if ( generate->written == options->records ) {
+			break;
+		}
+
+		channel = generate_random(generate) % options->channels;
+		dtime = generate_exponential(generate, lifetime);
+		dtime = dtime < dtime_max ? dtime : dtime_max;
+
+		switch ( options->format->format ) {
+			case GENERATE_HT3:
+			case GENERATE_PTU_T3:
+				generate_record(generate, (channel << 25) | (dtime << 10) | 
+						(uint32_t)(sync % wrap));
+				break;
+			case GENERATE_PT3:
+				generate_record(generate, (channel << 28) | 
+						(dtime << 16) | (uint32_t)(sync % wrap));
+				break;
+			case GENERATE_T3R:
+				generate_record(generate, (1u << 30) | (dtime << 16) | 
+						(uint32_t)(sync % wrap));
+				break;
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	generate_options_t options;
+	generate_t generate;
+	double resolution;
+	int result;
+
+	result = generate_options_parse(argc, argv, &options);
+	if ( result != PQ_SUCCESS ) {
+		return(pq_check(result));
+	}
+
+	generate.state = options.seed*UINT64_C(0x9e3779b97f4a7c15) | 1;
+	generate.written = 0;
+	generate.wraps = 0;
+	generate.stream_out = fopen(options.filename_out, "wb");
+
+	if ( generate.stream_out == NULL ) {
+		error("Could not open %s for writing.\n", options.filename_out);
+		return(pq_check(PQ_ERROR_IO));
+	}
+
+	/* Resolution of the t3 arrival times, in ps. */
+	switch ( options.format->format ) {
+		case GENERATE_HT2:
+		case GENERATE_HT3:
+			resolution = 8;
+			generate_hh_header(generate.stream_out, &options, resolution);
+			break;
+		case GENERATE_PT2:
+		case GENERATE_PT3:
+			resolution = 16;
+			generate_ph_header(generate.stream_out, &options, resolution);
+			break;
+		case GENERATE_PTU_T2:
+		case GENERATE_PTU_T3:
+			resolution = 8;
+			generate_pu_header(generate.stream_out, &options, resolution);
+			break;
+		default:
+			resolution = 100;
+			generate_th_header(generate.stream_out, &options, resolution);
+			break;
+	}
+
+	if ( options.format->t3 ) {
+		generate_t3(&generate, &options, resolution);
+	} else {
+		generate_t2(&generate, &options);
+	}
+
+	if ( fclose(generate.stream_out) != 0 ) {
+		error("Could not write %s.\n", options.filename_out);
+		return(pq_check(PQ_ERROR_IO));
+	}
+
+	return(0);
+}
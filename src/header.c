@@ -32,6 +32,7 @@
 #include "header.h"
 
 #include "error.h"
+#include "columns.h"
 
 #include <string.h>
 
@@ -49,6 +50,7 @@ int pq_unified_header_read(FILE *stream_in, pq_header_t *pq_header,
 
 	if ( result != sizeof(magic) ) {
 		error("Could not read magic bytes\n");
+		result = PQ_ERROR_IO;
 	} else {
 		if ( ! strncmp(magic, "PQTTTR", 6) || ! strncmp(magic, "PQHIST", 6) ) {
 			memcpy(&(pu_header->Ident[0]), magic, 8*sizeof(char));
@@ -57,6 +59,14 @@ int pq_unified_header_read(FILE *stream_in, pq_header_t *pq_header,
 			debug("Version: %.*s\n", 8, pu_header->Version);
 
 			result = PQ_FORMAT_UNIFIED;
+		} else if ( ! strncmp(magic, PQ_COLUMNS_MAGIC, 8) ) {
+			/* Columnar output of picoquant itself: the version and mode
+			 * follow the magic bytes.
+			 */
+			memcpy(&(pu_header->Ident[0]), magic, 8*sizeof(char));
+			memcpy(&(pu_header->Version[0]), &(magic[8]), 8*sizeof(char));
+
+			result = PQ_FORMAT_COLUMNS;
 		} else {
 			strncpy(&(pq_header->Ident[0]), magic, 16);
 
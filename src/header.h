@@ -32,10 +32,10 @@
 #ifndef HEADER_H_
 #define HEADER_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
+#pragma pack(push, 2)
+
 typedef struct {
 	char Ident[8];
 	char Version[8];
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "histogram.h"
+#include "error.h"
+#include "interactive.h"
+
+int pq_histogram_active(options_t *options) {
+	return(options->histogram_width > 0);
+}
+
+int pq_histogram_init(pq_histogram_t *histogram, options_t *options, 
+		tttr_t *tttr) {
+/*
+ * Set up the bins from the options. Without an explicit range, the histogram
+ * covers one sync period.
+ */
+	memset(histogram, 0, sizeof(pq_histogram_t));
+
+	histogram->width = options->histogram_width;
+	histogram->start = options->histogram_start;
+	histogram->stop = options->histogram_stop;
+
+	if ( histogram->stop == 0 ) {
+		if ( tttr->sync_rate == 0 ) {
+			error("Sync rate is not known, so the histogram range must "
+					"be given.\n");
+			return(PQ_ERROR_OPTIONS);
+		}
+
+		histogram->stop = (uint64_t)(1e12/tttr->sync_rate + 0.5);
+	}
+
+	if ( histogram->stop <= histogram->start ) {
+		error("Histogram range is empty: %"PRIu64" to %"PRIu64".\n", 
+				histogram->start, histogram->stop);
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	histogram->n_bins = (histogram->stop - histogram->start + 
+			histogram->width - 1)/histogram->width;
+	histogram->stop = histogram->start + histogram->n_bins*histogram->width;
+
+	debug("Histogram of %zu bins from %"PRIu64" to %"PRIu64".\n", 
+			histogram->n_bins, histogram->start, histogram->stop);
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_histogram_channels(pq_histogram_t *histogram, 
+		size_t n_channels) {
+/*
+ * Make room for the counts of channels up to n_channels.
+ */
+	uint32_t **counts;
+	size_t i;
+
+	counts = (uint32_t **)realloc(histogram->counts, 
+			n_channels*sizeof(uint32_t *));
+	if ( counts == NULL ) {
+		error("Could not allocate histogram channels.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	histogram->counts = counts;
+	for ( i = histogram->n_channels; i < n_channels; i++ ) {
+		histogram->counts[i] = NULL;
+	}
+	histogram->n_channels = n_channels;
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_histogram_channel(pq_histogram_t *histogram, 
+		uint32_t channel) {
+	int result = PQ_SUCCESS;
+
+	if ( channel >= histogram->n_channels ) {
+		result = pq_histogram_channels(histogram, (size_t)channel + 1);
+	}
+
+	if ( ! pq_check(result) && histogram->counts[channel] == NULL ) {
+		histogram->counts[channel] = (uint32_t *)calloc(histogram->n_bins, 
+				sizeof(uint32_t));
+		if ( histogram->counts[channel] == NULL ) {
+			error("Could not allocate histogram for channel %"PRIu32".\n", 
+					channel);
+			result = PQ_ERROR_MEM;
+		}
+	}
+
+	return(result);
+}
+
+int pq_histogram_add(pq_histogram_t *histogram, uint32_t channel, 
+		uint64_t time) {
+	int result;
+
+	if ( channel >= histogram->n_channels || 
+			histogram->counts[channel] == NULL ) {
+		result = pq_histogram_channel(histogram, channel);
+		if ( pq_check(result) ) {
+			return(result);
+		}
+	}
+
+	if ( time >= histogram->start && time < histogram->stop ) {
+		histogram->counts[channel][(time - histogram->start)/
+				histogram->width]++;
+	}
+
+	return(PQ_SUCCESS);
+}
+
+int pq_histogram_merge(pq_histogram_t *histogram, pq_histogram_t *other) {
+/*
+ * Add the counts of the other histogram, which has the same bins.
+ */
+	int result = PQ_SUCCESS;
+	size_t i;
+	size_t j;
+
+	for ( i = 0; ! pq_check(result) && i < other->n_channels; i++ ) {
+		if ( other->counts[i] == NULL ) {
+			continue;
+		}
+
+		result = pq_histogram_channel(histogram, i);
+		for ( j = 0; ! pq_check(result) && j < histogram->n_bins; j++ ) {
+			histogram->counts[i][j] += other->counts[i][j];
+		}
+	}
+
+	return(result);
+}
+
+void pq_histogram_print(FILE *stream_out, pq_histogram_t *histogram, 
+		options_t *options) {
+/*
+ * Write the histograms as interactive bins, with the channel as the curve.
+ */
+	size_t i;
+	size_t j;
+	pq_interactive_bin_t bin;
+	pq_interactive_bin_print_t print;
+
+	if ( options->binary_out ) {
+		print = pq_interactive_bin_fwrite;
+	} else {
+		print = pq_interactive_bin_printf;
+	}
+
+	for ( i = 0; i < histogram->n_channels; i++ ) {
+		if ( histogram->counts[i] == NULL ) {
+			continue;
+		}
+
+		bin.curve = i;
+		for ( j = 0; j < histogram->n_bins; j++ ) {
+			bin.bin_left = histogram->start + j*histogram->width;
+			bin.bin_right = bin.bin_left + histogram->width;
+			bin.counts = histogram->counts[i][j];
+			print(stream_out, &bin);
+		}
+	}
+}
+
+void pq_histogram_free(pq_histogram_t *histogram) {
+	size_t i;
+
+	for ( i = 0; i < histogram->n_channels; i++ ) {
+		free(histogram->counts[i]);
+	}
+
+	free(histogram->counts);
+	histogram->counts = NULL;
+	histogram->n_channels = 0;
+}
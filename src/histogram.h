@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef HISTOGRAM_H_
+#define HISTOGRAM_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "options.h"
+#include "tttr.h"
+
+/* Lifetime histograms of t3 data, one per channel, over the arrival times 
+ * [start, stop) in bins of width ps. Channels are added as they are seen. 
+ * Each thread fills its own histogram, and these are merged at the end.
+ */
+typedef struct {
+	uint64_t start;
+	uint64_t stop;
+	uint64_t width;
+	size_t n_bins;
+	size_t n_channels;
+	uint32_t **counts;
+} pq_histogram_t;
+
+int pq_histogram_active(options_t *options);
+int pq_histogram_init(pq_histogram_t *histogram, options_t *options, 
+		tttr_t *tttr);
+int pq_histogram_add(pq_histogram_t *histogram, uint32_t channel, 
+		uint64_t time);
+int pq_histogram_merge(pq_histogram_t *histogram, pq_histogram_t *other);
+void pq_histogram_print(FILE *stream_out, pq_histogram_t *histogram, 
+		options_t *options);
+void pq_histogram_free(pq_histogram_t *histogram);
+
+#endif
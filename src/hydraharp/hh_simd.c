@@ -0,0 +1,239 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "hh_simd.h"
+
+#include "../simd.h"
+#include "../error.h"
+
+#ifdef PQ_SIMD_X86
+/*
+ * Each kernel unpacks a vector of raw t2 records at once. Overflow records
+ * contribute to the origin of every record after them in the vector, so the
+ * origin of each lane is the running origin plus a prefix sum of the 
+ * overflow counts up to that lane. Special records are resolved with masks
+ * rather than branches, and the type of each record is reported alongside
+ * its decoded value, just as for the scalar decoder.
+ */
+__attribute__((target("avx2")))
+static size_t hh_t2_decode_avx2(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types, 
+		int time_shift, int overflow_counted) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[8];
+	uint64_t times[8];
+
+	__m256i const time_mask = _mm256_set1_epi32(0x01ffffff);
+	__m256i const channel_mask = _mm256_set1_epi32(0x3f);
+	__m256i const overflow_ident = _mm256_set1_epi32(0x7f);
+	__m256i const sync_ident = _mm256_set1_epi32(0x40);
+	__m256i const sync_channel = _mm256_set1_epi32(tttr->sync_channel);
+	__m256i const type_t2 = _mm256_set1_epi32(PQ_RECORD_T2);
+	__m256i const type_marker = _mm256_set1_epi32(PQ_RECORD_MARKER);
+	__m256i const type_overflow = _mm256_set1_epi32(PQ_RECORD_OVERFLOW);
+	__m256i const increment = _mm256_set1_epi64x(tttr->overflow_increment);
+	__m128i const shift = _mm_cvtsi32_si128(time_shift);
+
+	for ( i = 0; i + 8 <= n_records; i += 8 ) {
+		__m256i record, ident, time, channel, special, overflow, sync, marker;
+		__m256i count, type, origin_lo, origin_hi, time_lo, time_hi;
+		__m256i marker_lo, marker_hi, channel_lo, channel_hi;
+		uint32_t total;
+
+		record = _mm256_loadu_si256((__m256i const *)&records[i]);
+		ident = _mm256_srli_epi32(record, 25);
+		time = _mm256_srl_epi32(_mm256_and_si256(record, time_mask), shift);
+		channel = _mm256_and_si256(ident, channel_mask);
+		special = _mm256_srai_epi32(record, 31);
+		overflow = _mm256_cmpeq_epi32(ident, overflow_ident);
+		sync = _mm256_cmpeq_epi32(ident, sync_ident);
+		marker = _mm256_andnot_si256(_mm256_or_si256(overflow, sync), special);
+
+		if ( overflow_counted ) {
+			count = _mm256_and_si256(overflow, time);
+		} else {
+			count = _mm256_srli_epi32(overflow, 31);
+		}
+		count = pq_simd_prefix_sum_avx2(count);
+		total = (uint32_t)_mm256_extract_epi32(count, 7);
+
+		origin_lo = _mm256_add_epi64(_mm256_set1_epi64x(origin),
+				_mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_castsi256_si128(count)), increment));
+		origin_hi = _mm256_add_epi64(_mm256_set1_epi64x(origin),
+				_mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_extracti128_si256(count, 1)), increment));
+
+		/* Markers report their channel in place of a time. */
+		time_lo = _mm256_add_epi64(origin_lo, 
+				_mm256_cvtepu32_epi64(_mm256_castsi256_si128(time)));
+		time_hi = _mm256_add_epi64(origin_hi, 
+				_mm256_cvtepu32_epi64(_mm256_extracti128_si256(time, 1)));
+		channel_lo = _mm256_cvtepu32_epi64(_mm256_castsi256_si128(channel));
+		channel_hi = _mm256_cvtepu32_epi64(
+				_mm256_extracti128_si256(channel, 1));
+		marker_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(marker));
+		marker_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(marker, 1));
+		time_lo = _mm256_blendv_epi8(time_lo, channel_lo, marker_lo);
+		time_hi = _mm256_blendv_epi8(time_hi, channel_hi, marker_hi);
+
+		channel = _mm256_blendv_epi8(channel, sync_channel, sync);
+		type = _mm256_blendv_epi8(type_t2, type_marker, marker);
+		type = _mm256_blendv_epi8(type, type_overflow, overflow);
+
+		_mm256_storeu_si256((__m256i *)&types[i], type);
+		_mm256_storeu_si256((__m256i *)channels, channel);
+		_mm256_storeu_si256((__m256i *)&times[0], time_lo);
+		_mm256_storeu_si256((__m256i *)&times[4], time_hi);
+
+		for ( j = 0; j < 8; j++ ) {
+			t2[i+j].channel = channels[j];
+			t2[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t hh_t2_decode_sse42(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types, 
+		int time_shift, int overflow_counted) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[4];
+	uint64_t times[4];
+
+	__m128i const time_mask = _mm_set1_epi32(0x01ffffff);
+	__m128i const channel_mask = _mm_set1_epi32(0x3f);
+	__m128i const overflow_ident = _mm_set1_epi32(0x7f);
+	__m128i const sync_ident = _mm_set1_epi32(0x40);
+	__m128i const sync_channel = _mm_set1_epi32(tttr->sync_channel);
+	__m128i const type_t2 = _mm_set1_epi32(PQ_RECORD_T2);
+	__m128i const type_marker = _mm_set1_epi32(PQ_RECORD_MARKER);
+	__m128i const type_overflow = _mm_set1_epi32(PQ_RECORD_OVERFLOW);
+	__m128i const increment = _mm_set1_epi64x(tttr->overflow_increment);
+	__m128i const shift = _mm_cvtsi32_si128(time_shift);
+
+	for ( i = 0; i + 4 <= n_records; i += 4 ) {
+		__m128i record, ident, time, channel, special, overflow, sync, marker;
+		__m128i count, type, origin_lo, origin_hi, time_lo, time_hi;
+		__m128i marker_lo, marker_hi, channel_lo, channel_hi;
+		uint32_t total;
+
+		record = _mm_loadu_si128((__m128i const *)&records[i]);
+		ident = _mm_srli_epi32(record, 25);
+		time = _mm_srl_epi32(_mm_and_si128(record, time_mask), shift);
+		channel = _mm_and_si128(ident, channel_mask);
+		special = _mm_srai_epi32(record, 31);
+		overflow = _mm_cmpeq_epi32(ident, overflow_ident);
+		sync = _mm_cmpeq_epi32(ident, sync_ident);
+		marker = _mm_andnot_si128(_mm_or_si128(overflow, sync), special);
+
+		if ( overflow_counted ) {
+			count = _mm_and_si128(overflow, time);
+		} else {
+			count = _mm_srli_epi32(overflow, 31);
+		}
+		count = pq_simd_prefix_sum_sse42(count);
+		total = (uint32_t)_mm_extract_epi32(count, 3);
+
+		origin_lo = _mm_add_epi64(_mm_set1_epi64x(origin),
+				_mm_mul_epu32(_mm_cvtepu32_epi64(count), increment));
+		origin_hi = _mm_add_epi64(_mm_set1_epi64x(origin),
+				_mm_mul_epu32(_mm_cvtepu32_epi64(
+					_mm_srli_si128(count, 8)), increment));
+
+		time_lo = _mm_add_epi64(origin_lo, _mm_cvtepu32_epi64(time));
+		time_hi = _mm_add_epi64(origin_hi, 
+				_mm_cvtepu32_epi64(_mm_srli_si128(time, 8)));
+		channel_lo = _mm_cvtepu32_epi64(channel);
+		channel_hi = _mm_cvtepu32_epi64(_mm_srli_si128(channel, 8));
+		marker_lo = _mm_cvtepi32_epi64(marker);
+		marker_hi = _mm_cvtepi32_epi64(_mm_srli_si128(marker, 8));
+		time_lo = _mm_blendv_epi8(time_lo, channel_lo, marker_lo);
+		time_hi = _mm_blendv_epi8(time_hi, channel_hi, marker_hi);
+
+		channel = _mm_blendv_epi8(channel, sync_channel, sync);
+		type = _mm_blendv_epi8(type_t2, type_marker, marker);
+		type = _mm_blendv_epi8(type, type_overflow, overflow);
+
+		_mm_storeu_si128((__m128i *)&types[i], type);
+		_mm_storeu_si128((__m128i *)channels, channel);
+		_mm_storeu_si128((__m128i *)&times[0], time_lo);
+		_mm_storeu_si128((__m128i *)&times[2], time_hi);
+
+		for ( j = 0; j < 4; j++ ) {
+			t2[i+j].channel = channels[j];
+			t2[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+#endif
+
+size_t hh_t2_decode_simd(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types, 
+		int time_shift, int overflow_counted) {
+/*
+ * Decode as many whole vectors of records as possible, returning the number
+ * of records decoded. The caller finishes the remainder with the scalar
+ * decoder, which is also left to reject any filtered photons.
+ */
+#ifdef PQ_SIMD_X86
+	if ( tttr->filter ) {
+		return(0);
+	}
+
+	switch ( pq_simd_level() ) {
+		case PQ_SIMD_AVX2:
+			return(hh_t2_decode_avx2(records, n_records, tttr, t2, types,
+					time_shift, overflow_counted));
+		case PQ_SIMD_SSE42:
+			return(hh_t2_decode_sse42(records, n_records, tttr, t2, types,
+					time_shift, overflow_counted));
+		default:
+			return(0);
+	}
+#else
+	return(0);
+#endif
+}
@@ -88,6 +88,7 @@ hh_v10_header_t *hh_v10_header_alloc(int input_channels) {
 
 	hh_header = (hh_v10_header_t *)malloc(sizeof(hh_v10_header_t));
 	if ( hh_header != NULL ) {
+		hh_header->InputRate = NULL;
 		hh_header->InpChan = (hh_v10_input_channel_t *)malloc(
 				sizeof(hh_v10_input_channel_t)*input_channels);
 	} 
@@ -103,6 +104,7 @@ hh_v10_header_t *hh_v10_header_alloc(int input_channels) {
 void hh_v10_header_free(hh_v10_header_t **hh_header) {
 	if ( *hh_header != NULL ) {
 		free((*hh_header)->InpChan);
+		free((*hh_header)->InputRate);
 		free(*hh_header);
 	}
 }
@@ -118,6 +120,9 @@ int hh_v10_header_read(FILE *stream_in, hh_v10_header_t **hh_header) {
 		return(PQ_ERROR_MEM);
 	}
 
+	(*hh_header)->InpChan = NULL;
+	(*hh_header)->InputRate = NULL;
+
 	/* First, we want to read everything that is static. This is everything
 	 * up for the board definitions, which we will pull after we know how
 	 * many there are (hh_header->NumberOfBoards)
@@ -302,18 +307,21 @@ void hh_v10_header_printf(FILE *stream_out,
 }
 
 void hh_v10_header_fwrite(FILE *stream_out, hh_v10_header_t *hh_header) {
+	/* The same pieces as hh_v10_header_read. */
 	fwrite(hh_header,
 			sizeof(hh_v10_header_t) 
-			- sizeof(hh_v10_input_channel_t)
+			- sizeof(hh_v10_input_channel_t *)
 			- sizeof(int32_t *),
 			1,
 			stream_out);
-	fwrite(&(hh_header->InpChan),
+	fwrite(hh_header->InpChan,
 			sizeof(hh_v10_input_channel_t),
 			hh_header->InputChannelsPresent,
 			stream_out);
-	fwrite(&(hh_header->InputRate),
-			sizeof(int32_t),
-			hh_header->InputChannelsPresent,
-			stream_out);
+	if ( hh_header->MeasurementMode != HH_MODE_INTERACTIVE ) {
+		fwrite(hh_header->InputRate,
+				sizeof(int32_t),
+				hh_header->InputChannelsPresent,
+				stream_out);
+	}
 }
@@ -32,11 +32,11 @@
 #ifndef HH_V10_H_
 #define HH_V10_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 #include "../picoquant.h"
 
+#pragma pack(push, 2)
+
 typedef struct {
 	int32_t MapTo;
 	int32_t Show;
@@ -224,11 +224,17 @@ void hh_v10_interactive_data_print(FILE *stream_out,
 void hh_v10_t2_init(hh_v10_header_t *hh_header, 
 		hh_v10_tttr_header_t *tttr_header,
 		tttr_t *tttr);
+int hh_v10_t2_record_decode(hh_v10_t2_record_t *record, tttr_t *tttr, t2_t *t2);
 int hh_v10_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2);
+int hh_v10_t2_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types);
 void hh_v10_t3_init(hh_v10_header_t *hh_header, 
 		hh_v10_tttr_header_t *tttr_header,
 		tttr_t *tttr);
+int hh_v10_t3_record_decode(hh_v10_t3_record_t *record, tttr_t *tttr, t3_t *t3);
 int hh_v10_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3);
+int hh_v10_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types);
 int hh_v10_tttr_stream(FILE *stream_in, FILE *stream_out, 
 		pq_header_t *pq_header, hh_v10_header_t *hh_header, 
 		options_t *options);
@@ -237,7 +243,7 @@ int hh_v10_t2_stream(FILE *stream_in, FILE *stream_out,
 		hh_v10_tttr_header_t *tttr_header, options_t *options);
 int hh_v10_t3_stream(FILE *stream_in, FILE *stream_out,
 		hh_v10_header_t *hh_header, hh_v10_tttr_header_t *tttr_header, 
-		options_t *options);
+		float64_t sync_period, options_t *options);
 
 int hh_v10_tttr_header_read(FILE *stream_in, 
 		hh_v10_tttr_header_t **tttr_header);
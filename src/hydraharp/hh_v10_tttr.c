@@ -29,287 +29,340 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <math.h>
-#include <stdlib.h>
-
-#include "../hydraharp.h"
-#include "hh_v10.h"
-
-#include "../error.h"
-
-void hh_v10_t2_init(hh_v10_header_t *hh_header,
-		hh_v10_tttr_header_t *tttr_header,
-		tttr_t *tttr) {
-	tttr->sync_channel = hh_header->InputChannelsPresent;
-	tttr->origin = 0;
-	tttr->overflows = 0;
-	tttr->overflow_increment = HH_T2_OVERFLOW / 2;
-	tttr->sync_rate = tttr_header->SyncRate;
-	tttr->resolution_float = HH_BASE_RESOLUTION;
-	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
-}
-
-int hh_v10_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
-	size_t n_read;
-	hh_v10_t2_record_t record;
-
-	n_read = fread(&record, sizeof(record), 1, stream_in);
-		
-	if ( n_read != 1 ) {
-		if ( !feof(stream_in) ) {
-			error("Could not read t2 record.\n");
-			return(PQ_ERROR_IO);
-		} else {
-			return(PQ_ERROR_EOF);
-		}
-	} else {
-		if ( record.special ) {
-			if ( record.channel == 63 ) {
-				/* Overflow */
-				tttr->overflows++;
-				tttr->origin += tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			} else if ( record.channel == 0 ) {
-				/* 
-				 * Sync record. 
-				 * Label the sync channel as 1 greater than the maximum
-				 * signal channel index.
-				 */
-				t2->channel = tttr->sync_channel;
-				t2->time = tttr->origin + record.time/2;
-				return(PQ_RECORD_T2);
-			} else {
-				/* External marker. */
-				t2->time = record.channel;
-				return(PQ_RECORD_MARKER);
-			}
-		} else {
-			/* See the ht2 documentation for this, but the gist is that
-			 * the counts are registered at double the rate of the reported
-			 * resolution, so one count is actually 0.5ps, not 1ps. Cut
-			 * the integer values for time in half to get the correct
-			 * result.
-			 */
-			t2->channel = record.channel;
-			t2->time = tttr->origin + record.time/2;
-			return(PQ_RECORD_T2);
-		}
-	}
-}
-
-/*
- *
- * Reading and interpreting for t3 mode.
- *
- */
-void hh_v10_t3_init(hh_v10_header_t *hh_header,
-		hh_v10_tttr_header_t *tttr_header,
-		tttr_t *tttr) {
-	tttr->sync_channel = hh_header->InputChannelsPresent;
-	tttr->origin = 0;
-	tttr->overflows = 0;
-	tttr->overflow_increment = HH_T3_OVERFLOW;
-	tttr->sync_rate = tttr_header->SyncRate;
-	tttr->resolution_float = hh_header->Resolution*1e-12;
-	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
-}
-
-int hh_v10_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
-	size_t n_read;
-	hh_v10_t3_record_t record;
-		
-	n_read = fread(&record, sizeof(record), 1, stream_in);
-
-	if ( n_read != 1 ) {
-		if ( !feof(stream_in) ) {
-			error("Could not read t3 record.\n");
-			return(PQ_ERROR_IO);
-		} else {
-			return(PQ_ERROR_EOF);
-		}
-	} else {
-		if ( record.special ) {
-			if ( record.channel == 63 ) {
-				/* Overflow */
-				tttr->overflows++;;
-				tttr->origin += HH_T3_OVERFLOW;
-				return(PQ_RECORD_OVERFLOW);
-			} else {
-				/* External marker.  */
-				t3->time = record.channel;
-				return(PQ_RECORD_MARKER);
-			}
-		} else {
-			t3->channel = record.channel;
-			t3->pulse = tttr->origin + record.nsync;
-			t3->time = record.dtime * tttr->resolution_int;
-			return(PQ_RECORD_T3);
-		}
-	}
-}
-
-/*
- *
- * Streaming for t2 or t3 mode.
- *
- */
-int hh_v10_tttr_stream(FILE *stream_in, FILE *stream_out,
-		pq_header_t *pq_header, hh_v10_header_t *hh_header, 
-		options_t *options) {
-	hh_v10_tttr_header_t *tttr_header;
-	int result;
-
-	result = hh_v10_tttr_header_read(stream_in, &tttr_header);
-
-	if ( result != PQ_SUCCESS ) {
-		error("Failed while reading tttr header.\n");
-		return(result);
-	} else {
-		if ( options->print_header ) {
-			if ( options->binary_out ) {
-				pq_header_fwrite(stream_out, pq_header);
-				hh_v10_header_fwrite(stream_out, hh_header);
-				hh_v10_tttr_header_fwrite(stream_out, tttr_header);
-			} else {
-				pq_header_printf(stream_out, pq_header);
-				hh_v10_header_printf(stream_out, hh_header);
-				hh_v10_tttr_header_printf(stream_out, tttr_header);
-			}
-
-			result = PQ_SUCCESS;
-		} else {
-			if ( hh_header->MeasurementMode == HH_MODE_T2 ) {
-				debug("Found mode ht2.\n");
-				result = hh_v10_t2_stream(stream_in, stream_out, 
-						hh_header, tttr_header, options);
-			} else if ( hh_header->MeasurementMode == HH_MODE_T3 ) {
-				debug("Found mode ht3.\n");
-				result = hh_v10_t3_stream(stream_in, stream_out,
-						hh_header, tttr_header, options);
-			} else {
-				debug("Unrecognized mode.\n");
-				result = PQ_ERROR_MODE;
-			}
-		}
-	}
-
-	debug("Freeing tttr header.\n");
-	hh_v10_tttr_header_free(&tttr_header);
-	return(result);
-}
-
-int hh_v10_t2_stream(FILE *stream_in, FILE *stream_out,
-		hh_v10_header_t *hh_header, 
-		hh_v10_tttr_header_t *tttr_header, options_t *options) {
-	tttr_t tttr;
-	
-	hh_v10_t2_init(hh_header, tttr_header, &tttr);
-
-	if ( options->print_resolution ) {
-		pq_resolution_print(stream_out, -1,
-				tttr.resolution_float*1e12, options);
-		return(PQ_SUCCESS);
-	} else {
-		return(pq_t2_stream(stream_in, stream_out,
-				hh_v10_t2_decode, &tttr, options));
-	}
-}
-
-int hh_v10_t3_stream(FILE *stream_in, FILE *stream_out,
-		hh_v10_header_t *hh_header, 
-		hh_v10_tttr_header_t *tttr_header, options_t *options) {
-	tttr_t tttr;
-
-	hh_v10_t3_init(hh_header, tttr_header, &tttr);
-
-	if ( options->print_resolution ) {
-		pq_resolution_print(stream_out, -1,
-				tttr.resolution_float*1e12, options);
-		return(PQ_SUCCESS);
-	} else {
-		return(pq_t3_stream(stream_in, stream_out,
-				hh_v10_t3_decode, &tttr, options));
-	}
-}
-
-/*
- * 
- * Header for tttr mode (t2, t3)
- *
- */
-int hh_v10_tttr_header_read(FILE *stream_in, 
-		hh_v10_tttr_header_t **tttr_header) {
-	size_t n_read;
-
-	*tttr_header = (hh_v10_tttr_header_t *)malloc(sizeof(hh_v10_tttr_header_t));
-
-	if ( *tttr_header == NULL ) {
-		error("Could not allocate tttr header.\n");
-		return(PQ_ERROR_MEM);
-	}
-
-	n_read = fread(*tttr_header, 
-			sizeof(hh_v10_tttr_header_t)-sizeof(uint32_t *), 
-			1, 
-			stream_in);
-	if ( n_read != 1 ) {
-		error("Could not read tttr header.\n");
-		hh_v10_tttr_header_free(tttr_header);
-		return(PQ_ERROR_IO);
-	}
-
-	(*tttr_header)->ImgHdr = (uint32_t *)malloc(
-			(*tttr_header)->ImgHdrSize*sizeof(uint32_t));
-	if ( (*tttr_header)->ImgHdr == NULL ) {
-		error("Could not allocate memory for tttr image header.\n");
-		hh_v10_tttr_header_free(tttr_header);
-		return(PQ_ERROR_MEM);
-	}
-
-	n_read = fread((*tttr_header)->ImgHdr, 
-			sizeof(uint32_t),
-			(*tttr_header)->ImgHdrSize, 
-			stream_in);
-	if ( n_read != (*tttr_header)->ImgHdrSize ) {
-		error("Could not read Hydraharp tttr image header.\n");
-		hh_v10_tttr_header_free(tttr_header);
-		return(PQ_ERROR_IO);
-	}
-
-	return(PQ_SUCCESS);
-}
-
-void hh_v10_tttr_header_free(hh_v10_tttr_header_t **tttr_header) {
-	if ( *tttr_header != NULL ) {
-		free((*tttr_header)->ImgHdr);
-		free(*tttr_header);
-	}
-}
-
-void hh_v10_tttr_header_printf(FILE *stream_out,
-		hh_v10_tttr_header_t *tttr_header) {
-	int i;
-
-	fprintf(stream_out, "SyncRate = %"PRId32"\n", tttr_header->SyncRate);
-	fprintf(stream_out, "StopAfter = %"PRId32"\n", tttr_header->StopAfter);
-	fprintf(stream_out, "StopReason = %"PRId32"\n", tttr_header->StopReason);
-	fprintf(stream_out, "ImgHdrSize = %"PRId32"\n", tttr_header->ImgHdrSize);
-	fprintf(stream_out, "NumRecords = %"PRId64"\n", tttr_header->NumRecords);
-
-	for ( i = 0; i < tttr_header->ImgHdrSize; i++ ) {
-		fprintf(stream_out, "ImgHdr[%d] = %"PRIu32"\n", i,
-				tttr_header->ImgHdr[i]);
-	}
-}
-
-void hh_v10_tttr_header_fwrite(FILE *stream_out,
-		hh_v10_tttr_header_t *tttr_header) {
-	fwrite(tttr_header,
-			sizeof(hh_v10_tttr_header_t) - sizeof(uint32_t *),
-			1,
-			stream_out);
-	fwrite(tttr_header->ImgHdr,
-			sizeof(uint32_t),
-			tttr_header->ImgHdrSize,
-			stream_out);
-}	
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../hydraharp.h"
+#include "hh_v10.h"
+#include "hh_simd.h"
+
+#include "../error.h"
+
+void hh_v10_t2_init(hh_v10_header_t *hh_header,
+		hh_v10_tttr_header_t *tttr_header,
+		tttr_t *tttr) {
+	tttr->sync_channel = hh_header->InputChannelsPresent;
+	tttr->channels = hh_header->InputChannelsPresent + 1;
+	tttr->origin = 0;
+	tttr->overflows = 0;
+	tttr->overflow_increment = HH_T2_OVERFLOW / 2;
+	tttr->sync_rate = tttr_header->SyncRate;
+	tttr->resolution_float = HH_BASE_RESOLUTION;
+	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+}
+
+int hh_v10_t2_record_decode(hh_v10_t2_record_t *record, tttr_t *tttr, t2_t *t2) {
+	if ( record->special ) {
+		if ( record->channel == 63 ) {
+			/* Overflow */
+			tttr->overflows++;
+			tttr->origin += tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		} else if ( record->channel == 0 ) {
+			/* 
+			 * Sync record. 
+			 * Label the sync channel as 1 greater than the maximum
+			 * signal channel index.
+			 */
+			if ( TTTR_REJECTED_T2(tttr, tttr->sync_channel) ) {
+				return(PQ_RECORD_FILTERED);
+			}
+			t2->channel = tttr->sync_channel;
+			t2->time = tttr->origin + record->time/2;
+			return(PQ_RECORD_T2);
+		} else {
+			/* External marker. */
+			t2->time = record->channel;
+			return(PQ_RECORD_MARKER);
+		}
+	} else if ( TTTR_REJECTED_T2(tttr, record->channel) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		/* See the ht2 documentation for this, but the gist is that
+		 * the counts are registered at double the rate of the reported
+		 * resolution, so one count is actually 0.5ps, not 1ps. Cut
+		 * the integer values for time in half to get the correct
+		 * result.
+		 */
+		t2->channel = record->channel;
+		t2->time = tttr->origin + record->time/2;
+		return(PQ_RECORD_T2);
+	}
+}
+
+int hh_v10_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
+	size_t n_read;
+	hh_v10_t2_record_t record;
+
+	n_read = fread(&record, sizeof(record), 1, stream_in);
+		
+	if ( n_read != 1 ) {
+		if ( !feof(stream_in) ) {
+			error("Could not read t2 record.\n");
+			return(PQ_ERROR_IO);
+		} else {
+			return(PQ_ERROR_EOF);
+		}
+	} else {
+		return(hh_v10_t2_record_decode(&record, tttr, t2));
+	}
+}
+
+int hh_v10_t2_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+	size_t i;
+	hh_v10_t2_record_t record;
+
+	i = hh_t2_decode_simd(records, n_records, tttr, t2, types,
+			HH_T2_V10_TIME_SHIFT, 0);
+
+	for ( ; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = hh_v10_t2_record_decode(&record, tttr, &t2[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+/*
+ *
+ * Reading and interpreting for t3 mode.
+ *
+ */
+void hh_v10_t3_init(hh_v10_header_t *hh_header,
+		hh_v10_tttr_header_t *tttr_header,
+		tttr_t *tttr) {
+	tttr->sync_channel = hh_header->InputChannelsPresent;
+	tttr->channels = hh_header->InputChannelsPresent;
+	tttr->origin = 0;
+	tttr->overflows = 0;
+	tttr->overflow_increment = HH_T3_OVERFLOW;
+	tttr->sync_rate = tttr_header->SyncRate;
+	tttr->sync_period = 0;
+	tttr->resolution_float = hh_header->Resolution*1e-12;
+	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+	tttr->time_scale = 1;
+}
+
+int hh_v10_t3_record_decode(hh_v10_t3_record_t *record, tttr_t *tttr, t3_t *t3) {
+	if ( record->special ) {
+		if ( record->channel == 63 ) {
+			/* Overflow */
+			tttr->overflows++;;
+			tttr->origin += HH_T3_OVERFLOW;
+			return(PQ_RECORD_OVERFLOW);
+		} else {
+			/* External marker.  */
+			t3->time = record->channel;
+			return(PQ_RECORD_MARKER);
+		}
+	} else if ( TTTR_REJECTED_T3(tttr, record->channel, 
+			(uint64_t)record->dtime * tttr->resolution_int) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		t3->channel = record->channel;
+		t3->pulse = tttr->origin + record->nsync;
+		t3->time = record->dtime * tttr->resolution_int;
+		return(PQ_RECORD_T3);
+	}
+}
+
+int hh_v10_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
+	size_t n_read;
+	hh_v10_t3_record_t record;
+		
+	n_read = fread(&record, sizeof(record), 1, stream_in);
+
+	if ( n_read != 1 ) {
+		if ( !feof(stream_in) ) {
+			error("Could not read t3 record.\n");
+			return(PQ_ERROR_IO);
+		} else {
+			return(PQ_ERROR_EOF);
+		}
+	} else {
+		return(hh_v10_t3_record_decode(&record, tttr, t3));
+	}
+}
+
+int hh_v10_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i;
+	hh_v10_t3_record_t record;
+
+	for ( i = 0; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = hh_v10_t3_record_decode(&record, tttr, &t3[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+/*
+ *
+ * Streaming for t2 or t3 mode.
+ *
+ */
+int hh_v10_tttr_stream(FILE *stream_in, FILE *stream_out,
+		pq_header_t *pq_header, hh_v10_header_t *hh_header, 
+		options_t *options) {
+	hh_v10_tttr_header_t *tttr_header;
+	int result;
+
+	result = hh_v10_tttr_header_read(stream_in, &tttr_header);
+
+	if ( result != PQ_SUCCESS ) {
+		error("Failed while reading tttr header.\n");
+		return(result);
+	} else {
+		if ( options->print_header ) {
+			if ( options->binary_out ) {
+				pq_header_fwrite(stream_out, pq_header);
+				hh_v10_header_fwrite(stream_out, hh_header);
+				hh_v10_tttr_header_fwrite(stream_out, tttr_header);
+			} else {
+				pq_header_printf(stream_out, pq_header);
+				hh_v10_header_printf(stream_out, hh_header);
+				hh_v10_tttr_header_printf(stream_out, tttr_header);
+			}
+
+			result = PQ_SUCCESS;
+		} else {
+			if ( hh_header->MeasurementMode == HH_MODE_T2 ) {
+				debug("Found mode ht2.\n");
+				result = hh_v10_t2_stream(stream_in, stream_out, 
+						hh_header, tttr_header, options);
+			} else if ( hh_header->MeasurementMode == HH_MODE_T3 ) {
+				debug("Found mode ht3.\n");
+				result = hh_v10_t3_stream(stream_in, stream_out,
+						hh_header, tttr_header, 0, options);
+			} else {
+				debug("Unrecognized mode.\n");
+				result = PQ_ERROR_MODE;
+			}
+		}
+	}
+
+	debug("Freeing tttr header.\n");
+	hh_v10_tttr_header_free(&tttr_header);
+	return(result);
+}
+
+int hh_v10_t2_stream(FILE *stream_in, FILE *stream_out,
+		hh_v10_header_t *hh_header, 
+		hh_v10_tttr_header_t *tttr_header, options_t *options) {
+	tttr_t tttr;
+	
+	hh_v10_t2_init(hh_header, tttr_header, &tttr);
+
+	if ( options->print_resolution ) {
+		pq_resolution_print(stream_out, -1,
+				tttr.resolution_float*1e12, options);
+		return(PQ_SUCCESS);
+	} else {
+		return(pq_t2_stream(stream_in, stream_out,
+				hh_v10_t2_decode_block, &tttr, options));
+	}
+}
+
+int hh_v10_t3_stream(FILE *stream_in, FILE *stream_out,
+		hh_v10_header_t *hh_header, 
+		hh_v10_tttr_header_t *tttr_header, float64_t sync_period,
+		options_t *options) {
+	tttr_t tttr;
+
+	hh_v10_t3_init(hh_header, tttr_header, &tttr);
+	tttr.sync_period = sync_period;
+
+	if ( options->print_resolution ) {
+		pq_resolution_print(stream_out, -1,
+				tttr.resolution_float*1e12, options);
+		return(PQ_SUCCESS);
+	} else {
+		return(pq_t3_stream(stream_in, stream_out,
+				hh_v10_t3_decode_block, &tttr, options));
+	}
+}
+
+/*
+ * 
+ * Header for tttr mode (t2, t3)
+ *
+ */
+int hh_v10_tttr_header_read(FILE *stream_in, 
+		hh_v10_tttr_header_t **tttr_header) {
+	size_t n_read;
+
+	*tttr_header = (hh_v10_tttr_header_t *)malloc(sizeof(hh_v10_tttr_header_t));
+
+	if ( *tttr_header == NULL ) {
+		error("Could not allocate tttr header.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	n_read = fread(*tttr_header, 
+			sizeof(hh_v10_tttr_header_t)-sizeof(uint32_t *), 
+			1, 
+			stream_in);
+	if ( n_read != 1 ) {
+		error("Could not read tttr header.\n");
+		hh_v10_tttr_header_free(tttr_header);
+		return(PQ_ERROR_IO);
+	}
+
+	(*tttr_header)->ImgHdr = (uint32_t *)malloc(
+			(*tttr_header)->ImgHdrSize*sizeof(uint32_t));
+	if ( (*tttr_header)->ImgHdr == NULL ) {
+		error("Could not allocate memory for tttr image header.\n");
+		hh_v10_tttr_header_free(tttr_header);
+		return(PQ_ERROR_MEM);
+	}
+
+	n_read = fread((*tttr_header)->ImgHdr, 
+			sizeof(uint32_t),
+			(*tttr_header)->ImgHdrSize, 
+			stream_in);
+	if ( n_read != (*tttr_header)->ImgHdrSize ) {
+		error("Could not read Hydraharp tttr image header.\n");
+		hh_v10_tttr_header_free(tttr_header);
+		return(PQ_ERROR_IO);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+void hh_v10_tttr_header_free(hh_v10_tttr_header_t **tttr_header) {
+	if ( *tttr_header != NULL ) {
+		free((*tttr_header)->ImgHdr);
+		free(*tttr_header);
+	}
+}
+
+void hh_v10_tttr_header_printf(FILE *stream_out,
+		hh_v10_tttr_header_t *tttr_header) {
+	int i;
+
+	fprintf(stream_out, "SyncRate = %"PRId32"\n", tttr_header->SyncRate);
+	fprintf(stream_out, "StopAfter = %"PRId32"\n", tttr_header->StopAfter);
+	fprintf(stream_out, "StopReason = %"PRId32"\n", tttr_header->StopReason);
+	fprintf(stream_out, "ImgHdrSize = %"PRId32"\n", tttr_header->ImgHdrSize);
+	fprintf(stream_out, "NumRecords = %"PRId64"\n", tttr_header->NumRecords);
+
+	for ( i = 0; i < tttr_header->ImgHdrSize; i++ ) {
+		fprintf(stream_out, "ImgHdr[%d] = %"PRIu32"\n", i,
+				tttr_header->ImgHdr[i]);
+	}
+}
+
+void hh_v10_tttr_header_fwrite(FILE *stream_out,
+		hh_v10_tttr_header_t *tttr_header) {
+	fwrite(tttr_header,
+			sizeof(hh_v10_tttr_header_t) - sizeof(uint32_t *),
+			1,
+			stream_out);
+	fwrite(tttr_header->ImgHdr,
+			sizeof(uint32_t),
+			tttr_header->ImgHdrSize,
+			stream_out);
+}	
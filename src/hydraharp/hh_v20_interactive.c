@@ -37,6 +37,7 @@
 #include "../hydraharp.h"
 #include "../header.h"
 #include "../error.h"
+#include "../reader.h"
 
 int hh_v20_interactive_stream(FILE *stream_in, FILE *stream_out,
 		pq_header_t *pq_header, hh_v20_header_t *hh_header, 
@@ -145,13 +146,14 @@ void hh_v20_interactive_header_printf(FILE *stream_out,
 		hh_v20_header_t *hh_header, 
 		hh_v20_interactive_t *interactive) {
 	int i;
+	char time_buffer[PQ_CTIME_LENGTH];
 	int j;
 
 	for ( i = 0; i < hh_header->NumberOfCurves; i++ ) {
 		fprintf(stream_out, "Curve[%d].CurveIndex = %"PRId32"\n",
 			i, interactive->Curve[i].CurveIndex);
 		fprintf(stream_out, "Curve[%d].TimeOfRecording = %s",
-			i, ctime32(&interactive->Curve[i].TimeOfRecording));
+			i, ctime32(&interactive->Curve[i].TimeOfRecording, time_buffer));
 		fprintf(stream_out, "Curve[%d].HardwareIdent = %.*s\n",
 			i, 
 			(int)sizeof(interactive->Curve[i].HardwareIdent),
@@ -313,6 +315,11 @@ void hh_v20_interactive_data_print(FILE *stream_out,
 	pq_interactive_bin_t bin;
 	pq_interactive_bin_print_t print;
 
+	if ( options->reader != NULL ) {
+		/* A library reader takes the bins in binary form. */
+		pq_reader_attach_interactive(options->reader);
+	}
+
 	if ( options->binary_out ) {
 		print = pq_interactive_bin_fwrite;
 	} else {
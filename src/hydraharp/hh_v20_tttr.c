@@ -31,9 +31,11 @@
 
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "../hydraharp.h"
 #include "hh_v20.h"
+#include "hh_simd.h"
 
 #include "../error.h"
 
@@ -41,6 +43,7 @@ void hh_v20_t2_init(hh_v20_header_t *hh_header,
 		hh_v20_tttr_header_t *tttr_header,
 		tttr_t *tttr) {
 	tttr->sync_channel = hh_header->InputChannelsPresent;
+	tttr->channels = hh_header->InputChannelsPresent + 1;
 	tttr->origin = 0;
 	tttr->overflows = 0;
 	tttr->overflow_increment = HH_T2_OVERFLOW;
@@ -49,6 +52,46 @@ void hh_v20_t2_init(hh_v20_header_t *hh_header,
 	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
 }
 
+int hh_v20_t2_record_decode(hh_v20_t2_record_t *record, tttr_t *tttr, t2_t *t2) {
+	if ( record->special ) {
+		if ( record->channel == 63 ) {
+			/* Overflow */
+			tttr->overflows += record->time;
+			tttr->origin += (uint64_t)record->time*
+					(uint64_t)tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		} else if ( record->channel == 0 ) {
+			/* 
+			 * Sync record. 
+			 * Label the sync channel as 1 greater than the maximum
+			 * signal channel index.
+			 */
+			if ( TTTR_REJECTED_T2(tttr, tttr->sync_channel) ) {
+				return(PQ_RECORD_FILTERED);
+			}
+			t2->channel = tttr->sync_channel;
+			t2->time = tttr->origin + record->time;
+			return(PQ_RECORD_T2);
+		} else {
+			/* External marker. */
+			t2->time = record->channel;
+			return(PQ_RECORD_MARKER);
+		}
+	} else if ( TTTR_REJECTED_T2(tttr, record->channel) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		/* See the ht2 documentation for this, but the gist is that
+		 * the counts are registered at double the rate of the reported
+		 * resolution, so one count is actually 0.5ps, not 1ps. Cut
+		 * the integer values for time in half to get the correct
+		 * result.
+		 */
+		t2->channel = record->channel;
+		t2->time = tttr->origin + record->time;
+		return(PQ_RECORD_T2);
+	}
+}
+
 int hh_v20_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
 	size_t n_read;
 	hh_v20_t2_record_t record;
@@ -63,41 +106,26 @@ int hh_v20_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		if ( record.special ) {
-			if ( record.channel == 63 ) {
-				/* Overflow */
-				tttr->overflows += record.time;
-				tttr->origin += (uint64_t)record.time*
-						(uint64_t)tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			} else if ( record.channel == 0 ) {
-				/* 
-				 * Sync record. 
-				 * Label the sync channel as 1 greater than the maximum
-				 * signal channel index.
-				 */
-				t2->channel = tttr->sync_channel;
-				t2->time = tttr->origin + record.time;
-				return(PQ_RECORD_T2);
-			} else {
-				/* External marker. */
-				t2->time = record.channel;
-				return(PQ_RECORD_MARKER);
-			}
-		} else {
-			/* See the ht2 documentation for this, but the gist is that
-			 * the counts are registered at double the rate of the reported
-			 * resolution, so one count is actually 0.5ps, not 1ps. Cut
-			 * the integer values for time in half to get the correct
-			 * result.
-			 */
-			t2->channel = record.channel;
-			t2->time = tttr->origin + record.time;
-			return(PQ_RECORD_T2);
-		}
+		return(hh_v20_t2_record_decode(&record, tttr, t2));
 	}
 }
 
+int hh_v20_t2_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+	size_t i;
+	hh_v20_t2_record_t record;
+
+	i = hh_t2_decode_simd(records, n_records, tttr, t2, types,
+			HH_T2_V20_TIME_SHIFT, 1);
+
+	for ( ; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = hh_v20_t2_record_decode(&record, tttr, &t2[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
 /*
  *
  * Reading and interpreting for t3 mode.
@@ -107,12 +135,38 @@ void hh_v20_t3_init(hh_v20_header_t *hh_header,
 		hh_v20_tttr_header_t *tttr_header,
 		tttr_t *tttr) {
 	tttr->sync_channel = hh_header->InputChannelsPresent;
+	tttr->channels = hh_header->InputChannelsPresent;
 	tttr->origin = 0;
 	tttr->overflows = 0;
 	tttr->overflow_increment = HH_T3_OVERFLOW;
 	tttr->sync_rate = tttr_header->SyncRate;
+	tttr->sync_period = 0;
 	tttr->resolution_float = hh_header->Resolution*1e-12;
 	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+	tttr->time_scale = 1;
+}
+
+int hh_v20_t3_record_decode(hh_v20_t3_record_t *record, tttr_t *tttr, t3_t *t3) {
+	if ( record->special ) {
+		if ( record->channel == 63 ) {
+			/* Overflow */
+			tttr->overflows += record->dtime;
+			tttr->origin += record->nsync*HH_T3_OVERFLOW;
+			return(PQ_RECORD_OVERFLOW);
+		} else {
+			/* External marker.  */
+			t3->time = record->channel;
+			return(PQ_RECORD_MARKER);
+		}
+	} else if ( TTTR_REJECTED_T3(tttr, record->channel, 
+			(uint64_t)record->dtime * tttr->resolution_int) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		t3->channel = record->channel;
+		t3->pulse = tttr->origin + record->nsync;
+		t3->time = record->dtime * tttr->resolution_int;
+		return(PQ_RECORD_T3);
+	}
 }
 
 int hh_v20_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
@@ -129,26 +183,23 @@ int hh_v20_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		if ( record.special ) {
-			if ( record.channel == 63 ) {
-				/* Overflow */
-				tttr->overflows += record.dtime;
-				tttr->origin += record.nsync*HH_T3_OVERFLOW;
-				return(PQ_RECORD_OVERFLOW);
-			} else {
-				/* External marker.  */
-				t3->time = record.channel;
-				return(PQ_RECORD_MARKER);
-			}
-		} else {
-			t3->channel = record.channel;
-			t3->pulse = tttr->origin + record.nsync;
-			t3->time = record.dtime * tttr->resolution_int;
-			return(PQ_RECORD_T3);
-		}
+		return(hh_v20_t3_record_decode(&record, tttr, t3));
 	}
 }
 
+int hh_v20_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i;
+	hh_v20_t3_record_t record;
+
+	for ( i = 0; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = hh_v20_t3_record_decode(&record, tttr, &t3[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
 /*
  *
  * Streaming for t2 or t3 mode.
@@ -186,7 +237,7 @@ int hh_v20_tttr_stream(FILE *stream_in, FILE *stream_out,
 			} else if ( hh_header->MeasurementMode == HH_MODE_T3 ) {
 				debug("Found mode ht3.\n");
 				result = hh_v20_t3_stream(stream_in, stream_out,
-						hh_header, tttr_header, options);
+						hh_header, tttr_header, 0, options);
 			} else {
 				debug("Unrecognized mode.\n");
 				result = PQ_ERROR_MODE;
@@ -212,16 +263,18 @@ int hh_v20_t2_stream(FILE *stream_in, FILE *stream_out,
 		return(PQ_SUCCESS);
 	} else {
 		return(pq_t2_stream(stream_in, stream_out,
-				hh_v20_t2_decode, &tttr, options));
+				hh_v20_t2_decode_block, &tttr, options));
 	} 
 }
 
 int hh_v20_t3_stream(FILE *stream_in, FILE *stream_out,
 		hh_v20_header_t *hh_header, 
-		hh_v20_tttr_header_t *tttr_header, options_t *options) {
+		hh_v20_tttr_header_t *tttr_header, float64_t sync_period,
+		options_t *options) {
 	tttr_t tttr;
 
 	hh_v20_t3_init(hh_header, tttr_header, &tttr);
+	tttr.sync_period = sync_period;
 
 	if ( options->print_resolution ){
 		pq_resolution_print(stream_out, -1,
@@ -229,7 +282,7 @@ int hh_v20_t3_stream(FILE *stream_in, FILE *stream_out,
 		return(PQ_SUCCESS);
 	} else {
 		return(pq_t3_stream(stream_in, stream_out,
-				hh_v20_t3_decode, &tttr, options));
+				hh_v20_t3_decode_block, &tttr, options));
 	}
 }
 
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "index.h"
+#include "error.h"
+
+int pq_range_active(options_t *options) {
+/*
+ * Whether only part of the data was requested by time (or pulse).
+ */
+	return(options->start_time > 0 || options->stop_time < PQ_INDEX_NONE);
+}
+
+int pq_index_init(pq_index_t *index, FILE *stream_in, char const *filename) {
+/*
+ * Prepare an empty index for the input, whose records start at the current
+ * position. Only regular files can be indexed, since the index is used to 
+ * seek in the input.
+ */
+	struct stat file_stat;
+	off_t position;
+	int fd;
+
+	memset(index, 0, sizeof(pq_index_t));
+	index->interval = PQ_INDEX_INTERVAL;
+
+	if ( filename == NULL || stream_in == stdin ) {
+		return(PQ_ERROR_IO);
+	}
+
+	fd = fileno(stream_in);
+	position = ftello(stream_in);
+
+	if ( fd < 0 || position < 0 || 
+			fstat(fd, &file_stat) != 0 || 
+			! S_ISREG(file_stat.st_mode) ) {
+		return(PQ_ERROR_IO);
+	}
+
+	index->data_offset = position;
+	index->file_size = file_stat.st_size;
+	index->file_mtime = file_stat.st_mtime;
+
+	index->filename = (char *)malloc(strlen(filename) + 
+			strlen(PQ_INDEX_SUFFIX) + 1);
+	if ( index->filename == NULL ) {
+		error("Could not allocate index file name.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	strcpy(index->filename, filename);
+	strcat(index->filename, PQ_INDEX_SUFFIX);
+
+	return(PQ_SUCCESS);
+}
+
+int pq_index_load(pq_index_t *index) {
+/*
+ * Read the sidecar index, if it exists and matches the input.
+ */
+	FILE *stream;
+	char magic[8];
+	uint32_t version[2];
+	uint64_t header[5];
+	int result = PQ_SUCCESS;
+
+	stream = fopen(index->filename, "rb");
+	if ( stream == NULL ) {
+		debug("No index found at %s.\n", index->filename);
+		return(PQ_ERROR_IO);
+	}
+
+	if ( fread(magic, 1, sizeof(magic), stream) != sizeof(magic) ||
+			fread(version, sizeof(uint32_t), 2, stream) != 2 ||
+			fread(header, sizeof(uint64_t), 5, stream) != 5 ) {
+		warn("Could not read index header from %s.\n", index->filename);
+		result = PQ_ERROR_IO;
+	} else if ( strncmp(magic, PQ_INDEX_MAGIC, sizeof(magic)) ||
+			version[0] != PQ_INDEX_VERSION ) {
+		warn("%s is not a supported index.\n", index->filename);
+		result = PQ_ERROR_VERSION;
+	} else if ( header[1] != index->data_offset || 
+			header[2] != index->file_size ||
+			(int64_t)header[3] != index->file_mtime ) {
+		debug("Index %s does not match the input.\n", index->filename);
+		result = PQ_ERROR_VERSION;
+	} else {
+		index->interval = header[0];
+		index->n_entries = header[4];
+		index->capacity = index->n_entries;
+		index->entries = (pq_index_entry_t *)malloc(
+				index->capacity*sizeof(pq_index_entry_t));
+
+		if ( index->entries == NULL ) {
+			error("Could not allocate index entries.\n");
+			result = PQ_ERROR_MEM;
+		} else if ( fread(index->entries, sizeof(pq_index_entry_t), 
+					index->n_entries, stream) != index->n_entries ) {
+			warn("Could not read index entries from %s.\n", 
+					index->filename);
+			result = PQ_ERROR_IO;
+		}
+	}
+
+	fclose(stream);
+
+	if ( pq_check(result) ) {
+		free(index->entries);
+		index->entries = NULL;
+		index->n_entries = 0;
+		index->capacity = 0;
+		index->interval = PQ_INDEX_INTERVAL;
+	} else {
+		debug("Read %zu index entries from %s.\n", 
+				index->n_entries, index->filename);
+	}
+
+	return(result);
+}
+
+int pq_index_save(pq_index_t *index) {
+/*
+ * Write the index next to the input. Failing to do so is not an error, as
+ * the index has already been used by then.
+ */
+	FILE *stream;
+	uint32_t version[2] = {PQ_INDEX_VERSION, 0};
+	uint64_t header[5];
+	int result = PQ_SUCCESS;
+
+	header[0] = index->interval;
+	header[1] = index->data_offset;
+	header[2] = index->file_size;
+	header[3] = (uint64_t)index->file_mtime;
+	header[4] = index->n_entries;
+
+	stream = fopen(index->filename, "wb");
+	if ( stream == NULL ) {
+		warn("Could not write index to %s.\n", index->filename);
+		return(PQ_ERROR_IO);
+	}
+
+	fwrite(PQ_INDEX_MAGIC, 1, 8, stream);
+	fwrite(version, sizeof(uint32_t), 2, stream);
+	fwrite(header, sizeof(uint64_t), 5, stream);
+	fwrite(index->entries, sizeof(pq_index_entry_t), index->n_entries, 
+			stream);
+
+	if ( ferror(stream) ) {
+		warn("Could not write index to %s.\n", index->filename);
+		result = PQ_ERROR_IO;
+	}
+
+	if ( fclose(stream) != 0 || pq_check(result) ) {
+		remove(index->filename);
+		result = PQ_ERROR_IO;
+	} else {
+		debug("Wrote %zu index entries to %s.\n", 
+				index->n_entries, index->filename);
+	}
+
+	return(result);
+}
+
+int pq_index_append(pq_index_t *index, uint64_t record, tttr_t *tttr) {
+/*
+ * Add a checkpoint with the decoder state before the given record.
+ */
+	pq_index_entry_t *entries;
+
+	if ( index->n_entries == index->capacity ) {
+		index->capacity = index->capacity ? 2*index->capacity : 1024;
+		entries = (pq_index_entry_t *)realloc(index->entries, 
+				index->capacity*sizeof(pq_index_entry_t));
+		if ( entries == NULL ) {
+			error("Could not allocate index entries.\n");
+			return(PQ_ERROR_MEM);
+		}
+		index->entries = entries;
+	}
+
+	index->entries[index->n_entries].record = record;
+	index->entries[index->n_entries].origin = tttr->origin;
+	index->entries[index->n_entries].overflows = tttr->overflows;
+	index->entries[index->n_entries].first = PQ_INDEX_NONE;
+	index->n_entries++;
+
+	return(PQ_SUCCESS);
+}
+
+void pq_index_first(pq_index_t *index, uint64_t first) {
+/*
+ * Note the time (or pulse) of a photon following the latest checkpoint, 
+ * if it is the first one.
+ */
+	if ( index->n_entries > 0 && 
+			index->entries[index->n_entries-1].first == PQ_INDEX_NONE ) {
+		index->entries[index->n_entries-1].first = first;
+	}
+}
+
+int pq_index_seek(pq_index_t *index, FILE *stream_in, tttr_t *tttr,
+		uint64_t start, uint64_t stop, uint64_t *length) {
+/*
+ * Move the input and decoder state to the checkpoint before the start, and
+ * find how many records must be read from there to pass the stop. The 
+ * photons are only roughly in order of time across channels, so one 
+ * checkpoint of margin is kept on either side.
+ */
+	size_t i;
+	size_t first = 0;
+	size_t last = index->n_entries;
+	pq_index_entry_t *entry;
+
+	for ( i = 0; i < index->n_entries; i++ ) {
+		if ( index->entries[i].first == PQ_INDEX_NONE ) {
+			continue;
+		} else if ( index->entries[i].first <= start ) {
+			first = i;
+		} else if ( index->entries[i].first > stop && last == index->n_entries ) {
+			last = i;
+		}
+	}
+
+	first = (first > 0) ? first - 1 : 0;
+	*length = PQ_INDEX_NONE;
+
+	if ( index->n_entries == 0 ) {
+		return(PQ_SUCCESS);
+	}
+
+	entry = &index->entries[first];
+	debug("Starting from record %"PRIu64".\n", entry->record);
+
+	if ( fseeko(stream_in, index->data_offset + 
+				entry->record*sizeof(uint32_t), SEEK_SET) != 0 ) {
+		error("Could not seek to record %"PRIu64".\n", entry->record);
+		return(PQ_ERROR_IO);
+	}
+
+	tttr->origin = entry->origin;
+	tttr->overflows = entry->overflows;
+
+	if ( last + 1 < index->n_entries ) {
+		*length = index->entries[last+1].record - entry->record;
+	}
+
+	return(PQ_SUCCESS);
+}
+
+void pq_index_free(pq_index_t *index) {
+	free(index->filename);
+	free(index->entries);
+	index->filename = NULL;
+	index->entries = NULL;
+}
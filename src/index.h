@@ -0,0 +1,94 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INDEX_H_
+#define INDEX_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "tttr.h"
+#include "options.h"
+
+/* The overflow index is a sidecar file (the input file name followed by 
+ * PQ_INDEX_SUFFIX) holding the decoder state every PQ_INDEX_INTERVAL 
+ * records, so that decoding can start part-way through a file without 
+ * replaying all of the overflows before it. Each checkpoint also records the
+ * first photon time (t2) or pulse (t3) after it, which is what is used to
+ * find the checkpoints around --start-time and --stop-time.
+ *
+ * The file consists of:
+ *     char     magic[8]        "PQINDEX"
+ *     uint32_t version         PQ_INDEX_VERSION
+ *     uint32_t reserved
+ *     uint64_t interval        records between checkpoints
+ *     uint64_t data_offset     file offset of the first record
+ *     uint64_t file_size       size and modification time of the input,
+ *     int64_t  file_mtime      to detect a stale index
+ *     uint64_t n_entries
+ * followed by the entries (pq_index_entry_t).
+ */
+#define PQ_INDEX_MAGIC "PQINDEX"
+#define PQ_INDEX_VERSION 1
+#define PQ_INDEX_SUFFIX ".pqidx"
+#define PQ_INDEX_INTERVAL (128*TTTR_BLOCK_RECORDS)
+#define PQ_INDEX_NONE UINT64_MAX
+
+typedef struct {
+	uint64_t record;
+	int64_t origin;
+	uint64_t overflows;
+	uint64_t first;
+} pq_index_entry_t;
+
+typedef struct {
+	char *filename;
+	uint64_t interval;
+	uint64_t data_offset;
+	uint64_t file_size;
+	int64_t file_mtime;
+	size_t n_entries;
+	size_t capacity;
+	pq_index_entry_t *entries;
+} pq_index_t;
+
+int pq_range_active(options_t *options);
+
+int pq_index_init(pq_index_t *index, FILE *stream_in, char const *filename);
+int pq_index_load(pq_index_t *index);
+int pq_index_save(pq_index_t *index);
+int pq_index_append(pq_index_t *index, uint64_t record, tttr_t *tttr);
+void pq_index_first(pq_index_t *index, uint64_t first);
+int pq_index_seek(pq_index_t *index, FILE *stream_in, tttr_t *tttr,
+		uint64_t start, uint64_t stop, uint64_t *length);
+void pq_index_free(pq_index_t *index);
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "intensity.h"
+#include "error.h"
+
+int pq_intensity_active(options_t *options) {
+	return(options->intensity_width > 0);
+}
+
+int pq_intensity_init(pq_intensity_t *intensity, FILE *stream_out,
+		size_t n_channels, options_t *options) {
+/*
+ * n_channels is the number of channels given by the header, or 0 if unknown.
+ * When only some channels are kept, those up to the last one are counted.
+ */
+	memset(intensity, 0, sizeof(pq_intensity_t));
+
+	if ( options->channel_mask != UINT64_MAX ) {
+		n_channels = 64;
+		while ( ! ((options->channel_mask >> (n_channels - 1)) & 1) ) {
+			n_channels--;
+		}
+	}
+
+	if ( n_channels > 0 ) {
+		intensity->counts = (uint32_t *)calloc(n_channels, sizeof(uint32_t));
+		if ( intensity->counts == NULL ) {
+			error("Could not allocate intensity channels.\n");
+			return(PQ_ERROR_MEM);
+		}
+		intensity->n_channels = n_channels;
+	}
+
+	intensity->width = options->intensity_width;
+	intensity->stream_out = stream_out;
+
+	if ( options->binary_out ) {
+		intensity->print = pq_interactive_bin_fwrite;
+	} else {
+		intensity->print = pq_interactive_bin_printf;
+	}
+
+	return(PQ_SUCCESS);
+}
+
+static void pq_intensity_flush(pq_intensity_t *intensity) {
+/*
+ * Write out the counts of the current bin and clear them.
+ */
+	size_t i;
+	pq_interactive_bin_t bin;
+
+	bin.bin_left = intensity->bin*intensity->width;
+	bin.bin_right = bin.bin_left + intensity->width;
+
+	for ( i = 0; i < intensity->n_channels; i++ ) {
+		bin.curve = i;
+		bin.counts = intensity->counts[i];
+		intensity->print(intensity->stream_out, &bin);
+	}
+
+	memset(intensity->counts, 0, intensity->n_channels*sizeof(uint32_t));
+}
+
+int pq_intensity_add(pq_intensity_t *intensity, uint32_t channel, 
+		uint64_t time) {
+	uint32_t *counts;
+	uint64_t bin = time/intensity->width;
+
+	if ( ! intensity->started ) {
+		intensity->bin = bin;
+		intensity->started = 1;
+	}
+
+	/* Photons which are slightly out of order stay in the current bin. */
+	while ( intensity->bin < bin ) {
+		pq_intensity_flush(intensity);
+		intensity->bin++;
+	}
+
+	if ( channel >= intensity->n_channels ) {
+		counts = (uint32_t *)realloc(intensity->counts, 
+				((size_t)channel + 1)*sizeof(uint32_t));
+		if ( counts == NULL ) {
+			error("Could not allocate intensity channels.\n");
+			return(PQ_ERROR_MEM);
+		}
+
+		memset(&counts[intensity->n_channels], 0, 
+				(channel + 1 - intensity->n_channels)*sizeof(uint32_t));
+		intensity->counts = counts;
+		intensity->n_channels = (size_t)channel + 1;
+	}
+
+	intensity->counts[channel]++;
+
+	return(PQ_SUCCESS);
+}
+
+void pq_intensity_finish(pq_intensity_t *intensity) {
+/*
+ * Write out the last bin, which is only partly filled.
+ */
+	if ( intensity->started ) {
+		pq_intensity_flush(intensity);
+	}
+}
+
+void pq_intensity_free(pq_intensity_t *intensity) {
+	free(intensity->counts);
+	intensity->counts = NULL;
+	intensity->n_channels = 0;
+}
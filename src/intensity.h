@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef INTENSITY_H_
+#define INTENSITY_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "options.h"
+#include "interactive.h"
+
+/* The intensity trace counts the photons of each channel in consecutive bins
+ * of width ps, aligned to the start of the measurement. The photons arrive in
+ * order, so only the current bin is kept: when a photon arrives after it, 
+ * the bin (and any empty bins since) is written out and counting moves on.
+ * The channels are fixed before the first bin, from --channels or the header,
+ * so that every bin lists the same channels. Only when neither gives them are
+ * channels added as they are seen.
+ */
+typedef struct {
+	uint64_t width;
+	uint64_t bin;
+	int started;
+	size_t n_channels;
+	uint32_t *counts;
+	FILE *stream_out;
+	pq_interactive_bin_print_t print;
+} pq_intensity_t;
+
+int pq_intensity_active(options_t *options);
+int pq_intensity_init(pq_intensity_t *intensity, FILE *stream_out,
+		size_t n_channels, options_t *options);
+int pq_intensity_add(pq_intensity_t *intensity, uint32_t channel, 
+		uint64_t time);
+void pq_intensity_finish(pq_intensity_t *intensity);
+void pq_intensity_free(pq_intensity_t *intensity);
+
+#endif
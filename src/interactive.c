@@ -30,16 +30,25 @@
  */
 
 #include "interactive.h"
+#include "format.h"
 
 void pq_interactive_bin_printf(FILE *out_stream, pq_interactive_bin_t *bin) {
 /*
  * Print the interactive bin, in ascii format.
  */
-	fprintf(out_stream, "%"PRIu32",%"PRId64",%.2"PRId64",%"PRIu32"\n",
-			bin->curve,
-			bin->bin_left,
-			bin->bin_right,
-			bin->counts);
+	char line[PQ_FORMAT_LINE];
+	char *end = line;
+
+	end = pq_format_u64(end, bin->curve);
+	*end++ = ',';
+	end = pq_format_i64(end, bin->bin_left, 1);
+	*end++ = ',';
+	end = pq_format_i64(end, bin->bin_right, 2);
+	*end++ = ',';
+	end = pq_format_u64(end, bin->counts);
+	*end++ = '\n';
+
+	fwrite(line, 1, end - line, out_stream);
 }
 
 void pq_interactive_bin_fwrite(FILE *out_stream, pq_interactive_bin_t *bin) {
@@ -32,24 +32,19 @@
 #ifndef INTERACTIVE_H_
 #define INTERACTIVE_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "types.h"
-
-typedef struct {
-	uint32_t curve;
-	int64_t bin_left;
-	int64_t bin_right;
-	uint32_t counts;
-} pq_interactive_bin_t;
+#include "records.h"
 
 typedef void (*pq_interactive_bin_print_t)(FILE *, pq_interactive_bin_t *);
 
 void pq_interactive_bin_printf(FILE *out_stream, pq_interactive_bin_t *bin);
 void pq_interactive_bin_fwrite(FILE *out_stream, pq_interactive_bin_t *bin);
 
-#pragma pack(pop)
+/* Tells the library reader in options->reader (see reader.c) that the bins
+ * which follow are a histogram.
+ */
+int pq_reader_attach_interactive(void *reader);
 
 #endif 
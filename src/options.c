@@ -86,10 +86,29 @@ void usage() {
 "           -v, --verbose: Print debug-level information.\n"
 "           -i, --file-in: Specify the input file. By default, this is stdin.\n"
 "          -o, --file-out: Specify the output file. By default, \n"
-"                          this is stdout.\n"
+"                          this is stdout. For a batch, the directory to\n"
+"                          write the outputs to.\n"
+"        -F, --files-from: Decode each of the files listed in this file,\n"
+"                          one per line (- for stdin), as a batch.\n"
+"            -x, --suffix: For a batch, the output for each file is written\n"
+"                          next to it, with this suffix added. By default,\n"
+"                          this is .header, .resolution or .mode with\n"
+"                          --header-only, --resolution-only or --mode-only,\n"
+"                          and .data otherwise.\n"
 "        -b, --binary-out: Output mode-specific binary structures instead of \n"
 "                          ascii csv.\n"
+"          -c, --columnar: For t2 and t3 data, output binary columns (one\n"
+"                          array per field) in chunks, instead of ascii csv.\n"
+"           -k, --compact: As --columnar, but store the channels and times\n"
+"                          as varints, with the times as differences between\n"
+"                          records. Columnar files can be read back as input.\n"
 "       -p, --print-every: Print a status every n entries.\n"
+"             -s, --stats: On exit, print the bytes read, the records\n"
+"                          decoded of each type, the throughput and the time\n"
+"                          spent reading, decoding, formatting and writing,\n"
+"                          as a line of JSON. With --print-every, a line is\n"
+"                          also printed every n records. These go to stderr,\n"
+"                          or are appended to the file given as --stats=FILE.\n"
 "   -z, --resolution-only: Print the resolution of the measurement, as a\n"
 "                          double-precision float in ps.\n"
 "       -r, --header-only: Print the file header in text format.\n"
@@ -99,31 +118,109 @@ void usage() {
 "                          data in t2 mode. Note that this will only be\n"
 "                          accurate if the sync source is perfectly regular.\n"
 "             -n --number: Process n entries. By default, all entries are \n"
-"                          processed.\n");
+"                          processed.\n"
+"         -S --start-time: Only process t2 photons arriving at or after this\n"
+"                          time (in ps), or t3 photons from this pulse on.\n"
+"                          For input files, an index of the overflows is\n"
+"                          kept next to the file to skip ahead quickly.\n"
+"          -E --stop-time: Only process photons before this time (t2) or \n"
+"                          pulse (t3).\n"
+"            -T --threads: Decode t2 and t3 data using n threads. By default,\n"
+"                          a single thread is used, or one per processor\n"
+"                          for a batch.\n"
+"           -P --pipeline: Read, decode, and print t2 and t3 data on separate\n"
+"                          threads, so that waiting on the input overlaps\n"
+"                          with decoding and printing.\n"
+"          -H --histogram: For t3 data, print a histogram of the arrival\n"
+"                          times for each channel instead of the photons,\n"
+"                          with bins of this width (in ps). The output is\n"
+"                          the same as for interactive data, with the\n"
+"                          channel as the curve.\n"
+"    -R --histogram-range: The range of the histogram, as start,stop (in\n"
+"                          ps). By default, this is one sync period.\n"
+"          -C --correlate: For t2 data, print the correlation g2(tau) of\n"
+"                          each pair of channels for delays up to this\n"
+"                          time (in ps), instead of the photons.\n"
+"     -B --correlate-bins: Number of delay bins for --correlate. By\n"
+"                          default, this is 100. With --log-bins, the\n"
+"                          number of bins in each level of the cascade,\n"
+"                          16 by default.\n"
+"           -L --log-bins: Space the delay bins logarithmically, in a\n"
+"                          multi-tau cascade, counted on one thread (so\n"
+"                          not with --threads).\n"
+"          -I --intensity: For t2 and t3 data, print the number of photons\n"
+"                          on each channel in consecutive bins of this\n"
+"                          width (in ps), instead of the photons. The output\n"
+"                          is the same as for --histogram.\n"
+"           -l --channels: For t2 and t3 data, only process photons on\n"
+"                          these channels, given as a comma-separated list.\n"
+"               -g --gate: For t3 data, only process photons arriving in\n"
+"                          this window after the sync, as start,stop (in ps).\n"
+"                          Both are applied as the records are decoded.\n"
+"             -f --follow: For t2 and t3 data, keep waiting for records to\n"
+"                          be added to the input at its end, as for a\n"
+"                          measurement in progress. This stops once the\n"
+"                          file is closed by its writer, or on an interrupt.\n"
+"                -M --shm: For t2 and t3 data, publish the photons to the\n"
+"                          POSIX shared memory ring of this name instead of\n"
+"                          printing them, for other programs on the same\n"
+"                          host to read with pq_shm_attach.\n"
+"        -w --shm-readers: Wait for this many readers to attach to the\n"
+"                          --shm ring before publishing any photons, so\n"
+"                          that they see the whole stream.\n"
+"\n"
+"Files given after the options (or with --files-from) are decoded as a\n"
+"batch, several at once, each to its own output. Patterns such as *.ht3\n"
+"are expanded.\n"
+"\n"
+"picoquant catalog [options] [path ...] keeps a catalog of the headers of\n"
+"the data files in a directory tree: see picoquant catalog --help.\n");
 }
 
 int options_parse(int argc, char *argv[], options_t *options) {
 	int result = PQ_SUCCESS;
 	int c, option_index;
+	char *end;
+	uint64_t channel;
 
-	char *options_string = "hVvi:o:bp:zrmtn:";
+	char *options_string = "hVvi:o:F:x:bckp:zrmtn:S:E:T:PH:R:C:B:LI:l:g:fM:w:s::";
 
 	static struct option long_options[] = {
 		{"help", no_argument, 0, 'h'},
 		{"verbose", no_argument, 0, 'v'},
 		{"version", no_argument, 0, 'V'},
 		{"print-every", required_argument, 0, 'p'},
+		{"stats", optional_argument, 0, 's'},
 
 		{"file-in", required_argument, 0, 'i'},
 		{"file-out", required_argument, 0, 'o'},
+		{"files-from", required_argument, 0, 'F'},
+		{"suffix", required_argument, 0, 'x'},
 
 		{"binary-out", no_argument, 0, 'b'},
+		{"columnar", no_argument, 0, 'c'},
+		{"compact", no_argument, 0, 'k'},
 
 		{"resolution-only", no_argument, 0, 'z'},
 		{"header-only", no_argument, 0, 'r'},
 		{"mode-only", no_argument, 0, 'm'},
 		{"to-t2", no_argument, 0, 't'},
 		{"number", required_argument, 0, 'n'},
+		{"start-time", required_argument, 0, 'S'},
+		{"stop-time", required_argument, 0, 'E'},
+		{"threads", required_argument, 0, 'T'},
+		{"pipeline", no_argument, 0, 'P'},
+		{"histogram", required_argument, 0, 'H'},
+		{"histogram-range", required_argument, 0, 'R'},
+		{"correlate", required_argument, 0, 'C'},
+		{"correlate-bins", required_argument, 0, 'B'},
+		{"log-bins", no_argument, 0, 'L'},
+		{"intensity", required_argument, 0, 'I'},
+		{"channels", required_argument, 0, 'l'},
+		{"gate", required_argument, 0, 'g'},
+		{"follow", no_argument, 0, 'f'},
+		{"shm", required_argument, 0, 'M'},
+		{"shm-readers", required_argument, 0, 'w'},
 		{0, 0, 0, 0}};
 
 	while ( (c = getopt_long(argc, argv, options_string,
@@ -150,9 +247,22 @@ int options_parse(int argc, char *argv[], options_t *options) {
 			case 'o':
 				options->filename_out = strdup(optarg);
 				break;
+			case 'F':
+				options->filename_list = strdup(optarg);
+				break;
+			case 'x':
+				options->suffix = strdup(optarg);
+				break;
 			case 'b':
 				options->binary_out = 1;
 				break;
+			case 'c':
+				options->columnar = 1;
+				break;
+			case 'k':
+				options->columnar = 1;
+				options->compact = 1;
+				break;
 			case 'z':
 				options->print_resolution = 1;
 				break;
@@ -168,6 +278,122 @@ int options_parse(int argc, char *argv[], options_t *options) {
 			case 'n':
 				options->number = strtoi64(optarg, NULL, 10);
 				break;
+			case 'S':
+				options->start_time = strtoull(optarg, &end, 10);
+				if ( *optarg == '\0' || *optarg == '-' || *end != '\0' ) {
+					error("Start time must be a non-negative integer: %s\n",
+							optarg);
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'E':
+				options->stop_time = strtoull(optarg, &end, 10);
+				if ( *optarg == '\0' || *optarg == '-' || *end != '\0' ) {
+					error("Stop time must be a non-negative integer: %s\n",
+							optarg);
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'T':
+				options->threads = strtoi32(optarg, NULL, 10);
+				if ( options->threads < 1 ) {
+					error("Number of threads must be at least 1.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'P':
+				options->pipeline = 1;
+				break;
+			case 'H':
+				options->histogram_width = strtoull(optarg, NULL, 10);
+				if ( options->histogram_width == 0 ) {
+					error("Histogram bin width must be at least 1 ps.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'R':
+				options->histogram_start = strtoull(optarg, &end, 10);
+				if ( *end == ',' ) {
+					options->histogram_stop = strtoull(end + 1, &end, 10);
+				}
+
+				if ( *end != '\0' || options->histogram_stop == 0 ) {
+					error("Histogram range must be given as start,stop.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'C':
+				options->correlate_max = strtoull(optarg, NULL, 10);
+				if ( options->correlate_max == 0 ) {
+					error("Correlation delay must be at least 1 ps.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'B':
+				options->correlate_bins = strtoull(optarg, NULL, 10);
+				if ( options->correlate_bins == 0 ) {
+					error("Must have at least one correlation bin.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'L':
+				options->correlate_log = 1;
+				break;
+			case 'I':
+				options->intensity_width = strtoull(optarg, NULL, 10);
+				if ( options->intensity_width == 0 ) {
+					error("Intensity bin width must be at least 1 ps.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'l':
+				options->channel_mask = 0;
+				end = optarg;
+				do {
+					channel = strtoull(end, &end, 10);
+					if ( channel < 64 ) {
+						options->channel_mask |= (uint64_t)1 << channel;
+					}
+				} while ( *end == ',' && *(++end) != '\0' );
+
+				if ( *end != '\0' || options->channel_mask == 0 ) {
+					error("Channels must be given as a list of integers "
+							"less than 64, such as 0,2.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'g':
+				options->gate_start = strtoull(optarg, &end, 10);
+				if ( *end == ',' ) {
+					options->gate_stop = strtoull(end + 1, &end, 10);
+				}
+
+				if ( *end != '\0' || 
+						options->gate_stop <= options->gate_start ) {
+					error("Gate must be given as start,stop.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
+			case 'f':
+				options->follow = 1;
+				break;
+			case 's':
+				options->print_stats = 1;
+				if ( optarg != NULL ) {
+					options->filename_stats = strdup(optarg);
+				}
+				break;
+			case 'M':
+				options->shm_name = strdup(optarg);
+				break;
+			case 'w':
+				options->shm_readers = strtoi32(optarg, NULL, 10);
+				if ( options->shm_readers < 1 ) {
+					error("Number of shared memory readers must be at "
+							"least 1.\n");
+					result = PQ_ERROR_OPTIONS;
+				}
+				break;
 			case '?':
 			default:
 				usage();
@@ -176,29 +402,94 @@ int options_parse(int argc, char *argv[], options_t *options) {
 		}
 	}
 
+	if ( result == PQ_SUCCESS && 
+			options->start_time >= options->stop_time ) {
+		error("Time range is empty: %"PRIu64" to %"PRIu64".\n",
+				options->start_time, options->stop_time);
+		result = PQ_ERROR_OPTIONS;
+	}
+
+	if ( result == PQ_SUCCESS && 
+			options->shm_readers && options->shm_name == NULL ) {
+		error("--shm-readers needs --shm.\n");
+		result = PQ_ERROR_OPTIONS;
+	}
+
+	/* Any other arguments are the files of a batch. */
+	if ( result == PQ_SUCCESS && optind < argc ) {
+		options->filenames_batch = (char **)malloc(
+				(argc - optind)*sizeof(char *));
+		if ( options->filenames_batch == NULL ) {
+			error("Could not allocate the list of files.\n");
+			result = PQ_ERROR_MEM;
+		}
+
+		while ( result == PQ_SUCCESS && optind < argc ) {
+			options->filenames_batch[options->n_filenames_batch++] = 
+					strdup(argv[optind++]);
+		}
+	}
+
 	return(result);
 }
 
 void options_init(options_t *options) {
 	options->filename_in = NULL;
 	options->filename_out = NULL;
+	options->filename_stats = NULL;
+	options->filenames_batch = NULL;
+	options->n_filenames_batch = 0;
+	options->filename_list = NULL;
+	options->suffix = NULL;
 	options->print_every = 0;
 
 	options->binary_out = 0;
+	options->columnar = 0;
+	options->compact = 0;
 
 	options->number = INT64_MAX;
+	options->start_time = 0;
+	options->stop_time = UINT64_MAX;
+	options->histogram_width = 0;
+	options->histogram_start = 0;
+	options->histogram_stop = 0;
+	options->correlate_max = 0;
+	options->correlate_bins = 0;
+	options->correlate_log = 0;
+	options->intensity_width = 0;
+	options->follow = 0;
+	options->shm_name = NULL;
+	options->shm_readers = 0;
+	options->channel_mask = UINT64_MAX;
+	options->gate_start = 0;
+	options->gate_stop = UINT64_MAX;
 	options->print_header = 0;
 	options->print_resolution = 0;
 	options->print_mode = 0;
+	options->print_stats = 0;
 	options->to_t2 = 0;
+	options->threads = 0;
+	options->pipeline = 0;
+	options->reader = NULL;
+	options->stats = NULL;
 
 //	options->hardware_name = NULL;
 //	options->hardware_version  = NULL;
 }
 
 void options_free(options_t *options) {
+	int i;
+
 	free(options->filename_in);
 	free(options->filename_out);
+	free(options->filename_stats);
+	for ( i = 0; i < options->n_filenames_batch; i++ ) {
+		free(options->filenames_batch[i]);
+	}
+	free(options->filenames_batch);
+	free(options->filename_list);
+	free(options->suffix);
+	free(options->shm_name);
 //	free(options->hardware_name);
 //	free(options->format_version);
 }
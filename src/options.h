@@ -37,6 +37,11 @@
 typedef struct {
 	char *filename_in;
 	char *filename_out;
+	char *filename_stats;
+	char **filenames_batch;
+	int n_filenames_batch;
+	char *filename_list;
+	char *suffix;
 	int print_every; 
 	int binary_out; 
 	int64_t number; 
@@ -44,6 +49,28 @@ typedef struct {
 	int print_resolution; 
 	int to_t2; 
 	int print_mode;
+	int print_stats;
+	int threads;
+	int pipeline;
+	int columnar;
+	int compact;
+	uint64_t start_time;
+	uint64_t stop_time;
+	uint64_t histogram_width;
+	uint64_t histogram_start;
+	uint64_t histogram_stop;
+	uint64_t correlate_max;
+	uint64_t correlate_bins;
+	int correlate_log;
+	uint64_t intensity_width;
+	int follow;
+	char *shm_name;
+	int shm_readers;
+	uint64_t channel_mask;
+	uint64_t gate_start;
+	uint64_t gate_stop;
+	void *reader;
+	void *stats;
 	char *hardware_name;
 	char *hardware_version;
 } options_t;
@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ph_simd.h"
+
+#include "../simd.h"
+#include "../error.h"
+
+#ifdef PQ_SIMD_X86
+/*
+ * These follow the Hydraharp kernels: a vector of raw records is unpacked
+ * with masks, the overflow records are counted with a prefix sum to give 
+ * the origin of each lane, and the record types are selected with blends.
+ *
+ * For t2, the time in ps is (origin + time)*resolution. The origin term is
+ * carried as origin*resolution plus a multiple of 
+ * overflow_increment*resolution, which is exact as long as the latter fits
+ * in 32 bits (the caller checks this). The time term is a 32-bit product,
+ * as in the scalar decoder.
+ */
+#define PH_T2_TIME_MASK 0x0fffffff
+#define PH_T2_MARKER_MASK 01111
+#define PH_T3_NSYNC_MASK 0xffff
+#define PH_T3_DTIME_MASK 0x0fff
+#define PH_SPECIAL_CHANNEL 15
+
+__attribute__((target("avx2")))
+static size_t ph_t2_decode_avx2(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[8];
+	uint64_t times[8];
+
+	__m256i const time_mask = _mm256_set1_epi32(PH_T2_TIME_MASK);
+	__m256i const marker_mask = _mm256_set1_epi32(PH_T2_MARKER_MASK);
+	__m256i const special_channel = _mm256_set1_epi32(PH_SPECIAL_CHANNEL);
+	__m256i const resolution = _mm256_set1_epi32(tttr->resolution_int);
+	__m256i const step = _mm256_set1_epi64x(
+			(uint64_t)tttr->overflow_increment * tttr->resolution_int);
+	__m256i const type_t2 = _mm256_set1_epi32(PQ_RECORD_T2);
+	__m256i const type_marker = _mm256_set1_epi32(PQ_RECORD_MARKER);
+	__m256i const type_overflow = _mm256_set1_epi32(PQ_RECORD_OVERFLOW);
+
+	for ( i = 0; i + 8 <= n_records; i += 8 ) {
+		__m256i record, time, channel, special, marker, overflow, count;
+		__m256i type, scaled, base, time_lo, time_hi, marker_lo, marker_hi;
+		uint32_t total;
+
+		record = _mm256_loadu_si256((__m256i const *)&records[i]);
+		time = _mm256_and_si256(record, time_mask);
+		channel = _mm256_srli_epi32(record, 28);
+		special = _mm256_cmpeq_epi32(channel, special_channel);
+		marker = _mm256_and_si256(special, _mm256_cmpeq_epi32(
+				_mm256_and_si256(time, marker_mask), marker_mask));
+		overflow = _mm256_andnot_si256(marker, special);
+
+		count = pq_simd_prefix_sum_avx2(_mm256_srli_epi32(overflow, 31));
+		total = (uint32_t)_mm256_extract_epi32(count, 7);
+
+		base = _mm256_set1_epi64x(origin * tttr->resolution_int);
+		scaled = _mm256_mullo_epi32(time, resolution);
+		time_lo = _mm256_add_epi64(
+				_mm256_add_epi64(base, _mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_castsi256_si128(count)), step)),
+				_mm256_cvtepu32_epi64(_mm256_castsi256_si128(scaled)));
+		time_hi = _mm256_add_epi64(
+				_mm256_add_epi64(base, _mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_extracti128_si256(count, 1)), step)),
+				_mm256_cvtepu32_epi64(_mm256_extracti128_si256(scaled, 1)));
+
+		/* Markers report the raw time field. */
+		marker_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(marker));
+		marker_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(marker, 1));
+		time_lo = _mm256_blendv_epi8(time_lo, _mm256_cvtepu32_epi64(
+				_mm256_castsi256_si128(time)), marker_lo);
+		time_hi = _mm256_blendv_epi8(time_hi, _mm256_cvtepu32_epi64(
+				_mm256_extracti128_si256(time, 1)), marker_hi);
+
+		type = _mm256_blendv_epi8(type_t2, type_marker, marker);
+		type = _mm256_blendv_epi8(type, type_overflow, overflow);
+
+		_mm256_storeu_si256((__m256i *)&types[i], type);
+		_mm256_storeu_si256((__m256i *)channels, channel);
+		_mm256_storeu_si256((__m256i *)&times[0], time_lo);
+		_mm256_storeu_si256((__m256i *)&times[4], time_hi);
+
+		for ( j = 0; j < 8; j++ ) {
+			t2[i+j].channel = channels[j];
+			t2[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t ph_t2_decode_sse42(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[4];
+	uint64_t times[4];
+
+	__m128i const time_mask = _mm_set1_epi32(PH_T2_TIME_MASK);
+	__m128i const marker_mask = _mm_set1_epi32(PH_T2_MARKER_MASK);
+	__m128i const special_channel = _mm_set1_epi32(PH_SPECIAL_CHANNEL);
+	__m128i const resolution = _mm_set1_epi32(tttr->resolution_int);
+	__m128i const step = _mm_set1_epi64x(
+			(uint64_t)tttr->overflow_increment * tttr->resolution_int);
+	__m128i const type_t2 = _mm_set1_epi32(PQ_RECORD_T2);
+	__m128i const type_marker = _mm_set1_epi32(PQ_RECORD_MARKER);
+	__m128i const type_overflow = _mm_set1_epi32(PQ_RECORD_OVERFLOW);
+
+	for ( i = 0; i + 4 <= n_records; i += 4 ) {
+		__m128i record, time, channel, special, marker, overflow, count;
+		__m128i type, scaled, base, time_lo, time_hi, marker_lo, marker_hi;
+		uint32_t total;
+
+		record = _mm_loadu_si128((__m128i const *)&records[i]);
+		time = _mm_and_si128(record, time_mask);
+		channel = _mm_srli_epi32(record, 28);
+		special = _mm_cmpeq_epi32(channel, special_channel);
+		marker = _mm_and_si128(special, _mm_cmpeq_epi32(
+				_mm_and_si128(time, marker_mask), marker_mask));
+		overflow = _mm_andnot_si128(marker, special);
+
+		count = pq_simd_prefix_sum_sse42(_mm_srli_epi32(overflow, 31));
+		total = (uint32_t)_mm_extract_epi32(count, 3);
+
+		base = _mm_set1_epi64x(origin * tttr->resolution_int);
+		scaled = _mm_mullo_epi32(time, resolution);
+		time_lo = _mm_add_epi64(
+				_mm_add_epi64(base, _mm_mul_epu32(
+					_mm_cvtepu32_epi64(count), step)),
+				_mm_cvtepu32_epi64(scaled));
+		time_hi = _mm_add_epi64(
+				_mm_add_epi64(base, _mm_mul_epu32(
+					_mm_cvtepu32_epi64(_mm_srli_si128(count, 8)), step)),
+				_mm_cvtepu32_epi64(_mm_srli_si128(scaled, 8)));
+
+		marker_lo = _mm_cvtepi32_epi64(marker);
+		marker_hi = _mm_cvtepi32_epi64(_mm_srli_si128(marker, 8));
+		time_lo = _mm_blendv_epi8(time_lo, 
+				_mm_cvtepu32_epi64(time), marker_lo);
+		time_hi = _mm_blendv_epi8(time_hi, 
+				_mm_cvtepu32_epi64(_mm_srli_si128(time, 8)), marker_hi);
+
+		type = _mm_blendv_epi8(type_t2, type_marker, marker);
+		type = _mm_blendv_epi8(type, type_overflow, overflow);
+
+		_mm_storeu_si128((__m128i *)&types[i], type);
+		_mm_storeu_si128((__m128i *)channels, channel);
+		_mm_storeu_si128((__m128i *)&times[0], time_lo);
+		_mm_storeu_si128((__m128i *)&times[2], time_hi);
+
+		for ( j = 0; j < 4; j++ ) {
+			t2[i+j].channel = channels[j];
+			t2[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+
+__attribute__((target("avx2")))
+static size_t ph_t3_decode_avx2(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[8];
+	uint64_t pulses[8];
+	uint64_t times[8];
+
+	__m256i const nsync_mask = _mm256_set1_epi32(PH_T3_NSYNC_MASK);
+	__m256i const dtime_mask = _mm256_set1_epi32(PH_T3_DTIME_MASK);
+	__m256i const special_channel = _mm256_set1_epi32(PH_SPECIAL_CHANNEL);
+	__m256i const resolution = _mm256_set1_epi32(tttr->resolution_int);
+	__m256i const increment = _mm256_set1_epi64x(tttr->overflow_increment);
+	__m256i const type_t3 = _mm256_set1_epi32(PQ_RECORD_T3);
+	__m256i const type_marker = _mm256_set1_epi32(PQ_RECORD_MARKER);
+	__m256i const type_overflow = _mm256_set1_epi32(PQ_RECORD_OVERFLOW);
+
+	for ( i = 0; i + 8 <= n_records; i += 8 ) {
+		__m256i record, nsync, dtime, channel, special, marker, overflow;
+		__m256i count, type, base, pulse_lo, pulse_hi, marker_lo, marker_hi;
+		__m256i scaled;
+		uint32_t total;
+
+		record = _mm256_loadu_si256((__m256i const *)&records[i]);
+		nsync = _mm256_and_si256(record, nsync_mask);
+		dtime = _mm256_and_si256(_mm256_srli_epi32(record, 16), dtime_mask);
+		channel = _mm256_srli_epi32(record, 28);
+		special = _mm256_cmpeq_epi32(channel, special_channel);
+		overflow = _mm256_and_si256(special, 
+				_mm256_cmpeq_epi32(dtime, _mm256_setzero_si256()));
+		marker = _mm256_andnot_si256(overflow, special);
+
+		count = pq_simd_prefix_sum_avx2(_mm256_srli_epi32(overflow, 31));
+		total = (uint32_t)_mm256_extract_epi32(count, 7);
+
+		base = _mm256_set1_epi64x(origin);
+		pulse_lo = _mm256_add_epi64(
+				_mm256_add_epi64(base, _mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_castsi256_si128(count)), increment)),
+				_mm256_cvtepu32_epi64(_mm256_castsi256_si128(nsync)));
+		pulse_hi = _mm256_add_epi64(
+				_mm256_add_epi64(base, _mm256_mul_epu32(_mm256_cvtepu32_epi64(
+					_mm256_extracti128_si256(count, 1)), increment)),
+				_mm256_cvtepu32_epi64(_mm256_extracti128_si256(nsync, 1)));
+
+		/* Markers report dtime in place of the pulse. */
+		marker_lo = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(marker));
+		marker_hi = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(marker, 1));
+		pulse_lo = _mm256_blendv_epi8(pulse_lo, _mm256_cvtepu32_epi64(
+				_mm256_castsi256_si128(dtime)), marker_lo);
+		pulse_hi = _mm256_blendv_epi8(pulse_hi, _mm256_cvtepu32_epi64(
+				_mm256_extracti128_si256(dtime, 1)), marker_hi);
+
+		scaled = _mm256_mullo_epi32(dtime, resolution);
+
+		type = _mm256_blendv_epi8(type_t3, type_marker, marker);
+		type = _mm256_blendv_epi8(type, type_overflow, overflow);
+
+		_mm256_storeu_si256((__m256i *)&types[i], type);
+		_mm256_storeu_si256((__m256i *)channels, channel);
+		_mm256_storeu_si256((__m256i *)&pulses[0], pulse_lo);
+		_mm256_storeu_si256((__m256i *)&pulses[4], pulse_hi);
+		_mm256_storeu_si256((__m256i *)&times[0], _mm256_cvtepu32_epi64(
+				_mm256_castsi256_si128(scaled)));
+		_mm256_storeu_si256((__m256i *)&times[4], _mm256_cvtepu32_epi64(
+				_mm256_extracti128_si256(scaled, 1)));
+
+		for ( j = 0; j < 8; j++ ) {
+			t3[i+j].channel = channels[j];
+			t3[i+j].pulse = pulses[j];
+			t3[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+
+__attribute__((target("sse4.2")))
+static size_t ph_t3_decode_sse42(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i, j;
+	uint64_t origin = tttr->origin;
+	uint32_t channels[4];
+	uint64_t pulses[4];
+	uint64_t times[4];
+
+	__m128i const nsync_mask = _mm_set1_epi32(PH_T3_NSYNC_MASK);
+	__m128i const dtime_mask = _mm_set1_epi32(PH_T3_DTIME_MASK);
+	__m128i const special_channel = _mm_set1_epi32(PH_SPECIAL_CHANNEL);
+	__m128i const resolution = _mm_set1_epi32(tttr->resolution_int);
+	__m128i const increment = _mm_set1_epi64x(tttr->overflow_increment);
+	__m128i const type_t3 = _mm_set1_epi32(PQ_RECORD_T3);
+	__m128i const type_marker = _mm_set1_epi32(PQ_RECORD_MARKER);
+	__m128i const type_overflow = _mm_set1_epi32(PQ_RECORD_OVERFLOW);
+
+	for ( i = 0; i + 4 <= n_records; i += 4 ) {
+		__m128i record, nsync, dtime, channel, special, marker, overflow;
+		__m128i count, type, base, pulse_lo, pulse_hi, marker_lo, marker_hi;
+		__m128i scaled;
+		uint32_t total;
+
+		record = _mm_loadu_si128((__m128i const *)&records[i]);
+		nsync = _mm_and_si128(record, nsync_mask);
+		dtime = _mm_and_si128(_mm_srli_epi32(record, 16), dtime_mask);
+		channel = _mm_srli_epi32(record, 28);
+		special = _mm_cmpeq_epi32(channel, special_channel);
+		overflow = _mm_and_si128(special, 
+				_mm_cmpeq_epi32(dtime, _mm_setzero_si128()));
+		marker = _mm_andnot_si128(overflow, special);
+
+		count = pq_simd_prefix_sum_sse42(_mm_srli_epi32(overflow, 31));
+		total = (uint32_t)_mm_extract_epi32(count, 3);
+
+		base = _mm_set1_epi64x(origin);
+		pulse_lo = _mm_add_epi64(
+				_mm_add_epi64(base, _mm_mul_epu32(
+					_mm_cvtepu32_epi64(count), increment)),
+				_mm_cvtepu32_epi64(nsync));
+		pulse_hi = _mm_add_epi64(
+				_mm_add_epi64(base, _mm_mul_epu32(
+					_mm_cvtepu32_epi64(_mm_srli_si128(count, 8)), increment)),
+				_mm_cvtepu32_epi64(_mm_srli_si128(nsync, 8)));
+
+		marker_lo = _mm_cvtepi32_epi64(marker);
+		marker_hi = _mm_cvtepi32_epi64(_mm_srli_si128(marker, 8));
+		pulse_lo = _mm_blendv_epi8(pulse_lo, 
+				_mm_cvtepu32_epi64(dtime), marker_lo);
+		pulse_hi = _mm_blendv_epi8(pulse_hi, 
+				_mm_cvtepu32_epi64(_mm_srli_si128(dtime, 8)), marker_hi);
+
+		scaled = _mm_mullo_epi32(dtime, resolution);
+
+		type = _mm_blendv_epi8(type_t3, type_marker, marker);
+		type = _mm_blendv_epi8(type, type_overflow, overflow);
+
+		_mm_storeu_si128((__m128i *)&types[i], type);
+		_mm_storeu_si128((__m128i *)channels, channel);
+		_mm_storeu_si128((__m128i *)&pulses[0], pulse_lo);
+		_mm_storeu_si128((__m128i *)&pulses[2], pulse_hi);
+		_mm_storeu_si128((__m128i *)&times[0], _mm_cvtepu32_epi64(scaled));
+		_mm_storeu_si128((__m128i *)&times[2], 
+				_mm_cvtepu32_epi64(_mm_srli_si128(scaled, 8)));
+
+		for ( j = 0; j < 4; j++ ) {
+			t3[i+j].channel = channels[j];
+			t3[i+j].pulse = pulses[j];
+			t3[i+j].time = times[j];
+		}
+
+		origin += (uint64_t)total * tttr->overflow_increment;
+		tttr->overflows += total;
+	}
+
+	tttr->origin = origin;
+	return(i);
+}
+#endif
+
+size_t ph_t2_decode_simd(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+/*
+ * Decode as many whole vectors of records as possible, returning the number
+ * of records decoded. The caller finishes the remainder with the scalar
+ * decoder.
+ */
+#ifdef PQ_SIMD_X86
+	if ( tttr->filter || 
+			(uint64_t)tttr->overflow_increment * tttr->resolution_int 
+			> UINT32_MAX ) {
+		/* Filtered photons are rejected by the scalar decoder. */
+		return(0);
+	}
+
+	switch ( pq_simd_level() ) {
+		case PQ_SIMD_AVX2:
+			return(ph_t2_decode_avx2(records, n_records, tttr, t2, types));
+		case PQ_SIMD_SSE42:
+			return(ph_t2_decode_sse42(records, n_records, tttr, t2, types));
+		default:
+			return(0);
+	}
+#else
+	return(0);
+#endif
+}
+
+size_t ph_t3_decode_simd(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+#ifdef PQ_SIMD_X86
+	if ( tttr->filter ) {
+		return(0);
+	}
+
+	switch ( pq_simd_level() ) {
+		case PQ_SIMD_AVX2:
+			return(ph_t3_decode_avx2(records, n_records, tttr, t3, types));
+		case PQ_SIMD_SSE42:
+			return(ph_t3_decode_sse42(records, n_records, tttr, t3, types));
+		default:
+			return(0);
+	}
+#else
+	return(0);
+#endif
+}
@@ -341,7 +341,7 @@ void ph_v20_header_fwrite(FILE *stream_out, ph_v20_header_t *ph_header) {
 				1,
 				stream_out);
 
-		fwrite(&(ph_header->Brd[i].RtCh),
+		fwrite(ph_header->Brd[i].RtCh,
 				sizeof(ph_v20_router_channel_t),
 				ph_header->RoutingChannels,
 				stream_out);
@@ -32,13 +32,13 @@
 #ifndef PH_V20_H_
 #define PH_V20_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "../picoquant.h"
 #include "../tttr.h"
 
+#pragma pack(push, 2)
+
 #define PH_V20_BASE_RESOLUTION 4e-12
 
 typedef struct {
@@ -226,11 +226,17 @@ void ph_v20_interactive_data_print(FILE *stream_out,
 void ph_v20_t2_init(ph_v20_header_t *ph_header,
 		ph_v20_tttr_header_t *tttr_header,
 		tttr_t *tttr);
+int ph_v20_t2_record_decode(ph_v20_t2_record_t *record, tttr_t *tttr, t2_t *t2);
 int ph_v20_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2);
+int ph_v20_t2_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types);
 void ph_v20_t3_init(ph_v20_header_t *ph_header,
 		ph_v20_tttr_header_t *tttr_header,
 		tttr_t *tttr);
+int ph_v20_t3_record_decode(ph_v20_t3_record_t *record, tttr_t *tttr, t3_t *t3);
 int ph_v20_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3);
+int ph_v20_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types);
 int ph_v20_tttr_stream(FILE *stream_in, FILE *stream_out, 
 		pq_header_t *pq_header, ph_v20_header_t *ph_header, 
 		options_t *options);
@@ -239,7 +245,7 @@ int ph_v20_t2_stream(FILE *stream_in, FILE *stream_out,
 		options_t *options);
 int ph_v20_t3_stream(FILE *stream_in, FILE *stream_out, 
 		ph_v20_header_t *ph_header, ph_v20_tttr_header_t *tttr_header,
-		options_t *options);
+		float64_t sync_period, options_t *options);
 
 int ph_v20_tttr_header_read(FILE *stream_in, 
 		ph_v20_tttr_header_t **tttr_header);
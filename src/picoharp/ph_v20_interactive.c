@@ -37,6 +37,7 @@
 #include "../picoharp.h"
 #include "../interactive.h"
 #include "../error.h"
+#include "../reader.h"
 
 /* 
  *
@@ -174,12 +175,13 @@ void ph_v20_interactive_header_printf(FILE *stream_out,
 		ph_v20_header_t *ph_header, 
 		ph_v20_interactive_t *interactive) {
 	int i;
+	char time_buffer[PQ_CTIME_LENGTH];
 
 	for ( i = 0; i < ph_header->NumberOfCurves; i++ ) {
 		fprintf(stream_out, "Crv[%d].CurveIndex = %"PRId32"\n",
 			i, interactive->Curve[i].CurveIndex);
 		fprintf(stream_out, "Crv[%d].TimeOfRecording = %s",
-			i, ctime32(&interactive->Curve[i].TimeOfRecording));
+			i, ctime32(&interactive->Curve[i].TimeOfRecording, time_buffer));
 		fprintf(stream_out, "Crv[%d].HardwareIdent = %s\n",
 			i, interactive->Curve[i].HardwareIdent);
 		fprintf(stream_out, "Crv[%d].HardwareVersion = %s\n",
@@ -326,6 +328,11 @@ void ph_v20_interactive_data_print(FILE *stream_out,
 	pq_interactive_bin_t bin;
 	pq_interactive_bin_print_t print;
 
+	if ( options->reader != NULL ) {
+		/* A library reader takes the bins in binary form. */
+		pq_reader_attach_interactive(options->reader);
+	}
+
 	if ( options->binary_out ) {
 		print = pq_interactive_bin_fwrite;
 	} else {
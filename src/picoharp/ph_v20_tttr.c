@@ -30,9 +30,11 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "ph_v20.h"
+#include "ph_simd.h"
 
 #include "../picoharp.h"
 #include "../error.h"
@@ -47,12 +49,38 @@ void ph_v20_t2_init(ph_v20_header_t *ph_header,
 		tttr_t *tttr) {
 	tttr->origin = 0;
 	tttr->overflows = 0;
+	tttr->channels = ph_header->RoutingChannels + 1;
 	tttr->overflow_increment = PH_T2_OVERFLOW;
 	tttr->sync_rate = tttr_header->InpRate0;
 	tttr->resolution_float = PH_V20_BASE_RESOLUTION;
 	tttr->resolution_int = floor(fabs(tttr->resolution_float * 1e12));
 }
 
+int ph_v20_t2_record_decode(ph_v20_t2_record_t *record, tttr_t *tttr, t2_t *t2) {
+	/* Now, interpret the record as an overflow or data. */
+	if ( record->channel == 15 ) {
+		/* Special record */
+		if ( (record->time & 01111) == 01111 ) {
+			/* External marker. */
+			t2->channel = 15;
+			t2->time = record->time;
+			return(PQ_RECORD_MARKER);
+		} else {
+			/* Overflow */
+			tttr->overflows++;
+			tttr->origin += tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		}
+	} else if ( TTTR_REJECTED_T2(tttr, record->channel) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		t2->channel = record->channel;
+		t2->time = tttr->origin * tttr->resolution_int + 
+				record->time * tttr->resolution_int;
+		return(PQ_RECORD_T2);
+	}
+}
+
 int ph_v20_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
 	size_t n_read;
 	ph_v20_t2_record_t record;
@@ -67,29 +95,25 @@ int ph_v20_t2_decode(FILE *stream_in, tttr_t *tttr, t2_t *t2) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		/* Now, interpret the record as an overflow or data. */
-		if ( record.channel == 15 ) {
-			/* Special record */
-			if ( (record.time & 01111) == 01111 ) {
-				/* External marker. */
-				t2->channel = 15;
-				t2->time = record.time;
-				return(PQ_RECORD_MARKER);
-			} else {
-				/* Overflow */
-				tttr->overflows++;
-				tttr->origin += tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			}
-		} else {
-			t2->channel = record.channel;
-			t2->time = tttr->origin * tttr->resolution_int + 
-					record.time * tttr->resolution_int;
-			return(PQ_RECORD_T2);
-		}
+		return(ph_v20_t2_record_decode(&record, tttr, t2));
 	}
 }
 
+int ph_v20_t2_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t2_t *t2, int *types) {
+	size_t i;
+	ph_v20_t2_record_t record;
+
+	i = ph_t2_decode_simd(records, n_records, tttr, t2, types);
+
+	for ( ; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = ph_v20_t2_record_decode(&record, tttr, &t2[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
 /*
  *
  * Reading and interpreting for t3 mode.
@@ -101,10 +125,36 @@ void ph_v20_t3_init(ph_v20_header_t *ph_header,
 		tttr_t *tttr) {
 	tttr->origin = 0;
 	tttr->overflows = 0;
+	tttr->channels = ph_header->RoutingChannels + 1;
 	tttr->overflow_increment = PH_T3_OVERFLOW;
 	tttr->sync_rate = tttr_header->InpRate0;
+	tttr->sync_period = 0;
 	tttr->resolution_float = ph_header->Brd[0].Resolution*1e-9;
 	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+	tttr->time_scale = 1;
+}
+
+int ph_v20_t3_record_decode(ph_v20_t3_record_t *record, tttr_t *tttr, t3_t *t3) {
+	if ( record->channel == 15 ) {
+		/* Special record. */
+		if ( record->dtime == 0 ) {
+			tttr->overflows++;
+			tttr->origin += tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		} else {
+			t3->channel = 15;
+			t3->pulse = record->dtime;
+			return(PQ_RECORD_MARKER);
+		}
+	} else if ( TTTR_REJECTED_T3(tttr, record->channel, 
+			(uint64_t)record->dtime * tttr->resolution_int) ) {
+		return(PQ_RECORD_FILTERED);
+	} else {
+		t3->channel = record->channel;
+		t3->pulse = tttr->origin + record->nsync;
+		t3->time = record->dtime * tttr->resolution_int;
+		return(PQ_RECORD_T3);
+	}
 }
 
 int ph_v20_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
@@ -120,26 +170,25 @@ int ph_v20_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		if ( record.channel == 15 ) {
-			/* Special record. */
-			if ( record.dtime == 0 ) {
-				tttr->overflows++;
-				tttr->origin += tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			} else {
-				t3->channel = 15;
-				t3->pulse = record.dtime;
-				return(PQ_RECORD_MARKER);
-			}
-		} else {
-			t3->channel = record.channel;
-			t3->pulse = tttr->origin + record.nsync;
-			t3->time = record.dtime * tttr->resolution_int;
-			return(PQ_RECORD_T3);
-		}
+		return(ph_v20_t3_record_decode(&record, tttr, t3));
 	}
 }
 
+int ph_v20_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i;
+	ph_v20_t3_record_t record;
+
+	i = ph_t3_decode_simd(records, n_records, tttr, t3, types);
+
+	for ( ; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = ph_v20_t3_record_decode(&record, tttr, &t3[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
+
 /*
  *
  * Streaming for t2 or t3 mode.
@@ -174,7 +223,7 @@ int ph_v20_tttr_stream(FILE *stream_in, FILE *stream_out,
 						ph_header, tttr_header, options);
 			} else if ( ph_header->MeasurementMode == PH_MODE_T3 ) {
 				result = ph_v20_t3_stream(stream_in, stream_out,
-						ph_header, tttr_header, options);
+						ph_header, tttr_header, 0, options);
 			} else {
 				debug("Unrecognized mode.\n");
 				result = PQ_ERROR_MODE;
@@ -200,16 +249,17 @@ int ph_v20_t2_stream(FILE *stream_in, FILE *stream_out,
 		return(PQ_SUCCESS);
 	} else {
 		return(pq_t2_stream(stream_in, stream_out, 
-				ph_v20_t2_decode, &tttr, options));
+				ph_v20_t2_decode_block, &tttr, options));
 	}
 }
 
 int ph_v20_t3_stream(FILE *stream_in, FILE *stream_out, 
 		ph_v20_header_t *ph_header, ph_v20_tttr_header_t *tttr_header,
-		options_t *options) {
+		float64_t sync_period, options_t *options) {
 	tttr_t tttr;
 
 	ph_v20_t3_init(ph_header, tttr_header, &tttr);
+	tttr.sync_period = sync_period;
 
 	if ( options->print_resolution ) {
 		pq_resolution_print(stream_out, -1, 
@@ -217,7 +267,7 @@ int ph_v20_t3_stream(FILE *stream_in, FILE *stream_out,
 		return(PQ_SUCCESS);
 	} else {
 		return(pq_t3_stream(stream_in, stream_out,
-				ph_v20_t3_decode, &tttr, options));
+				ph_v20_t3_decode_block, &tttr, options));
 	}
 }
 
@@ -47,6 +47,7 @@
 #include "continuous.h"
 #include "t2.h"
 #include "t3.h"
+#include "columns.h"
 
 int pq_dispatch(FILE *stream_in, FILE *stream_out, options_t *options) {
 	int result;
@@ -61,13 +62,18 @@ int pq_dispatch(FILE *stream_in, FILE *stream_out, options_t *options) {
 	} else if ( result == PQ_FORMAT_CLASSIC ) {
 		dispatch = pq_dispatch_get(options, &pq_header);
 		if ( dispatch == NULL ) {
-			error("Could not identify board %s.\n", pq_header.Ident);
+			error("Could not identify board %.*s.\n", 
+					(int)sizeof(pq_header.Ident), pq_header.Ident);
+			result = PQ_ERROR_UNKNOWN_DATA;
 		} else {
 			result = dispatch(stream_in, stream_out, 
 					&pq_header, options);
 		}
 	} else if ( result == PQ_FORMAT_UNIFIED ) {
 		result = pu_dispatch(stream_in, stream_out, &pu_header, options);
+	} else if ( result == PQ_FORMAT_COLUMNS ) {
+		result = pq_columns_dispatch(stream_in, stream_out, &pu_header, 
+				options);
 	} else {
 		error("Unknown result for header (code %d)\n", result);
 	}
@@ -32,8 +32,6 @@
 #ifndef PICOQUANT_H_
 #define PICOQUANT_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "types.h"
@@ -44,6 +42,8 @@
 #include "t2.h"
 #include "t3.h"
 
+#pragma pack(push, 2)
+
 // General board and mode dispatch
 typedef int (*pq_dispatch_t)(FILE *, FILE *, pq_header_t *, options_t *);
 
@@ -31,11 +31,15 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "error.h"
 #include "options.h"
 #include "picoquant.h"
 #include "files.h"
+#include "stats.h"
+#include "catalog.h"
+#include "batch.h"
 
 int main(int argc, char *argv[]) {
 	/* This software is designed to read in Picoquant data files and
@@ -44,24 +48,46 @@ int main(int argc, char *argv[]) {
 	 * stream of raw data and output a stream of processed data.
 	 */
 	options_t options;
+	pq_stats_t stats;
 
 	int result = 0;
 
 	FILE *stream_in = NULL;
 	FILE *stream_out = NULL;
 
+	if ( argc > 1 && ! strcmp(argv[1], "catalog") ) {
+		return(pq_check(pq_catalog_main(argc - 1, argv + 1)));
+	}
+
 	options_init(&options);
 	result = options_parse(argc, argv, &options);
 
+	if ( result == PQ_SUCCESS && pq_batch_active(&options) ) {
+		result = pq_batch_run(&options);
+		options_free(&options);
+		return(pq_check(result));
+	}
+
 	if ( result == PQ_SUCCESS ) {
 		result = streams_open(&stream_in, options.filename_in, 
 				&stream_out, options.filename_out);
 	}
 
+	if ( result == PQ_SUCCESS && options.print_stats ) {
+		result = pq_stats_init(&stats, &options);
+		if ( result == PQ_SUCCESS ) {
+			result = pq_stats_wrap(&stats, &stream_out);
+		}
+	}
+
 	if ( result == PQ_SUCCESS ) {
 		/* Do the actual work, if there are no errors. */
 		result = pq_dispatch(stream_in, stream_out, &options);
 	}
+
+	if ( options.stats != NULL ) {
+		result = pq_stats_finish(&stats, &stream_out, result);
+	}
 		
 	debug("Freeing options.\n");
 	options_free(&options);
@@ -0,0 +1,314 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "pipeline.h"
+#include "error.h"
+#include "tttr.h"
+
+#define PQ_PIPELINE_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define PQ_PIPELINE_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+typedef struct {
+	pq_pipeline_t *pipeline;
+	int stage;
+} pq_pipeline_thread_t;
+
+static int pq_pipeline_read(pq_batch_t *batch, void *args) {
+/*
+ * Copy the next block of records into the batch.
+ */
+	tttr_block_t *block = (tttr_block_t *)args;
+	int result;
+
+	result = tttr_block_read(block);
+
+	if ( ! pq_check(result) ) {
+		memcpy(batch->records, block->records, 
+				block->length*sizeof(uint32_t));
+		batch->length = block->length;
+	}
+
+	return(result);
+}
+
+#ifdef HAVE_PTHREAD_H
+static int pq_pipeline_stage(pq_pipeline_t *pipeline, int stage, 
+		pq_batch_t *batch) {
+/*
+ * Run the stage on the batch, timing it for --stats. The writer formats the
+ * records as it goes, so its time is counted as formatting.
+ */
+	static int const stats_stages[PQ_PIPELINE_STAGES] = {
+			PQ_STATS_READ, PQ_STATS_DECODE, PQ_STATS_FORMAT};
+	uint64_t clock;
+	int result;
+
+	if ( pipeline->stats == NULL ) {
+		return(pipeline->stages[stage](batch, pipeline->args[stage]));
+	}
+
+	clock = pq_stats_clock();
+	result = pipeline->stages[stage](batch, pipeline->args[stage]);
+	pq_stats_lap(pipeline->stats, stats_stages[stage], &clock);
+
+	if ( result == PQ_SUCCESS && stage == PQ_PIPELINE_READ ) {
+		pq_stats_input(pipeline->stats, batch->length*sizeof(uint32_t));
+	} else if ( result == PQ_SUCCESS && stage == PQ_PIPELINE_DECODE ) {
+		pq_stats_records(pipeline->stats, batch->types, batch->length);
+	}
+
+	return(result);
+}
+
+static void pq_pipeline_backoff(int *spins) {
+/*
+ * Give up the processor while waiting on another stage. Short waits only
+ * yield, but a stage waiting on slow storage should not keep a core busy.
+ */
+	struct timespec pause = {0, 100000};
+
+	if ( *spins < 64 ) {
+		(*spins)++;
+		sched_yield();
+	} else {
+		nanosleep(&pause, NULL);
+	}
+}
+
+static int pq_pipeline_ready(pq_pipeline_t *pipeline, int stage) {
+/*
+ * Wait until a batch is available to the stage. Returns 0 if the stage should
+ * finish instead, either because it was stopped or because the stage before
+ * it has finished and all of its batches have been handled.
+ */
+	int spins = 0;
+	int finished;
+	size_t available;
+
+	while ( ! PQ_PIPELINE_LOAD(pipeline->stop[stage]) ) {
+		if ( stage == PQ_PIPELINE_READ ) {
+			available = PQ_PIPELINE_LOAD(
+					pipeline->count[PQ_PIPELINE_WRITE]);
+			if ( pipeline->count[stage] - available < PQ_PIPELINE_BATCHES ) {
+				return(1);
+			}
+		} else {
+			/* The finished flag must be loaded before the count, so that a
+			 * batch finished just before the flag was set is not missed. 
+			 */
+			finished = PQ_PIPELINE_LOAD(pipeline->finished[stage-1]);
+			available = PQ_PIPELINE_LOAD(pipeline->count[stage-1]);
+			if ( available > pipeline->count[stage] ) {
+				return(1);
+			} else if ( finished ) {
+				return(0);
+			}
+		}
+
+		pq_pipeline_backoff(&spins);
+	}
+
+	return(0);
+}
+
+static void *pq_pipeline_thread(void *thread) {
+	pq_pipeline_t *pipeline = ((pq_pipeline_thread_t *)thread)->pipeline;
+	int stage = ((pq_pipeline_thread_t *)thread)->stage;
+	int result = PQ_SUCCESS;
+	int i;
+	pq_batch_t *batch;
+
+	while ( pq_pipeline_ready(pipeline, stage) ) {
+		batch = &pipeline->batches[
+				pipeline->count[stage] % PQ_PIPELINE_BATCHES];
+		result = pq_pipeline_stage(pipeline, stage, batch);
+
+		if ( result != PQ_SUCCESS ) {
+			break;
+		}
+
+		PQ_PIPELINE_STORE(pipeline->count[stage], pipeline->count[stage]+1);
+	}
+
+	pipeline->result[stage] = (result == PQ_ERROR_EOF) ? PQ_SUCCESS : result;
+
+	/* Once a stage is done, the stages before it cannot make progress. */
+	for ( i = 0; i < stage; i++ ) {
+		PQ_PIPELINE_STORE(pipeline->stop[i], 1);
+	}
+	PQ_PIPELINE_STORE(pipeline->finished[stage], 1);
+
+	return(NULL);
+}
+
+static int pq_pipeline_threads(pq_pipeline_t *pipeline) {
+/*
+ * Run the decoder and writer on their own threads, and the reader on this
+ * one. If the threads cannot be started, nothing has been consumed yet and
+ * the caller can fall back to running the stages in turn.
+ */
+	pq_pipeline_thread_t threads[PQ_PIPELINE_STAGES];
+	pthread_t handles[PQ_PIPELINE_STAGES];
+	int started[PQ_PIPELINE_STAGES] = {0};
+	int failed = 0;
+	int i;
+
+	for ( i = 0; i < PQ_PIPELINE_STAGES; i++ ) {
+		threads[i].pipeline = pipeline;
+		threads[i].stage = i;
+	}
+
+	for ( i = PQ_PIPELINE_DECODE; ! failed && i < PQ_PIPELINE_STAGES; i++ ) {
+		started[i] = ! pthread_create(&handles[i], NULL, 
+				pq_pipeline_thread, &threads[i]);
+		failed = ! started[i];
+	}
+
+	if ( failed ) {
+		warn("Could not start pipeline threads, running serially.\n");
+		for ( i = 0; i < PQ_PIPELINE_STAGES; i++ ) {
+			PQ_PIPELINE_STORE(pipeline->stop[i], 1);
+		}
+	} else {
+		pq_pipeline_thread(&threads[PQ_PIPELINE_READ]);
+	}
+
+	for ( i = PQ_PIPELINE_DECODE; i < PQ_PIPELINE_STAGES; i++ ) {
+		if ( started[i] ) {
+			pthread_join(handles[i], NULL);
+		}
+	}
+
+	return( ! failed );
+}
+#endif
+
+static int pq_pipeline_serial(pq_pipeline_t *pipeline) {
+/*
+ * Run each stage on a single batch in turn.
+ */
+	int result = PQ_SUCCESS;
+	int stage;
+	
+	while ( result == PQ_SUCCESS ) {
+		for ( stage = 0; 
+				result == PQ_SUCCESS && stage < PQ_PIPELINE_STAGES; 
+				stage++ ) {
+			result = pq_pipeline_stage(pipeline, stage, 
+					&pipeline->batches[0]);
+		}
+	}
+
+	return( (result == PQ_ERROR_EOF) ? PQ_SUCCESS : result );
+}
+
+int pq_pipeline_run(FILE *stream_in, size_t record_size,
+		pq_pipeline_stage_t decode, pq_pipeline_stage_t write, void *args,
+		pq_stats_t *stats) {
+/*
+ * Stream the input through the decode and write stages, with reading, 
+ * decoding and writing each running on a thread of their own. The batches
+ * are handled in order by each stage, so the output matches the serial case.
+ */
+	int result = PQ_SUCCESS;
+	int i;
+	tttr_block_t block;
+	pq_pipeline_t *pipeline;
+
+	pipeline = (pq_pipeline_t *)calloc(1, sizeof(pq_pipeline_t));
+	if ( pipeline == NULL ) {
+		error("Could not allocate pipeline.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	result = tttr_block_init(&block, stream_in, TTTR_BLOCK_RECORDS);
+
+	for ( i = 0; ! pq_check(result) && i < PQ_PIPELINE_BATCHES; i++ ) {
+		pipeline->batches[i].records = (uint32_t *)malloc(
+				TTTR_BLOCK_RECORDS*sizeof(uint32_t));
+		pipeline->batches[i].decoded = malloc(TTTR_BLOCK_RECORDS*record_size);
+		pipeline->batches[i].types = (int *)malloc(
+				TTTR_BLOCK_RECORDS*sizeof(int));
+
+		if ( pipeline->batches[i].records == NULL || 
+				pipeline->batches[i].decoded == NULL ||
+				pipeline->batches[i].types == NULL ) {
+			error("Could not allocate pipeline batch.\n");
+			result = PQ_ERROR_MEM;
+		}
+	}
+
+	pipeline->stages[PQ_PIPELINE_READ] = pq_pipeline_read;
+	pipeline->args[PQ_PIPELINE_READ] = &block;
+	pipeline->stages[PQ_PIPELINE_DECODE] = decode;
+	pipeline->args[PQ_PIPELINE_DECODE] = args;
+	pipeline->stages[PQ_PIPELINE_WRITE] = write;
+	pipeline->args[PQ_PIPELINE_WRITE] = args;
+	pipeline->stats = stats;
+
+	if ( ! pq_check(result) ) {
+#ifdef HAVE_PTHREAD_H
+		if ( pq_pipeline_threads(pipeline) ) {
+			/* A stage only sees batches which the stages before it handled
+			 * successfully, so the error furthest down the pipeline is the 
+			 * first one in the stream.
+			 */
+			for ( i = 0; i < PQ_PIPELINE_STAGES; i++ ) {
+				if ( pq_check(pipeline->result[i]) ) {
+					result = pipeline->result[i];
+				}
+			}
+		} else {
+			result = pq_pipeline_serial(pipeline);
+		}
+#else
+		result = pq_pipeline_serial(pipeline);
+#endif
+	}
+
+	for ( i = 0; i < PQ_PIPELINE_BATCHES; i++ ) {
+		free(pipeline->batches[i].records);
+		free(pipeline->batches[i].decoded);
+		free(pipeline->batches[i].types);
+	}
+	free(pipeline);
+	tttr_block_free(&block);
+
+	return(result);
+}
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "stats.h"
+
+/* The pipeline connects a reader, a decoder and a writer thread with ring
+ * buffers of record batches. Each stage owns a counter of the batches it has
+ * finished, and may only touch a batch once the stage before it is done with
+ * it, so every ring has a single producer and a single consumer and needs no
+ * locks.
+ */
+#define PQ_PIPELINE_BATCHES 16
+
+#define PQ_PIPELINE_READ 0
+#define PQ_PIPELINE_DECODE 1
+#define PQ_PIPELINE_WRITE 2
+#define PQ_PIPELINE_STAGES 3
+
+typedef struct {
+	uint32_t *records;
+	size_t length;
+	void *decoded;
+	int *types;
+} pq_batch_t;
+
+/* A stage returns PQ_SUCCESS to pass the batch on, PQ_ERROR_EOF to finish 
+ * normally without passing it on, or an error code.
+ */
+typedef int (*pq_pipeline_stage_t)(pq_batch_t *batch, void *args);
+
+typedef struct {
+	pq_batch_t batches[PQ_PIPELINE_BATCHES];
+	size_t count[PQ_PIPELINE_STAGES];
+	int finished[PQ_PIPELINE_STAGES];
+	int stop[PQ_PIPELINE_STAGES];
+	int result[PQ_PIPELINE_STAGES];
+	pq_pipeline_stage_t stages[PQ_PIPELINE_STAGES];
+	void *args[PQ_PIPELINE_STAGES];
+	pq_stats_t *stats;
+} pq_pipeline_t;
+
+int pq_pipeline_run(FILE *stream_in, size_t record_size,
+		pq_pipeline_stage_t decode, pq_pipeline_stage_t write, void *args,
+		pq_stats_t *stats);
+
+#endif
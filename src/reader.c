@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "reader.h"
+#include "error.h"
+#include "options.h"
+#include "tttr.h"
+#include "t2.h"
+#include "t3.h"
+#include "interactive.h"
+#include "picoquant.h"
+
+struct pq_reader {
+	FILE *stream_in;
+	int mode;
+	int result;
+	tttr_t tttr;
+	pq_t2_decode_block_t decode_t2;
+	pq_t3_decode_block_t decode_t3;
+
+	tttr_block_t block;
+	int block_open;
+	void *decoded;
+	int *types;
+	char *capture;
+	size_t capture_length;
+	size_t length;
+	size_t position;
+};
+
+static FILE *pq_reader_capture_open(pq_reader_t *reader) {
+/*
+ * Histograms are written out by their dispatch rather than decoded on demand,
+ * so they are caught in memory (or a temporary file) in binary form.
+ */
+	free(reader->capture);
+	reader->capture = NULL;
+	reader->capture_length = 0;
+
+#ifdef HAVE_OPEN_MEMSTREAM
+	return(open_memstream(&reader->capture, &reader->capture_length));
+#else
+	return(tmpfile());
+#endif
+}
+
+static int pq_reader_capture_close(pq_reader_t *reader, FILE *stream) {
+#ifdef HAVE_OPEN_MEMSTREAM
+	fclose(stream);
+#else
+	long length;
+
+	fseek(stream, 0, SEEK_END);
+	length = ftell(stream);
+	rewind(stream);
+
+	reader->capture = (char *)malloc(length + 1);
+	if ( reader->capture == NULL ) {
+		fclose(stream);
+		return(PQ_ERROR_MEM);
+	}
+
+	reader->capture_length = fread(reader->capture, 1, length, stream);
+	reader->capture[reader->capture_length] = '\0';
+	fclose(stream);
+#endif
+
+	if ( reader->capture == NULL ) {
+		return(PQ_ERROR_MEM);
+	} else {
+		return(PQ_SUCCESS);
+	}
+}
+
+pq_reader_t *pq_reader_open(char const *filename) {
+/*
+ * Open the file (or stdin, if no name is given) and read its header, leaving
+ * the reader ready to decode its records. Histograms are read in full here.
+ * Returns NULL if the file cannot be read or holds some other kind of data.
+ */
+	int result = PQ_SUCCESS;
+	options_t options;
+	pq_reader_t *reader;
+	FILE *stream_capture;
+
+	reader = (pq_reader_t *)calloc(1, sizeof(pq_reader_t));
+	if ( reader == NULL ) {
+		error("Could not allocate reader.\n");
+		return(NULL);
+	}
+
+	if ( filename == NULL ) {
+		reader->stream_in = stdin;
+	} else {
+		reader->stream_in = fopen(filename, "rb");
+	}
+
+	if ( reader->stream_in == NULL ) {
+		error("Could not open %s.\n", filename);
+		pq_reader_close(reader);
+		return(NULL);
+	}
+
+	stream_capture = pq_reader_capture_open(reader);
+	if ( stream_capture == NULL ) {
+		error("Could not open a stream for histograms.\n");
+		pq_reader_close(reader);
+		return(NULL);
+	}
+
+	options_init(&options);
+	options.filename_in = (char *)filename;
+	options.binary_out = 1;
+	options.reader = reader;
+
+	result = pq_dispatch(reader->stream_in, stream_capture, &options);
+	if ( ! pq_check(result) ) {
+		result = pq_reader_capture_close(reader, stream_capture);
+	} else {
+		pq_reader_capture_close(reader, stream_capture);
+	}
+
+	if ( pq_check(result) ) {
+		pq_reader_close(reader);
+		return(NULL);
+	} else if ( reader->mode == PQ_RECORD_INTERACTIVE ) {
+		reader->length = reader->capture_length/sizeof(pq_interactive_bin_t);
+		return(reader);
+	} else if ( reader->mode != PQ_RECORD_T2 && 
+			reader->mode != PQ_RECORD_T3 ) {
+		error("Only t2, t3, and interactive data can be read.\n");
+		pq_reader_close(reader);
+		return(NULL);
+	}
+
+	result = tttr_block_init(&reader->block, reader->stream_in, 
+			TTTR_BLOCK_RECORDS);
+	reader->block_open = 1;
+	reader->decoded = malloc(TTTR_BLOCK_RECORDS*
+			(reader->mode == PQ_RECORD_T2 ? sizeof(t2_t) : sizeof(t3_t)));
+	reader->types = (int *)malloc(TTTR_BLOCK_RECORDS*sizeof(int));
+
+	if ( pq_check(result) || 
+			reader->decoded == NULL || reader->types == NULL ) {
+		error("Could not allocate reader buffers.\n");
+		pq_reader_close(reader);
+		return(NULL);
+	}
+
+	return(reader);
+}
+
+int pq_reader_mode(pq_reader_t *reader) {
+/*
+ * PQ_RECORD_T2, PQ_RECORD_T3, or PQ_RECORD_INTERACTIVE.
+ */
+	return(reader->mode);
+}
+
+float64_t pq_reader_resolution(pq_reader_t *reader) {
+/*
+ * The resolution of the measurement, in ps. Histograms carry their own
+ * resolution in the bin edges, and give 0 here.
+ */
+	if ( reader->mode == PQ_RECORD_INTERACTIVE ) {
+		return(0);
+	}
+
+	return(reader->tttr.resolution_float*1e12);
+}
+
+int64_t pq_reader_remaining(pq_reader_t *reader) {
+/*
+ * The number of histogram bins not yet read. The number of photons is only
+ * known once they are decoded, so t2 and t3 data give -1.
+ */
+	if ( reader->mode == PQ_RECORD_INTERACTIVE ) {
+		return(reader->length - reader->position);
+	} else {
+		return(-1);
+	}
+}
+
+/* The photons are handed out either as records or as one array per field.
+ */
+typedef struct {
+	void *records;
+	size_t record_size;
+	uint32_t *channel;
+	uint64_t *pulse;
+	uint64_t *time;
+} pq_reader_sink_t;
+
+static int pq_reader_fill(pq_reader_t *reader) {
+/*
+ * Decode the next block of records, once the last one has been used up.
+ */
+	if ( reader->position < reader->length ) {
+		return(PQ_SUCCESS);
+	}
+
+	reader->position = 0;
+	reader->length = 0;
+
+	reader->result = tttr_block_read(&reader->block);
+	if ( pq_check(reader->result) ) {
+		return(reader->result);
+	}
+
+	if ( reader->mode == PQ_RECORD_T2 ) {
+		reader->result = reader->decode_t2(reader->block.records, 
+				reader->block.length, &reader->tttr, 
+				(t2_t *)reader->decoded, reader->types);
+	} else {
+		reader->result = reader->decode_t3(reader->block.records, 
+				reader->block.length, &reader->tttr, 
+				(t3_t *)reader->decoded, reader->types);
+	}
+
+	if ( ! pq_check(reader->result) ) {
+		reader->length = reader->block.length;
+	}
+
+	return(reader->result);
+}
+
+static char const *pq_reader_mode_name(int mode) {
+	if ( mode == PQ_RECORD_T2 ) {
+		return("t2");
+	} else if ( mode == PQ_RECORD_T3 ) {
+		return("t3");
+	} else {
+		return("interactive");
+	}
+}
+
+static int64_t pq_reader_next(pq_reader_t *reader, int mode, 
+		pq_reader_sink_t *sink, size_t n) {
+/*
+ * Copy up to n photons into the sink. Returns the number copied, which is
+ * 0 at the end of the data, or an error code.
+ */
+	size_t count = 0;
+	int type;
+	t2_t const *t2;
+	t3_t const *t3;
+
+	if ( reader->mode != mode ) {
+		error("Reader has %s data.\n", pq_reader_mode_name(reader->mode));
+		return(PQ_ERROR_MODE);
+	}
+
+	while ( count < n ) {
+		if ( pq_check(pq_reader_fill(reader)) ) {
+			break;
+		}
+
+		type = reader->types[reader->position];
+
+		if ( type == mode ) {
+			if ( sink->records != NULL ) {
+				memcpy((char *)sink->records + count*sink->record_size, 
+						(char *)reader->decoded + 
+						reader->position*sink->record_size, 
+						sink->record_size);
+			} else if ( mode == PQ_RECORD_T2 ) {
+				t2 = &((t2_t const *)reader->decoded)[reader->position];
+				sink->channel[count] = t2->channel;
+				sink->time[count] = t2->time;
+			} else {
+				t3 = &((t3_t const *)reader->decoded)[reader->position];
+				sink->channel[count] = t3->channel;
+				sink->pulse[count] = t3->pulse;
+				sink->time[count] = t3->time;
+			}
+			count++;
+		} else if ( type != PQ_RECORD_MARKER && 
+				type != PQ_RECORD_OVERFLOW && 
+				type != PQ_RECORD_FILTERED ) {
+			error("Record type not recognized: %d\n", type);
+			reader->result = PQ_ERROR_UNKNOWN_DATA;
+			break;
+		}
+
+		reader->position++;
+	}
+
+	if ( count == 0 && reader->result != PQ_ERROR_EOF && 
+			pq_check(reader->result) ) {
+		return(reader->result);
+	} else {
+		return(count);
+	}
+}
+
+int64_t pq_reader_next_t2(pq_reader_t *reader, t2_t *records, size_t n) {
+	pq_reader_sink_t sink = {records, sizeof(t2_t), NULL, NULL, NULL};
+
+	return(pq_reader_next(reader, PQ_RECORD_T2, &sink, n));
+}
+
+int64_t pq_reader_next_t3(pq_reader_t *reader, t3_t *records, size_t n) {
+	pq_reader_sink_t sink = {records, sizeof(t3_t), NULL, NULL, NULL};
+
+	return(pq_reader_next(reader, PQ_RECORD_T3, &sink, n));
+}
+
+int64_t pq_reader_next_columns(pq_reader_t *reader, uint32_t *channel, 
+		uint64_t *pulse, uint64_t *time, size_t n) {
+/*
+ * As pq_reader_next_t2 or pq_reader_next_t3, but store up to n photons as 
+ * one array per field, straight from the decoded block. pulse is only used
+ * for t3 data.
+ */
+	pq_reader_sink_t sink = {NULL, 0, channel, pulse, time};
+
+	if ( reader->mode != PQ_RECORD_T2 && reader->mode != PQ_RECORD_T3 ) {
+		error("Reader has %s data.\n", pq_reader_mode_name(reader->mode));
+		return(PQ_ERROR_MODE);
+	}
+
+	return(pq_reader_next(reader, reader->mode, &sink, n));
+}
+
+int64_t pq_reader_next_bins(pq_reader_t *reader, pq_interactive_bin_t *bins,
+		size_t n) {
+/*
+ * Copy up to n histogram bins, in order of curve and then time.
+ */
+	if ( reader->mode != PQ_RECORD_INTERACTIVE ) {
+		error("Reader has %s data.\n", pq_reader_mode_name(reader->mode));
+		return(PQ_ERROR_MODE);
+	}
+
+	if ( n > reader->length - reader->position ) {
+		n = reader->length - reader->position;
+	}
+
+	memcpy(bins, reader->capture + 
+			reader->position*sizeof(pq_interactive_bin_t), 
+			n*sizeof(pq_interactive_bin_t));
+	reader->position += n;
+
+	return(n);
+}
+
+int64_t pq_reader_next_bin_columns(pq_reader_t *reader, uint32_t *curve,
+		int64_t *bin_left, int64_t *bin_right, uint32_t *counts, size_t n) {
+/*
+ * As pq_reader_next_bins, but store the bins as one array per field.
+ */
+	size_t i;
+	pq_interactive_bin_t bin;
+
+	if ( reader->mode != PQ_RECORD_INTERACTIVE ) {
+		error("Reader has %s data.\n", pq_reader_mode_name(reader->mode));
+		return(PQ_ERROR_MODE);
+	}
+
+	if ( n > reader->length - reader->position ) {
+		n = reader->length - reader->position;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		memcpy(&bin, reader->capture + 
+				(reader->position + i)*sizeof(pq_interactive_bin_t), 
+				sizeof(pq_interactive_bin_t));
+		curve[i] = bin.curve;
+		bin_left[i] = bin.bin_left;
+		bin_right[i] = bin.bin_right;
+		counts[i] = bin.counts;
+	}
+	reader->position += n;
+
+	return(n);
+}
+
+void pq_reader_close(pq_reader_t *reader) {
+	if ( reader == NULL ) {
+		return;
+	}
+
+	if ( reader->block_open ) {
+		tttr_block_free(&reader->block);
+	}
+
+	if ( reader->stream_in != NULL && reader->stream_in != stdin ) {
+		fclose(reader->stream_in);
+	}
+
+	free(reader->capture);
+	free(reader->decoded);
+	free(reader->types);
+	free(reader);
+}
+
+int pq_reader_attach_t2(void *reader, pq_t2_decode_block_t decode, 
+		tttr_t *tttr) {
+/*
+ * Called by pq_t2_stream in place of decoding, when reading for a library.
+ */
+	pq_reader_t *pq_reader = (pq_reader_t *)reader;
+
+	pq_reader->mode = PQ_RECORD_T2;
+	pq_reader->decode_t2 = decode;
+	pq_reader->tttr = *tttr;
+
+	return(PQ_SUCCESS);
+}
+
+int pq_reader_attach_t3(void *reader, pq_t3_decode_block_t decode, 
+		tttr_t *tttr) {
+	pq_reader_t *pq_reader = (pq_reader_t *)reader;
+
+	pq_reader->mode = PQ_RECORD_T3;
+	pq_reader->decode_t3 = decode;
+	pq_reader->tttr = *tttr;
+
+	return(PQ_SUCCESS);
+}
+
+int pq_reader_attach_interactive(void *reader) {
+/*
+ * Called as a histogram is written out, which the reader catches in binary.
+ */
+	pq_reader_t *pq_reader = (pq_reader_t *)reader;
+
+	pq_reader->mode = PQ_RECORD_INTERACTIVE;
+
+	return(PQ_SUCCESS);
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef READER_H_
+#define READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codes.h"
+#include "records.h"
+
+/* The reader lets other programs pull photons out of a file in batches, 
+ * rather than running picoquant and parsing its output:
+ *
+ *     #include <picoquant/reader.h>
+ *
+ *     pq_reader_t *reader = pq_reader_open("data.ht2");
+ *     t2_t photons[1024];
+ *     int64_t n;
+ *
+ *     while ( (n = pq_reader_next_t2(reader, photons, 1024)) > 0 ) {
+ *         ...
+ *     }
+ *     pq_reader_close(reader);
+ *
+ * The file is identified and its header read by the same dispatch as for
+ * picoquant itself, but the t2 or t3 stream hands its decoder over to the
+ * reader instead of decoding the records. Histograms are read whole when the
+ * file is opened, and handed out bin by bin with pq_reader_next_bins.
+ * pq_reader_next_columns and pq_reader_next_bin_columns store the same data
+ * as one array per field instead, for callers which keep it that way.
+ *
+ * This header, with codes.h, records.h and shm_reader.h, is installed as the
+ * interface of libpicoquant; the rest of the library is not exported.
+ */
+typedef struct pq_reader pq_reader_t;
+
+pq_reader_t *pq_reader_open(char const *filename);
+int pq_reader_mode(pq_reader_t *reader);
+double pq_reader_resolution(pq_reader_t *reader);
+int64_t pq_reader_remaining(pq_reader_t *reader);
+int64_t pq_reader_next_t2(pq_reader_t *reader, t2_t *records, size_t n);
+int64_t pq_reader_next_t3(pq_reader_t *reader, t3_t *records, size_t n);
+int64_t pq_reader_next_bins(pq_reader_t *reader, pq_interactive_bin_t *bins,
+		size_t n);
+int64_t pq_reader_next_columns(pq_reader_t *reader, uint32_t *channel, 
+		uint64_t *pulse, uint64_t *time, size_t n);
+int64_t pq_reader_next_bin_columns(pq_reader_t *reader, uint32_t *curve,
+		int64_t *bin_left, int64_t *bin_right, uint32_t *counts, size_t n);
+void pq_reader_close(pq_reader_t *reader);
+
+#endif
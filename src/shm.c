@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+
+#ifdef HAVE_SHM_OPEN
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "shm.h"
+#include "error.h"
+
+#define PQ_SHM_LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define PQ_SHM_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+int pq_shm_active(options_t *options) {
+	return(options->shm_name != NULL);
+}
+
+static void pq_shm_backoff(int *spins) {
+/*
+ * As in the pipeline: yield for short waits, then sleep.
+ */
+	struct timespec pause = {0, 100000};
+
+	if ( *spins < 64 ) {
+		(*spins)++;
+		sched_yield();
+	} else {
+		nanosleep(&pause, NULL);
+	}
+}
+
+static char *pq_shm_name(char const *name) {
+/*
+ * Shared memory names start with a slash, which may be left out.
+ */
+	char *full;
+
+	full = (char *)malloc(strlen(name) + 2);
+	if ( full != NULL ) {
+		full[0] = '/';
+		strcpy(full + (name[0] != '/'), name);
+	}
+
+	return(full);
+}
+
+static int pq_shm_attached(pq_shm_header_t *header) {
+/*
+ * Count the readers which have claimed a slot and set their tail. The pid is
+ * set last, and cleared on detaching, so it marks a reader as ready.
+ */
+	int attached = 0;
+	int i;
+
+	for ( i = 0; i < PQ_SHM_READERS; i++ ) {
+		if ( PQ_SHM_LOAD(header->readers[i].active) && 
+				PQ_SHM_LOAD(header->readers[i].pid) != 0 ) {
+			attached++;
+		}
+	}
+
+	return(attached);
+}
+
+int pq_shm_open(pq_shm_t *shm, char const *name, int mode, 
+		size_t record_size, int readers) {
+/*
+ * Create the segment, replacing any left by an earlier writer. Readers 
+ * which still have the old one mapped keep it until they detach.
+ * If readers is given, wait for that many to attach before returning, so 
+ * that nothing is published before they start.
+ */
+#ifdef HAVE_SHM_OPEN
+	int fd;
+	int spins = 0;
+	uint64_t capacity = PQ_SHM_RECORDS;
+
+	memset(shm, 0, sizeof(pq_shm_t));
+
+	if ( readers > PQ_SHM_READERS ) {
+		error("At most %d shared memory readers can attach, not %d.\n",
+				PQ_SHM_READERS, readers);
+		return(PQ_ERROR_OPTIONS);
+	}
+
+	shm->name = pq_shm_name(name);
+	if ( shm->name == NULL ) {
+		error("Could not allocate shared memory name.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	shm->record_size = record_size;
+	shm->mask = capacity - 1;
+	shm->length = sizeof(pq_shm_header_t) + capacity*record_size;
+
+	shm_unlink(shm->name);
+	fd = shm_open(shm->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	if ( fd < 0 ) {
+		error("Could not create shared memory %s: %s\n", shm->name,
+				strerror(errno));
+		free(shm->name);
+		shm->name = NULL;
+		return(PQ_ERROR_IO);
+	}
+
+	if ( ftruncate(fd, shm->length) != 0 ) {
+		error("Could not size shared memory %s: %s\n", shm->name, 
+				strerror(errno));
+		close(fd);
+		shm_unlink(shm->name);
+		free(shm->name);
+		shm->name = NULL;
+		return(PQ_ERROR_IO);
+	}
+
+	shm->header = (pq_shm_header_t *)mmap(NULL, shm->length, 
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( shm->header == MAP_FAILED ) {
+		error("Could not map shared memory %s.\n", shm->name);
+		shm->header = NULL;
+		shm_unlink(shm->name);
+		free(shm->name);
+		shm->name = NULL;
+		return(PQ_ERROR_MEM);
+	}
+
+	debug("Publishing records to shared memory %s.\n", shm->name);
+
+	memcpy(shm->header->magic, PQ_SHM_MAGIC, sizeof(shm->header->magic));
+	shm->header->mode = mode;
+	shm->header->record_size = record_size;
+	shm->header->n_readers = PQ_SHM_READERS;
+	shm->header->capacity = capacity;
+	shm->header->data_offset = sizeof(pq_shm_header_t);
+	shm->data = (char *)shm->header + shm->header->data_offset;
+	shm->limit = capacity;
+
+	/* Readers wait for the version, so it marks the header as complete. */
+	PQ_SHM_STORE(shm->header->version, PQ_SHM_VERSION);
+
+	if ( readers > 0 ) {
+		debug("Waiting for %d shared memory readers.\n", readers);
+		while ( pq_shm_attached(shm->header) < readers ) {
+			pq_shm_backoff(&spins);
+		}
+	}
+
+	return(PQ_SUCCESS);
+#else
+	error("Shared memory output is not supported on this system.\n");
+	return(PQ_ERROR_OPTIONS);
+#endif
+}
+
+static uint64_t pq_shm_limit(pq_shm_t *shm) {
+/*
+ * Find how far the writer may go: a full ring past the slowest reader, or
+ * past the published records if there are no readers.
+ * Slots of readers which have exited are freed along the way.
+ */
+	pq_shm_header_t *header = shm->header;
+	uint64_t limit = shm->position + header->capacity;
+	uint64_t tail;
+	int i;
+
+	for ( i = 0; i < PQ_SHM_READERS; i++ ) {
+		if ( ! PQ_SHM_LOAD(header->readers[i].active) ) {
+			continue;
+		}
+
+		tail = PQ_SHM_LOAD(header->readers[i].tail);
+		if ( tail + header->capacity < limit ) {
+#ifdef HAVE_SHM_OPEN
+			if ( header->readers[i].pid > 0 && 
+					kill(header->readers[i].pid, 0) != 0 && 
+					errno == ESRCH ) {
+				warn("Shared memory reader %d has exited, dropping it.\n",
+						header->readers[i].pid);
+				PQ_SHM_STORE(header->readers[i].active, 0);
+				continue;
+			}
+#endif
+			limit = tail + header->capacity;
+		}
+	}
+
+	return(limit);
+}
+
+int pq_shm_append(pq_shm_t *shm, void const *record) {
+/*
+ * Add a record to the ring. It is seen by the readers once published.
+ */
+	int spins = 0;
+
+	while ( shm->position >= shm->limit ) {
+		/* The ring is full as far as the writer knows, so hand over what
+		 * there is and wait for the readers to catch up.
+		 */
+		pq_shm_publish(shm);
+		if ( shm->position >= shm->limit ) {
+			pq_shm_backoff(&spins);
+		}
+	}
+
+	memcpy(shm->data + (shm->position & shm->mask)*shm->record_size, 
+			record, shm->record_size);
+	shm->position++;
+
+	return(PQ_SUCCESS);
+}
+
+void pq_shm_publish(pq_shm_t *shm) {
+/*
+ * Make the records appended so far visible to the readers. A reader which 
+ * attaches after this starts at this head or later, so this is also when the
+ * limit is safe to refresh: it then covers readers the writer has not seen.
+ */
+	PQ_SHM_STORE(shm->header->head, shm->position);
+	shm->limit = pq_shm_limit(shm);
+}
+
+int pq_shm_finish(pq_shm_t *shm, int result) {
+/*
+ * Publish the last records and mark the stream as finished. The segment 
+ * stays, so that readers can take their time with the end of it.
+ */
+	if ( shm->header != NULL ) {
+		pq_shm_publish(shm);
+		PQ_SHM_STORE(shm->header->finished, 
+				pq_check(result) ? PQ_SHM_FAILED : PQ_SHM_DONE);
+#ifdef HAVE_SHM_OPEN
+		munmap(shm->header, shm->length);
+#endif
+		shm->header = NULL;
+	}
+
+	free(shm->name);
+	shm->name = NULL;
+
+	return(result);
+}
+
+int pq_shm_attach(pq_shm_reader_t *reader, char const *name) {
+/*
+ * Map the segment and claim a reader slot, starting from the records 
+ * published from now on: all of them, if the writer is waiting for readers.
+ * The pid is stored after the tail, to tell such a writer it can go on.
+ * Returns PQ_ERROR_IO if there is no segment by that
+ * name yet, or its writer has not finished setting it up.
+ */
+#ifdef HAVE_SHM_OPEN
+	struct stat shm_stat;
+	pq_shm_header_t *header;
+	char *full;
+	uint32_t inactive;
+	int fd;
+	int i;
+
+	memset(reader, 0, sizeof(pq_shm_reader_t));
+	reader->slot = -1;
+
+	full = pq_shm_name(name);
+	if ( full == NULL ) {
+		error("Could not allocate shared memory name.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	fd = shm_open(full, O_RDWR, 0);
+	free(full);
+
+	if ( fd < 0 ) {
+		return(PQ_ERROR_IO);
+	}
+
+	if ( fstat(fd, &shm_stat) != 0 || 
+			(size_t)shm_stat.st_size < sizeof(pq_shm_header_t) ) {
+		close(fd);
+		return(PQ_ERROR_IO);
+	}
+
+	reader->length = shm_stat.st_size;
+	header = (pq_shm_header_t *)mmap(NULL, reader->length, 
+			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if ( header == MAP_FAILED ) {
+		return(PQ_ERROR_IO);
+	}
+
+	reader->header = header;
+
+	if ( PQ_SHM_LOAD(header->version) != PQ_SHM_VERSION || 
+			memcmp(header->magic, PQ_SHM_MAGIC, sizeof(header->magic)) ||
+			header->data_offset + header->capacity*header->record_size > 
+				reader->length ) {
+		pq_shm_detach(reader);
+		return(PQ_ERROR_IO);
+	}
+
+	reader->data = (char *)header + header->data_offset;
+	reader->record_size = header->record_size;
+	reader->mask = header->capacity - 1;
+
+	for ( i = 0; i < PQ_SHM_READERS; i++ ) {
+		inactive = 0;
+		if ( __atomic_compare_exchange_n(&header->readers[i].active, 
+					&inactive, 1, 0, 
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ) {
+			PQ_SHM_STORE(header->readers[i].tail, PQ_SHM_LOAD(header->head));
+			PQ_SHM_STORE(header->readers[i].pid, getpid());
+			reader->slot = i;
+			return(PQ_SUCCESS);
+		}
+	}
+
+	error("All %d shared memory reader slots are in use.\n", PQ_SHM_READERS);
+	pq_shm_detach(reader);
+	return(PQ_ERROR_IO);
+#else
+	error("Shared memory is not supported on this system.\n");
+	return(PQ_ERROR_OPTIONS);
+#endif
+}
+
+int pq_shm_reader_mode(pq_shm_reader_t *reader) {
+	return(reader->header->mode);
+}
+
+int64_t pq_shm_read(pq_shm_reader_t *reader, void *records, size_t n) {
+/*
+ * Copy up to n records into the array, waiting for at least one. Returns 
+ * the number of records copied, 0 at the end of the stream, or an error.
+ */
+	pq_shm_header_t *header = reader->header;
+	pq_shm_slot_t *slot = &header->readers[reader->slot];
+	uint64_t tail = slot->tail;
+	uint64_t head;
+	uint64_t start;
+	size_t count;
+	size_t first;
+	int finished;
+	int spins = 0;
+
+	while ( 1 ) {
+		/* As in the pipeline, load the flag before the count. */
+		finished = PQ_SHM_LOAD(header->finished);
+		head = PQ_SHM_LOAD(header->head);
+
+		if ( head > tail ) {
+			break;
+		} else if ( finished == PQ_SHM_FAILED ) {
+			error("Shared memory writer failed.\n");
+			return(PQ_ERROR_IO);
+		} else if ( finished ) {
+			return(0);
+		} else if ( ! PQ_SHM_LOAD(slot->active) ) {
+			error("Shared memory reader was dropped by the writer.\n");
+			return(PQ_ERROR_IO);
+		}
+
+		pq_shm_backoff(&spins);
+	}
+
+	count = head - tail < n ? head - tail : n;
+	start = tail & reader->mask;
+	first = count < reader->mask + 1 - start ? count : reader->mask + 1 - start;
+
+	memcpy(records, reader->data + start*reader->record_size, 
+			first*reader->record_size);
+	memcpy((char *)records + first*reader->record_size, reader->data, 
+			(count - first)*reader->record_size);
+
+	PQ_SHM_STORE(slot->tail, tail + count);
+	return(count);
+}
+
+void pq_shm_detach(pq_shm_reader_t *reader) {
+	if ( reader->header == NULL ) {
+		return;
+	}
+
+	if ( reader->slot >= 0 ) {
+		PQ_SHM_STORE(reader->header->readers[reader->slot].pid, 0);
+		PQ_SHM_STORE(reader->header->readers[reader->slot].active, 0);
+	}
+
+#ifdef HAVE_SHM_OPEN
+	munmap(reader->header, reader->length);
+#endif
+	reader->header = NULL;
+	reader->slot = -1;
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHM_H_
+#define SHM_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "options.h"
+#include "shm_reader.h"
+
+/* Shared-memory output, into the ring described in shm_reader.h. The writer
+ * keeps the position of the next record, which is published by 
+ * pq_shm_publish, and how far it may go before checking the readers again.
+ */
+typedef struct {
+	char *name;
+	pq_shm_header_t *header;
+	char *data;
+	size_t length;
+	size_t record_size;
+	uint64_t mask;
+	uint64_t position;
+	uint64_t limit;
+} pq_shm_t;
+
+int pq_shm_active(options_t *options);
+int pq_shm_open(pq_shm_t *shm, char const *name, int mode, 
+		size_t record_size, int readers);
+int pq_shm_append(pq_shm_t *shm, void const *record);
+void pq_shm_publish(pq_shm_t *shm);
+int pq_shm_finish(pq_shm_t *shm, int result);
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SHM_READER_H_
+#define SHM_READER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "codes.h"
+#include "records.h"
+
+/* Shared-memory output. The decoded records (t2_t or t3_t, exactly as 
+ * written by --binary-out) are published into a ring buffer in a named POSIX
+ * shared memory segment, which any number of processes on the same machine
+ * can read from while it is being written. The segment starts with a header,
+ * with each counter on a cache line of its own:
+ *
+ *     offset 0    char     magic[8]       "PQSHMRNG"
+ *             8   uint32_t version        PQ_SHM_VERSION, set last
+ *            12   uint32_t mode           PQ_RECORD_T2 or PQ_RECORD_T3
+ *            16   uint32_t record_size    bytes per record
+ *            20   uint32_t n_readers      PQ_SHM_READERS
+ *            24   uint64_t capacity       records in the ring (a power of 2)
+ *            32   uint64_t data_offset    bytes from the start of the segment
+ *                                         to the ring
+ *            64   uint64_t head           records published so far
+ *            72   uint32_t finished       0 while writing, then PQ_SHM_DONE
+ *                                         or PQ_SHM_FAILED
+ *           128   one line per reader:
+ *                 uint64_t tail           records consumed by the reader
+ *                 uint32_t active         1 while the slot is in use
+ *                 int32_t  pid            of the reader
+ *
+ * Record i is stored at data_offset + (i % capacity)*record_size. There is 
+ * one writer, and each reader claims a slot by changing active from 0 to 1 
+ * with a compare-and-swap, then sets its tail to the current head and then
+ * its pid (both with release semantics). The pid is cleared again, before 
+ * active, when the reader detaches. The 
+ * writer stores the records before advancing head (with release semantics),
+ * and never lets head run more than capacity records past the tail of an 
+ * active reader. A reader loads head (with acquire semantics), copies the 
+ * records from its tail up to head, then advances its tail (with release 
+ * semantics) to hand the space back. A reader which exits without giving up
+ * its slot is found by its pid and dropped, so it cannot stall the writer. 
+ * Once finished is set, the head will not move again.
+ *
+ * A reader gets every record published after it attaches, in order and 
+ * without gaps, but not those published before. To get the whole stream,
+ * start the writer with --shm-readers N: it then publishes nothing until N 
+ * slots are active with their pid set, so those readers start from record 0.
+ *
+ * The segment is replaced when the next writer with the same name starts, 
+ * or can be removed with shm_unlink. The pq_shm_attach family below 
+ * implements the reader side, for programs using libpicoquant.
+ */
+#define PQ_SHM_MAGIC "PQSHMRNG"
+#define PQ_SHM_VERSION 1
+#define PQ_SHM_READERS 16
+#define PQ_SHM_LINE 64
+#define PQ_SHM_RECORDS ((uint64_t)1 << 22)
+
+#define PQ_SHM_DONE 1
+#define PQ_SHM_FAILED 2
+
+typedef struct {
+	uint64_t tail;
+	uint32_t active;
+	int32_t pid;
+	uint8_t reserved[PQ_SHM_LINE - 16];
+} pq_shm_slot_t;
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t mode;
+	uint32_t record_size;
+	uint32_t n_readers;
+	uint64_t capacity;
+	uint64_t data_offset;
+	uint8_t reserved_0[PQ_SHM_LINE - 40];
+	uint64_t head;
+	uint32_t finished;
+	uint8_t reserved_1[PQ_SHM_LINE - 12];
+	pq_shm_slot_t readers[PQ_SHM_READERS];
+} pq_shm_header_t;
+
+typedef struct {
+	pq_shm_header_t *header;
+	char *data;
+	size_t length;
+	size_t record_size;
+	uint64_t mask;
+	int slot;
+} pq_shm_reader_t;
+
+int pq_shm_attach(pq_shm_reader_t *reader, char const *name);
+int pq_shm_reader_mode(pq_shm_reader_t *reader);
+int64_t pq_shm_read(pq_shm_reader_t *reader, void *records, size_t n);
+void pq_shm_detach(pq_shm_reader_t *reader);
+
+#endif
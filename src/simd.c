@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "simd.h"
+#include "error.h"
+
+int pq_simd_level(void) {
+/*
+ * Determine the best instruction set available for the block decoders.
+ * The answer does not change while running, so only ask the processor once.
+ * PICOQUANT_SIMD (none, sse4.2, or avx2) lowers the level, so that the 
+ * narrower decoders can be checked against the others on any processor.
+ */
+	static int level = -1;
+	char const *limit;
+
+	if ( level < 0 ) {
+		level = PQ_SIMD_NONE;
+#ifdef PQ_SIMD_X86
+		__builtin_cpu_init();
+		if ( __builtin_cpu_supports("avx2") ) {
+			level = PQ_SIMD_AVX2;
+		} else if ( __builtin_cpu_supports("sse4.2") ) {
+			level = PQ_SIMD_SSE42;
+		}
+#endif
+
+		limit = getenv("PICOQUANT_SIMD");
+		if ( limit == NULL || ! strcmp(limit, "avx2") ) {
+			;
+		} else if ( ! strcmp(limit, "sse4.2") ) {
+			level = level < PQ_SIMD_SSE42 ? level : PQ_SIMD_SSE42;
+		} else if ( ! strcmp(limit, "none") ) {
+			level = PQ_SIMD_NONE;
+		} else {
+			warn("Unknown PICOQUANT_SIMD: %s\n", limit);
+		}
+
+		debug("Using SIMD level %d for decoding.\n", level);
+	}
+
+	return(level);
+}
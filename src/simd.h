@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SIMD_H_
+#define SIMD_H_
+
+/* The vectorized decoders are built with per-function target attributes and
+ * selected at runtime, so a single binary runs on any x86 processor.
+ */
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define PQ_SIMD_X86 1
+#endif
+
+#define PQ_SIMD_NONE                    0
+#define PQ_SIMD_SSE42                   1
+#define PQ_SIMD_AVX2                    2
+
+int pq_simd_level(void);
+
+#ifdef PQ_SIMD_X86
+#include <immintrin.h>
+
+/* Inclusive prefix sums of 32-bit lanes, used by the decoders to turn 
+ * per-record overflow counts into per-record origins.
+ */
+__attribute__((target("avx2")))
+static inline __m256i pq_simd_prefix_sum_avx2(__m256i x) {
+	__m256i carry;
+
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 4));
+	x = _mm256_add_epi32(x, _mm256_slli_si256(x, 8));
+	carry = _mm256_permutevar8x32_epi32(x, 
+			_mm256_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3));
+	carry = _mm256_blend_epi32(_mm256_setzero_si256(), carry, 0xf0);
+	return(_mm256_add_epi32(x, carry));
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i pq_simd_prefix_sum_sse42(__m128i x) {
+	x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+	return(_mm_add_epi32(x, _mm_slli_si128(x, 8)));
+}
+#endif
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stats.h"
+#include "error.h"
+#include "format.h"
+
+#define PQ_STATS_ADD(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define PQ_STATS_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+static char const *pq_stats_stage_names[PQ_STATS_STAGES] = {
+		"read", "decode", "format", "write"};
+
+int pq_stats_init(pq_stats_t *stats, options_t *options) {
+/*
+ * The statistics are written as JSON lines to stderr, or appended to the
+ * file given with --stats, so that several runs can share one file.
+ */
+	memset(stats, 0, sizeof(pq_stats_t));
+	stats->start = pq_stats_clock();
+	stats->print_every = options->print_every > 0 ? options->print_every : 0;
+	stats->next_print = stats->print_every;
+
+	if ( options->filename_stats == NULL ) {
+		stats->stream_stats = stderr;
+	} else {
+		stats->stream_stats = fopen(options->filename_stats, "a");
+		if ( stats->stream_stats == NULL ) {
+			error("Could not open %s for statistics.\n", 
+					options->filename_stats);
+			return(PQ_ERROR_IO);
+		}
+	}
+
+	options->stats = stats;
+
+	return(PQ_SUCCESS);
+}
+
+#ifdef HAVE_FOPENCOOKIE
+static ssize_t pq_stats_write(void *cookie, char const *buffer, size_t size) {
+/*
+ * Pass the output on to the real stream, timing how long it takes.
+ */
+	pq_stats_t *stats = (pq_stats_t *)cookie;
+	uint64_t clock = pq_stats_clock();
+	size_t written;
+
+	written = fwrite(buffer, 1, size, stats->stream_out);
+	pq_stats_lap(stats, PQ_STATS_WRITE, &clock);
+	PQ_STATS_ADD(stats->bytes_out, written);
+
+	return( (written == 0 && size > 0) ? -1 : (ssize_t)written );
+}
+#endif
+
+int pq_stats_wrap(pq_stats_t *stats, FILE **stream_out) {
+/*
+ * Replace the output stream with one which times and counts the writes made
+ * to the original, with the same buffering as streams_open gives it.
+ */
+	stats->stream_out = *stream_out;
+
+#ifdef HAVE_FOPENCOOKIE
+	cookie_io_functions_t functions = {NULL, pq_stats_write, NULL, NULL};
+
+	stats->stream_wrapped = fopencookie(stats, "w", functions);
+	if ( stats->stream_wrapped == NULL ) {
+		error("Could not wrap the output stream for statistics.\n");
+		return(PQ_ERROR_IO);
+	}
+
+	if ( ! isatty(fileno(*stream_out)) ) {
+		stats->buffer = (char *)malloc(PQ_FORMAT_STREAM_BUFFER);
+		if ( stats->buffer == NULL ) {
+			error("Could not allocate statistics output buffer.\n");
+			fclose(stats->stream_wrapped);
+			stats->stream_wrapped = NULL;
+			return(PQ_ERROR_MEM);
+		}
+		setvbuf(stats->stream_wrapped, stats->buffer, _IOFBF, 
+				PQ_FORMAT_STREAM_BUFFER);
+	} else {
+		setvbuf(stats->stream_wrapped, NULL, _IOLBF, 0);
+	}
+
+	*stream_out = stats->stream_wrapped;
+#endif
+
+	return(PQ_SUCCESS);
+}
+
+int pq_stats_finish(pq_stats_t *stats, FILE **stream_out, int result) {
+/*
+ * Flush and unwrap the output, then print the totals.
+ */
+	uint64_t clock;
+
+	if ( stats->stream_wrapped != NULL ) {
+		if ( fclose(stats->stream_wrapped) != 0 && ! pq_check(result) ) {
+			error("Could not write output.\n");
+			result = PQ_ERROR_IO;
+		}
+		stats->stream_wrapped = NULL;
+
+		clock = pq_stats_clock();
+		fflush(stats->stream_out);
+		pq_stats_lap(stats, PQ_STATS_WRITE, &clock);
+		free(stats->buffer);
+		stats->buffer = NULL;
+	}
+
+	if ( stats->stream_out != NULL ) {
+		*stream_out = stats->stream_out;
+	}
+
+	pq_stats_print(stats, "done");
+
+	if ( stats->stream_stats != stderr ) {
+		fclose(stats->stream_stats);
+	}
+
+	return(result);
+}
+
+uint64_t pq_stats_clock(void) {
+/*
+ * Nanoseconds on the monotonic clock, which is read through the vdso and
+ * costs well under a microsecond.
+ */
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return((uint64_t)now.tv_sec*1000000000 + now.tv_nsec);
+}
+
+void pq_stats_lap(pq_stats_t *stats, int stage, uint64_t *clock) {
+/*
+ * Add the time since the clock was last read to the stage, and restart the
+ * clock for the next stage.
+ */
+	uint64_t now;
+
+	if ( stats == NULL ) {
+		return;
+	}
+
+	now = pq_stats_clock();
+	PQ_STATS_ADD(stats->nanoseconds[stage], now - *clock);
+	*clock = now;
+}
+
+void pq_stats_input(pq_stats_t *stats, size_t bytes) {
+	if ( stats != NULL ) {
+		PQ_STATS_ADD(stats->bytes_in, bytes);
+	}
+}
+
+void pq_stats_records(pq_stats_t *stats, int const *types, size_t n) {
+/*
+ * Count the decoded records by type. With --print-every, this also reports
+ * the progress so far each time that many more records have been decoded.
+ */
+	uint64_t counts[PQ_STATS_TYPES] = {0};
+	uint64_t total = 0;
+	size_t i;
+	int type;
+
+	if ( stats == NULL ) {
+		return;
+	}
+
+	for ( i = 0; i < n; i++ ) {
+		if ( types[i] >= 0 && types[i] < PQ_STATS_TYPES ) {
+			counts[types[i]]++;
+		}
+	}
+
+	for ( type = 0; type < PQ_STATS_TYPES; type++ ) {
+		if ( counts[type] > 0 ) {
+			PQ_STATS_ADD(stats->records[type], counts[type]);
+		}
+		total += PQ_STATS_LOAD(stats->records[type]);
+	}
+
+	if ( stats->print_every > 0 && total >= stats->next_print ) {
+		pq_stats_print(stats, "progress");
+		stats->next_print = (total/stats->print_every + 1)*stats->print_every;
+	}
+}
+
+void pq_stats_print(pq_stats_t *stats, char const *event) {
+/*
+ * Write one JSON object on a line of its own. Time spent writing happens
+ * while formatting, so it is taken out of the formatting time.
+ */
+	double elapsed;
+	double seconds[PQ_STATS_STAGES];
+	uint64_t records[PQ_STATS_TYPES];
+	uint64_t bytes_in;
+	uint64_t total = 0;
+	int i;
+
+	elapsed = (pq_stats_clock() - stats->start)*1e-9;
+	bytes_in = PQ_STATS_LOAD(stats->bytes_in);
+
+	for ( i = 0; i < PQ_STATS_TYPES; i++ ) {
+		records[i] = PQ_STATS_LOAD(stats->records[i]);
+		total += records[i];
+	}
+
+	for ( i = 0; i < PQ_STATS_STAGES; i++ ) {
+		seconds[i] = PQ_STATS_LOAD(stats->nanoseconds[i])*1e-9;
+	}
+
+	seconds[PQ_STATS_FORMAT] -= seconds[PQ_STATS_WRITE];
+	if ( seconds[PQ_STATS_FORMAT] < 0 ) {
+		seconds[PQ_STATS_FORMAT] = 0;
+	}
+
+	fprintf(stats->stream_stats, 
+			"{\"event\": \"%s\", \"elapsed_s\": %.6f, "
+			"\"bytes_in\": %"PRIu64", \"bytes_out\": %"PRIu64", "
+			"\"records\": {\"t2\": %"PRIu64", \"t3\": %"PRIu64", "
+			"\"marker\": %"PRIu64", \"overflow\": %"PRIu64", "
+			"\"filtered\": %"PRIu64"}, "
+			"\"records_per_s\": %.1f, \"mb_per_s\": %.3f, ",
+			event, elapsed, bytes_in, PQ_STATS_LOAD(stats->bytes_out),
+			records[PQ_RECORD_T2], records[PQ_RECORD_T3], 
+			records[PQ_RECORD_MARKER], records[PQ_RECORD_OVERFLOW],
+			records[PQ_RECORD_FILTERED],
+			elapsed > 0 ? total/elapsed : 0.0,
+			elapsed > 0 ? bytes_in*1e-6/elapsed : 0.0);
+
+	fprintf(stats->stream_stats, "\"stage_s\": {");
+	for ( i = 0; i < PQ_STATS_STAGES; i++ ) {
+		fprintf(stats->stream_stats, "%s\"%s\": %.6f", 
+				i > 0 ? ", " : "", pq_stats_stage_names[i], seconds[i]);
+	}
+	fprintf(stats->stream_stats, "}}\n");
+	fflush(stats->stream_stats);
+}
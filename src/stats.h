@@ -0,0 +1,79 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdio.h>
+
+#include "types.h"
+#include "options.h"
+
+/* Throughput statistics. The time spent in each stage is accumulated from a
+ * monotonic clock, sampled once per block of records. Writing is only timed
+ * where the output can be wrapped (fopencookie), and is otherwise part of 
+ * formatting. In --pipeline mode the stages overlap, so their times may add
+ * up to more than the elapsed time.
+ */
+#define PQ_STATS_READ 0
+#define PQ_STATS_DECODE 1
+#define PQ_STATS_FORMAT 2
+#define PQ_STATS_WRITE 3
+#define PQ_STATS_STAGES 4
+
+/* Record types (see error.h) are counted by their value. */
+#define PQ_STATS_TYPES 16
+
+typedef struct {
+	FILE *stream_stats;
+	FILE *stream_out;
+	FILE *stream_wrapped;
+	char *buffer;
+	uint64_t print_every;
+	uint64_t next_print;
+	uint64_t start;
+	uint64_t bytes_in;
+	uint64_t bytes_out;
+	uint64_t records[PQ_STATS_TYPES];
+	uint64_t nanoseconds[PQ_STATS_STAGES];
+} pq_stats_t;
+
+int pq_stats_init(pq_stats_t *stats, options_t *options);
+int pq_stats_wrap(pq_stats_t *stats, FILE **stream_out);
+int pq_stats_finish(pq_stats_t *stats, FILE **stream_out, int result);
+
+uint64_t pq_stats_clock(void);
+void pq_stats_lap(pq_stats_t *stats, int stage, uint64_t *clock);
+void pq_stats_input(pq_stats_t *stats, size_t bytes);
+void pq_stats_records(pq_stats_t *stats, int const *types, size_t n);
+void pq_stats_print(pq_stats_t *stats, char const *event);
+
+#endif
@@ -29,19 +29,87 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+
 #include "t2.h"
 
 #include "error.h"
+#include "format.h"
+#include "index.h"
+#include "histogram.h"
+#include "reader.h"
+#include "threads.h"
 
 int pq_t2_stream(FILE *stream_in, FILE *stream_out,
-		pq_t2_decode_t decode, tttr_t *tttr, options_t *options) {
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options) {
 	/* 
 	 * Use the specified decoder to process the incoming stream of t2 records.
+	 * Records are read and decoded a block at a time, then printed in order.
 	 */
 	int64_t record_count = 0;
 	int result = PQ_SUCCESS;
-	t2_t t2;
+	uint64_t clock;
+	size_t i;
+	tttr_block_t block;
+	t2_t *t2 = NULL;
+	int *types = NULL;
 	pq_t2_print_t print;
+	pq_columns_t columns = {0};
+	pq_correlator_t correlator = {0};
+	pq_correlator_job_t correlator_job = {0};
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+	uint64_t remaining = PQ_INDEX_NONE;
+
+	if ( pq_histogram_active(options) ) {
+		error("Histograms can only be made of t3 data.\n");
+		return(PQ_ERROR_MODE);
+	} else if ( pq_correlate_active(options) && options->columnar ) {
+		error("Correlations can not be combined with --columnar.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( pq_intensity_active(options) && 
+			(options->columnar || pq_correlate_active(options)) ) {
+		error("Intensity traces can not be combined with --columnar or "
+				"--correlate.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( pq_shm_active(options) && 
+			(options->columnar || pq_correlate_active(options) || 
+			 pq_intensity_active(options)) ) {
+		error("Shared memory output can not be combined with --columnar, "
+				"--correlate, or --intensity.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( options->correlate_log && options->threads > 1 ) {
+		error("The --log-bins cascade counts on one thread, so it can not "
+				"be combined with --threads.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( options->gate_start > 0 || options->gate_stop < UINT64_MAX ) {
+		error("The gate can only be applied to t3 data.\n");
+		return(PQ_ERROR_MODE);
+	}
+
+	tttr_filter_init(tttr, options->channel_mask, 
+			options->gate_start, options->gate_stop);
+
+	if ( options->reader != NULL ) {
+		/* A library reader decodes the records as they are asked for. */
+		return(pq_reader_attach_t2(options->reader, decode, tttr));
+	} else if ( options->follow ) {
+		/* The input is still growing, so it can neither be indexed nor 
+		 * read ahead in large pieces: decode the records as they arrive.
+		 */
+	} else if ( pq_range_active(options) ) {
+		/* Only part of the data was asked for, so skip ahead to it. */
+		result = pq_t2_seek(stream_in, decode, tttr, options, &remaining);
+		if ( pq_check(result) ) {
+			return(result);
+		}
+	} else if ( options->pipeline ) {
+		return(pq_t2_stream_pipeline(stream_in, stream_out, 
+				decode, tttr, options));
+	} else if ( options->threads > 1 ) {
+		return(pq_t2_stream_parallel(stream_in, stream_out, 
+				decode, tttr, options));
+	}
 
 	if ( options->binary_out ) {
 		print = pq_t2_fwrite;
@@ -49,37 +117,763 @@ int pq_t2_stream(FILE *stream_in, FILE *stream_out,
 		print = pq_t2_fprintf;
 	}
 
-	/* To do: add some logic to read a large amount of records (e.g. 1024) and
-	 * then process them. This should reduce the number of disk i/o calls.
-	 */
+	if ( options->follow ) {
+		result = tttr_block_follow(&block, stream_in, TTTR_BLOCK_RECORDS,
+				options->filename_in, stream_out);
+	} else {
+		result = tttr_block_init(&block, stream_in, TTTR_BLOCK_RECORDS);
+	}
+	t2 = (t2_t *)malloc(TTTR_BLOCK_RECORDS*sizeof(t2_t));
+	types = (int *)malloc(TTTR_BLOCK_RECORDS*sizeof(int));
+
+	if ( t2 == NULL || types == NULL ) {
+		error("Could not allocate t2 record block.\n");
+		result = PQ_ERROR_MEM;
+	}
+
+	if ( ! pq_check(result) && options->columnar ) {
+		result = pq_t2_columns_init(&columns, stream_out, 
+				options->compact);
+	} else if ( ! pq_check(result) && pq_correlate_active(options) ) {
+		result = pq_correlator_init(&correlator, options);
+	} else if ( ! pq_check(result) && pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+	} else if ( ! pq_check(result) && pq_shm_active(options) ) {
+		result = pq_shm_open(&shm, options->shm_name, PQ_RECORD_T2, 
+				sizeof(t2_t), options->shm_readers);
+	}
+
+	clock = pq_stats_clock();
 	while ( ! pq_check(result) && 
-			! feof(stream_in) &&
-			record_count < options->number ) {
-		result = pq_t2_next(stream_in, decode, tttr, &t2);
+			record_count < options->number &&
+			remaining > 0 ) {
+		result = tttr_block_read(&block);
+		pq_stats_lap(options->stats, PQ_STATS_READ, &clock);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		if ( block.length > remaining ) {
+			block.length = remaining;
+		}
+		remaining -= block.length;
+		pq_stats_input(options->stats, block.length*sizeof(uint32_t));
+
+		result = decode(block.records, block.length, tttr, t2, types);
+		pq_stats_lap(options->stats, PQ_STATS_DECODE, &clock);
+		pq_stats_records(options->stats, types, block.length);
+
+		for ( i = 0; 
+				! pq_check(result) && 
+				i < block.length && 
+				record_count < options->number; 
+				i++ ) {
+			if ( types[i] == PQ_RECORD_T2 ) {
+				if ( t2[i].time < options->start_time || 
+						t2[i].time >= options->stop_time ) {
+					continue;
+				}
 
-		if ( ! pq_check(result) ) {
-			/* Found a record, process it. */
-			if ( result == PQ_RECORD_T2 ) {
 				record_count++;
 				pq_record_status_print("picoquant", record_count, options);
-				print(stream_out, &t2);
-			} else if ( result == PQ_RECORD_MARKER ) {
-				tttr_marker_print(stream_out, t2.time);
-			} else if ( result == PQ_RECORD_OVERFLOW ) {
-				/* overflow must be performed in the decoder. */
+				if ( options->columnar ) {
+					result = pq_t2_columns_append(&columns, &t2[i]);
+				} else if ( pq_shm_active(options) ) {
+					result = pq_shm_append(&shm, &t2[i]);
+				} else if ( pq_correlate_active(options) ) {
+					result = pq_correlator_append(&correlator, 
+							t2[i].channel, t2[i].time);
+				} else if ( pq_intensity_active(options) ) {
+					result = pq_intensity_add(&intensity, 
+							t2[i].channel, t2[i].time);
+				} else {
+					print(stream_out, &t2[i]);
+				}
+			} else if ( types[i] == PQ_RECORD_MARKER ) {
+				tttr_marker_print(stream_out, t2[i].time);
+			} else if ( types[i] == PQ_RECORD_OVERFLOW ||
+					types[i] == PQ_RECORD_FILTERED ) {
+				/* overflow and filtering must be performed in the decoder. */
 			} else { 
-				error("Record type not recognized: %d\n", result);
+				error("Record type not recognized: %d\n", types[i]);
 				result = PQ_ERROR_UNKNOWN_DATA;
 			}
-		} else if ( result == PQ_ERROR_EOF ) {
-			/* loop will take care of the EOF */
-			result = PQ_SUCCESS;
 		}
+
+		if ( ! pq_check(result) && pq_correlate_active(options) ) {
+			result = pq_correlator_update(&correlator, &correlator_job, 1);
+		} else if ( ! pq_check(result) && pq_shm_active(options) ) {
+			pq_shm_publish(&shm);
+		}
+		pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+	}
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_correlate_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_correlator_print(stream_out, &correlator, options);
+		}
+		pq_correlator_jobs_free(&correlator_job, 1);
+		pq_correlator_free(&correlator);
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
 	}
 
+	free(t2);
+	free(types);
+	tttr_block_free(&block);
+
 	return(result);
 }	
 
+int pq_t2_stream_parallel(FILE *stream_in, FILE *stream_out,
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options) {
+	/*
+	 * Decode the stream using several threads. Each pass reads one chunk of
+	 * records per thread and decodes the chunks independently, starting from
+	 * origin 0. The overflows counted in each chunk are then accumulated in
+	 * order, which gives the origin of the following chunks, and the chunks
+	 * are shifted and formatted in parallel before being written in order.
+	 *
+	 * The decoders are linear in the origin, so the shift for a chunk is 
+	 * found by decoding one of its photons at the true origin and at 0.
+	 */
+	int64_t record_count = 0;
+	int result = PQ_SUCCESS;
+	uint64_t clock;
+	int k, n_chunks;
+	int n_threads = options->threads;
+	int type;
+	size_t i;
+	tttr_block_t block;
+	tttr_t probe;
+	t2_t t2_true, t2_zero;
+	pq_t2_chunk_t *chunks;
+	pq_t2_print_t print;
+	pq_columns_t columns = {0};
+	pq_correlator_t correlator = {0};
+	pq_correlator_job_t *correlator_jobs = NULL;
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+
+	if ( options->binary_out ) {
+		print = pq_t2_fwrite;
+	} else {
+		print = pq_t2_fprintf;
+	}
+
+	result = tttr_block_init(&block, stream_in, 
+			(size_t)n_threads*TTTR_CHUNK_RECORDS);
+	chunks = (pq_t2_chunk_t *)calloc(n_threads, sizeof(pq_t2_chunk_t));
+
+	if ( chunks == NULL ) {
+		error("Could not allocate t2 chunks.\n");
+		tttr_block_free(&block);
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( k = 0; ! pq_check(result) && k < n_threads; k++ ) {
+		chunks[k].decode = decode;
+		chunks[k].print = print;
+		chunks[k].stream_out = stream_out;
+		chunks[k].t2 = (t2_t *)malloc(TTTR_CHUNK_RECORDS*sizeof(t2_t));
+		chunks[k].types = (int *)malloc(TTTR_CHUNK_RECORDS*sizeof(int));
+
+		if ( chunks[k].t2 == NULL || chunks[k].types == NULL ) {
+			error("Could not allocate t2 chunk.\n");
+			result = PQ_ERROR_MEM;
+		}
+	}
+
+	if ( ! pq_check(result) && options->columnar ) {
+		result = pq_t2_columns_init(&columns, stream_out, 
+				options->compact);
+	} else if ( ! pq_check(result) && pq_correlate_active(options) ) {
+		correlator_jobs = (pq_correlator_job_t *)calloc(n_threads, 
+				sizeof(pq_correlator_job_t));
+		if ( correlator_jobs == NULL ) {
+			error("Could not allocate correlation jobs.\n");
+			result = PQ_ERROR_MEM;
+		} else {
+			result = pq_correlator_init(&correlator, options);
+		}
+	} else if ( ! pq_check(result) && pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+	} else if ( ! pq_check(result) && pq_shm_active(options) ) {
+		result = pq_shm_open(&shm, options->shm_name, PQ_RECORD_T2, 
+				sizeof(t2_t), options->shm_readers);
+	}
+
+	clock = pq_stats_clock();
+	while ( ! pq_check(result) && 
+			record_count < options->number ) {
+		/* Each pass ends with formatting, which may end it early. */
+		pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+		result = tttr_block_read(&block);
+		pq_stats_lap(options->stats, PQ_STATS_READ, &clock);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		n_chunks = (block.length + TTTR_CHUNK_RECORDS - 1) / 
+				TTTR_CHUNK_RECORDS;
+		for ( k = 0; k < n_chunks; k++ ) {
+			chunks[k].records = block.records + k*TTTR_CHUNK_RECORDS;
+			chunks[k].n_records = block.length - k*TTTR_CHUNK_RECORDS;
+			if ( chunks[k].n_records > TTTR_CHUNK_RECORDS ) {
+				chunks[k].n_records = TTTR_CHUNK_RECORDS;
+			}
+			chunks[k].tttr = *tttr;
+			chunks[k].tttr.origin = 0;
+			chunks[k].tttr.overflows = 0;
+		}
+
+		pq_stats_input(options->stats, block.length*sizeof(uint32_t));
+		pq_threads_run(pq_t2_chunk_decode, chunks, sizeof(pq_t2_chunk_t), 
+				n_chunks);
+		pq_stats_lap(options->stats, PQ_STATS_DECODE, &clock);
+		for ( k = 0; k < n_chunks; k++ ) {
+			pq_stats_records(options->stats, chunks[k].types, 
+					chunks[k].n_records);
+		}
+
+		/* Accumulate the origin in order, and handle everything which must
+		 * be done sequentially (markers, status, record limits).
+		 */
+		for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+			chunks[k].shift = 0;
+			chunks[k].limit = 0;
+			result = chunks[k].result;
+
+			for ( i = 0; 
+					! pq_check(result) && 
+					i < chunks[k].n_records && 
+					record_count < options->number;
+					i++ ) {
+				if ( chunks[k].types[i] == PQ_RECORD_T2 ) {
+					if ( chunks[k].limit == 0 ) {
+						probe = *tttr;
+						decode(&chunks[k].records[i], 1, &probe, &t2_true, &type);
+						probe.origin = 0;
+						decode(&chunks[k].records[i], 1, &probe, &t2_zero, &type);
+						chunks[k].shift = t2_true.time - t2_zero.time;
+					}
+
+					chunks[k].limit++;
+					record_count++;
+					pq_record_status_print("picoquant", record_count, options);
+				} else if ( chunks[k].types[i] == PQ_RECORD_MARKER ) {
+					tttr_marker_print(stream_out, chunks[k].t2[i].time);
+				} else if ( chunks[k].types[i] == PQ_RECORD_OVERFLOW ||
+						chunks[k].types[i] == PQ_RECORD_FILTERED ) {
+					/* overflow and filtering must be performed in the decoder. */
+				} else {
+					error("Record type not recognized: %d\n", 
+							chunks[k].types[i]);
+					result = PQ_ERROR_UNKNOWN_DATA;
+				}
+			}
+
+			tttr->origin += chunks[k].tttr.origin;
+			tttr->overflows += chunks[k].tttr.overflows;
+		}
+
+		if ( options->columnar ) {
+			/* Gathering the columns is only copying, so there is little to
+			 * gain from doing it in parallel.
+			 */
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t2_chunk_columns(&chunks[k], &columns);
+			}
+			continue;
+		} else if ( pq_shm_active(options) ) {
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t2_chunk_shm(&chunks[k], &shm);
+			}
+			pq_shm_publish(&shm);
+			continue;
+		} else if ( pq_correlate_active(options) ) {
+			/* The photons are gathered in order, then the pairs are counted
+			 * on all threads.
+			 */
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t2_chunk_correlate(&chunks[k], &correlator);
+			}
+
+			if ( ! pq_check(result) ) {
+				result = pq_correlator_update(&correlator, correlator_jobs,
+						n_threads);
+			}
+			continue;
+		} else if ( pq_intensity_active(options) ) {
+			/* Counting is cheap, but must be done in order. */
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t2_chunk_intensity(&chunks[k], &intensity);
+			}
+			continue;
+		}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+		pq_threads_run(pq_t2_chunk_print, chunks, sizeof(pq_t2_chunk_t),
+				n_chunks);
+
+		for ( k = 0; k < n_chunks; k++ ) {
+			if ( pq_check(chunks[k].result) ) {
+				result = chunks[k].result;
+			}
+
+			if ( chunks[k].output != NULL ) {
+				fwrite(chunks[k].output, 1, chunks[k].output_length, 
+						stream_out);
+				free(chunks[k].output);
+				chunks[k].output = NULL;
+			}
+		}
+#else
+		for ( k = 0; k < n_chunks; k++ ) {
+			pq_t2_chunk_print(&chunks[k]);
+		}
+#endif
+
+		if ( ferror(stream_out) ) {
+			result = PQ_ERROR_IO;
+		}
+	}
+
+	pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_correlate_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_correlator_print(stream_out, &correlator, options);
+		}
+
+		if ( correlator_jobs != NULL ) {
+			pq_correlator_jobs_free(correlator_jobs, n_threads);
+			free(correlator_jobs);
+		}
+		pq_correlator_free(&correlator);
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
+	}
+
+	for ( k = 0; k < n_threads; k++ ) {
+		free(chunks[k].t2);
+		free(chunks[k].types);
+	}
+	free(chunks);
+	tttr_block_free(&block);
+
+	return(result);
+}
+
+int pq_t2_stream_pipeline(FILE *stream_in, FILE *stream_out,
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options) {
+	/*
+	 * Decode the stream with reading, decoding and printing each running on 
+	 * their own thread, so that waiting on the input does not hold up the
+	 * formatting of the records already read.
+	 */
+	int result = PQ_SUCCESS;
+	pq_t2_pipeline_t t2_pipeline = {0};
+	pq_columns_t columns = {0};
+	pq_correlator_t correlator = {0};
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+
+	t2_pipeline.decode = decode;
+	t2_pipeline.tttr = tttr;
+	t2_pipeline.stream_out = stream_out;
+	t2_pipeline.options = options;
+	t2_pipeline.record_count = 0;
+	t2_pipeline.columns = NULL;
+
+	if ( options->binary_out ) {
+		t2_pipeline.print = pq_t2_fwrite;
+	} else {
+		t2_pipeline.print = pq_t2_fprintf;
+	}
+
+	if ( options->columnar ) {
+		result = pq_t2_columns_init(&columns, stream_out, 
+				options->compact);
+		t2_pipeline.columns = &columns;
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_open(&shm, options->shm_name, PQ_RECORD_T2, 
+				sizeof(t2_t), options->shm_readers);
+		t2_pipeline.shm = &shm;
+	} else if ( pq_correlate_active(options) ) {
+		result = pq_correlator_init(&correlator, options);
+		t2_pipeline.correlator = &correlator;
+	} else if ( pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+		t2_pipeline.intensity = &intensity;
+	}
+
+	if ( ! pq_check(result) && options->number > 0 ) {
+		result = pq_pipeline_run(stream_in, sizeof(t2_t), 
+				pq_t2_pipeline_decode, pq_t2_pipeline_write, &t2_pipeline,
+				options->stats);
+	}
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_correlate_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_correlator_print(stream_out, &correlator, options);
+		}
+		pq_correlator_jobs_free(&t2_pipeline.correlator_job, 1);
+		pq_correlator_free(&correlator);
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
+	}
+
+	return(result);
+}
+
+int pq_t2_pipeline_decode(pq_batch_t *batch, void *args) {
+	pq_t2_pipeline_t *t2_pipeline = (pq_t2_pipeline_t *)args;
+
+	return(t2_pipeline->decode(batch->records, batch->length, 
+			t2_pipeline->tttr, (t2_t *)batch->decoded, batch->types));
+}
+
+int pq_t2_pipeline_write(pq_batch_t *batch, void *args) {
+/*
+ * Print the decoded batch. Once the requested number of records has been
+ * printed, the pipeline is finished.
+ */
+	pq_t2_pipeline_t *t2_pipeline = (pq_t2_pipeline_t *)args;
+	options_t *options = t2_pipeline->options;
+	FILE *stream_out = t2_pipeline->stream_out;
+	t2_t *t2 = (t2_t *)batch->decoded;
+	int result = PQ_SUCCESS;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < batch->length && 
+			t2_pipeline->record_count < options->number; 
+			i++ ) {
+		if ( batch->types[i] == PQ_RECORD_T2 ) {
+			t2_pipeline->record_count++;
+			pq_record_status_print("picoquant", t2_pipeline->record_count, 
+					options);
+			if ( t2_pipeline->columns != NULL ) {
+				result = pq_t2_columns_append(t2_pipeline->columns, &t2[i]);
+			} else if ( t2_pipeline->shm != NULL ) {
+				result = pq_shm_append(t2_pipeline->shm, &t2[i]);
+			} else if ( t2_pipeline->correlator != NULL ) {
+				result = pq_correlator_append(t2_pipeline->correlator, 
+						t2[i].channel, t2[i].time);
+			} else if ( t2_pipeline->intensity != NULL ) {
+				result = pq_intensity_add(t2_pipeline->intensity, 
+						t2[i].channel, t2[i].time);
+			} else {
+				t2_pipeline->print(stream_out, &t2[i]);
+			}
+		} else if ( batch->types[i] == PQ_RECORD_MARKER ) {
+			tttr_marker_print(stream_out, t2[i].time);
+		} else if ( batch->types[i] == PQ_RECORD_OVERFLOW ||
+				batch->types[i] == PQ_RECORD_FILTERED ) {
+			/* overflow and filtering must be performed in the decoder. */
+		} else { 
+			error("Record type not recognized: %d\n", batch->types[i]);
+			result = PQ_ERROR_UNKNOWN_DATA;
+		}
+	}
+
+	if ( ! pq_check(result) && t2_pipeline->correlator != NULL ) {
+		result = pq_correlator_update(t2_pipeline->correlator, 
+				&t2_pipeline->correlator_job, 1);
+	} else if ( ! pq_check(result) && t2_pipeline->shm != NULL ) {
+		pq_shm_publish(t2_pipeline->shm);
+	}
+
+	if ( ! pq_check(result) && 
+			t2_pipeline->record_count >= options->number ) {
+		result = PQ_ERROR_EOF;
+	}
+
+	return(result);
+}
+
+void *pq_t2_chunk_decode(void *chunk) {
+	pq_t2_chunk_t *t2_chunk = (pq_t2_chunk_t *)chunk;
+
+	t2_chunk->result = t2_chunk->decode(t2_chunk->records, 
+			t2_chunk->n_records, &t2_chunk->tttr, 
+			t2_chunk->t2, t2_chunk->types);
+
+	return(NULL);
+}
+
+void *pq_t2_chunk_print(void *chunk) {
+/*
+ * Shift the photons in the chunk to their true origin and print them, either
+ * to a buffer (to be written in order later) or directly to the output.
+ */
+	pq_t2_chunk_t *t2_chunk = (pq_t2_chunk_t *)chunk;
+	FILE *stream_out = t2_chunk->stream_out;
+	int64_t printed = 0;
+	size_t i;
+
+	t2_chunk->output = NULL;
+	t2_chunk->output_length = 0;
+
+	if ( t2_chunk->limit == 0 ) {
+		return(NULL);
+	}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+	stream_out = open_memstream(&t2_chunk->output, &t2_chunk->output_length);
+	if ( stream_out == NULL ) {
+		error("Could not open output buffer for t2 chunk.\n");
+		t2_chunk->result = PQ_ERROR_MEM;
+		return(NULL);
+	}
+#endif
+
+	for ( i = 0; i < t2_chunk->n_records && printed < t2_chunk->limit; i++ ) {
+		if ( t2_chunk->types[i] == PQ_RECORD_T2 ) {
+			t2_chunk->t2[i].time += t2_chunk->shift;
+			t2_chunk->print(stream_out, &t2_chunk->t2[i]);
+			printed++;
+		}
+	}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+	fclose(stream_out);
+#endif
+
+	return(NULL);
+}
+
+int pq_t2_chunk_correlate(pq_t2_chunk_t *chunk, 
+		pq_correlator_t *correlator) {
+/*
+ * Shift the photons in the chunk to their true origin and add them to the
+ * correlator.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T2 ) {
+			result = pq_correlator_append(correlator, chunk->t2[i].channel,
+					chunk->t2[i].time + chunk->shift);
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t2_chunk_intensity(pq_t2_chunk_t *chunk, pq_intensity_t *intensity) {
+/*
+ * Shift the photons in the chunk to their true origin and count them into
+ * the intensity trace.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T2 ) {
+			result = pq_intensity_add(intensity, chunk->t2[i].channel,
+					chunk->t2[i].time + chunk->shift);
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t2_chunk_shm(pq_t2_chunk_t *chunk, pq_shm_t *shm) {
+/*
+ * Shift the photons in the chunk to their true origin and add them to the
+ * shared memory ring.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T2 ) {
+			chunk->t2[i].time += chunk->shift;
+			result = pq_shm_append(shm, &chunk->t2[i]);
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t2_chunk_columns(pq_t2_chunk_t *chunk, pq_columns_t *columns) {
+/*
+ * Shift the photons in the chunk to their true origin and add them to the 
+ * output columns.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T2 ) {
+			chunk->t2[i].time += chunk->shift;
+			result = pq_t2_columns_append(columns, &chunk->t2[i]);
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t2_seek(FILE *stream_in, pq_t2_decode_block_t decode, 
+		tttr_t *tttr, options_t *options, uint64_t *length) {
+/*
+ * Move the stream and decoder state to the checkpoint before --start-time,
+ * using the index of the input (building it first if necessary), and find
+ * how many records must be decoded from there. Without an index (such as 
+ * for stdin), everything is decoded and the records filtered.
+ */
+	int result;
+	pq_index_t index;
+
+	*length = PQ_INDEX_NONE;
+
+	result = pq_index_init(&index, stream_in, options->filename_in);
+	if ( result == PQ_ERROR_IO ) {
+		debug("Input cannot be indexed, decoding all of it.\n");
+		pq_index_free(&index);
+		return(PQ_SUCCESS);
+	} 
+	
+	if ( ! pq_check(result) && pq_check(pq_index_load(&index)) ) {
+		result = pq_t2_index_build(stream_in, decode, tttr, &index);
+		if ( ! pq_check(result) ) {
+			pq_index_save(&index);
+		}
+	}
+
+	if ( ! pq_check(result) ) {
+		result = pq_index_seek(&index, stream_in, tttr, 
+				options->start_time, options->stop_time, length);
+	}
+
+	pq_index_free(&index);
+	return(result);
+}
+
+int pq_t2_index_build(FILE *stream_in, pq_t2_decode_block_t decode,
+		tttr_t *tttr, pq_index_t *index) {
+/*
+ * Decode the whole stream, noting the decoder state at every checkpoint and 
+ * the time of the first photon after it.
+ */
+	int result = PQ_SUCCESS;
+	uint64_t record = 0;
+	size_t i;
+	tttr_t state = *tttr;
+	tttr_block_t block;
+	t2_t *t2 = NULL;
+	int *types = NULL;
+
+	debug("Building index %s.\n", index->filename);
+
+	/* The checkpoints do not depend on which photons are kept. */
+	state.filter = 0;
+
+	result = tttr_block_init(&block, stream_in, TTTR_BLOCK_RECORDS);
+	t2 = (t2_t *)malloc(TTTR_BLOCK_RECORDS*sizeof(t2_t));
+	types = (int *)malloc(TTTR_BLOCK_RECORDS*sizeof(int));
+
+	if ( t2 == NULL || types == NULL ) {
+		error("Could not allocate t2 record block.\n");
+		result = PQ_ERROR_MEM;
+	}
+
+	while ( ! pq_check(result) ) {
+		result = tttr_block_read(&block);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		if ( index->n_entries == 0 || record >= 
+				index->entries[index->n_entries-1].record + index->interval ) {
+			result = pq_index_append(index, record, &state);
+		}
+
+		if ( ! pq_check(result) ) {
+			result = decode(block.records, block.length, &state, t2, types);
+		}
+
+		for ( i = 0; ! pq_check(result) && i < block.length; i++ ) {
+			if ( types[i] == PQ_RECORD_T2 ) {
+				pq_index_first(index, t2[i].time);
+				break;
+			}
+		}
+
+		record += block.length;
+	}
+
+	free(t2);
+	free(types);
+	tttr_block_free(&block);
+
+	return(result);
+}
+
 int pq_t2_next(FILE *stream_in, pq_t2_decode_t decode, 
 		tttr_t *tttr, t2_t *t2) {
 /*
@@ -92,9 +886,15 @@ int pq_t2_fprintf(FILE *stream_out, t2_t *record) {
 /* 
  * Print the t2 record in csv format.
  */
-	fprintf(stream_out, "%"PRIu32",%"PRIu64"\n", 
-			record->channel,
-			record->time);
+	char line[PQ_FORMAT_LINE];
+	char *end = line;
+
+	end = pq_format_u64(end, record->channel);
+	*end++ = ',';
+	end = pq_format_u64(end, record->time);
+	*end++ = '\n';
+
+	fwrite(line, 1, end - line, stream_out);
 
 	return( ! ferror(stream_out) ? PQ_SUCCESS : PQ_ERROR_IO );
 }
@@ -107,3 +907,30 @@ int pq_t2_fwrite(FILE *stream_out, t2_t *record) {
 
 	return ( ! ferror(stream_out) ? PQ_SUCCESS : PQ_ERROR_IO );
 }
+
+int pq_t2_columns_init(pq_columns_t *columns, FILE *stream_out, 
+		int compact) {
+/*
+ * Start columnar output of t2 records: channel (uint32_t), time (uint64_t).
+ * Compact output stores the channels as varints, and the times as the 
+ * differences between successive records.
+ */
+	static char const * const names[] = {"channel", "time"};
+	static size_t const sizes[] = {sizeof(uint32_t), sizeof(uint64_t)};
+	static int const encodings[] = {PQ_COLUMNS_VARINT, PQ_COLUMNS_DELTA};
+
+	return(pq_columns_init(columns, stream_out, PQ_RECORD_T2, 2, 
+			names, sizes, compact ? encodings : NULL));
+}
+
+int pq_t2_columns_append(pq_columns_t *columns, t2_t *record) {
+	((uint32_t *)columns->data[0])[columns->length] = record->channel;
+	((uint64_t *)columns->data[1])[columns->length] = record->time;
+	columns->length++;
+
+	if ( columns->length == columns->capacity ) {
+		return(pq_columns_flush(columns));
+	} else {
+		return(PQ_SUCCESS);
+	}
+}
@@ -32,27 +32,95 @@
 #ifndef T2_H_
 #define T2_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "types.h"
+#include "records.h"
 #include "tttr.h"
 #include "options.h"
+#include "pipeline.h"
+#include "correlate.h"
+#include "intensity.h"
+#include "shm.h"
+#include "columns.h"
+#include "index.h"
 
-typedef struct {
-	uint32_t channel;
-	uint64_t time;
-} t2_t;
+#pragma pack(push, 2)
 
 typedef int (*pq_t2_decode_t)(FILE *, tttr_t *, t2_t *);
+typedef int (*pq_t2_decode_block_t)(uint32_t const *, size_t, tttr_t *, 
+		t2_t *, int *);
 typedef int (*pq_t2_print_t)(FILE *, t2_t *);
 
-int pq_t2_stream(FILE *stream_in, FILE *stream_out, pq_t2_decode_t decode,
-		tttr_t *tttr, options_t *options);
+/* When decoding in parallel, each chunk of records is decoded as though it
+ * started at origin 0. Once the overflows in the preceding chunks are known,
+ * the photons are shifted by the corresponding amount and printed.
+ */
+typedef struct {
+	pq_t2_decode_block_t decode;
+	uint32_t const *records;
+	size_t n_records;
+	tttr_t tttr;
+	t2_t *t2;
+	int *types;
+	int result;
+
+	uint64_t shift;
+	int64_t limit;
+	pq_t2_print_t print;
+	FILE *stream_out;
+	char *output;
+	size_t output_length;
+} pq_t2_chunk_t;
+
+/* In pipeline mode, the decoder stage owns the tttr state and the writer stage
+ * owns the record count.
+ */
+typedef struct {
+	pq_t2_decode_block_t decode;
+	tttr_t *tttr;
+	pq_t2_print_t print;
+	FILE *stream_out;
+	options_t *options;
+	int64_t record_count;
+	pq_columns_t *columns;
+	pq_correlator_t *correlator;
+	pq_correlator_job_t correlator_job;
+	pq_intensity_t *intensity;
+	pq_shm_t *shm;
+} pq_t2_pipeline_t;
+
+int pq_t2_stream(FILE *stream_in, FILE *stream_out, 
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t2_stream_parallel(FILE *stream_in, FILE *stream_out, 
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t2_stream_pipeline(FILE *stream_in, FILE *stream_out, 
+		pq_t2_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t2_pipeline_decode(pq_batch_t *batch, void *args);
+int pq_t2_pipeline_write(pq_batch_t *batch, void *args);
+void *pq_t2_chunk_decode(void *chunk);
+void *pq_t2_chunk_print(void *chunk);
+int pq_t2_chunk_correlate(pq_t2_chunk_t *chunk, 
+		pq_correlator_t *correlator);
+int pq_t2_chunk_intensity(pq_t2_chunk_t *chunk, pq_intensity_t *intensity);
+int pq_t2_chunk_shm(pq_t2_chunk_t *chunk, pq_shm_t *shm);
+int pq_t2_chunk_columns(pq_t2_chunk_t *chunk, pq_columns_t *columns);
+int pq_t2_seek(FILE *stream_in, pq_t2_decode_block_t decode, 
+		tttr_t *tttr, options_t *options, uint64_t *length);
+int pq_t2_index_build(FILE *stream_in, pq_t2_decode_block_t decode,
+		tttr_t *tttr, pq_index_t *index);
 int pq_t2_next(FILE *stream_in, pq_t2_decode_t decode, tttr_t *tttr, t2_t *t2);
 int pq_t2_fprintf(FILE *stream_out, t2_t *record);
 int pq_t2_fwrite(FILE *stream_out, t2_t *record);
+int pq_t2_columns_init(pq_columns_t *columns, FILE *stream_out, 
+		int compact);
+int pq_t2_columns_append(pq_columns_t *columns, t2_t *record);
+
+/* Hands the decoder to the library reader in options->reader (see reader.c),
+ * in place of decoding the stream.
+ */
+int pq_reader_attach_t2(void *reader, pq_t2_decode_block_t decode, 
+		tttr_t *tttr);
 
 #pragma pack(pop)
 
@@ -30,21 +30,83 @@
  */
 
 #include <math.h> 
+#include <stdlib.h>
 
 #include "t3.h"
 #include "error.h"
+#include "format.h"
+#include "index.h"
+#include "reader.h"
+#include "threads.h"
 
-int pq_t3_stream(FILE *stream_in, FILE *stream_out, pq_t3_decode_t decode, 
-		tttr_t *tttr, options_t *options) {
+int pq_t3_stream(FILE *stream_in, FILE *stream_out, 
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options) {
 	/* 
 	 * Use the specified decoder to process the incoming stream of t3 records.
+	 * Records are read and decoded a block at a time, then printed in order.
 	 */
 	int64_t record_count = 0;
 	int result = PQ_SUCCESS;
-	t3_t t3;
+	uint64_t clock;
+	size_t i;
+	tttr_block_t block;
+	t3_t *t3 = NULL;
+	int *types = NULL;
 	t2_t t2;
 	pq_t3_print_t print_t3;
 	pq_t2_print_t print_t2;
+	pq_columns_t columns = {0};
+	pq_histogram_t histogram = {0};
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+	uint64_t remaining = PQ_INDEX_NONE;
+
+	if ( pq_histogram_active(options) && 
+			(options->to_t2 || options->columnar) ) {
+		error("Histograms can not be combined with --to-t2 or --columnar.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( pq_intensity_active(options) && 
+			(options->to_t2 || options->columnar || 
+			 pq_histogram_active(options)) ) {
+		error("Intensity traces can not be combined with --to-t2, "
+				"--columnar, or --histogram.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( pq_shm_active(options) && 
+			(options->columnar || pq_histogram_active(options) || 
+			 pq_intensity_active(options)) ) {
+		error("Shared memory output can not be combined with --columnar, "
+				"--histogram, or --intensity.\n");
+		return(PQ_ERROR_OPTIONS);
+	} else if ( pq_correlate_active(options) ) {
+		error("Correlations can only be made of t2 data.\n");
+		return(PQ_ERROR_MODE);
+	}
+
+	tttr_filter_init(tttr, options->channel_mask, 
+			options->gate_start, options->gate_stop);
+	tttr_timebase_init(&tttr->timebase, tttr->sync_rate, 
+			tttr->sync_period);
+
+	if ( options->reader != NULL ) {
+		/* A library reader decodes the records as they are asked for. */
+		return(pq_reader_attach_t3(options->reader, decode, tttr));
+	} else if ( options->follow ) {
+		/* The input is still growing, so it can neither be indexed nor 
+		 * read ahead in large pieces: decode the records as they arrive.
+		 */
+	} else if ( pq_range_active(options) ) {
+		/* Only part of the data was asked for, so skip ahead to it. */
+		result = pq_t3_seek(stream_in, decode, tttr, options, &remaining);
+		if ( pq_check(result) ) {
+			return(result);
+		}
+	} else if ( options->pipeline ) {
+		return(pq_t3_stream_pipeline(stream_in, stream_out, 
+				decode, tttr, options));
+	} else if ( options->threads > 1 ) {
+		return(pq_t3_stream_parallel(stream_in, stream_out, 
+				decode, tttr, options));
+	}
 
 	if ( options->binary_out ) {
 		print_t3 = pq_t3_fwrite;
@@ -54,52 +116,807 @@ int pq_t3_stream(FILE *stream_in, FILE *stream_out, pq_t3_decode_t decode,
 		print_t2 = pq_t2_fprintf;
 	}
 
-	/* To do: add some logic to read a large amount of records (e.g. 1024) and
-	 * then process them. This should reduce the number of disk i/o calls.
-	 */
+	if ( options->follow ) {
+		result = tttr_block_follow(&block, stream_in, TTTR_BLOCK_RECORDS,
+				options->filename_in, stream_out);
+	} else {
+		result = tttr_block_init(&block, stream_in, TTTR_BLOCK_RECORDS);
+	}
+	t3 = (t3_t *)malloc(TTTR_BLOCK_RECORDS*sizeof(t3_t));
+	types = (int *)malloc(TTTR_BLOCK_RECORDS*sizeof(int));
+
+	if ( t3 == NULL || types == NULL ) {
+		error("Could not allocate t3 record block.\n");
+		result = PQ_ERROR_MEM;
+	}
+
+	if ( ! pq_check(result) && options->columnar ) {
+		result = pq_t3_columns_init(&columns, stream_out, 
+				options->to_t2, options->compact);
+	} else if ( ! pq_check(result) && pq_histogram_active(options) ) {
+		result = pq_histogram_init(&histogram, options, tttr);
+	} else if ( ! pq_check(result) && pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+	} else if ( ! pq_check(result) && pq_shm_active(options) ) {
+		result = pq_t3_shm_open(&shm, options);
+	}
+
+	clock = pq_stats_clock();
 	while ( ! pq_check(result) && 
-			! feof(stream_in) &&
-			record_count < options->number ) {
-		result = pq_t3_next(stream_in, decode, tttr, &t3);
+			record_count < options->number &&
+			remaining > 0 ) {
+		result = tttr_block_read(&block);
+		pq_stats_lap(options->stats, PQ_STATS_READ, &clock);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		if ( block.length > remaining ) {
+			block.length = remaining;
+		}
+		remaining -= block.length;
+		pq_stats_input(options->stats, block.length*sizeof(uint32_t));
+
+		result = decode(block.records, block.length, tttr, t3, types);
+		pq_stats_lap(options->stats, PQ_STATS_DECODE, &clock);
+		pq_stats_records(options->stats, types, block.length);
+
+		for ( i = 0; 
+				! pq_check(result) &&
+				i < block.length && 
+				record_count < options->number;
+				i++ ) {
+			if ( types[i] == PQ_RECORD_T3 ) {
+				if ( t3[i].pulse < options->start_time || 
+						t3[i].pulse >= options->stop_time ) {
+					continue;
+				}
 
-		if ( ! pq_check(result) ) {
-			/* Found a record, process it. */
-			if ( result == PQ_RECORD_T3 ) {
 				record_count++;
 				pq_record_status_print("picoquant", record_count, options);
-				if ( options->to_t2 ) {
-					pq_t3_to_t2(&t3, &t2, tttr);
-					print_t2(stream_out, &t2);
+				if ( pq_histogram_active(options) ) {
+					result = pq_histogram_add(&histogram, 
+							t3[i].channel, t3[i].time);
+				} else if ( pq_intensity_active(options) ) {
+					result = pq_intensity_add(&intensity, t3[i].channel, 
+							tttr_timebase_time(&tttr->timebase, t3[i].pulse));
+				} else if ( pq_shm_active(options) ) {
+					if ( options->to_t2 ) {
+						pq_t3_to_t2(&t3[i], &t2, tttr);
+						result = pq_shm_append(&shm, &t2);
+					} else {
+						result = pq_shm_append(&shm, &t3[i]);
+					}
+				} else if ( options->to_t2 ) {
+					pq_t3_to_t2(&t3[i], &t2, tttr);
+					if ( options->columnar ) {
+						result = pq_t2_columns_append(&columns, &t2);
+					} else {
+						print_t2(stream_out, &t2);
+					}
+				} else if ( options->columnar ) {
+					result = pq_t3_columns_append(&columns, &t3[i]);
 				} else {
-					print_t3(stream_out, &t3);
+					print_t3(stream_out, &t3[i]);
 				}
-			} else if ( result == PQ_RECORD_MARKER ) {
-				tttr_marker_print(stream_out, t3.pulse);
-			} else if ( result == PQ_RECORD_OVERFLOW ) {
-				/* overflows must be performed in the decoder. */
+			} else if ( types[i] == PQ_RECORD_MARKER ) {
+				tttr_marker_print(stream_out, t3[i].pulse);
+			} else if ( types[i] == PQ_RECORD_OVERFLOW ||
+					types[i] == PQ_RECORD_FILTERED ) {
+				/* overflows and filtering must be performed in the decoder. */
 			} else { 
-				error("Record type not recognized: %d\n", result);
+				error("Record type not recognized: %d\n", types[i]);
 				result = PQ_ERROR_UNKNOWN_DATA;
 			}
-		} else if ( result == PQ_ERROR_EOF ) {
-			/* loop will take care of the EOF */
-			result = PQ_SUCCESS;
 		}
+
+		if ( ! pq_check(result) && pq_shm_active(options) ) {
+			pq_shm_publish(&shm);
+		}
+		pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+	}
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_histogram_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_histogram_print(stream_out, &histogram, options);
+		}
+		pq_histogram_free(&histogram);
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
 	}
 
+	free(t3);
+	free(types);
+	tttr_block_free(&block);
+
 	return(result);
 }	
 
+int pq_t3_stream_parallel(FILE *stream_in, FILE *stream_out,
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options) {
+	/*
+	 * Decode the stream using several threads, as in pq_t2_stream_parallel.
+	 * For t3 records, the origin shifts the pulse number.
+	 */
+	int64_t record_count = 0;
+	int result = PQ_SUCCESS;
+	uint64_t clock;
+	int k, n_chunks;
+	int n_threads = options->threads;
+	int type;
+	size_t i;
+	tttr_block_t block;
+	tttr_t probe;
+	t3_t t3_true, t3_zero;
+	pq_t3_chunk_t *chunks;
+	pq_t3_print_t print_t3;
+	pq_t2_print_t print_t2;
+	pq_columns_t columns = {0};
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+
+	if ( options->binary_out ) {
+		print_t3 = pq_t3_fwrite;
+		print_t2 = pq_t2_fwrite;
+	} else {
+		print_t3 = pq_t3_fprintf;
+		print_t2 = pq_t2_fprintf;
+	}
+
+	result = tttr_block_init(&block, stream_in, 
+			(size_t)n_threads*TTTR_CHUNK_RECORDS);
+	chunks = (pq_t3_chunk_t *)calloc(n_threads, sizeof(pq_t3_chunk_t));
+
+	if ( chunks == NULL ) {
+		error("Could not allocate t3 chunks.\n");
+		tttr_block_free(&block);
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( k = 0; ! pq_check(result) && k < n_threads; k++ ) {
+		chunks[k].decode = decode;
+		chunks[k].to_t2 = options->to_t2;
+		chunks[k].print_t3 = print_t3;
+		chunks[k].print_t2 = print_t2;
+		chunks[k].stream_out = stream_out;
+		chunks[k].t3 = (t3_t *)malloc(TTTR_CHUNK_RECORDS*sizeof(t3_t));
+		chunks[k].types = (int *)malloc(TTTR_CHUNK_RECORDS*sizeof(int));
+
+		if ( chunks[k].t3 == NULL || chunks[k].types == NULL ) {
+			error("Could not allocate t3 chunk.\n");
+			result = PQ_ERROR_MEM;
+		} else if ( pq_histogram_active(options) ) {
+			result = pq_histogram_init(&chunks[k].histogram, options, tttr);
+		}
+	}
+
+	if ( ! pq_check(result) && options->columnar ) {
+		result = pq_t3_columns_init(&columns, stream_out, 
+				options->to_t2, options->compact);
+	} else if ( ! pq_check(result) && pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+	} else if ( ! pq_check(result) && pq_shm_active(options) ) {
+		result = pq_t3_shm_open(&shm, options);
+	}
+
+	clock = pq_stats_clock();
+	while ( ! pq_check(result) && 
+			record_count < options->number ) {
+		/* Each pass ends with formatting, which may end it early. */
+		pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+		result = tttr_block_read(&block);
+		pq_stats_lap(options->stats, PQ_STATS_READ, &clock);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		n_chunks = (block.length + TTTR_CHUNK_RECORDS - 1) / 
+				TTTR_CHUNK_RECORDS;
+		for ( k = 0; k < n_chunks; k++ ) {
+			chunks[k].records = block.records + k*TTTR_CHUNK_RECORDS;
+			chunks[k].n_records = block.length - k*TTTR_CHUNK_RECORDS;
+			if ( chunks[k].n_records > TTTR_CHUNK_RECORDS ) {
+				chunks[k].n_records = TTTR_CHUNK_RECORDS;
+			}
+			chunks[k].tttr = *tttr;
+			chunks[k].tttr.origin = 0;
+			chunks[k].tttr.overflows = 0;
+		}
+
+		pq_stats_input(options->stats, block.length*sizeof(uint32_t));
+		pq_threads_run(pq_t3_chunk_decode, chunks, sizeof(pq_t3_chunk_t), 
+				n_chunks);
+		pq_stats_lap(options->stats, PQ_STATS_DECODE, &clock);
+		for ( k = 0; k < n_chunks; k++ ) {
+			pq_stats_records(options->stats, chunks[k].types, 
+					chunks[k].n_records);
+		}
+
+		for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+			chunks[k].shift = 0;
+			chunks[k].limit = 0;
+			result = chunks[k].result;
+
+			for ( i = 0; 
+					! pq_check(result) && 
+					i < chunks[k].n_records && 
+					record_count < options->number;
+					i++ ) {
+				if ( chunks[k].types[i] == PQ_RECORD_T3 ) {
+					if ( chunks[k].limit == 0 ) {
+						probe = *tttr;
+						decode(&chunks[k].records[i], 1, &probe, &t3_true, &type);
+						probe.origin = 0;
+						decode(&chunks[k].records[i], 1, &probe, &t3_zero, &type);
+						chunks[k].shift = t3_true.pulse - t3_zero.pulse;
+					}
+
+					chunks[k].limit++;
+					record_count++;
+					pq_record_status_print("picoquant", record_count, options);
+				} else if ( chunks[k].types[i] == PQ_RECORD_MARKER ) {
+					tttr_marker_print(stream_out, chunks[k].t3[i].pulse);
+				} else if ( chunks[k].types[i] == PQ_RECORD_OVERFLOW ||
+						chunks[k].types[i] == PQ_RECORD_FILTERED ) {
+					/* overflows and filtering must be performed in the decoder. */
+				} else {
+					error("Record type not recognized: %d\n", 
+							chunks[k].types[i]);
+					result = PQ_ERROR_UNKNOWN_DATA;
+				}
+			}
+
+			tttr->origin += chunks[k].tttr.origin;
+			tttr->overflows += chunks[k].tttr.overflows;
+		}
+
+		if ( options->columnar ) {
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t3_chunk_columns(&chunks[k], &columns);
+			}
+			continue;
+		} else if ( pq_histogram_active(options) ) {
+			/* Each thread keeps counting into the histogram of its chunk. */
+			pq_threads_run(pq_t3_chunk_histogram, chunks, 
+					sizeof(pq_t3_chunk_t), n_chunks);
+			for ( k = 0; k < n_chunks; k++ ) {
+				if ( pq_check(chunks[k].result) ) {
+					result = chunks[k].result;
+				}
+			}
+			continue;
+		} else if ( pq_intensity_active(options) ) {
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t3_chunk_intensity(&chunks[k], &intensity);
+			}
+			continue;
+		} else if ( pq_shm_active(options) ) {
+			for ( k = 0; ! pq_check(result) && k < n_chunks; k++ ) {
+				result = pq_t3_chunk_shm(&chunks[k], &shm);
+			}
+			pq_shm_publish(&shm);
+			continue;
+		}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+		pq_threads_run(pq_t3_chunk_print, chunks, sizeof(pq_t3_chunk_t),
+				n_chunks);
+
+		for ( k = 0; k < n_chunks; k++ ) {
+			if ( pq_check(chunks[k].result) ) {
+				result = chunks[k].result;
+			}
+
+			if ( chunks[k].output != NULL ) {
+				fwrite(chunks[k].output, 1, chunks[k].output_length, 
+						stream_out);
+				free(chunks[k].output);
+				chunks[k].output = NULL;
+			}
+		}
+#else
+		for ( k = 0; k < n_chunks; k++ ) {
+			pq_t3_chunk_print(&chunks[k]);
+		}
+#endif
+
+		if ( ferror(stream_out) ) {
+			result = PQ_ERROR_IO;
+		}
+	}
+
+	pq_stats_lap(options->stats, PQ_STATS_FORMAT, &clock);
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_histogram_active(options) ) {
+		for ( k = 1; ! pq_check(result) && k < n_threads; k++ ) {
+			result = pq_histogram_merge(&chunks[0].histogram, 
+					&chunks[k].histogram);
+		}
+
+		if ( ! pq_check(result) ) {
+			pq_histogram_print(stream_out, &chunks[0].histogram, options);
+		}
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
+	}
+
+	for ( k = 0; k < n_threads; k++ ) {
+		free(chunks[k].t3);
+		free(chunks[k].types);
+		pq_histogram_free(&chunks[k].histogram);
+	}
+	free(chunks);
+	tttr_block_free(&block);
+
+	return(result);
+}
+
+int pq_t3_stream_pipeline(FILE *stream_in, FILE *stream_out,
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options) {
+	/*
+	 * Decode the stream with reading, decoding and printing each running on 
+	 * their own thread, as in pq_t2_stream_pipeline.
+	 */
+	int result = PQ_SUCCESS;
+	pq_t3_pipeline_t t3_pipeline;
+	pq_columns_t columns;
+	pq_histogram_t histogram = {0};
+	pq_intensity_t intensity = {0};
+	pq_shm_t shm = {0};
+
+	t3_pipeline.decode = decode;
+	t3_pipeline.tttr = tttr;
+	t3_pipeline.tttr_out = *tttr;
+	t3_pipeline.stream_out = stream_out;
+	t3_pipeline.options = options;
+	t3_pipeline.record_count = 0;
+	t3_pipeline.columns = NULL;
+	t3_pipeline.histogram = NULL;
+	t3_pipeline.intensity = NULL;
+	t3_pipeline.shm = NULL;
+
+	if ( options->binary_out ) {
+		t3_pipeline.print_t3 = pq_t3_fwrite;
+		t3_pipeline.print_t2 = pq_t2_fwrite;
+	} else {
+		t3_pipeline.print_t3 = pq_t3_fprintf;
+		t3_pipeline.print_t2 = pq_t2_fprintf;
+	}
+
+	if ( options->columnar ) {
+		result = pq_t3_columns_init(&columns, stream_out, 
+				options->to_t2, options->compact);
+		t3_pipeline.columns = &columns;
+	} else if ( pq_histogram_active(options) ) {
+		result = pq_histogram_init(&histogram, options, tttr);
+		t3_pipeline.histogram = &histogram;
+	} else if ( pq_intensity_active(options) ) {
+		result = pq_intensity_init(&intensity, stream_out, 
+				tttr->channels, options);
+		t3_pipeline.intensity = &intensity;
+	} else if ( pq_shm_active(options) ) {
+		result = pq_t3_shm_open(&shm, options);
+		t3_pipeline.shm = &shm;
+	}
+
+	if ( ! pq_check(result) && options->number > 0 ) {
+		result = pq_pipeline_run(stream_in, sizeof(t3_t), 
+				pq_t3_pipeline_decode, pq_t3_pipeline_write, &t3_pipeline,
+				options->stats);
+	}
+
+	if ( options->columnar ) {
+		result = pq_columns_finish(&columns, result);
+	} else if ( pq_shm_active(options) ) {
+		result = pq_shm_finish(&shm, result);
+	} else if ( pq_histogram_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_histogram_print(stream_out, &histogram, options);
+		}
+		pq_histogram_free(&histogram);
+	} else if ( pq_intensity_active(options) ) {
+		if ( ! pq_check(result) ) {
+			pq_intensity_finish(&intensity);
+		}
+		pq_intensity_free(&intensity);
+	}
+
+	return(result);
+}
+
+int pq_t3_pipeline_decode(pq_batch_t *batch, void *args) {
+	pq_t3_pipeline_t *t3_pipeline = (pq_t3_pipeline_t *)args;
+
+	return(t3_pipeline->decode(batch->records, batch->length, 
+			t3_pipeline->tttr, (t3_t *)batch->decoded, batch->types));
+}
+
+int pq_t3_pipeline_write(pq_batch_t *batch, void *args) {
+	pq_t3_pipeline_t *t3_pipeline = (pq_t3_pipeline_t *)args;
+	options_t *options = t3_pipeline->options;
+	FILE *stream_out = t3_pipeline->stream_out;
+	t3_t *t3 = (t3_t *)batch->decoded;
+	t2_t t2;
+	int result = PQ_SUCCESS;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < batch->length && 
+			t3_pipeline->record_count < options->number; 
+			i++ ) {
+		if ( batch->types[i] == PQ_RECORD_T3 ) {
+			t3_pipeline->record_count++;
+			pq_record_status_print("picoquant", t3_pipeline->record_count, 
+					options);
+			if ( t3_pipeline->histogram != NULL ) {
+				result = pq_histogram_add(t3_pipeline->histogram, 
+						t3[i].channel, t3[i].time);
+			} else if ( t3_pipeline->intensity != NULL ) {
+				result = pq_intensity_add(t3_pipeline->intensity, 
+						t3[i].channel, tttr_timebase_time(
+							&t3_pipeline->tttr_out.timebase, t3[i].pulse));
+			} else if ( t3_pipeline->shm != NULL ) {
+				if ( options->to_t2 ) {
+					pq_t3_to_t2(&t3[i], &t2, &t3_pipeline->tttr_out);
+					result = pq_shm_append(t3_pipeline->shm, &t2);
+				} else {
+					result = pq_shm_append(t3_pipeline->shm, &t3[i]);
+				}
+			} else if ( options->to_t2 ) {
+				pq_t3_to_t2(&t3[i], &t2, &t3_pipeline->tttr_out);
+				if ( t3_pipeline->columns != NULL ) {
+					result = pq_t2_columns_append(t3_pipeline->columns, &t2);
+				} else {
+					t3_pipeline->print_t2(stream_out, &t2);
+				}
+			} else if ( t3_pipeline->columns != NULL ) {
+				result = pq_t3_columns_append(t3_pipeline->columns, &t3[i]);
+			} else {
+				t3_pipeline->print_t3(stream_out, &t3[i]);
+			}
+		} else if ( batch->types[i] == PQ_RECORD_MARKER ) {
+			tttr_marker_print(stream_out, t3[i].pulse);
+		} else if ( batch->types[i] == PQ_RECORD_OVERFLOW ||
+				batch->types[i] == PQ_RECORD_FILTERED ) {
+			/* overflows and filtering must be performed in the decoder. */
+		} else { 
+			error("Record type not recognized: %d\n", batch->types[i]);
+			result = PQ_ERROR_UNKNOWN_DATA;
+		}
+	}
+
+	if ( ! pq_check(result) && t3_pipeline->shm != NULL ) {
+		pq_shm_publish(t3_pipeline->shm);
+	}
+
+	if ( ! pq_check(result) && 
+			t3_pipeline->record_count >= options->number ) {
+		result = PQ_ERROR_EOF;
+	}
+
+	return(result);
+}
+
+void *pq_t3_chunk_decode(void *chunk) {
+	pq_t3_chunk_t *t3_chunk = (pq_t3_chunk_t *)chunk;
+
+	t3_chunk->result = t3_chunk->decode(t3_chunk->records, 
+			t3_chunk->n_records, &t3_chunk->tttr, 
+			t3_chunk->t3, t3_chunk->types);
+
+	return(NULL);
+}
+
+void *pq_t3_chunk_print(void *chunk) {
+	pq_t3_chunk_t *t3_chunk = (pq_t3_chunk_t *)chunk;
+	FILE *stream_out = t3_chunk->stream_out;
+	int64_t printed = 0;
+	size_t i;
+	t2_t t2;
+
+	t3_chunk->output = NULL;
+	t3_chunk->output_length = 0;
+
+	if ( t3_chunk->limit == 0 ) {
+		return(NULL);
+	}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+	stream_out = open_memstream(&t3_chunk->output, &t3_chunk->output_length);
+	if ( stream_out == NULL ) {
+		error("Could not open output buffer for t3 chunk.\n");
+		t3_chunk->result = PQ_ERROR_MEM;
+		return(NULL);
+	}
+#endif
+
+	for ( i = 0; i < t3_chunk->n_records && printed < t3_chunk->limit; i++ ) {
+		if ( t3_chunk->types[i] == PQ_RECORD_T3 ) {
+			t3_chunk->t3[i].pulse += t3_chunk->shift;
+			if ( t3_chunk->to_t2 ) {
+				pq_t3_to_t2(&t3_chunk->t3[i], &t2, &t3_chunk->tttr);
+				t3_chunk->print_t2(stream_out, &t2);
+			} else {
+				t3_chunk->print_t3(stream_out, &t3_chunk->t3[i]);
+			}
+			printed++;
+		}
+	}
+
+#ifdef HAVE_OPEN_MEMSTREAM
+	fclose(stream_out);
+#endif
+
+	return(NULL);
+}
+
+void *pq_t3_chunk_histogram(void *chunk) {
+/*
+ * Count the photons of the chunk into its histogram.
+ */
+	pq_t3_chunk_t *t3_chunk = (pq_t3_chunk_t *)chunk;
+	int64_t added = 0;
+	size_t i;
+
+	t3_chunk->result = PQ_SUCCESS;
+
+	for ( i = 0; 
+			! pq_check(t3_chunk->result) && 
+			i < t3_chunk->n_records && 
+			added < t3_chunk->limit; 
+			i++ ) {
+		if ( t3_chunk->types[i] == PQ_RECORD_T3 ) {
+			t3_chunk->result = pq_histogram_add(&t3_chunk->histogram, 
+					t3_chunk->t3[i].channel, t3_chunk->t3[i].time);
+			added++;
+		}
+	}
+
+	return(NULL);
+}
+
+int pq_t3_chunk_columns(pq_t3_chunk_t *chunk, pq_columns_t *columns) {
+/*
+ * Shift the photons in the chunk to their true origin and add them to the
+ * output columns, as in pq_t2_chunk_columns.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+	t2_t t2;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T3 ) {
+			chunk->t3[i].pulse += chunk->shift;
+			if ( chunk->to_t2 ) {
+				pq_t3_to_t2(&chunk->t3[i], &t2, &chunk->tttr);
+				result = pq_t2_columns_append(columns, &t2);
+			} else {
+				result = pq_t3_columns_append(columns, &chunk->t3[i]);
+			}
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t3_chunk_shm(pq_t3_chunk_t *chunk, pq_shm_t *shm) {
+/*
+ * Shift the photons in the chunk to their true origin and add them to the
+ * shared memory ring, as in pq_t2_chunk_shm.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+	t2_t t2;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T3 ) {
+			chunk->t3[i].pulse += chunk->shift;
+			if ( chunk->to_t2 ) {
+				pq_t3_to_t2(&chunk->t3[i], &t2, &chunk->tttr);
+				result = pq_shm_append(shm, &t2);
+			} else {
+				result = pq_shm_append(shm, &chunk->t3[i]);
+			}
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t3_shm_open(pq_shm_t *shm, options_t *options) {
+/*
+ * Records converted to t2 are published as t2_t, so readers need not know
+ * the sync rate.
+ */
+	if ( options->to_t2 ) {
+		return(pq_shm_open(shm, options->shm_name, PQ_RECORD_T2, 
+				sizeof(t2_t), options->shm_readers));
+	} else {
+		return(pq_shm_open(shm, options->shm_name, PQ_RECORD_T3, 
+				sizeof(t3_t), options->shm_readers));
+	}
+}
+
+int pq_t3_chunk_intensity(pq_t3_chunk_t *chunk, pq_intensity_t *intensity) {
+/*
+ * Shift the photons in the chunk to their true origin and count them into
+ * the intensity trace, at the time of their sync pulse.
+ */
+	int result = PQ_SUCCESS;
+	int64_t added = 0;
+	size_t i;
+
+	for ( i = 0; 
+			! pq_check(result) && 
+			i < chunk->n_records && 
+			added < chunk->limit; 
+			i++ ) {
+		if ( chunk->types[i] == PQ_RECORD_T3 ) {
+			chunk->t3[i].pulse += chunk->shift;
+			result = pq_intensity_add(intensity, chunk->t3[i].channel, 
+					tttr_timebase_time(&chunk->tttr.timebase, 
+						chunk->t3[i].pulse));
+			added++;
+		}
+	}
+
+	return(result);
+}
+
+int pq_t3_seek(FILE *stream_in, pq_t3_decode_block_t decode, 
+		tttr_t *tttr, options_t *options, uint64_t *length) {
+/*
+ * Move the stream and decoder state to the checkpoint before --start-time,
+ * using the index of the input (building it first if necessary), and find
+ * how many records must be decoded from there. Without an index (such as 
+ * for stdin), everything is decoded and the records filtered.
+ */
+	int result;
+	pq_index_t index;
+
+	*length = PQ_INDEX_NONE;
+
+	result = pq_index_init(&index, stream_in, options->filename_in);
+	if ( result == PQ_ERROR_IO ) {
+		debug("Input cannot be indexed, decoding all of it.\n");
+		pq_index_free(&index);
+		return(PQ_SUCCESS);
+	} 
+	
+	if ( ! pq_check(result) && pq_check(pq_index_load(&index)) ) {
+		result = pq_t3_index_build(stream_in, decode, tttr, &index);
+		if ( ! pq_check(result) ) {
+			pq_index_save(&index);
+		}
+	}
+
+	if ( ! pq_check(result) ) {
+		result = pq_index_seek(&index, stream_in, tttr, 
+				options->start_time, options->stop_time, length);
+	}
+
+	pq_index_free(&index);
+	return(result);
+}
+
+int pq_t3_index_build(FILE *stream_in, pq_t3_decode_block_t decode,
+		tttr_t *tttr, pq_index_t *index) {
+/*
+ * Decode the whole stream, noting the decoder state at every checkpoint and 
+ * the pulse of the first photon after it.
+ */
+	int result = PQ_SUCCESS;
+	uint64_t record = 0;
+	size_t i;
+	tttr_t state = *tttr;
+	tttr_block_t block;
+	t3_t *t3 = NULL;
+	int *types = NULL;
+
+	debug("Building index %s.\n", index->filename);
+
+	/* The checkpoints do not depend on which photons are kept. */
+	state.filter = 0;
+
+	result = tttr_block_init(&block, stream_in, TTTR_BLOCK_RECORDS);
+	t3 = (t3_t *)malloc(TTTR_BLOCK_RECORDS*sizeof(t3_t));
+	types = (int *)malloc(TTTR_BLOCK_RECORDS*sizeof(int));
+
+	if ( t3 == NULL || types == NULL ) {
+		error("Could not allocate t3 record block.\n");
+		result = PQ_ERROR_MEM;
+	}
+
+	while ( ! pq_check(result) ) {
+		result = tttr_block_read(&block);
+
+		if ( result == PQ_ERROR_EOF ) {
+			result = PQ_SUCCESS;
+			break;
+		} else if ( pq_check(result) ) {
+			break;
+		}
+
+		if ( index->n_entries == 0 || record >= 
+				index->entries[index->n_entries-1].record + index->interval ) {
+			result = pq_index_append(index, record, &state);
+		}
+
+		if ( ! pq_check(result) ) {
+			result = decode(block.records, block.length, &state, t3, types);
+		}
+
+		for ( i = 0; ! pq_check(result) && i < block.length; i++ ) {
+			if ( types[i] == PQ_RECORD_T3 ) {
+				pq_index_first(index, t3[i].pulse);
+				break;
+			}
+		}
+
+		record += block.length;
+	}
+
+	free(t3);
+	free(types);
+	tttr_block_free(&block);
+
+	return(result);
+}
+
 int pq_t3_next(FILE *stream_in, pq_t3_decode_t decode, 
 		tttr_t *tttr, t3_t *t3) {
 	return(decode(stream_in, tttr, t3));
 }
 
 int pq_t3_fprintf(FILE *stream_out, t3_t *record) {
-	fprintf(stream_out, "%"PRIu32",%"PRIu64",%"PRIu64"\n",
-			record->channel,
-			record->pulse,
-			record->time);
+	char line[PQ_FORMAT_LINE];
+	char *end = line;
+
+	end = pq_format_u64(end, record->channel);
+	*end++ = ',';
+	end = pq_format_u64(end, record->pulse);
+	*end++ = ',';
+	end = pq_format_u64(end, record->time);
+	*end++ = '\n';
+
+	fwrite(line, 1, end - line, stream_out);
 
 	return( ! ferror(stream_out) ? PQ_SUCCESS : PQ_ERROR_IO );
 }
@@ -108,11 +925,46 @@ int pq_t3_fwrite(FILE *stream_out, t3_t *record) {
 	return(fwrite(record, sizeof(t3_t), 1, stream_out));
 }
 
+int pq_t3_columns_init(pq_columns_t *columns, FILE *stream_out, int to_t2,
+		int compact) {
+/*
+ * Start columnar output of t3 records: channel (uint32_t), pulse (uint64_t),
+ * time (uint64_t). Records converted to t2 use the t2 columns instead.
+ * Compact output stores the pulses as differences between successive records.
+ */
+	static char const * const names[] = {"channel", "pulse", "time"};
+	static size_t const sizes[] = {sizeof(uint32_t), sizeof(uint64_t), 
+			sizeof(uint64_t)};
+	static int const encodings[] = {PQ_COLUMNS_VARINT, PQ_COLUMNS_DELTA,
+			PQ_COLUMNS_VARINT};
+
+	if ( to_t2 ) {
+		return(pq_t2_columns_init(columns, stream_out, compact));
+	} else {
+		return(pq_columns_init(columns, stream_out, PQ_RECORD_T3, 3, 
+				names, sizes, compact ? encodings : NULL));
+	}
+}
+
+int pq_t3_columns_append(pq_columns_t *columns, t3_t *record) {
+	((uint32_t *)columns->data[0])[columns->length] = record->channel;
+	((uint64_t *)columns->data[1])[columns->length] = record->pulse;
+	((uint64_t *)columns->data[2])[columns->length] = record->time;
+	columns->length++;
+
+	if ( columns->length == columns->capacity ) {
+		return(pq_columns_flush(columns));
+	} else {
+		return(PQ_SUCCESS);
+	}
+}
+
 void pq_t3_to_t2(t3_t *record_in, t2_t *record_out, tttr_t *tttr) {
 /*
- * Use the t3 sync rate to convert the pulse number into a t3-like time, in ps.
+ * Use the sync period to convert the pulse number into a time, in ps, then 
+ * add the arrival time after the pulse, also in ps.
  */
 	record_out->channel = record_in->channel;
-	record_out->time = (int64_t)floor(
-		record_in->pulse * (1e12 / tttr->sync_rate) );
+	record_out->time = (int64_t)(tttr_timebase_time(&tttr->timebase, 
+			record_in->pulse) + record_in->time*tttr->time_scale);
 }
@@ -32,32 +32,95 @@
 #ifndef T3_H_
 #define T3_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "types.h"
+#include "records.h"
 #include "tttr.h"
 #include "t2.h"
 #include "options.h"
+#include "pipeline.h"
+#include "histogram.h"
+#include "intensity.h"
+#include "shm.h"
 
-typedef struct {
-	uint32_t channel;
-	uint64_t pulse;
-	uint64_t time;
-} t3_t;
+#pragma pack(push, 2)
 
 typedef int (*pq_t3_decode_t)(FILE *, tttr_t *, t3_t *);
+typedef int (*pq_t3_decode_block_t)(uint32_t const *, size_t, tttr_t *, 
+		t3_t *, int *);
 typedef int (*pq_t3_print_t)(FILE *, t3_t *);
 
-int pq_t3_stream(FILE *stream_in, FILE *stream_out, pq_t3_decode_t decode,
-		tttr_t *tttr, options_t *options);
+/* See pq_t2_chunk_t for how the chunks are used. */
+typedef struct {
+	pq_t3_decode_block_t decode;
+	uint32_t const *records;
+	size_t n_records;
+	tttr_t tttr;
+	t3_t *t3;
+	int *types;
+	int result;
+
+	uint64_t shift;
+	int64_t limit;
+	int to_t2;
+	pq_t3_print_t print_t3;
+	pq_t2_print_t print_t2;
+	FILE *stream_out;
+	char *output;
+	size_t output_length;
+	pq_histogram_t histogram;
+} pq_t3_chunk_t;
+
+/* See pq_t2_pipeline_t. The writer keeps its own copy of the tttr state for
+ * the conversion to t2, since the decoder updates the shared one.
+ */
+typedef struct {
+	pq_t3_decode_block_t decode;
+	tttr_t *tttr;
+	tttr_t tttr_out;
+	pq_t3_print_t print_t3;
+	pq_t2_print_t print_t2;
+	FILE *stream_out;
+	options_t *options;
+	int64_t record_count;
+	pq_columns_t *columns;
+	pq_histogram_t *histogram;
+	pq_intensity_t *intensity;
+	pq_shm_t *shm;
+} pq_t3_pipeline_t;
+
+int pq_t3_stream(FILE *stream_in, FILE *stream_out, 
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t3_stream_parallel(FILE *stream_in, FILE *stream_out, 
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t3_stream_pipeline(FILE *stream_in, FILE *stream_out, 
+		pq_t3_decode_block_t decode, tttr_t *tttr, options_t *options);
+int pq_t3_pipeline_decode(pq_batch_t *batch, void *args);
+int pq_t3_pipeline_write(pq_batch_t *batch, void *args);
+void *pq_t3_chunk_decode(void *chunk);
+void *pq_t3_chunk_print(void *chunk);
+void *pq_t3_chunk_histogram(void *chunk);
+int pq_t3_chunk_columns(pq_t3_chunk_t *chunk, pq_columns_t *columns);
+int pq_t3_chunk_intensity(pq_t3_chunk_t *chunk, pq_intensity_t *intensity);
+int pq_t3_chunk_shm(pq_t3_chunk_t *chunk, pq_shm_t *shm);
+int pq_t3_shm_open(pq_shm_t *shm, options_t *options);
+int pq_t3_seek(FILE *stream_in, pq_t3_decode_block_t decode, 
+		tttr_t *tttr, options_t *options, uint64_t *length);
+int pq_t3_index_build(FILE *stream_in, pq_t3_decode_block_t decode,
+		tttr_t *tttr, pq_index_t *index);
 int pq_t3_next(FILE *stream_in, pq_t3_decode_t decode, tttr_t *tttr, t3_t *t3);
 int pq_t3_fprintf(FILE *stream_out, t3_t *record);
 int pq_t3_fwrite(FILE *stream_out, t3_t *record);
+int pq_t3_columns_init(pq_columns_t *columns, FILE *stream_out, int to_t2,
+		int compact);
+int pq_t3_columns_append(pq_columns_t *columns, t3_t *record);
 
 void pq_t3_to_t2(t3_t *record_in, t2_t *record_out, tttr_t *tttr);
 
+int pq_reader_attach_t3(void *reader, pq_t3_decode_block_t decode, 
+		tttr_t *tttr);
+
 #pragma pack(pop)
 
 #endif
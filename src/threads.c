@@ -0,0 +1,379 @@
+/*
+ * Copyright (c) 2011-2014, Thomas Bischof
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without 
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ *    this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice, 
+ *    this list of conditions and the following disclaimer in the documentation 
+ *    and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the Massachusetts Institute of Technology nor the 
+ *    names of its contributors may be used to endorse or promote products 
+ *    derived from this software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE 
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE 
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR 
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF 
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS 
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN 
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) 
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE 
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+
+#include "threads.h"
+#include "error.h"
+
+
+#ifdef HAVE_PTHREAD_H
+/* The work-stealing pool behind pq_pool_run. Each worker has a deque of
+ * tasks: it pushes and pops its own at the tail, and an idle worker steals 
+ * the oldest task at the head of another. Tasks are whole files or chunks of
+ * 65536 records, so a single lock for all of the deques is not contended.
+ */
+typedef struct {
+	pq_thread_work_t work;
+	void *arg;
+	size_t *pending;
+} pq_pool_task_t;
+
+typedef struct {
+	pq_pool_task_t *tasks;
+	size_t head;
+	size_t tail;
+	size_t capacity;
+} pq_pool_deque_t;
+
+typedef struct {
+	pq_pool_deque_t *deques;
+	int n_threads;
+	size_t outstanding;
+	pthread_mutex_t lock;
+	pthread_cond_t changed;
+} pq_pool_t;
+
+typedef struct {
+	pq_pool_t *pool;
+	int index;
+} pq_pool_worker_t;
+
+static pthread_key_t pq_pool_key;
+static pthread_once_t pq_pool_key_once = PTHREAD_ONCE_INIT;
+
+static void pq_pool_key_create(void) {
+	pthread_key_create(&pq_pool_key, NULL);
+}
+
+static int pq_pool_push(pq_pool_t *pool, int index, pq_thread_work_t work, 
+		void *arg, size_t *pending) {
+/*
+ * Add a task at the tail of the deque of worker index. The lock is held.
+ */
+	pq_pool_deque_t *deque = &pool->deques[index];
+	pq_pool_task_t *tasks;
+	size_t capacity;
+
+	if ( deque->tail == deque->capacity ) {
+		if ( deque->head > 0 ) {
+			memmove(deque->tasks, deque->tasks + deque->head, 
+					(deque->tail - deque->head)*sizeof(pq_pool_task_t));
+			deque->tail -= deque->head;
+			deque->head = 0;
+		} else {
+			capacity = deque->capacity == 0 ? 64 : 2*deque->capacity;
+			tasks = (pq_pool_task_t *)realloc(deque->tasks, 
+					capacity*sizeof(pq_pool_task_t));
+			if ( tasks == NULL ) {
+				return(PQ_ERROR_MEM);
+			}
+			deque->tasks = tasks;
+			deque->capacity = capacity;
+		}
+	}
+
+	deque->tasks[deque->tail].work = work;
+	deque->tasks[deque->tail].arg = arg;
+	deque->tasks[deque->tail].pending = pending;
+	deque->tail++;
+	pool->outstanding++;
+
+	return(PQ_SUCCESS);
+}
+
+static int pq_pool_take(pq_pool_t *pool, int index, size_t *pending, 
+		pq_pool_task_t *task) {
+/*
+ * Take the newest task of worker index or, failing that, steal the oldest
+ * task of another worker. With pending, only take a task of that group, 
+ * which can only be on our own deque since stolen tasks are run at once.
+ * The lock is held.
+ */
+	pq_pool_deque_t *deque = &pool->deques[index];
+	int i;
+
+	if ( deque->tail > deque->head && 
+			(pending == NULL || 
+			 deque->tasks[deque->tail - 1].pending == pending) ) {
+		*task = deque->tasks[--deque->tail];
+		return(1);
+	}
+
+	for ( i = 1; pending == NULL && i < pool->n_threads; i++ ) {
+		deque = &pool->deques[(index + i) % pool->n_threads];
+		if ( deque->tail > deque->head ) {
+			*task = deque->tasks[deque->head++];
+			return(1);
+		}
+	}
+
+	return(0);
+}
+
+static void pq_pool_execute(pq_pool_t *pool, pq_pool_task_t *task) {
+/*
+ * Run the task without the lock, then mark it done. The lock is held on
+ * entry and on return.
+ */
+	pthread_mutex_unlock(&pool->lock);
+	task->work(task->arg);
+	pthread_mutex_lock(&pool->lock);
+
+	if ( task->pending != NULL ) {
+		(*task->pending)--;
+	}
+	pool->outstanding--;
+	pthread_cond_broadcast(&pool->changed);
+}
+
+static void *pq_pool_worker(void *arg) {
+	pq_pool_worker_t *worker = (pq_pool_worker_t *)arg;
+	pq_pool_t *pool = worker->pool;
+	pq_pool_task_t task;
+	void *outer = pthread_getspecific(pq_pool_key);
+
+	pthread_setspecific(pq_pool_key, worker);
+	pthread_mutex_lock(&pool->lock);
+
+	while ( pool->outstanding > 0 ) {
+		if ( pq_pool_take(pool, worker->index, NULL, &task) ) {
+			pq_pool_execute(pool, &task);
+		} else {
+			pthread_cond_wait(&pool->changed, &pool->lock);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+	pthread_setspecific(pq_pool_key, outer);
+	return(NULL);
+}
+
+static int pq_pool_fork(pq_pool_worker_t *worker, pq_thread_work_t work, 
+		void *args, size_t arg_size, int n_threads) {
+/*
+ * pq_threads_run from inside a task of the pool: queue the elements after 
+ * the first where idle workers can steal them, take the first, and help 
+ * with the rest until all are done.
+ */
+	pq_pool_t *pool = worker->pool;
+	pq_pool_task_t task;
+	char *arg = (char *)args;
+	size_t pending = 0;
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+	for ( i = n_threads - 1; i > 0; i-- ) {
+		if ( pq_pool_push(pool, worker->index, work, arg + i*arg_size, 
+				&pending) == PQ_SUCCESS ) {
+			pending++;
+		} else {
+			pthread_mutex_unlock(&pool->lock);
+			work(arg + i*arg_size);
+			pthread_mutex_lock(&pool->lock);
+		}
+	}
+	pthread_cond_broadcast(&pool->changed);
+	pthread_mutex_unlock(&pool->lock);
+
+	work(arg);
+
+	pthread_mutex_lock(&pool->lock);
+	while ( pending > 0 ) {
+		if ( pq_pool_take(pool, worker->index, &pending, &task) ) {
+			pq_pool_execute(pool, &task);
+		} else {
+			pthread_cond_wait(&pool->changed, &pool->lock);
+		}
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return(PQ_SUCCESS);
+}
+#endif
+
+int pq_threads_run(pq_thread_work_t work, void *args, size_t arg_size,
+		int n_threads) {
+/*
+ * Call work() once for each of the n_threads elements of args (each 
+ * arg_size bytes long), in parallel where possible, and wait for all of
+ * them to finish. The calling thread takes the first element. If threads
+ * are unavailable, the work is done serially.
+ */
+	int i;
+	char *arg = (char *)args;
+#ifdef HAVE_PTHREAD_H
+	pthread_t *threads;
+	int *started;
+	pq_pool_worker_t *worker;
+
+	/* Inside the pool, the threads are already there. */
+	pthread_once(&pq_pool_key_once, pq_pool_key_create);
+	worker = (pq_pool_worker_t *)pthread_getspecific(pq_pool_key);
+	if ( worker != NULL && n_threads > 1 ) {
+		return(pq_pool_fork(worker, work, args, arg_size, n_threads));
+	}
+
+	threads = (pthread_t *)malloc(n_threads*sizeof(pthread_t));
+	started = (int *)calloc(n_threads, sizeof(int));
+
+	if ( threads == NULL || started == NULL ) {
+		error("Could not allocate threads.\n");
+		free(threads);
+		free(started);
+		return(PQ_ERROR_MEM);
+	}
+
+	for ( i = 1; i < n_threads; i++ ) {
+		started[i] = ! pthread_create(&threads[i], NULL, work, 
+				arg + i*arg_size);
+	}
+
+	work(arg);
+
+	for ( i = 1; i < n_threads; i++ ) {
+		if ( started[i] ) {
+			pthread_join(threads[i], NULL);
+		} else {
+			work(arg + i*arg_size);
+		}
+	}
+
+	free(threads);
+	free(started);
+#else
+	for ( i = 0; i < n_threads; i++ ) {
+		work(arg + i*arg_size);
+	}
+#endif
+
+	return(PQ_SUCCESS);
+}
+
+int pq_pool_run(pq_thread_work_t work, void *args, size_t arg_size,
+		size_t n_tasks, int n_threads) {
+/*
+ * Call work() once for each of the n_tasks elements of args, on a pool of
+ * n_threads threads (including this one) which steal work from each other.
+ * The tasks are dealt out in turn, and each worker takes its own in order,
+ * so the longest tasks should come first. Calls to pq_threads_run from a 
+ * task share the threads of the pool, so that a task can split itself up 
+ * for the workers which are idle.
+ */
+	size_t i;
+	char *arg = (char *)args;
+#ifdef HAVE_PTHREAD_H
+	pq_pool_t pool;
+	pq_pool_worker_t *workers;
+	pthread_t *threads;
+	int *started;
+	int k;
+	int result = PQ_SUCCESS;
+
+	if ( n_threads < 1 ) {
+		n_threads = 1;
+	}
+
+	pthread_once(&pq_pool_key_once, pq_pool_key_create);
+
+	pool.n_threads = n_threads;
+	pool.outstanding = 0;
+	pool.deques = (pq_pool_deque_t *)calloc(n_threads, 
+			sizeof(pq_pool_deque_t));
+	workers = (pq_pool_worker_t *)malloc(n_threads*sizeof(pq_pool_worker_t));
+	threads = (pthread_t *)malloc(n_threads*sizeof(pthread_t));
+	started = (int *)calloc(n_threads, sizeof(int));
+
+	if ( pool.deques == NULL || workers == NULL || threads == NULL || 
+			started == NULL ) {
+		error("Could not allocate thread pool.\n");
+		result = PQ_ERROR_MEM;
+	}
+
+	/* Deal the tasks out from the back, so that the first tasks end up at
+	 * the tails of the deques and are taken first.
+	 */
+	for ( i = n_tasks; result == PQ_SUCCESS && i > 0; i-- ) {
+		result = pq_pool_push(&pool, (i - 1) % n_threads, work, 
+				arg + (i - 1)*arg_size, NULL);
+		if ( result != PQ_SUCCESS ) {
+			error("Could not allocate thread pool tasks.\n");
+		}
+	}
+
+	if ( result == PQ_SUCCESS ) {
+		pthread_mutex_init(&pool.lock, NULL);
+		pthread_cond_init(&pool.changed, NULL);
+
+		for ( k = 0; k < n_threads; k++ ) {
+			workers[k].pool = &pool;
+			workers[k].index = k;
+		}
+
+		/* A worker which does not start leaves its tasks to be stolen. */
+		for ( k = 1; k < n_threads; k++ ) {
+			started[k] = ! pthread_create(&threads[k], NULL, 
+					pq_pool_worker, &workers[k]);
+		}
+
+		pq_pool_worker(&workers[0]);
+
+		for ( k = 1; k < n_threads; k++ ) {
+			if ( started[k] ) {
+				pthread_join(threads[k], NULL);
+			}
+		}
+
+		pthread_cond_destroy(&pool.changed);
+		pthread_mutex_destroy(&pool.lock);
+	}
+
+	for ( k = 0; pool.deques != NULL && k < n_threads; k++ ) {
+		free(pool.deques[k].tasks);
+	}
+	free(pool.deques);
+	free(workers);
+	free(threads);
+	free(started);
+
+	return(result);
+#else
+	for ( i = 0; i < n_tasks; i++ ) {
+		work(arg + i*arg_size);
+	}
+
+	return(PQ_SUCCESS);
+#endif
+}
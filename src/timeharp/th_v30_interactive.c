@@ -37,6 +37,7 @@
 #include "th_v30.h"
 
 #include "../error.h"
+#include "../reader.h"
 #include "../interactive.h"
 
 /* 
@@ -135,12 +136,13 @@ void th_v30_interactive_header_printf(FILE *stream_out,
 		th_v30_header_t *th_header, 
 		th_v30_interactive_t **interactive) {
 	int i;
+	char time_buffer[PQ_CTIME_LENGTH];
 
 	for ( i = 0; i < th_header->NumberOfCurves; i++ ) {
 		fprintf(stream_out, "Crv[%d].CurveIndex = %"PRId32"\n",
 			i, (*interactive)[i].CurveIndex); 
 		fprintf(stream_out, "Crv[%d].TimeOfRecording = %s",
-			i, ctime32(&(*interactive)[i].TimeOfRecording));
+			i, ctime32(&(*interactive)[i].TimeOfRecording, time_buffer));
 		fprintf(stream_out, "Crv[%d].BoardSerial = %"PRId32"\n",
 			i, (*interactive)[i].BoardSerial);
 		fprintf(stream_out, "Crv[%d].CFDZeroCross = %"PRId32"\n",
@@ -202,6 +204,11 @@ void th_v30_interactive_data_print(FILE *stream_out,
 
 	pq_interactive_bin_print_t print;
 
+	if ( options->reader != NULL ) {
+		/* A library reader takes the bins in binary form. */
+		pq_reader_attach_interactive(options->reader);
+	}
+
 	if ( options->binary_out ) {
 		print = pq_interactive_bin_fwrite;
 	} else {
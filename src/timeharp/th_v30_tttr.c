@@ -48,10 +48,39 @@ void th_v30_t3_init(th_v30_header_t *th_header,
 		tttr_t *tttr) {
 	tttr->origin = 0;
 	tttr->overflows = 0;
+	tttr->channels = 1;
 	tttr->overflow_increment = TH_TTTR_OVERFLOW;
 	tttr->sync_rate = tttr_header->SyncRate;
+	tttr->sync_period = 0;
 	tttr->resolution_float = th_header->Brd[0].Resolution*1e-9;
 	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+	tttr->time_scale = tttr->resolution_int;
+}
+
+int th_v30_t3_record_decode(th_v30_tttr_record_t *record, tttr_t *tttr, t3_t *t3) {
+	if ( record->Valid ) {
+		/* Normal record. */
+		if ( TTTR_REJECTED_T3(tttr, 0, record->Data) ) {
+			return(PQ_RECORD_FILTERED);
+		}
+
+		t3->channel = 0;
+		t3->pulse = tttr->origin + record->TimeTag;
+		t3->time = record->Data;
+		return(PQ_RECORD_T3);
+	} else {
+		/* Special record. */
+		if ( 0x800 & record->Data ) {
+			/* Overflow */
+			tttr->overflows++;
+			tttr->origin += tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		} else {
+			t3->channel = 0x800;
+			t3->pulse = record->Data & 0x07;
+			return(PQ_RECORD_MARKER);
+		}
+	}
 }
 
 int th_v30_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
@@ -68,26 +97,21 @@ int th_v30_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		if ( record.Valid ) {
-			/* Normal record. */
-			t3->channel = 0;
-			t3->pulse = tttr->origin + record.TimeTag;
-			t3->time = record.Data;
-			return(PQ_RECORD_T3);
-		} else {
-			/* Special record. */
-			if ( 0x800 & record.Data ) {
-				/* Overflow */
-				tttr->overflows++;
-				tttr->origin += tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			} else {
-				t3->channel = 0x800;
-				t3->pulse = record.Data & 0x07;
-				return(PQ_RECORD_MARKER);
-			}
-		}
+		return(th_v30_t3_record_decode(&record, tttr, t3));
+	}
+}
+
+int th_v30_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i;
+	th_v30_tttr_record_t record;
+
+	for ( i = 0; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = th_v30_t3_record_decode(&record, tttr, &t3[i]);
 	}
+
+	return(PQ_SUCCESS);
 }
 				
 int th_v30_t3_stream(FILE *stream_in, FILE *stream_out, 
@@ -97,13 +121,8 @@ int th_v30_t3_stream(FILE *stream_in, FILE *stream_out,
 
 	th_v30_t3_init(th_header, tttr_header, &tttr);
 
-	if ( options->to_t2 ) {
-		error("T3 -> T2 not supported for Timeharp.\n");
-		return(PQ_ERROR_OPTIONS);
-	} else {
-		return(pq_t3_stream(stream_in, stream_out, 
-				th_v30_t3_decode, &tttr, options));
-	}
+	return(pq_t3_stream(stream_in, stream_out, 
+			th_v30_t3_decode_block, &tttr, options));
 }
 		
 int th_v30_tttr_stream(FILE *stream_in, FILE *stream_out, 
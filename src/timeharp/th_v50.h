@@ -32,13 +32,13 @@
 #ifndef TH_V50_H_
 #define TH_V50_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "../picoquant.h"
 #include "../tttr.h"
 
+#pragma pack(push, 2)
+
 typedef struct {
 	int32_t MapTo;
 	int32_t Show;
@@ -174,7 +174,10 @@ void th_v50_interactive_data_print(FILE *stream_out,
 void th_v50_t3_init(th_v50_header_t *th_header,
 		th_v50_tttr_header_t *tttr_header,
 		tttr_t *tttr);
+int th_v50_t3_record_decode(th_v50_tttr_record_t *record, tttr_t *tttr, t3_t *t3);
 int th_v50_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3);
+int th_v50_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types);
 int th_v50_tttr_stream(FILE *stream_in, FILE *stream_out, 
 		pq_header_t *pq_header, th_v50_header_t *th_header, 
 		options_t *options);
@@ -36,6 +36,7 @@
 #include "th_v60.h"
 
 #include "../error.h"
+#include "../reader.h"
 #include "../interactive.h"
 
 /* 
@@ -134,12 +135,13 @@ void th_v60_interactive_header_printf(FILE *stream_out,
 		th_v60_header_t *th_header, 
 		th_v60_interactive_t **interactive) {
 	int i;
+	char time_buffer[PQ_CTIME_LENGTH];
 
 	for ( i = 0; i < th_header->NumberOfCurves; i++ ) {
 		fprintf(stream_out, "Crv[%d].CurveIndex = %"PRId32"\n",
 			i, (*interactive)[i].CurveIndex); 
 		fprintf(stream_out, "Crv[%d].TimeOfRecording = %s",
-			i, ctime32(&(*interactive)[i].TimeOfRecording));
+			i, ctime32(&(*interactive)[i].TimeOfRecording, time_buffer));
 		fprintf(stream_out, "Crv[%d].BoardSerial = %"PRId32"\n",
 			i, (*interactive)[i].BoardSerial);
 		fprintf(stream_out, "Crv[%d].CFDZeroCross = %"PRId32"\n",
@@ -201,6 +203,11 @@ void th_v60_interactive_data_print(FILE *stream_out,
 
 	pq_interactive_bin_print_t print;
 
+	if ( options->reader != NULL ) {
+		/* A library reader takes the bins in binary form. */
+		pq_reader_attach_interactive(options->reader);
+	}
+
 	if ( options->binary_out ) {
 		print = pq_interactive_bin_fwrite;
 	} else {
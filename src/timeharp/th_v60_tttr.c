@@ -48,10 +48,39 @@ void th_v60_t3_init(th_v60_header_t *th_header,
 		tttr_t *tttr) {
 	tttr->origin = 0;
 	tttr->overflows = 0;
+	tttr->channels = 0;
 	tttr->overflow_increment = TH_TTTR_OVERFLOW;
 	tttr->sync_rate = tttr_header->SyncRate;
+	tttr->sync_period = 0;
 	tttr->resolution_float = th_header->Brd[0].Resolution*1e-9;
 	tttr->resolution_int = floor(fabs(tttr->resolution_float*1e12));
+	tttr->time_scale = tttr->resolution_int;
+}
+
+int th_v60_t3_record_decode(th_v60_tttr_record_t *record, tttr_t *tttr, t3_t *t3) {
+	if ( record->Valid ) {
+		/* Normal record. */
+		if ( TTTR_REJECTED_T3(tttr, record->Data, record->TimeTag) ) {
+			return(PQ_RECORD_FILTERED);
+		}
+
+		t3->channel = record->Data;
+		t3->pulse = tttr->origin;
+		t3->time = record->TimeTag;
+		return(PQ_RECORD_T3);
+	} else {
+		/* Special record. */
+		if ( 0x800 & record->Data ) {
+			/* Overflow */
+			tttr->overflows++;
+			tttr->origin += tttr->overflow_increment;
+			return(PQ_RECORD_OVERFLOW);
+		} else {
+			t3->channel = 0x800;
+			t3->pulse = record->Data & 0x07;
+			return(PQ_RECORD_MARKER);
+		}
+	}
 }
 
 int th_v60_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
@@ -68,27 +97,22 @@ int th_v60_t3_decode(FILE *stream_in, tttr_t *tttr, t3_t *t3) {
 			return(PQ_ERROR_EOF);
 		}
 	} else {
-		if ( record.Valid ) {
-			/* Normal record. */
-			t3->channel = record.Data;
-			t3->pulse = tttr->origin;
-			t3->time = record.TimeTag;
-			return(PQ_RECORD_T3);
-		} else {
-			/* Special record. */
-			if ( 0x800 & record.Data ) {
-				/* Overflow */
-				tttr->overflows++;
-				tttr->origin += tttr->overflow_increment;
-				return(PQ_RECORD_OVERFLOW);
-			} else {
-				t3->channel = 0x800;
-				t3->pulse = record.Data & 0x07;
-				return(PQ_RECORD_MARKER);
-			}
-		}
+		return(th_v60_t3_record_decode(&record, tttr, t3));
 	}
 }
+
+int th_v60_t3_decode_block(uint32_t const *records, size_t n_records,
+		tttr_t *tttr, t3_t *t3, int *types) {
+	size_t i;
+	th_v60_tttr_record_t record;
+
+	for ( i = 0; i < n_records; i++ ) {
+		memcpy(&record, &records[i], sizeof(record));
+		types[i] = th_v60_t3_record_decode(&record, tttr, &t3[i]);
+	}
+
+	return(PQ_SUCCESS);
+}
 				
 int th_v60_t3_stream(FILE *stream_in, FILE *stream_out, 
 		th_v60_header_t *th_header, th_v60_tttr_header_t *tttr_header,
@@ -97,13 +121,8 @@ int th_v60_t3_stream(FILE *stream_in, FILE *stream_out,
 
 	th_v60_t3_init(th_header, tttr_header, &tttr);
 
-	if ( options->to_t2 ) {
-		error("T3 -> T2 not supported for Timeharp.\n");
-		return(PQ_ERROR_OPTIONS);
-	} else {
-		return(pq_t3_stream(stream_in, stream_out, 
-				th_v60_t3_decode, &tttr, options));
-	}
+	return(pq_t3_stream(stream_in, stream_out, 
+			th_v60_t3_decode_block, &tttr, options));
 }
 		
 int th_v60_tttr_stream(FILE *stream_in, FILE *stream_out, 
@@ -164,6 +183,7 @@ int th_v60_tttr_header_read(FILE *stream_in,
 		return(PQ_ERROR_IO);
 	}
 
+	(*tttr_header)->SpecHeader = NULL;
 	if ( (*tttr_header)->SpecHeaderLength > 0 ) {
 		(*tttr_header)->SpecHeader = (int32_t *)malloc(
 				sizeof(int32_t)*(*tttr_header)->SpecHeaderLength);
@@ -172,6 +192,14 @@ int th_v60_tttr_header_read(FILE *stream_in,
 			th_v60_tttr_header_free(tttr_header);
 			return(PQ_ERROR_MEM);
 		}
+
+		n_read = fread((*tttr_header)->SpecHeader, sizeof(int32_t),
+				(*tttr_header)->SpecHeaderLength, stream_in);
+		if ( n_read != (size_t)(*tttr_header)->SpecHeaderLength ) {
+			error("Could not read special header.\n");
+			th_v60_tttr_header_free(tttr_header);
+			return(PQ_ERROR_IO);
+		}
 	}
 
 	return(PQ_SUCCESS);
@@ -29,6 +29,24 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#include <stdlib.h>
+#include <math.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+
+#ifdef HAVE_MMAP
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
 #include "tttr.h"
 #include "error.h"
 
@@ -36,3 +54,383 @@ void tttr_marker_print(FILE *stream_out, uint64_t marker) {
 	warn("External marker: %"PRIu64"\n", marker);
 }
 
+void tttr_filter_init(tttr_t *tttr, uint64_t channel_mask,
+		uint64_t gate_start, uint64_t gate_stop) {
+	tttr->channel_mask = channel_mask;
+	tttr->gate_start = gate_start;
+	tttr->gate_stop = gate_stop;
+	tttr->filter = ( channel_mask != UINT64_MAX || 
+			gate_start != 0 || 
+			gate_stop != UINT64_MAX );
+}
+
+void tttr_timebase_init(tttr_timebase_t *timebase, unsigned int sync_rate,
+		float64_t sync_period) {
+/*
+ * Prefer the sync period (in seconds) where the file records it, since the
+ * sync rate is only given to the nearest Hz. Otherwise the period is exactly
+ * 1e12/sync_rate ps, and that fraction is used to correct the rounding.
+ */
+	uint64_t remainder, high, low;
+	int exponent;
+	float64_t mantissa;
+	int i;
+
+	timebase->period_int = 0;
+	timebase->period_frac = 0;
+	timebase->numerator = 0;
+	timebase->denominator = 0;
+
+	if ( sync_period > 0 ) {
+		/* 1e12*period = m*2^(e-53) ps, with m < 2^53 an integer. Form m*1e12
+		 * as 128 bits, then shift the binary point to 64.
+		 */
+		mantissa = frexp(sync_period, &exponent);
+		tttr_multiply((uint64_t)ldexp(mantissa, 53), 1000000000000, 
+				&high, &low);
+		exponent += 64 - 53;
+
+		if ( exponent == 0 ) {
+			timebase->period_int = high;
+			timebase->period_frac = low;
+			return;
+		} else if ( exponent < 0 ) {
+			/* Periods below 2^-64 ps are taken as 0. */
+			if ( exponent > -64 ) {
+				timebase->period_int = high >> -exponent;
+				timebase->period_frac = (low >> -exponent) | 
+						(high << (64 + exponent));
+			} else if ( exponent > -128 ) {
+				timebase->period_frac = high >> (-exponent - 64);
+			}
+			return;
+		} else if ( exponent < 64 && (high >> (64 - exponent)) == 0 ) {
+			timebase->period_int = (high << exponent) | 
+					(low >> (64 - exponent));
+			timebase->period_frac = low << exponent;
+			return;
+		} else {
+			warn("Sync period of %e s is too long, using the sync rate "
+					"instead.\n", sync_period);
+		}
+	}
+
+	if ( sync_rate == 0 ) {
+		return;
+	}
+
+	timebase->numerator = 1000000000000;
+	timebase->denominator = sync_rate;
+	timebase->period_int = timebase->numerator/timebase->denominator;
+
+	/* Long division of the remainder, one bit at a time. */
+	remainder = timebase->numerator % timebase->denominator;
+	for ( i = 0; i < 64; i++ ) {
+		remainder <<= 1;
+		timebase->period_frac <<= 1;
+		if ( remainder >= timebase->denominator ) {
+			remainder -= timebase->denominator;
+			timebase->period_frac |= 1;
+		}
+	}
+}
+
+
+int tttr_block_map(tttr_block_t *block) {
+/*
+ * Map the remainder of a regular input file into memory, starting at the
+ * current position of the stream (just past the header). Returns 
+ * PQ_SUCCESS if the map is available, otherwise the caller should fall 
+ * back to reading the stream.
+ */
+#ifdef HAVE_MMAP
+	struct stat file_stat;
+	off_t position;
+	int fd;
+
+	if ( block->stream_in == stdin ) {
+		return(PQ_ERROR_IO);
+	}
+
+	fd = fileno(block->stream_in);
+	position = ftello(block->stream_in);
+
+	if ( fd < 0 || position < 0 || 
+			fstat(fd, &file_stat) != 0 || 
+			! S_ISREG(file_stat.st_mode) ||
+			file_stat.st_size <= position ||
+			position % sizeof(uint32_t) != 0 ) {
+		return(PQ_ERROR_IO);
+	}
+
+	block->map_length = file_stat.st_size;
+	block->map = mmap(NULL, block->map_length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+	if ( block->map == MAP_FAILED ) {
+		debug("Could not map input, reading the stream instead.\n");
+		block->map = NULL;
+		block->map_length = 0;
+		return(PQ_ERROR_IO);
+	}
+
+#ifdef HAVE_MADVISE
+	madvise(block->map, block->map_length, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+	madvise(block->map, block->map_length, MADV_HUGEPAGE);
+#endif
+#endif
+
+	debug("Mapped %zu bytes of input.\n", block->map_length);
+	block->map_offset = position;
+	block->map_position = position;
+	return(PQ_SUCCESS);
+#else
+	return(PQ_ERROR_IO);
+#endif
+}
+
+static volatile sig_atomic_t tttr_follow_stopped = 0;
+static struct sigaction tttr_follow_sigint;
+static struct sigaction tttr_follow_sigterm;
+
+static void tttr_follow_stop(int signum) {
+	(void)signum;
+	tttr_follow_stopped = 1;
+}
+
+static int tttr_block_setup(tttr_block_t *block, FILE *stream_in, 
+		size_t capacity, int map) {
+	block->stream_in = stream_in;
+	block->records = NULL;
+	block->length = 0;
+	block->capacity = capacity;
+	block->buffer = NULL;
+	block->map = NULL;
+	block->map_length = 0;
+	block->map_offset = 0;
+	block->map_position = 0;
+	block->follow = 0;
+	block->follow_watch = -1;
+	block->follow_closed = 0;
+	block->follow_pending = 0;
+	block->follow_flush = NULL;
+
+	if ( map && tttr_block_map(block) == PQ_SUCCESS ) {
+		return(PQ_SUCCESS);
+	}
+
+	block->buffer = (uint32_t *)malloc(capacity*sizeof(uint32_t));
+
+	if ( block->buffer == NULL ) {
+		error("Could not allocate tttr record block.\n");
+		return(PQ_ERROR_MEM);
+	}
+
+	block->records = block->buffer;
+	return(PQ_SUCCESS);
+}
+
+int tttr_block_init(tttr_block_t *block, FILE *stream_in, size_t capacity) {
+/*
+ * Prepare to read blocks of up to capacity records from the stream.
+ */
+	return(tttr_block_setup(block, stream_in, capacity, 1));
+}
+
+int tttr_block_follow(tttr_block_t *block, FILE *stream_in, size_t capacity,
+		char const *filename, FILE *stream_flush) {
+/*
+ * As tttr_block_init, but keep reading the stream as it grows. The file is 
+ * not mapped, since the map would not grow with it.
+ */
+	struct sigaction action;
+	int result;
+
+	result = tttr_block_setup(block, stream_in, capacity, 0);
+	if ( pq_check(result) ) {
+		return(result);
+	}
+
+	block->follow = 1;
+	block->follow_flush = stream_flush;
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if ( filename != NULL ) {
+		block->follow_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if ( block->follow_watch >= 0 && 
+				inotify_add_watch(block->follow_watch, filename, 
+					IN_MODIFY | IN_CLOSE_WRITE) < 0 ) {
+			close(block->follow_watch);
+			block->follow_watch = -1;
+		}
+	}
+#endif
+
+	if ( block->follow_watch < 0 ) {
+		debug("Polling the input for new records.\n");
+	}
+
+	/* An interrupt ends the stream normally, so that anything which is only
+	 * written at the end (such as a histogram) still is.
+	 */
+	tttr_follow_stopped = 0;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = tttr_follow_stop;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, &tttr_follow_sigint);
+	sigaction(SIGTERM, &action, &tttr_follow_sigterm);
+
+	return(PQ_SUCCESS);
+}
+
+static int tttr_block_wait(tttr_block_t *block) {
+/*
+ * Wait for the file to grow. Returns PQ_ERROR_EOF once the writer is done 
+ * with it, or when interrupted.
+ */
+	struct timespec interval = {0, TTTR_FOLLOW_INTERVAL*1000000L};
+#ifdef HAVE_SYS_INOTIFY_H
+	char events[4096] 
+			__attribute__ ((aligned(__alignof__(struct inotify_event))));
+	struct inotify_event const *event;
+	struct pollfd watch;
+	ssize_t n_read;
+	ssize_t i;
+#endif
+
+	if ( block->follow_closed || tttr_follow_stopped ) {
+		return(PQ_ERROR_EOF);
+	}
+
+	if ( block->follow_flush != NULL ) {
+		fflush(block->follow_flush);
+	}
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if ( block->follow_watch >= 0 ) {
+		watch.fd = block->follow_watch;
+		watch.events = POLLIN;
+
+		if ( poll(&watch, 1, TTTR_FOLLOW_TIMEOUT) > 0 ) {
+			while ( (n_read = read(block->follow_watch, events, 
+						sizeof(events))) > 0 ) {
+				i = 0;
+				while ( i < n_read ) {
+					event = (struct inotify_event const *)&events[i];
+					if ( event->mask & IN_CLOSE_WRITE ) {
+						/* Read whatever was written before the close. */
+						debug("Input was closed by the writer.\n");
+						block->follow_closed = 1;
+					}
+					i += sizeof(struct inotify_event) + event->len;
+				}
+			}
+		}
+
+		return( tttr_follow_stopped ? PQ_ERROR_EOF : PQ_SUCCESS );
+	}
+#endif
+
+	nanosleep(&interval, NULL);
+	return( tttr_follow_stopped ? PQ_ERROR_EOF : PQ_SUCCESS );
+}
+
+static int tttr_block_read_follow(tttr_block_t *block) {
+/*
+ * Read whatever records have been written since the last block. A record 
+ * may be only partly written, so the bytes past the last whole record are 
+ * kept for the next read.
+ */
+	char *bytes = (char *)block->buffer;
+	size_t size = block->capacity*sizeof(uint32_t);
+	size_t n_read;
+	int result;
+
+	memmove(bytes, bytes + block->length*sizeof(uint32_t), 
+			block->follow_pending);
+	block->length = 0;
+
+	while ( block->follow_pending < sizeof(uint32_t) ) {
+		clearerr(block->stream_in);
+		n_read = fread(bytes + block->follow_pending, 1, 
+				size - block->follow_pending, block->stream_in);
+		block->follow_pending += n_read;
+
+		if ( ferror(block->stream_in) ) {
+			error("Could not read tttr records.\n");
+			return(PQ_ERROR_IO);
+		} else if ( n_read == 0 ) {
+			result = tttr_block_wait(block);
+			if ( pq_check(result) ) {
+				return(result);
+			}
+		}
+	}
+
+	block->length = block->follow_pending / sizeof(uint32_t);
+	block->follow_pending -= block->length*sizeof(uint32_t);
+	return(PQ_SUCCESS);
+}
+
+int tttr_block_read(tttr_block_t *block) {
+/*
+ * Read the next block of raw records from the stream. Any trailing partial
+ * record is ignored, as it would have been when reading one at a time.
+ */
+	size_t remaining;
+
+	if ( block->follow ) {
+		return(tttr_block_read_follow(block));
+	} else if ( block->map != NULL ) {
+		remaining = (block->map_length - block->map_position) / 
+				sizeof(uint32_t);
+		block->length = remaining < block->capacity ? 
+				remaining : block->capacity;
+		block->records = (uint32_t const *)
+				((char *)block->map + block->map_position);
+		block->map_position += block->length*sizeof(uint32_t);
+
+		return( block->length > 0 ? PQ_SUCCESS : PQ_ERROR_EOF );
+	}
+
+	block->length = fread(block->buffer, sizeof(uint32_t), 
+			block->capacity, block->stream_in);
+
+	if ( block->length == 0 ) {
+		if ( ! feof(block->stream_in) ) {
+			error("Could not read tttr records.\n");
+			return(PQ_ERROR_IO);
+		} else {
+			return(PQ_ERROR_EOF);
+		}
+	} else {
+		return(PQ_SUCCESS);
+	}
+}
+
+void tttr_block_free(tttr_block_t *block) {
+	if ( block->follow ) {
+		sigaction(SIGINT, &tttr_follow_sigint, NULL);
+		sigaction(SIGTERM, &tttr_follow_sigterm, NULL);
+#ifdef HAVE_SYS_INOTIFY_H
+		if ( block->follow_watch >= 0 ) {
+			close(block->follow_watch);
+		}
+#endif
+		block->follow = 0;
+	}
+
+#ifdef HAVE_MMAP
+	if ( block->map != NULL ) {
+		/* Leave the stream where the records left off. */
+		fseeko(block->stream_in, block->map_position, SEEK_SET);
+		munmap(block->map, block->map_length);
+	}
+#endif
+
+	free(block->buffer);
+	block->buffer = NULL;
+	block->records = NULL;
+	block->map = NULL;
+	block->length = 0;
+}
@@ -32,23 +32,162 @@
 #ifndef TTTR_H_
 #define TTTR_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
 
 #include "types.h"
 
+#pragma pack(push, 2)
+
+/*
+ * The sync period, in ps, as a 64.64 fixed-point number. When the period is
+ * only known as 1e12/sync_rate, that fraction is also kept, so the whole
+ * picoseconds of any pulse can be corrected to be exact.
+ */
+typedef struct {
+	uint64_t period_int;
+	uint64_t period_frac;
+	uint64_t numerator;
+	uint64_t denominator;
+} tttr_timebase_t;
+
 typedef struct {
 	unsigned int sync_channel;
+	/* The number of channels photons are reported on, from the header, or 0
+	 * when the header does not say.
+	 */
+	unsigned int channels;
 	int64_t origin;
 	unsigned int overflows;
 	unsigned int overflow_increment;
 	unsigned int sync_rate;
+	float64_t sync_period;
 	float64_t resolution_float;
 	unsigned int resolution_int;
+	/* The ps in one unit of the t3 time: 1 where the decoder gives ps, or
+	 * resolution_int where it gives the bin of the arrival.
+	 */
+	unsigned int time_scale;
+	int filter;
+	uint64_t channel_mask;
+	uint64_t gate_start;
+	uint64_t gate_stop;
+	tttr_timebase_t timebase;
 } tttr_t;
 
+/* Photons can be rejected by channel or, for t3, by their time relative to
+ * the sync, before they are decoded any further. The channel is the one
+ * which would be reported, and the time is in the units reported for t3
+ * records. Channels past the end of the mask are always kept.
+ */
+#define TTTR_CHANNEL_REJECTED(tttr, channel) \
+	( (channel) < 64 && ! (((tttr)->channel_mask >> (channel)) & 1) )
+#define TTTR_REJECTED_T2(tttr, channel) \
+	( (tttr)->filter && TTTR_CHANNEL_REJECTED(tttr, channel) )
+#define TTTR_REJECTED_T3(tttr, channel, time) \
+	( (tttr)->filter && \
+		( TTTR_CHANNEL_REJECTED(tttr, channel) || \
+		  (time) < (tttr)->gate_start || \
+		  (time) >= (tttr)->gate_stop ) )
+
+/* All of the supported tttr formats use 32-bit records, so the streaming
+ * routines read them in large blocks and hand the whole block to the 
+ * format-specific decoder at once. When the input is a regular file, the
+ * records are mapped into memory and the block points directly into the map.
+ */
+#define TTTR_BLOCK_RECORDS 8192
+
+/* When decoding in parallel, each thread takes a chunk of this many records.
+ */
+#define TTTR_CHUNK_RECORDS 65536
+
+/* When following a file which is still being written, the end of the file 
+ * only means waiting for more records. The output is flushed, then the wait
+ * is woken by inotify where it is available, checking again at least every
+ * TTTR_FOLLOW_TIMEOUT ms in case a change was missed. Otherwise, the file is
+ * polled every TTTR_FOLLOW_INTERVAL ms. Following ends once the writer closes
+ * the file, or on SIGINT or SIGTERM.
+ */
+#define TTTR_FOLLOW_TIMEOUT 1000
+#define TTTR_FOLLOW_INTERVAL 100
+
+typedef struct {
+	FILE *stream_in;
+	uint32_t const *records;
+	size_t length;
+	size_t capacity;
+
+	uint32_t *buffer;
+
+	void *map;
+	size_t map_length;
+	size_t map_offset;
+	size_t map_position;
+
+	int follow;
+	int follow_watch;
+	int follow_closed;
+	size_t follow_pending;
+	FILE *follow_flush;
+} tttr_block_t;
+
 void tttr_marker_print(FILE *stream_out, uint64_t marker);
+void tttr_filter_init(tttr_t *tttr, uint64_t channel_mask, 
+		uint64_t gate_start, uint64_t gate_stop);
+void tttr_timebase_init(tttr_timebase_t *timebase, unsigned int sync_rate,
+		float64_t sync_period);
+
+static inline void tttr_multiply(uint64_t a, uint64_t b, 
+		uint64_t *high, uint64_t *low) {
+/*
+ * The full 128-bit product of a and b.
+ */
+#ifdef __SIZEOF_INT128__
+	unsigned __int128 product = (unsigned __int128)a*b;
+	*high = (uint64_t)(product >> 64);
+	*low = (uint64_t)product;
+#else
+	uint64_t a_low = a & 0xffffffff, a_high = a >> 32;
+	uint64_t b_low = b & 0xffffffff, b_high = b >> 32;
+	uint64_t low_low = a_low*b_low;
+	uint64_t high_low = a_high*b_low;
+	uint64_t low_high = a_low*b_high;
+	uint64_t middle = (low_low >> 32) + (high_low & 0xffffffff) + 
+			(low_high & 0xffffffff);
+
+	*high = a_high*b_high + (high_low >> 32) + (low_high >> 32) + 
+			(middle >> 32);
+	*low = (middle << 32) | (low_low & 0xffffffff);
+#endif
+}
+
+static inline uint64_t tttr_timebase_time(tttr_timebase_t const *timebase,
+		uint64_t pulse) {
+/*
+ * The time of the sync pulse, in whole ps, rounded down.
+ */
+	uint64_t time, high, low, exact_high, exact_low;
+
+	tttr_multiply(pulse, timebase->period_frac, &high, &low);
+	time = pulse*timebase->period_int + high;
+
+	/* The fraction was rounded down, so we may be one short. */
+	if ( timebase->denominator != 0 ) {
+		tttr_multiply(pulse, timebase->numerator, &exact_high, &exact_low);
+		tttr_multiply(time + 1, timebase->denominator, &high, &low);
+		if ( high < exact_high || (high == exact_high && low <= exact_low) ) {
+			time++;
+		}
+	}
+
+	return(time);
+}
+
+int tttr_block_map(tttr_block_t *block);
+int tttr_block_init(tttr_block_t *block, FILE *stream_in, size_t capacity);
+int tttr_block_follow(tttr_block_t *block, FILE *stream_in, size_t capacity,
+		char const *filename, FILE *stream_flush);
+int tttr_block_read(tttr_block_t *block);
+void tttr_block_free(tttr_block_t *block);
 
 #pragma pack(pop)
 
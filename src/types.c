@@ -31,13 +31,13 @@
 
 #include "types.h"
 
-char* ctime32(time32_t *mytime) {
+char* ctime32(time32_t *mytime, char *buffer) {
 #ifdef __i386__
-	return(ctime(mytime));
+	return(ctime_r(mytime, buffer));
 #else
 	time_t mytime64;
 	mytime64 = (int64_t)*mytime;
-	return(ctime(&mytime64));
+	return(ctime_r(&mytime64, buffer));
 #endif
 }
 
@@ -44,7 +44,12 @@ typedef time_t time32_t;
 typedef int32_t time32_t;
 #endif 
 
-char* ctime32(time32_t *mytime);
+/* ctime32 writes into buffer, which holds at least PQ_CTIME_LENGTH bytes,
+ * so that headers can be printed from several threads at once.
+ */
+#define PQ_CTIME_LENGTH 26
+
+char* ctime32(time32_t *mytime, char *buffer);
 
 typedef float float32_t;
 typedef double float64_t;
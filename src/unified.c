@@ -36,6 +36,8 @@ POSSIBILITY OF SUCH DAMAGE.
 #include <math.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "hydraharp.h"
 #include "hydraharp/hh_v10.h"
@@ -48,11 +50,11 @@ POSSIBILITY OF SUCH DAMAGE.
 #include "timeharp/th_v50.h"
 #include "timeharp/th_v60.h"
 
-#define TAG_PRINT(x) if ( options->print_header ) { x; }
 #define NOT_IMPLEMENTED error("Mode 0x%08lx not implemented\n", pu_options.record_type); break;
 
 int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, options_t *options) {
 	int result;
+	pu_tags_t tags;
 	pu_options_t pu_options;
 
 	hh_v10_header_t hh_v10_header;
@@ -61,25 +63,41 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 	hh_v20_tttr_header_t hh_v20_tttr;
 
 	ph_v20_header_t ph_v20_header;
+	ph_v20_board_t ph_v20_board;
 	ph_v20_tttr_header_t ph_v20_tttr;
 
-	result = pu_tags_read(stream_in, stream_out, pu_header, options, &pu_options);
+	pu_tags_init(&tags);
+	result = pu_tags_read(stream_in, &tags);
 
 	if ( result == PQ_SUCCESS ) {
+		pu_options_init(&pu_options, &tags);
+
 		if ( options->print_header ) {
-			; // this was handled implicitly in pu_tags_read
-			// TODO: implement a dictionary type to read in the tags, then print separately.
-		} else if ( options->print_resolution ) { 
-			error("Unified resolution print not yet implemented.\n");
-			result = PQ_ERROR_OPTIONS;
+			pu_tags_printf(stream_out, &tags);
+		} else if ( options->print_mode ) {
+			if ( PU_RECORD_MODE(pu_options.record_type) == PU_RECORD_MODE_T2 ) {
+				fprintf(stream_out, "t2\n");
+			} else if ( PU_RECORD_MODE(pu_options.record_type) == 
+					PU_RECORD_MODE_T3 ) {
+				fprintf(stream_out, "t3\n");
+			} else {
+				error("Unknown record type:  0x%08lx\n", 
+						pu_options.record_type);
+				result = PQ_ERROR_MODE;
+			}
 		} else {
-			// actually stream data
+			// actually stream data, or print the resolution from the decoder
 			debug("Record type: 0x%08lx\n", pu_options.record_type);
 			debug("Resolution (ps): %lld\n", (uint64_t)(1e12*pu_options.resolution_seconds));
 
 			switch ( pu_options.record_type ) {
 				case PU_RECORD_PH_T3:
 				case PU_RECORD_PH_T2:
+					ph_v20_board.Resolution = pu_options.resolution_seconds*1e9;
+					ph_v20_header.Brd = &ph_v20_board;
+					/* As for the classic files, the router always has four channels. */
+					ph_v20_header.RoutingChannels = 4;
+
 					ph_v20_tttr.InpRate0 = pu_options.sync_rate;
 					ph_v20_tttr.StopAfter = pu_options.stop_after;
 					ph_v20_tttr.StopReason = 0;
@@ -87,9 +105,9 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 					ph_v20_tttr.NumRecords = pu_options.number_of_records;
 
 					if ( pu_options.record_type == PU_RECORD_PH_T3 ) {
-						ph_v20_t3_stream(stream_in, stream_out, &ph_v20_header, &ph_v20_tttr, options);
+						result = ph_v20_t3_stream(stream_in, stream_out, &ph_v20_header, &ph_v20_tttr, pu_options.global_resolution, options);
 					} else {
-						ph_v20_t2_stream(stream_in, stream_out, &ph_v20_header, &ph_v20_tttr, options);
+						result = ph_v20_t2_stream(stream_in, stream_out, &ph_v20_header, &ph_v20_tttr, options);
 					}
 						
 					break;
@@ -105,9 +123,9 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 					hh_v10_tttr.NumRecords = pu_options.number_of_records;
 
 					if ( pu_options.record_type == PU_RECORD_HH_V1_T3 ) {
-						hh_v10_t3_stream(stream_in, stream_out, &hh_v10_header, &hh_v10_tttr, options);
+						result = hh_v10_t3_stream(stream_in, stream_out, &hh_v10_header, &hh_v10_tttr, pu_options.global_resolution, options);
 					} else {
-						hh_v10_t2_stream(stream_in, stream_out, &hh_v10_header, &hh_v10_tttr, options);
+						result = hh_v10_t2_stream(stream_in, stream_out, &hh_v10_header, &hh_v10_tttr, options);
 					}
 					break;
 				case PU_RECORD_HH_V2_T3:
@@ -122,9 +140,9 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 					hh_v20_tttr.NumRecords = pu_options.number_of_records;
 
 					if ( pu_options.record_type == PU_RECORD_HH_V2_T3 ) {
-						hh_v20_t3_stream(stream_in, stream_out, &hh_v20_header, &hh_v20_tttr, options);
+						result = hh_v20_t3_stream(stream_in, stream_out, &hh_v20_header, &hh_v20_tttr, pu_options.global_resolution, options);
 					} else {
-						hh_v20_t2_stream(stream_in, stream_out, &hh_v20_header, &hh_v20_tttr, options);
+						result = hh_v20_t2_stream(stream_in, stream_out, &hh_v20_header, &hh_v20_tttr, options);
 					}
 						
 					break;
@@ -133,6 +151,7 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 				case PU_RECORD_TH_260_PT3:
 				case PU_RECORD_TH_260_PT2:
 					error("This mode is not implemented due to a lack of test data. Please open a pull request at https://github.com/tsbischof/picoquant-sample-data and we will get to work on the decoder.\n");
+					result = PQ_ERROR_MODE;
 					NOT_IMPLEMENTED;
 				default:
 					error("Unknown record type:  0x%08lx\n", pu_options.record_type);
@@ -141,135 +160,200 @@ int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, optio
 		}
 	} 
 
+	pu_tags_free(&tags);
 	return(result);
 }
 
-int pu_tags_read(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, options_t *options, pu_options_t *pu_options) {
-	int result;
-	size_t index;
+void pu_options_init(pu_options_t *pu_options, pu_tags_t *tags) {
+/*
+ * Pick out the tags needed to decode the records. 
+ */
+	pu_options->record_type = pu_tags_int(tags, 
+			"TTResultFormat_TTTRRecType", 0);
+	pu_options->input_channels_present = pu_tags_int(tags, 
+			"HW_InpChannels", 0);
+	pu_options->sync_rate = pu_tags_int(tags, "TTResult_SyncRate", 0);
+	pu_options->stop_after = pu_tags_int(tags, "TTResult_StopAfter", 0);
+	pu_options->number_of_records = pu_tags_int(tags, 
+			"TTResult_NumberOfRecords", 0);
+	pu_options->resolution_seconds = pu_tags_float(tags, 
+			"MeasDesc_Resolution", 0);
+	/* In t3 mode the global resolution is the sync period, more precise 
+	 * than the sync rate for converting t3 to t2. It reaches the decoder as
+	 * the sync_period of the tttr state.
+	 */
+	pu_options->global_resolution = pu_tags_float(tags, 
+			"MeasDesc_GlobalResolution", 0);
+}
+
+static size_t pu_tags_hash(char const *ident, int32_t index) {
+/*
+ * FNV-1a, over the name and then the index.
+ */
+	uint64_t hash = 14695981039346656037ULL;
+	size_t i;
+
+	for ( i = 0; i < sizeof(((pu_tag_t *)0)->ident) && ident[i] != '\0'; i++ ) {
+		hash = (hash ^ (unsigned char)ident[i]) * 1099511628211ULL;
+	}
+
+	for ( i = 0; i < sizeof(index); i++ ) {
+		hash = (hash ^ (((uint32_t)index >> (8*i)) & 0xff)) * 1099511628211ULL;
+	}
+
+	return(hash);
+}
+
+static size_t *pu_tags_slot(pu_tags_t *tags, char const *ident, 
+		int32_t index) {
+/*
+ * The slot of the table which holds this tag, or the empty slot where it 
+ * belongs. Slots hold the position in entries plus 1, so 0 is empty.
+ */
+	pu_tag_t *tag;
+	size_t slot = pu_tags_hash(ident, index) & (tags->table_size - 1);
+
+	while ( tags->table[slot] != 0 ) {
+		tag = &tags->entries[tags->table[slot] - 1].tag;
+		if ( tag->index == index && 
+				! strncmp(tag->ident, ident, sizeof(tag->ident)) ) {
+			break;
+		}
+		slot = (slot + 1) & (tags->table_size - 1);
+	}
+
+	return(&tags->table[slot]);
+}
+
+static int pu_tags_add(pu_tags_t *tags, pu_tag_t *tag, off_t offset, 
+		char *data) {
+/*
+ * Add the tag at the end, growing the entries and table as needed. A
+ * repeated tag replaces the earlier one in lookups, but both are printed.
+ */
+	pu_entry_t *entries;
+	size_t *table;
+	size_t i;
+
+	if ( tags->length == tags->capacity ) {
+		entries = (pu_entry_t *)realloc(tags->entries, 
+				2*tags->capacity*sizeof(pu_entry_t));
+		if ( entries == NULL ) {
+			error("Could not allocate tags.\n");
+			return(PQ_ERROR_MEM);
+		}
+		tags->entries = entries;
+		tags->capacity *= 2;
+	}
+
+	tags->entries[tags->length].tag = *tag;
+	tags->entries[tags->length].offset = offset;
+	tags->entries[tags->length].data = data;
+	tags->length++;
+
+	/* Keep the table at most half full, so the probes stay short. */
+	if ( 2*tags->length > tags->table_size ) {
+		table = (size_t *)calloc(2*tags->table_size, sizeof(size_t));
+		if ( table == NULL ) {
+			tags->length--;
+			error("Could not allocate tag table.\n");
+			return(PQ_ERROR_MEM);
+		}
+		free(tags->table);
+		tags->table = table;
+		tags->table_size *= 2;
+
+		for ( i = 0; i + 1 < tags->length; i++ ) {
+			*pu_tags_slot(tags, tags->entries[i].tag.ident, 
+					tags->entries[i].tag.index) = i + 1;
+		}
+	}
+
+	*pu_tags_slot(tags, tag->ident, tag->index) = tags->length;
+	return(PQ_SUCCESS);
+}
+
+void pu_tags_init(pu_tags_t *tags) {
+	tags->stream_in = NULL;
+	tags->entries = NULL;
+	tags->length = 0;
+	tags->capacity = 0;
+	tags->table = NULL;
+	tags->table_size = 0;
+}
+
+static int pu_tag_length_check(FILE *stream_in, pu_tag_t *tag, 
+		off_t offset) {
+/*
+ * The length of a payload comes from the file, so check that it is not 
+ * negative, and for a regular file that it does not run past the end, 
+ * before seeking over it or allocating for it.
+ */
+	struct stat file_stat;
+
+	if ( tag->value < 0 ) {
+		error("Negative length for %.*s: %" PRId64 ".\n", 
+				(int)sizeof(tag->ident), tag->ident, tag->value);
+		return(PQ_ERROR_UNKNOWN_DATA);
+	}
+
+	if ( offset >= 0 && fstat(fileno(stream_in), &file_stat) == 0 && 
+			S_ISREG(file_stat.st_mode) && 
+			tag->value > file_stat.st_size - offset ) {
+		error("Length of %.*s runs past the end of the file: %" PRId64 
+				".\n", (int)sizeof(tag->ident), tag->ident, tag->value);
+		return(PQ_ERROR_UNKNOWN_DATA);
+	}
+
+	return(PQ_SUCCESS);
+}
+
+int pu_tags_read(FILE *stream_in, pu_tags_t *tags) {
+/*
+ * Read all tags up to Header_End, leaving the stream at the first record.
+ * Strings, arrays, and blobs (which can be preview images of several MB) 
+ * are skipped over, unless the stream can not seek back to them.
+ */
+	int result = PQ_SUCCESS;
 	pu_tag_t tag;
-	float64_t value_float;
-	char *buffer_char;
-	wchar_t *buffer_wchar;
-	float64_t *buffer_float64;
+	char *data;
+	size_t length;
+	off_t offset;
+
+	tags->stream_in = stream_in;
+	tags->capacity = 256;
+	tags->entries = (pu_entry_t *)malloc(tags->capacity*sizeof(pu_entry_t));
+	tags->table_size = 2*tags->capacity;
+	tags->table = (size_t *)calloc(tags->table_size, sizeof(size_t));
+
+	if ( tags->entries == NULL || tags->table == NULL ) {
+		error("Could not allocate tags.\n");
+		return(PQ_ERROR_MEM);
+	}
 
 	do {
-		result = fread(&tag, sizeof(tag), 1, stream_in);
-		if ( result != 1 ) {
+		if ( fread(&tag, sizeof(tag), 1, stream_in) != 1 ) {
+			error("Could not read tag.\n");
 			result = PQ_ERROR_IO;
 			break;
-		} else {
-			result = PQ_SUCCESS;
 		}
 
-		if ( tag.index > 0 ) {
-			TAG_PRINT(fprintf(stream_out, "%s[%d] = ", tag.ident, tag.index))
-		} else {
-			TAG_PRINT(fprintf(stream_out, "%s = ", tag.ident))
-		}
-		
 		switch ( tag.type ) {
 			case PU_TAG_Empty8:
-				TAG_PRINT(fprintf(stream_out, "null"))
-				break;
 			case PU_TAG_Bool8:
-				TAG_PRINT(fprintf(stream_out, "%s", tag.value ? "true" : "false"))
-				break;
 			case PU_TAG_Int8:
-				if ( ! strcmp(tag.ident, "TTResultFormat_TTTRRecType") ) {
-					pu_options->record_type = tag.value;
-				} else if ( ! strcmp(tag.ident, "HW_InpChannels") ) {
-					pu_options->input_channels_present = tag.value;
-				} else if ( ! strcmp(tag.ident, "TTResult_SyncRate") ) {
-					pu_options->sync_rate = tag.value;
-				} else if ( ! strcmp(tag.ident, "TTResult_StopAfter") ) {
-					pu_options->stop_after = tag.value;
-				} else if ( ! strcmp(tag.ident, "TTResult_NumberOfRecords") ) {
-					pu_options->number_of_records = tag.value;
-				}
-
-				TAG_PRINT(fprintf(stream_out, "%" PRId64, (int64_t)tag.value))
-				break;
 			case PU_TAG_BitSet64:
-			case PU_TAG_Color8:  // just print both BitSet64 and Color8 for now
-				TAG_PRINT(fprintf(stream_out, "0x%" PRIu64 "x", (uint64_t)tag.value))
-				break;
+			case PU_TAG_Color8:
 			case PU_TAG_Float8:
-				memcpy((char *)&value_float, (char *)(&tag.value), sizeof(float64_t));
-
-				if ( ! strcmp(tag.ident, "MeasDesc_Resolution") ) { 
-					pu_options->resolution_seconds = value_float;
-				}
-
-				TAG_PRINT(fprintf(stream_out, "%E", value_float))
-				break;
 			case PU_TAG_TDateTime:
-				TAG_PRINT(fprintf(stream_out, "0x%016" PRIx64, tag.value))
+				length = 0;
 				break;
 			case PU_TAG_Float8Array:
-				buffer_float64 = (float64_t *)malloc(tag.value*sizeof(float64_t));
-				result = fread(buffer_float64, sizeof(float64_t), tag.value, stream_in);
-				if ( result != tag.value ) {
-					error("Could not read float array\n.");
-					result = PQ_ERROR_IO;
-				} else { 
-					result = PQ_SUCCESS;
-					for ( index = 0; index < tag.value; index++ ) {
-						memcpy((char *)&value_float, (char *)(&tag.value), sizeof(float64_t));
-						TAG_PRINT(
-							fprintf(stream_out, "%lf", value_float);
-							if ( index + 1 != tag.value ) {
-								fprintf(stream_out, ", ");
-							} 
-						)
-					}
-				}
-
-				free(buffer_float64);
-				break;
 			case PU_TAG_AnsiString:
-				buffer_char = (char *)malloc(tag.value*sizeof(char));
-				result = fread(buffer_char, sizeof(char), tag.value, stream_in);
-				if ( result != tag.value ) {
-					error("Could not read ANSI string.\n");
-					result = PQ_ERROR_IO;
-				} else { 
-					result = PQ_SUCCESS;
-					TAG_PRINT(fprintf(stream_out, "%.*s", (int32_t)tag.value, buffer_char))
-				}
-
-				free(buffer_char);
-				break;
 			case PU_TAG_WideString:
-				buffer_wchar = (wchar_t *)malloc(tag.value*sizeof(wchar_t));
-				result = fread(buffer_wchar, sizeof(wchar_t), tag.value, stream_in);
-				if ( result != tag.value ) {
-					error("Could not read ANSI string.\n");
-					result = PQ_ERROR_IO;
-				} else { 
-					result = PQ_SUCCESS;
-					TAG_PRINT(fprintf(stream_out, "%.*ls", (int32_t)tag.value, buffer_wchar))
-				}
-
-				free(buffer_wchar);
-				break;
 			case PU_TAG_BinaryBlob:
-				buffer_char = malloc(tag.value*sizeof(char));
-				result = fread(buffer_char, sizeof(char), tag.value, stream_in);
-				
-				if ( result != tag.value ) { 
-					error("Could not read binary blob.\n");
-					result = PQ_ERROR_IO;
-				} else {
-					result = PQ_SUCCESS;
-					TAG_PRINT(
-						for ( index = 0; index < tag.value; index++ ) {
-							fprintf(stream_out, "%02x", buffer_char[index] & 0xff);
-						}
-					)
-				}
-
-				free(buffer_char);
+				/* The value is the length of the data, in bytes. */
+				length = tag.value;
 				break;
 			default:
 				error("Unknown tag type: 0x%016x.\n", tag.type);
@@ -277,8 +361,307 @@ int pu_tags_read(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, opti
 				break;
 		}
 
-		TAG_PRINT(fprintf(stream_out, "\n"))
-	} while ( ! result && strcmp(tag.ident, "Header_End") );
+		if ( result != PQ_SUCCESS ) {
+			break;
+		}
+
+		data = NULL;
+		offset = -1;
+		if ( length > 0 ) {
+			offset = ftello(stream_in);
+			result = pu_tag_length_check(stream_in, &tag, offset);
+			if ( result != PQ_SUCCESS ) {
+				break;
+			} else if ( offset >= 0 && 
+					fseeko(stream_in, length, SEEK_CUR) == 0 ) {
+				;
+			} else if ( (data = (char *)malloc(length)) == NULL ) {
+				error("Could not allocate data for %s.\n", tag.ident);
+				result = PQ_ERROR_MEM;
+			} else if ( fread(data, sizeof(char), length, stream_in) != 
+					length ) {
+				error("Could not read data for %s.\n", tag.ident);
+				result = PQ_ERROR_IO;
+			}
+		}
+
+		if ( result == PQ_SUCCESS ) {
+			result = pu_tags_add(tags, &tag, offset, data);
+		}
+
+		if ( result != PQ_SUCCESS ) {
+			free(data);
+		}
+	} while ( result == PQ_SUCCESS && 
+			strncmp(tag.ident, "Header_End", sizeof(tag.ident)) );
 
 	return(result);
 }
+
+pu_entry_t *pu_tags_find(pu_tags_t *tags, char const *ident, int32_t index) {
+	size_t slot;
+
+	if ( tags->table_size == 0 ) {
+		return(NULL);
+	}
+
+	slot = *pu_tags_slot(tags, ident, index);
+	if ( slot == 0 ) {
+		return(NULL);
+	} else {
+		return(&tags->entries[slot - 1]);
+	}
+}
+
+static pu_entry_t *pu_tags_find_scalar(pu_tags_t *tags, char const *ident) {
+/*
+ * Single values have an index of -1, but accept the first of an array too.
+ */
+	pu_entry_t *entry = pu_tags_find(tags, ident, -1);
+
+	if ( entry == NULL ) {
+		entry = pu_tags_find(tags, ident, 0);
+	}
+
+	return(entry);
+}
+
+int64_t pu_tags_int(pu_tags_t *tags, char const *ident, int64_t missing) {
+	pu_entry_t *entry = pu_tags_find_scalar(tags, ident);
+
+	if ( entry == NULL ) {
+		return(missing);
+	} else {
+		return(entry->tag.value);
+	}
+}
+
+float64_t pu_tags_float(pu_tags_t *tags, char const *ident, 
+		float64_t missing) {
+	pu_entry_t *entry = pu_tags_find_scalar(tags, ident);
+	float64_t value;
+
+	if ( entry == NULL || entry->tag.type != PU_TAG_Float8 ) {
+		return(missing);
+	} else {
+		memcpy(&value, &entry->tag.value, sizeof(value));
+		return(value);
+	}
+}
+
+char const *pu_tags_data(pu_tags_t *tags, pu_entry_t *entry) {
+/*
+ * The payload of a string, array, or blob, read from the file on first use. 
+ * The stream is returned to where it was.
+ */
+	off_t position;
+	size_t length = entry->tag.value;
+
+	if ( entry->data != NULL || entry->offset < 0 || length == 0 ) {
+		return(entry->data);
+	}
+
+	if ( pu_tag_length_check(tags->stream_in, &entry->tag, 
+			entry->offset) != PQ_SUCCESS ) {
+		return(NULL);
+	}
+
+	entry->data = (char *)malloc(length);
+	position = ftello(tags->stream_in);
+
+	if ( entry->data == NULL ) {
+		error("Could not allocate data for %s.\n", entry->tag.ident);
+	} else if ( position < 0 || 
+			fseeko(tags->stream_in, entry->offset, SEEK_SET) != 0 ||
+			fread(entry->data, sizeof(char), length, tags->stream_in) != 
+				length ) {
+		error("Could not read data for %s.\n", entry->tag.ident);
+		free(entry->data);
+		entry->data = NULL;
+	}
+
+	if ( position >= 0 ) {
+		fseeko(tags->stream_in, position, SEEK_SET);
+	}
+
+	return(entry->data);
+}
+
+static size_t pu_widestring_utf8(char *utf8, char const *data, 
+		size_t length) {
+/*
+ * Wide strings are UTF-16 (little-endian), which we convert to UTF-8. The 
+ * result takes at most 3*length/2 bytes, and its length is returned.
+ */
+	uint32_t code, low;
+	size_t i;
+	size_t n = 0;
+
+	for ( i = 0; i + 1 < length; i += 2 ) {
+		code = (unsigned char)data[i] | ((unsigned char)data[i+1] << 8);
+
+		if ( code >= 0xd800 && code < 0xdc00 && i + 3 < length ) {
+			low = (unsigned char)data[i+2] | ((unsigned char)data[i+3] << 8);
+			if ( low >= 0xdc00 && low < 0xe000 ) {
+				code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+				i += 2;
+			}
+		}
+
+		if ( code == 0 ) {
+			break;
+		} else if ( code < 0x80 ) {
+			utf8[n++] = code;
+		} else if ( code < 0x800 ) {
+			utf8[n++] = 0xc0 | (code >> 6);
+			utf8[n++] = 0x80 | (code & 0x3f);
+		} else if ( code < 0x10000 ) {
+			utf8[n++] = 0xe0 | (code >> 12);
+			utf8[n++] = 0x80 | ((code >> 6) & 0x3f);
+			utf8[n++] = 0x80 | (code & 0x3f);
+		} else {
+			utf8[n++] = 0xf0 | (code >> 18);
+			utf8[n++] = 0x80 | ((code >> 12) & 0x3f);
+			utf8[n++] = 0x80 | ((code >> 6) & 0x3f);
+			utf8[n++] = 0x80 | (code & 0x3f);
+		}
+	}
+
+	return(n);
+}
+
+static char *pu_entry_string(pu_tags_t *tags, pu_entry_t *entry) {
+/*
+ * A copy of the string tag, as UTF-8 ending in a null, or NULL if it is not
+ * a string. The caller frees the copy.
+ */
+	char const *data;
+	char const *end;
+	char *value;
+	size_t length;
+
+	if ( entry == NULL || (entry->tag.type != PU_TAG_AnsiString && 
+			entry->tag.type != PU_TAG_WideString) ) {
+		return(NULL);
+	}
+
+	data = pu_tags_data(tags, entry);
+	length = data == NULL ? 0 : entry->tag.value;
+	value = (char *)malloc(3*length/2 + 1);
+	if ( value == NULL ) {
+		return(NULL);
+	}
+
+	if ( entry->tag.type == PU_TAG_WideString ) {
+		length = pu_widestring_utf8(value, data, length);
+	} else {
+		end = (char const *)memchr(data, '\0', length);
+		if ( end != NULL ) {
+			length = end - data;
+		}
+		memcpy(value, data, length);
+	}
+
+	value[length] = '\0';
+	return(value);
+}
+
+char *pu_tags_string(pu_tags_t *tags, char const *ident) {
+	return(pu_entry_string(tags, pu_tags_find_scalar(tags, ident)));
+}
+
+void pu_tag_printf(FILE *stream_out, pu_tags_t *tags, pu_entry_t *entry) {
+/*
+ * Print one tag as a line of the INI-style header.
+ */
+	pu_tag_t *tag = &entry->tag;
+	char const *data = pu_tags_data(tags, entry);
+	char *value;
+	float64_t value_float;
+	size_t index;
+
+	if ( tag->index > 0 ) {
+		fprintf(stream_out, "%.*s[%d] = ", (int)sizeof(tag->ident), 
+				tag->ident, tag->index);
+	} else {
+		fprintf(stream_out, "%.*s = ", (int)sizeof(tag->ident), 
+				tag->ident);
+	}
+	
+	switch ( tag->type ) {
+		case PU_TAG_Empty8:
+			fprintf(stream_out, "null");
+			break;
+		case PU_TAG_Bool8:
+			fprintf(stream_out, "%s", tag->value ? "true" : "false");
+			break;
+		case PU_TAG_Int8:
+			fprintf(stream_out, "%" PRId64, (int64_t)tag->value);
+			break;
+		case PU_TAG_BitSet64:
+		case PU_TAG_Color8:  // just print both BitSet64 and Color8 for now
+			fprintf(stream_out, "0x%016" PRIx64, (uint64_t)tag->value);
+			break;
+		case PU_TAG_Float8:
+			memcpy(&value_float, &tag->value, sizeof(float64_t));
+			fprintf(stream_out, "%E", value_float);
+			break;
+		case PU_TAG_TDateTime:
+			fprintf(stream_out, "0x%016" PRIx64, tag->value);
+			break;
+		case PU_TAG_Float8Array:
+			for ( index = 0; 
+					data != NULL && 
+					(index + 1)*sizeof(float64_t) <= (size_t)tag->value; 
+					index++ ) {
+				if ( index > 0 ) {
+					fprintf(stream_out, ", ");
+				}
+				memcpy(&value_float, data + index*sizeof(float64_t), 
+						sizeof(float64_t));
+				fprintf(stream_out, "%lf", value_float);
+			}
+			break;
+		case PU_TAG_AnsiString:
+			fprintf(stream_out, "%.*s", (int32_t)tag->value, 
+					data == NULL ? "" : data);
+			break;
+		case PU_TAG_WideString:
+			value = pu_entry_string(tags, entry);
+			fprintf(stream_out, "%s", value == NULL ? "" : value);
+			free(value);
+			break;
+		case PU_TAG_BinaryBlob:
+			for ( index = 0; 
+					data != NULL && index < (size_t)tag->value; 
+					index++ ) {
+				fprintf(stream_out, "%02x", data[index] & 0xff);
+			}
+			break;
+	}
+
+	fprintf(stream_out, "\n");
+}
+
+void pu_tags_printf(FILE *stream_out, pu_tags_t *tags) {
+/*
+ * Print the tags in file order, in the INI style of the other headers.
+ */
+	size_t i;
+
+	for ( i = 0; i < tags->length; i++ ) {
+		pu_tag_printf(stream_out, tags, &tags->entries[i]);
+	}
+}
+
+void pu_tags_free(pu_tags_t *tags) {
+	size_t i;
+
+	for ( i = 0; i < tags->length; i++ ) {
+		free(tags->entries[i].data);
+	}
+
+	free(tags->entries);
+	free(tags->table);
+	pu_tags_init(tags);
+}
@@ -1,12 +1,13 @@
 #ifndef UNIFIED_H_
 #define UNIFIED_H_
 
-#pragma pack(push, 2)
-
 #include <stdio.h>
+#include <sys/types.h>
 #include "header.h"
 #include "options.h"
 
+#pragma pack(push, 2)
+
 #define PU_TAG_Empty8      0xFFFF0008
 #define PU_TAG_Bool8       0x00000008
 #define PU_TAG_Int8        0x10000008
@@ -30,6 +31,11 @@
 #define PU_RECORD_TH_260_PT3 0x00010306
 #define PU_RECORD_TH_260_PT2 0x00010206
 
+/* The byte in the record type which gives the measurement mode. */
+#define PU_RECORD_MODE(x) (((x) >> 8) & 0xff)
+#define PU_RECORD_MODE_T2 0x02
+#define PU_RECORD_MODE_T3 0x03
+
 typedef struct pu_tag_t {
 	char ident[32];
 	int32_t index;
@@ -40,14 +46,46 @@ typedef struct pu_tag_t {
 typedef struct pu_options_t {
 	int64_t record_type;
 	float64_t resolution_seconds;
+	float64_t global_resolution;
 	int64_t input_channels_present;
 	int64_t sync_rate;
 	int64_t stop_after;
 	int64_t number_of_records;
 } pu_options_t;
 
+/*
+ * The tags of a header, in file order, with a hash table on (ident, index)
+ * for lookup. The payload of strings, arrays, and blobs is left in the file
+ * at offset, and only read into data by pu_tags_data.
+ */
+typedef struct pu_entry_t {
+	pu_tag_t tag;
+	off_t offset;
+	char *data;
+} pu_entry_t;
+
+typedef struct pu_tags_t {
+	FILE *stream_in;
+	pu_entry_t *entries;
+	size_t length;
+	size_t capacity;
+	size_t *table;
+	size_t table_size;
+} pu_tags_t;
+
 int pu_dispatch(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, options_t *options);
-int pu_tags_read(FILE *stream_in, FILE *stream_out, pu_header_t *pu_header, options_t *options, pu_options_t *pu_options);
+
+void pu_tags_init(pu_tags_t *tags);
+int pu_tags_read(FILE *stream_in, pu_tags_t *tags);
+pu_entry_t *pu_tags_find(pu_tags_t *tags, char const *ident, int32_t index);
+int64_t pu_tags_int(pu_tags_t *tags, char const *ident, int64_t missing);
+float64_t pu_tags_float(pu_tags_t *tags, char const *ident, float64_t missing);
+char const *pu_tags_data(pu_tags_t *tags, pu_entry_t *entry);
+char *pu_tags_string(pu_tags_t *tags, char const *ident);
+void pu_tag_printf(FILE *stream_out, pu_tags_t *tags, pu_entry_t *entry);
+void pu_tags_printf(FILE *stream_out, pu_tags_t *tags);
+void pu_tags_free(pu_tags_t *tags);
+void pu_options_init(pu_options_t *pu_options, pu_tags_t *tags);
 
 #pragma pack(pop)
 
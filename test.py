@@ -3,10 +3,12 @@
 import os
 import re
 import subprocess
+import tempfile
 import unittest
 import warnings
 
 picoquant = "./src/picoquant"
+generate = "./src/picoquant_generate"
 binary_file_pattern = re.compile("v.+\.([hpt]hd|t3r|[ph]t[23]|ptu)$")
 
 
@@ -26,6 +28,19 @@ def run(file_in, *args):
     return raw
 
 
+def output(*args, env=None):
+    """The raw output of picoquant, and whether it succeeded."""
+    p = subprocess.run([picoquant, *args], stdout=subprocess.PIPE,
+                       stderr=subprocess.PIPE, env=env)
+    return p.stdout, p.returncode == 0
+
+
+def tttr_file_paths():
+    for path in binary_file_paths():
+        if not re.search("\\.[hpt]hd$", path):
+            yield path
+
+
 warnings.warn(
     """The current decoded test data were generated with an unknown version
     of picoquant. If you observe a failure for one of these data files, 
@@ -89,5 +104,157 @@ class PicoquantTestCase(unittest.TestCase):
                 self.assertTrue(content == reference)
 
 
+class GeneratedTestCase(unittest.TestCase):
+    """Synthetic files of each t2 and t3 format, large enough to span several
+    chunks of records, with frequent overflows between the photons."""
+
+    formats = ["ht2", "ht3", "pt2", "pt3", "ptu-t2", "ptu-t3", "t3r"]
+    t3_formats = ["ht3", "pt3", "ptu-t3", "t3r"]
+
+    @classmethod
+    def setUpClass(cls):
+        if not os.path.exists(generate):
+            raise unittest.SkipTest(f"{generate} has not been built")
+
+        cls.directory = tempfile.TemporaryDirectory()
+        cls.paths = {}
+        for fmt in cls.formats:
+            path = os.path.join(cls.directory.name, "test." + fmt)
+            subprocess.run([generate, "--format", fmt, "--file-out", path,
+                            "--records", "300000", "--count-rate", "1e5",
+                            "--overflows", "0.05"], check=True)
+            cls.paths[fmt] = path
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.directory.cleanup()
+
+
+class ParallelTestCase(GeneratedTestCase):
+    """--threads and --pipeline must give exactly the serial output."""
+
+    def check_parallel(self, path, *flags):
+        serial, ok = output("--file-in", path, *flags)
+        for parallel in [["--threads", "4"], ["--pipeline"]]:
+            with self.subTest(path=path, flags=flags, parallel=parallel):
+                content, parallel_ok = output("--file-in", path, *flags,
+                                              *parallel)
+                self.assertEqual(ok, parallel_ok)
+                self.assertEqual(content, serial)
+
+    def test_sample_data(self):
+        for path in tttr_file_paths():
+            self.check_parallel(path)
+            self.check_parallel(path, "--binary-out")
+            self.check_parallel(path, "--to-t2")
+
+    def test_generated(self):
+        for fmt, path in self.paths.items():
+            content, ok = output("--file-in", path, "--number", "1")
+            self.assertTrue(ok and content, fmt)
+
+            self.check_parallel(path)
+            self.check_parallel(path, "--binary-out")
+            if fmt in self.t3_formats:
+                self.check_parallel(path, "--to-t2")
+
+
+class SimdTestCase(GeneratedTestCase):
+    """Each of the vectorized decoders must match the scalar one. The best
+    available is used by default, so force the narrower ones."""
+
+    def test_levels(self):
+        for fmt, path in self.paths.items():
+            outputs = {}
+            for level in ["none", "sse4.2", "avx2"]:
+                env = dict(os.environ, PICOQUANT_SIMD=level)
+                outputs[level], ok = output("--file-in", path, env=env)
+                self.assertTrue(ok and outputs[level], (fmt, level))
+
+            with self.subTest(fmt=fmt):
+                self.assertEqual(outputs["sse4.2"], outputs["none"])
+                self.assertEqual(outputs["avx2"], outputs["none"])
+
+
+class ColumnarTestCase(GeneratedTestCase):
+    """Columnar and compact files are read back as input, and must decode to
+    the csv of the file they were written from."""
+
+    def check_round_trip(self, fmt, *flags):
+        path = self.paths[fmt]
+        reference, ok = output("--file-in", path, *flags)
+        self.assertTrue(ok and reference, fmt)
+
+        for columnar in ["--columnar", "--compact"]:
+            with self.subTest(fmt=fmt, flags=flags, columnar=columnar):
+                columns = os.path.join(
+                    self.directory.name,
+                    "{}{}{}.columns".format(fmt, columnar, "".join(flags)))
+                _, ok = output("--file-in", path, "--file-out", columns,
+                               columnar, *flags)
+                self.assertTrue(ok)
+
+                content, ok = output("--file-in", columns)
+                self.assertTrue(ok)
+                self.assertEqual(content, reference)
+
+    def test_t2(self):
+        for fmt in ["ht2", "pt2", "ptu-t2"]:
+            self.check_round_trip(fmt)
+
+    def test_t3(self):
+        for fmt in self.t3_formats:
+            self.check_round_trip(fmt)
+
+    def test_t3_to_t2(self):
+        for fmt in self.t3_formats:
+            self.check_round_trip(fmt, "--to-t2")
+
+
+class RangeTestCase(GeneratedTestCase):
+    """--start-time and --stop-time must give the same photons as filtering
+    the full output, by time for t2 and by pulse for t3, whether the index
+    next to the file is built, reused, or out of date."""
+
+    def check_range(self, path):
+        full, ok = output("--file-in", path)
+        lines = full.splitlines(keepends=True)
+        last = int(lines[-1].split(b",")[1])
+        start, stop = last*3//10, last*6//10
+        expected = b"".join(line for line in lines
+                            if start <= int(line.split(b",")[1]) < stop)
+        self.assertTrue(expected)
+
+        for attempt in ["build", "reuse"]:
+            with self.subTest(path=path, attempt=attempt):
+                content, ok = output("--file-in", path, "--start-time",
+                                     str(start), "--stop-time", str(stop))
+                self.assertTrue(ok)
+                self.assertEqual(content, expected)
+                self.assertTrue(os.path.exists(path + ".pqidx"))
+
+    def test_range(self):
+        for fmt in ["ht2", "pt2", "ptu-t2", "ht3", "pt3", "ptu-t3"]:
+            self.check_range(self.paths[fmt])
+
+    def test_stale_index(self):
+        path = os.path.join(self.directory.name, "stale.ht2")
+        for seed, mtime in [(1, 1000000000), (2, 1000000100)]:
+            subprocess.run([generate, "--format", "ht2", "--file-out", path,
+                            "--records", "300000", "--count-rate", "1e5",
+                            "--seed", str(seed)], check=True)
+            os.utime(path, (mtime, mtime))
+            self.check_range(path)
+
+    def test_invalid(self):
+        path = self.paths["ht2"]
+        for flags in [["--start-time", "abc"], ["--stop-time", "-1"],
+                      ["--start-time", "5", "--stop-time", "2"]]:
+            with self.subTest(flags=flags):
+                content, ok = output("--file-in", path, *flags)
+                self.assertFalse(ok)
+                self.assertEqual(content, b"")
+
+
 if __name__ == "__main__":
     unittest.main()